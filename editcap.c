@@ -86,6 +86,10 @@ struct select_item {
 
 /*
  * Duplicate frame detection
+ *
+ * The frames in the window are kept in a ring, oldest first, and the
+ * digests in the ring are counted in a hash table, so that looking for a
+ * duplicate takes the same time whatever the size of the window.
  */
 typedef struct _fd_hash_t {
     guint8     digest[16];
@@ -93,15 +97,34 @@ typedef struct _fd_hash_t {
     nstime_t   frame_time;
 } fd_hash_t;
 
+typedef struct _fd_hash_count_t {
+    guint8     digest[16];
+    guint32    len;
+    guint32    count;           /* frames in the window with this digest */
+} fd_hash_count_t;
+
 #define DEFAULT_DUP_DEPTH       5   /* Used with -d */
-#define MAX_DUP_DEPTH     1000000   /* the maximum window (and actual size of fd_hash[]) for de-duplication */
+#define MIN_DUP_RING_SIZE    1024
 
-static fd_hash_t fd_hash[MAX_DUP_DEPTH];
-static int       dup_window    = DEFAULT_DUP_DEPTH;
-static int       cur_dup_entry = 0;
+static fd_hash_t  *fd_hash       = NULL;  /* ring of the frames in the window */
+static guint32     fd_hash_size  = 0;
+static guint32     fd_hash_first = 0;     /* oldest frame */
+static guint32     fd_hash_count = 0;
+static GHashTable *fd_hash_index = NULL;  /* fd_hash_count_t of the frames in the ring */
+static guint32     dup_window    = DEFAULT_DUP_DEPTH;
+static guint8      cur_dup_digest[16];
 
 static guint32   ignored_bytes  = 0;  /* Used with -I */
 
+/* Ranges of bytes treated as zero when hashing, used with --ignore-bytes */
+struct ignore_range {
+    guint32 offset, length;
+};
+
+#define MAX_IGNORE_RANGES 16
+static struct ignore_range ignore_ranges[MAX_IGNORE_RANGES];
+static guint               num_ignore_ranges = 0;
+
 #define ONE_BILLION 1000000000
 
 /* Weights of different errors we can introduce */
@@ -637,22 +660,112 @@ set_unused_info(const wtap_packet_header *phdr, guint8* fd) {
     }
 }
 
+static guint
+fd_hash_count_hash(gconstpointer key)
+{
+    const fd_hash_count_t *entry = (const fd_hash_count_t *)key;
+    guint hash;
+
+    /* The digest is already well distributed. */
+    memcpy(&hash, entry->digest, sizeof hash);
+    return hash ^ entry->len;
+}
+
 static gboolean
-is_duplicate(guint8* fd, guint32 len) {
-    int i;
+fd_hash_count_equal(gconstpointer a, gconstpointer b)
+{
+    const fd_hash_count_t *entry_a = (const fd_hash_count_t *)a;
+    const fd_hash_count_t *entry_b = (const fd_hash_count_t *)b;
+
+    return entry_a->len == entry_b->len &&
+           memcmp(entry_a->digest, entry_b->digest, 16) == 0;
+}
+
+static fd_hash_count_t *
+dup_window_lookup(const fd_hash_t *frame)
+{
+    fd_hash_count_t key;
+
+    memcpy(key.digest, frame->digest, 16);
+    key.len = frame->len;
+    return (fd_hash_count_t *)g_hash_table_lookup(fd_hash_index, &key);
+}
+
+/* Add a frame to the end of the window. */
+static void
+dup_window_push(const fd_hash_t *frame)
+{
+    fd_hash_count_t *entry;
+    fd_hash_t *ring;
+    guint32 size;
+    guint32 i;
+
+    if (fd_hash_count == fd_hash_size) {
+        size = fd_hash_size ? fd_hash_size * 2 : MIN_DUP_RING_SIZE;
+        ring = g_new(fd_hash_t, size);
+        for (i = 0; i < fd_hash_count; i++) {
+            ring[i] = fd_hash[(fd_hash_first + i) % fd_hash_size];
+        }
+        g_free(fd_hash);
+        fd_hash = ring;
+        fd_hash_size = size;
+        fd_hash_first = 0;
+    }
+    fd_hash[(fd_hash_first + fd_hash_count) % fd_hash_size] = *frame;
+    fd_hash_count++;
+
+    entry = dup_window_lookup(frame);
+    if (entry == NULL) {
+        entry = g_new(fd_hash_count_t, 1);
+        memcpy(entry->digest, frame->digest, 16);
+        entry->len = frame->len;
+        entry->count = 0;
+        g_hash_table_add(fd_hash_index, entry);
+    }
+    entry->count++;
+}
+
+/* Remove the oldest frame from the window. */
+static void
+dup_window_pop(void)
+{
+    fd_hash_count_t *entry;
+
+    entry = dup_window_lookup(&fd_hash[fd_hash_first]);
+    ws_assert(entry != NULL);
+    if (--entry->count == 0) {
+        g_hash_table_remove(fd_hash_index, entry);
+    }
+    fd_hash_first = (fd_hash_first + 1) % fd_hash_size;
+    fd_hash_count--;
+}
+
+/*
+ * Compute the digest of a frame, also kept in cur_dup_digest for -V,
+ * leaving out the bytes
+ * to ignore (-I or the radiotap header) and treating the ranges given with
+ * --ignore-bytes, which are relative to the first byte hashed, as zero.
+ */
+static void
+dup_digest(fd_hash_t *frame, const guint8 *fd, guint32 len,
+           gboolean skip_radiotap_hdr)
+{
+    static guint8  *masked_fd = NULL;
+    static guint32  masked_size = 0;
     const struct ieee80211_radiotap_header* tap_header;
 
     /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
     guint32 offset = ignored_bytes;
     guint32 new_len;
-    guint8 *new_fd;
+    const guint8 *new_fd;
+    guint i;
 
     if (len <= ignored_bytes) {
         offset = 0;
     }
 
     /* Get the size of radiotap header and use that as offset (-p option) */
-    if (skip_radiotap == TRUE) {
+    if (skip_radiotap_hdr) {
         tap_header = (const struct ieee80211_radiotap_header*)fd;
         offset = pletoh16(&tap_header->it_len);
         if (offset >= len)
@@ -662,140 +775,85 @@ is_duplicate(guint8* fd, guint32 len) {
     new_fd  = &fd[offset];
     new_len = len - (offset);
 
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
-
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
-
-    fd_hash[cur_dup_entry].len = len;
-
-    /* Look for duplicates */
-    for (i = 0; i < dup_window; i++) {
-        if (i == cur_dup_entry)
-            continue;
-
-        if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-            && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return TRUE;
+    if (num_ignore_ranges > 0) {
+        if (masked_size < new_len) {
+            masked_size = new_len;
+            masked_fd = (guint8 *)g_realloc(masked_fd, masked_size);
+        }
+        memcpy(masked_fd, new_fd, new_len);
+        for (i = 0; i < num_ignore_ranges; i++) {
+            if (ignore_ranges[i].offset >= new_len)
+                continue;
+            memset(&masked_fd[ignore_ranges[i].offset], 0,
+                   MIN(ignore_ranges[i].length, new_len - ignore_ranges[i].offset));
         }
+        new_fd = masked_fd;
     }
 
-    return FALSE;
+    /* Calculate our digest */
+    gcry_md_hash_buffer(GCRY_MD_MD5, frame->digest, new_fd, new_len);
+    memcpy(cur_dup_digest, frame->digest, 16);
+
+    frame->len = len;
 }
 
 static gboolean
-is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
-    int i;
+is_duplicate(guint8* fd, guint32 len) {
+    fd_hash_t frame;
+    gboolean duplicate;
 
-    /*Hint to ignore some bytes at the start of the frame for the digest calculation(-I option) */
-    guint32 offset = ignored_bytes;
-    guint32 new_len;
-    guint8 *new_fd;
+    dup_digest(&frame, fd, len, skip_radiotap);
+    nstime_set_unset(&frame.frame_time);
 
-    if (len <= ignored_bytes) {
-        offset = 0;
+    /* The current frame is compared to the previous dup_window - 1 ones. */
+    while (fd_hash_count > 0 && fd_hash_count >= dup_window) {
+        dup_window_pop();
     }
 
-    new_fd  = &fd[offset];
-    new_len = len - (offset);
+    /* Look for duplicates */
+    duplicate = dup_window_lookup(&frame) != NULL;
 
-    cur_dup_entry++;
-    if (cur_dup_entry >= dup_window)
-        cur_dup_entry = 0;
+    if (dup_window > 1) {
+        dup_window_push(&frame);
+    }
 
-    /* Calculate our digest */
-    gcry_md_hash_buffer(GCRY_MD_MD5, fd_hash[cur_dup_entry].digest, new_fd, new_len);
+    return duplicate;
+}
+
+static gboolean
+is_duplicate_rel_time(guint8* fd, guint32 len, const nstime_t *current) {
+    fd_hash_t frame;
+    nstime_t delta;
+    gboolean duplicate;
 
-    fd_hash[cur_dup_entry].len = len;
-    fd_hash[cur_dup_entry].frame_time.secs = current->secs;
-    fd_hash[cur_dup_entry].frame_time.nsecs = current->nsecs;
+    dup_digest(&frame, fd, len, FALSE);
+    frame.frame_time = *current;
 
     /*
-     * Look for relative time related duplicates.
-     * This is hopefully a reasonably efficient mechanism for
-     * finding duplicates by rel time in the fd_hash[] cache.
-     * We check starting from the most recently added hash
-     * entries and work backwards towards older packets.
-     * This approach allows the dup test to be terminated
-     * when the relative time of a cached entry is found to
-     * be beyond the dup time window.
+     * Drop the frames that are more than the dup time window older than
+     * the current one from the window.
      *
-     * Of course this assumes that the input trace file is
-     * "well-formed" in the sense that the packet timestamps are
-     * in strict chronologically increasing order (which is NOT
-     * always the case!!).
-     *
-     * The fd_hash[] table was deliberately created large (1,000,000).
-     * Looking for time related duplicates in large trace files with
-     * non-fractional dup time window values can potentially take
-     * a long time to complete.
+     * This assumes that the input trace file is "well-formed" in the
+     * sense that the packet timestamps are in chronologically increasing
+     * order (which is NOT always the case!!). We stop at the first frame
+     * that is in the window or later than the current one, so a frame
+     * out of order keeps the frames after it in the window for longer.
      */
-
-    for (i = cur_dup_entry - 1;; i--) {
-        nstime_t delta;
-        int cmp;
-
-        if (i < 0)
-            i = dup_window - 1;
-
-        if (i == cur_dup_entry) {
-            /*
-             * We've decremented back to where we started.
-             * Check no more!
-             */
+    while (fd_hash_count > 0) {
+        nstime_delta(&delta, current, &fd_hash[fd_hash_first].frame_time);
+        if (delta.secs < 0 || delta.nsecs < 0 ||
+            nstime_cmp(&delta, &relative_time_window) <= 0) {
             break;
         }
+        dup_window_pop();
+    }
 
-        if (nstime_is_unset(&(fd_hash[i].frame_time))) {
-            /*
-             * We've decremented to an unused fd_hash[] entry.
-             * Check no more!
-             */
-            break;
-        }
-
-        nstime_delta(&delta, current, &fd_hash[i].frame_time);
-
-        if (delta.secs < 0 || delta.nsecs < 0) {
-            /*
-             * A negative delta implies that the current packet
-             * has an absolute timestamp less than the cached packet
-             * that it is being compared to.  This is NOT a normal
-             * situation since trace files usually have packets in
-             * chronological order (oldest to newest).
-             *
-             * There are several possible ways to deal with this:
-             * 1. 'continue' dup checking with the next cached frame.
-             * 2. 'break' from looking for a duplicate of the current frame.
-             * 3. Take the absolute value of the delta and see if that
-             * falls within the specifed dup time window.
-             *
-             * Currently this code does option 1.  But it would pretty
-             * easy to add yet-another-editcap-option to select one of
-             * the other behaviors for dealing with out-of-sequence
-             * packets.
-             */
-            continue;
-        }
-
-        cmp = nstime_cmp(&delta, &relative_time_window);
+    /* Look for relative time related duplicates. */
+    duplicate = dup_window_lookup(&frame) != NULL;
 
-        if (cmp > 0) {
-            /*
-             * The delta time indicates that we are now looking at
-             * cached packets beyond the specified dup time window.
-             * Check no more!
-             */
-            break;
-        } else if (fd_hash[i].len == fd_hash[cur_dup_entry].len
-                   && memcmp(fd_hash[i].digest, fd_hash[cur_dup_entry].digest, 16) == 0) {
-            return TRUE;
-        }
-    }
+    dup_window_push(&frame);
 
-    return FALSE;
+    return duplicate;
 }
 
 static void
@@ -821,7 +879,6 @@ print_usage(FILE *output)
     fprintf(output, "  --novlan               remove vlan info from packets before checking for duplicates.\n");
     fprintf(output, "  -d                     remove packet if duplicate (window == %d).\n", DEFAULT_DUP_DEPTH);
     fprintf(output, "  -D <dup window>        remove packet if duplicate; configurable <dup window>.\n");
-    fprintf(output, "                         Valid <dup window> values are 0 to %d.\n", MAX_DUP_DEPTH);
     fprintf(output, "                         NOTE: A <dup window> of 0 with -V (verbose option) is\n");
     fprintf(output, "                         useful to print MD5 hashes.\n");
     fprintf(output, "  -w <dup time window>   remove packet if duplicate packet is found EQUAL TO OR\n");
@@ -835,6 +892,11 @@ print_usage(FILE *output)
     fprintf(output, "  --skip-radiotap-header skip radiotap header when checking for packet duplicates.\n");
     fprintf(output, "                         Useful when processing packets captured by multiple radios\n");
     fprintf(output, "                         on the same channel in the vicinity of each other.\n");
+    fprintf(output, "  --ignore-bytes <offset>[:<length>]\n");
+    fprintf(output, "                         treat <length> (default 1) bytes at <offset> as zero\n");
+    fprintf(output, "                         when checking for duplicates, e.g. a TTL or checksum.\n");
+    fprintf(output, "                         <offset> is relative to the first byte hashed, after\n");
+    fprintf(output, "                         the bytes skipped by -I. Can be given more than once.\n");
     fprintf(output, "  --set-unused           set unused byts to zero in sll link addr.\n");
     fprintf(output, "\n");
     fprintf(output, "Packet manipulation:\n");
@@ -1197,6 +1259,7 @@ main(int argc, char *argv[])
 #define LONGOPT_CAPTURE_COMMENT      LONGOPT_BASE_APPLICATION+6
 #define LONGOPT_DISCARD_CAPTURE_COMMENT LONGOPT_BASE_APPLICATION+7
 #define LONGOPT_SET_UNUSED           LONGOPT_BASE_APPLICATION+8
+#define LONGOPT_IGNORE_BYTES         LONGOPT_BASE_APPLICATION+9
 
     static const struct ws_option long_options[] = {
         {"novlan", ws_no_argument, NULL, LONGOPT_NO_VLAN},
@@ -1209,6 +1272,7 @@ main(int argc, char *argv[])
         {"capture-comment", ws_required_argument, NULL, LONGOPT_CAPTURE_COMMENT},
         {"discard-capture-comment", ws_no_argument, NULL, LONGOPT_DISCARD_CAPTURE_COMMENT},
         {"set-unused", ws_no_argument, NULL, LONGOPT_SET_UNUSED},
+        {"ignore-bytes", ws_required_argument, NULL, LONGOPT_IGNORE_BYTES},
         {0, 0, 0, 0 }
     };
 
@@ -1393,6 +1457,31 @@ main(int argc, char *argv[])
             break;
         }
 
+        case LONGOPT_IGNORE_BYTES:
+        {
+            const char *end;
+            guint32 range_offset, range_length = 1;
+
+            if (num_ignore_ranges >= MAX_IGNORE_RANGES) {
+                fprintf(stderr, "editcap: Too many byte ranges to ignore; the maximum is %d\n",
+                        MAX_IGNORE_RANGES);
+                ret = WS_EXIT_INVALID_OPTION;
+                goto clean_exit;
+            }
+            if (!ws_strtou32(ws_optarg, &end, &range_offset) ||
+                (*end == ':' && (!ws_strtou32(end + 1, NULL, &range_length) || range_length == 0)) ||
+                (*end != ':' && *end != '\0')) {
+                fprintf(stderr, "editcap: \"%s\" isn't a valid <offset>[:<length>] byte range\n",
+                        ws_optarg);
+                ret = WS_EXIT_INVALID_OPTION;
+                goto clean_exit;
+            }
+            ignore_ranges[num_ignore_ranges].offset = range_offset;
+            ignore_ranges[num_ignore_ranges].length = range_length;
+            num_ignore_ranges++;
+            break;
+        }
+
         case 'a':
         {
             guint frame_number;
@@ -1505,12 +1594,6 @@ main(int argc, char *argv[])
             dup_detect = TRUE;
             dup_detect_by_time = FALSE;
             dup_window = get_guint32(ws_optarg, "duplicate window");
-            if (dup_window > MAX_DUP_DEPTH) {
-                fprintf(stderr, "editcap: \"%d\" duplicate window value must be between 0 and %d inclusive.\n",
-                        dup_window, MAX_DUP_DEPTH);
-                ret = WS_EXIT_INVALID_OPTION;
-                goto clean_exit;
-            }
             break;
 
         case 'E':
@@ -1624,7 +1707,6 @@ main(int argc, char *argv[])
         case 'w':
             dup_detect = FALSE;
             dup_detect_by_time = TRUE;
-            dup_window = MAX_DUP_DEPTH;
             if (!set_rel_time(ws_optarg)) {
                 ret = WS_EXIT_INVALID_OPTION;
                 goto clean_exit;
@@ -1839,11 +1921,8 @@ main(int argc, char *argv[])
         max_packet_number = G_MAXUINT;
 
     if (dup_detect || dup_detect_by_time) {
-        for (i = 0; i < dup_window; i++) {
-            memset(&fd_hash[i].digest, 0, 16);
-            fd_hash[i].len = 0;
-            nstime_set_unset(&fd_hash[i].frame_time);
-        }
+        fd_hash_index = g_hash_table_new_full(fd_hash_count_hash, fd_hash_count_equal,
+                                              g_free, NULL);
     }
 
     /* Set up an array of all IDBs seen */
@@ -2181,7 +2260,7 @@ main(int argc, char *argv[])
                                     rec->rec_header.packet_header.caplen);
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
-                                        (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                                        (unsigned char)cur_dup_digest[i]);
                             fprintf(stderr, "\n");
                         }
                         duplicate_count++;
@@ -2194,7 +2273,7 @@ main(int argc, char *argv[])
                                     rec->rec_header.packet_header.caplen);
                             for (i = 0; i < 16; i++)
                                 fprintf(stderr, "%02x",
-                                        (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                                        (unsigned char)cur_dup_digest[i]);
                             fprintf(stderr, "\n");
                         }
                     }
@@ -2217,7 +2296,7 @@ main(int argc, char *argv[])
                                         rec->rec_header.packet_header.caplen);
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
-                                            (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                                            (unsigned char)cur_dup_digest[i]);
                                 fprintf(stderr, "\n");
                             }
                             duplicate_count++;
@@ -2230,7 +2309,7 @@ main(int argc, char *argv[])
                                         rec->rec_header.packet_header.caplen);
                                 for (i = 0; i < 16; i++)
                                     fprintf(stderr, "%02x",
-                                            (unsigned char)fd_hash[cur_dup_entry].digest[i]);
+                                            (unsigned char)cur_dup_digest[i]);
                                 fprintf(stderr, "\n");
                             }
                         }
@@ -2436,7 +2515,7 @@ main(int argc, char *argv[])
     }
 
     if (dup_detect) {
-        fprintf(stderr, "%u packet%s seen, %u packet%s skipped with duplicate window of %i packets.\n",
+        fprintf(stderr, "%u packet%s seen, %u packet%s skipped with duplicate window of %u packets.\n",
                 count - 1, plurality(count - 1, "", "s"), duplicate_count,
                 plurality(duplicate_count, "", "s"), dup_window);
     } else if (dup_detect_by_time) {
@@ -2451,6 +2530,10 @@ clean_exit:
     if (filename) {
         g_free(filename);
     }
+    if (fd_hash_index) {
+        g_hash_table_destroy(fd_hash_index);
+    }
+    g_free(fd_hash);
     if (frames_user_comments) {
         g_tree_destroy(frames_user_comments);
     }
@@ -88,6 +88,7 @@
 #include <wsutil/file_util.h>
 #include <wsutil/pint.h>
 #include <wsutil/inet_addr.h>
+#include <wsutil/prefix_trie.h>
 
 #include <epan/strutil.h>
 #include <epan/to_str.h>
@@ -109,27 +110,6 @@
 #define HASHETHSIZE      2048
 #define HASHHOSTSIZE     2048
 #define HASHIPXNETSIZE    256
-#define SUBNETLENGTHSIZE   32  /*1-32 inc.*/
-
-/* hash table used for IPv4 lookup */
-
-#define HASH_IPV4_ADDRESS(addr) (g_htonl(addr) & (HASHHOSTSIZE - 1))
-
-
-typedef struct sub_net_hashipv4 {
-    guint             addr;
-    /* XXX: No longer needed?*/
-    guint8            flags;          /* B0 dummy_entry, B1 resolve, B2 If the address is used in the trace */
-    struct sub_net_hashipv4   *next;
-    gchar             name[MAXNAMELEN];
-} sub_net_hashipv4_t;
-
-/* Array of entries of subnets of different lengths */
-typedef struct {
-    gsize        mask_length;      /*1-32*/
-    guint32      mask;             /* e.g. 255.255.255.*/
-    sub_net_hashipv4_t** subnet_addresses; /* Hash table of subnet addresses */
-} subnet_length_entry_t;
 
 
 /* hash table used for IPX network lookup */
@@ -225,8 +205,9 @@ static wmem_map_t *eth_hashtable = NULL;
 static wmem_map_t *serv_port_hashtable = NULL;
 static GHashTable *enterprises_hashtable = NULL;
 
-static subnet_length_entry_t subnet_length_entries[SUBNETLENGTHSIZE]; /* Ordered array of entries */
-static gboolean have_subnet_entry = FALSE;
+/* Subnet names by prefix, see read_subnets_file() */
+static prefix_trie_t *subnet_trie_ipv4 = NULL;
+static prefix_trie_t *subnet_trie_ipv6 = NULL;
 
 static gboolean new_resolved_objects = FALSE;
 
@@ -627,7 +608,7 @@ c_ares_set_dns_servers(void)
 
 typedef struct {
     guint32      mask;
-    gsize        mask_length;
+    guint        mask_length;
     const gchar* name; /* Shallow copy */
 } subnet_entry_t;
 
@@ -652,7 +633,8 @@ fgetline(char *buf, int size, FILE *fp)
  *  Local function definitions
  */
 static subnet_entry_t subnet_lookup(const guint32 addr);
-static void subnet_entry_set(guint32 subnet_addr, const guint8 mask_length, const gchar* name);
+static const gchar *subnet_lookup6(const ws_in6_addr *addr, guint *mask_length);
+static void subnet_entry_set(prefix_trie_t *trie, const guint8 *subnet_addr, const guint8 mask_length, const gchar* name);
 
 
 static void
@@ -1048,13 +1030,55 @@ fill_dummy_ip4(const guint addr, hashipv4_t* volatile tp)
 }
 
 
-/* Fill in an IP6 structure with the string form of the address.
+/* Fill in an IP6 structure with info from subnets file or just with the
+ * string form of the address.
  */
 static void
 fill_dummy_ip6(hashipv6_t* volatile tp)
 {
+    const gchar *subnet_name;
+    guint mask_length;
+
     /* Overwrite if we get async DNS reply */
-    (void) g_strlcpy(tp->name, tp->ip6, MAXNAMELEN);
+
+    /* Do we have a subnet for this address? */
+    subnet_name = subnet_lookup6((const ws_in6_addr *)tp->addr, &mask_length);
+    if (subnet_name != NULL) {
+        /* Print name, then "::", then the 16-bit groups after the subnet
+         * mask, from the first group that is not zero. This is not done
+         * with ip6_to_str_buf() as that can print the host part as an
+         * IPv4 address.
+         */
+        guint8 host_addr[16];
+        gchar buffer[WS_INET6_ADDRSTRLEN];
+        gchar* paddr;
+        guint i;
+
+        memcpy(host_addr, tp->addr, sizeof host_addr);
+        for (i = 0; i < mask_length / 8; i++) {
+            host_addr[i] = 0;
+        }
+        if (mask_length % 8) {
+            host_addr[i] &= 0xff >> (mask_length % 8);
+        }
+
+        /* If length of mask is 128, we chomp the whole address. */
+        paddr = buffer;
+        *paddr = '\0';
+        if (mask_length < 128) {
+            for (i = 0; i < 16 && host_addr[i] == 0; i++)
+                ;
+            paddr = g_stpcpy(paddr, "::");
+            for (i &= ~1U; i < 16; i += 2) {
+                paddr += snprintf(paddr, 6, i < 14 ? "%x:" : "%x",
+                                  pntoh16(&host_addr[i]));
+            }
+        }
+
+        snprintf(tp->name, MAXNAMELEN, "%s%s", subnet_name, buffer);
+    } else {
+        (void) g_strlcpy(tp->name, tp->ip6, MAXNAMELEN);
+    }
 }
 
 static void
@@ -2494,15 +2518,13 @@ get_addrinfo_list(void)
  * <line> = <comment> | <entry> | <whitespace>
  * <comment> = <whitespace>#<any>
  * <entry> = <subnet_definition> <whitespace> <subnet_name> [<comment>|<whitespace><any>]
- * <subnet_definition> = <ipv4_address> / <subnet_mask_length>
- * <ipv4_address> is a full address; it will be masked to get the subnet-ID.
- * <subnet_mask_length> is a decimal 1-31
+ * <subnet_definition> = <ip_address> / <subnet_mask_length>
+ * <ip_address> is a full IPv4 or IPv6 address; it will be masked to get the subnet-ID.
+ * <subnet_mask_length> is a decimal 1-32 for IPv4 and 1-128 for IPv6
  * <subnet_name> is a string containing no whitespace.
  * <whitespace> = (space | tab)+
  * Any malformed entries are ignored.
  * Any trailing data after the subnet_name is ignored.
- *
- * XXX Support IPv6
  */
 static gboolean
 read_subnets_file (const char *subnetspath)
@@ -2510,7 +2532,8 @@ read_subnets_file (const char *subnetspath)
     FILE *hf;
     char line[MAX_LINELEN];
     gchar *cp, *cp2;
-    guint32 host_addr; /* IPv4 ONLY */
+    guint32 host_addr;
+    ws_in6_addr host_addr6;
     guint8 mask_length;
 
     if ((hf = ws_fopen(subnetspath, "r")) == NULL)
@@ -2524,7 +2547,7 @@ read_subnets_file (const char *subnetspath)
             continue; /* no tokens in the line */
 
 
-        /* Expected format is <IP4 address>/<subnet length> */
+        /* Expected format is <IP address>/<subnet length> */
         cp2 = strchr(cp, '/');
         if (NULL == cp2) {
             /* No length */
@@ -2533,19 +2556,25 @@ read_subnets_file (const char *subnetspath)
         *cp2 = '\0'; /* Cut token */
         ++cp2    ;
 
-        /* Check if this is a valid IPv4 address */
-        if (!str_to_ip(cp, &host_addr)) {
-            continue; /* no */
-        }
+        if (str_to_ip(cp, &host_addr)) {
+            if (!ws_strtou8(cp2, NULL, &mask_length) || mask_length == 0 || mask_length > 32) {
+                continue; /* invalid mask length */
+            }
 
-        if (!ws_strtou8(cp2, NULL, &mask_length) || mask_length == 0 || mask_length > 32) {
-            continue; /* invalid mask length */
-        }
+            if ((cp = strtok(NULL, " \t")) == NULL)
+                continue; /* no subnet name */
 
-        if ((cp = strtok(NULL, " \t")) == NULL)
-            continue; /* no subnet name */
+            subnet_entry_set(subnet_trie_ipv4, (const guint8 *)&host_addr, mask_length, cp);
+        } else if (str_to_ip6(cp, &host_addr6)) {
+            if (!ws_strtou8(cp2, NULL, &mask_length) || mask_length == 0 || mask_length > 128) {
+                continue; /* invalid mask length */
+            }
+
+            if ((cp = strtok(NULL, " \t")) == NULL)
+                continue; /* no subnet name */
 
-        subnet_entry_set(host_addr, mask_length, cp);
+            subnet_entry_set(subnet_trie_ipv6, host_addr6.bytes, mask_length, cp);
+        }
     }
 
     fclose(hf);
@@ -2556,110 +2585,52 @@ static subnet_entry_t
 subnet_lookup(const guint32 addr)
 {
     subnet_entry_t subnet_entry;
-    guint32 i;
-
-    /* Search mask lengths linearly, longest first */
-
-    i = SUBNETLENGTHSIZE;
-    while(have_subnet_entry && i > 0) {
-        guint32 masked_addr;
-        subnet_length_entry_t* length_entry;
-
-        /* Note that we run from 31 (length 32)  to 0 (length 1)  */
-        --i;
-        ws_assert(i < SUBNETLENGTHSIZE);
+    guint mask_length;
 
-
-        length_entry = &subnet_length_entries[i];
-
-        if (NULL != length_entry->subnet_addresses) {
-            sub_net_hashipv4_t * tp;
-            guint32 hash_idx;
-
-            masked_addr = addr & length_entry->mask;
-            hash_idx = HASH_IPV4_ADDRESS(masked_addr);
-
-            tp = length_entry->subnet_addresses[hash_idx];
-            while(tp != NULL && tp->addr != masked_addr) {
-                tp = tp->next;
-            }
-
-            if (NULL != tp) {
-                subnet_entry.mask = length_entry->mask;
-                subnet_entry.mask_length = i + 1; /* Length is offset + 1 */
-                subnet_entry.name = tp->name;
-                return subnet_entry;
-            }
-        }
+    subnet_entry.name = (const gchar *)prefix_trie_lookup(subnet_trie_ipv4, (const guint8 *)&addr, &mask_length);
+    if (subnet_entry.name != NULL) {
+        subnet_entry.mask = g_htonl(ip_get_subnet_mask(mask_length));
+        subnet_entry.mask_length = mask_length;
+    } else {
+        subnet_entry.mask = 0;
+        subnet_entry.mask_length = 0;
     }
 
-    subnet_entry.mask = 0;
-    subnet_entry.mask_length = 0;
-    subnet_entry.name = NULL;
-
     return subnet_entry;
 }
 
+/* Returns the name of the longest subnet that contains the address, or
+ * NULL.
+ */
+static const gchar *
+subnet_lookup6(const ws_in6_addr *addr, guint *mask_length)
+{
+    return (const gchar *)prefix_trie_lookup(subnet_trie_ipv6, addr->bytes, mask_length);
+}
+
 /* Add a subnet-definition - name pair to the set.
  * The definition is taken by masking the address passed in with the mask of the
- * given length.
+ * given length. The first definition of a subnet is kept.
  */
 static void
-subnet_entry_set(guint32 subnet_addr, const guint8 mask_length, const gchar* name)
+subnet_entry_set(prefix_trie_t *trie, const guint8 *subnet_addr, const guint8 mask_length, const gchar* name)
 {
-    subnet_length_entry_t* entry;
-    sub_net_hashipv4_t * tp;
-    gsize hash_idx;
-
-    ws_assert(mask_length > 0 && mask_length <= 32);
-
-    entry = &subnet_length_entries[mask_length - 1];
-
-    subnet_addr &= entry->mask;
-
-    hash_idx = HASH_IPV4_ADDRESS(subnet_addr);
-
-    if (NULL == entry->subnet_addresses) {
-        entry->subnet_addresses = (sub_net_hashipv4_t**)wmem_alloc0(wmem_epan_scope(), sizeof(sub_net_hashipv4_t*) * HASHHOSTSIZE);
+    if (prefix_trie_find(trie, subnet_addr, mask_length) != NULL) {
+        return; /* XXX provide warning that an address was repeated? */
     }
 
-    if (NULL != (tp = entry->subnet_addresses[hash_idx])) {
-        sub_net_hashipv4_t * new_tp;
-
-        while (tp->next) {
-            if (tp->addr == subnet_addr) {
-                return; /* XXX provide warning that an address was repeated? */
-            } else {
-                tp = tp->next;
-            }
-        }
-
-        new_tp = wmem_new(wmem_epan_scope(), sub_net_hashipv4_t);
-        tp->next = new_tp;
-        tp = new_tp;
-    } else {
-        tp = entry->subnet_addresses[hash_idx] = wmem_new(wmem_epan_scope(), sub_net_hashipv4_t);
-    }
-
-    tp->next = NULL;
-    tp->addr = subnet_addr;
-    (void) g_strlcpy(tp->name, name, MAXNAMELEN); /* This is longer than subnet names can actually be */
-    have_subnet_entry = TRUE;
+    prefix_trie_insert(trie, subnet_addr, mask_length, g_strndup(name, MAXNAMELEN - 1));
 }
 
 static void
 subnet_name_lookup_init(void)
 {
     gchar* subnetspath;
-    guint32 i;
-
-    for(i = 0; i < SUBNETLENGTHSIZE; ++i) {
-        guint32 length = i + 1;
 
-        subnet_length_entries[i].subnet_addresses  = NULL;
-        subnet_length_entries[i].mask_length  = length;
-        subnet_length_entries[i].mask = g_htonl(ip_get_subnet_mask(length));
-    }
+    ws_assert(subnet_trie_ipv4 == NULL);
+    subnet_trie_ipv4 = prefix_trie_new(32, g_free);
+    ws_assert(subnet_trie_ipv6 == NULL);
+    subnet_trie_ipv6 = prefix_trie_new(128, g_free);
 
     /* Check profile directory before personal configuration */
     subnetspath = get_persconffile_path(ENAME_SUBNETS, TRUE);
@@ -3206,9 +3177,6 @@ host_name_lookup_init(void)
 static void
 host_name_lookup_cleanup(void)
 {
-    guint32 i, j;
-    sub_net_hashipv4_t *entry, *next_entry;
-
     _host_name_lookup_cleanup();
 
     ipxnet_hash_table = NULL;
@@ -3216,21 +3184,11 @@ host_name_lookup_cleanup(void)
     ipv6_hash_table = NULL;
     ss7pc_hash_table = NULL;
 
-    for(i = 0; i < SUBNETLENGTHSIZE; ++i) {
-        if (subnet_length_entries[i].subnet_addresses != NULL) {
-            for (j = 0; j < HASHHOSTSIZE; j++) {
-                for (entry = subnet_length_entries[i].subnet_addresses[j];
-                     entry != NULL; entry = next_entry) {
-                    next_entry = entry->next;
-                    wmem_free(wmem_epan_scope(), entry);
-                }
-            }
-            wmem_free(wmem_epan_scope(), subnet_length_entries[i].subnet_addresses);
-            subnet_length_entries[i].subnet_addresses = NULL;
-        }
-    }
+    prefix_trie_free(subnet_trie_ipv4);
+    subnet_trie_ipv4 = NULL;
+    prefix_trie_free(subnet_trie_ipv6);
+    subnet_trie_ipv6 = NULL;
 
-    have_subnet_entry = FALSE;
     new_resolved_objects = FALSE;
 }
 
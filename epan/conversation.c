@@ -98,6 +98,38 @@ static wmem_map_t *conversation_hashtable_no_addr2_or_port2 = NULL;
  */
 static wmem_map_t *conversation_hashtable_id = NULL;
 
+/*
+ * Index of the conversations in conversation_hashtable_exact_addr_port
+ * between two IPv4 or two IPv6 endpoints, by far the most common ones.
+ *
+ * The key holds the addresses inline, with the endpoints in a canonical order
+ * (the lower address/port pair first), so that a single probe of the open
+ * addressing table finds the conversation chains of both directions. Each
+ * slot mirrors the chain heads of conversation_hashtable_exact_addr_port,
+ * which remains the authoritative table and the only one used for other
+ * address types. Slots are not removed, a slot whose chains are both empty
+ * is simply a miss.
+ */
+#define CONV_FLAT_ADDR_LEN      16
+#define CONV_FLAT_MIN_SLOTS     1024
+
+typedef struct {
+    guint8  addr[2][CONV_FLAT_ADDR_LEN];
+    guint32 port[2];
+    guint32 ctype;
+    guint32 addr_type;
+} conv_flat_key_t;
+
+typedef struct {
+    guint32         hash;       /* 0 if the slot is empty. */
+    conv_flat_key_t key;
+    conversation_t *chain[2];   /* Chain heads for addr[0] -> addr[1] and addr[1] -> addr[0]. */
+} conv_flat_slot_t;
+
+static conv_flat_slot_t *conversation_flat_slots = NULL;
+static guint32 conversation_flat_mask;
+static guint32 conversation_flat_count;
+
 static guint32 new_index;
 
 /*
@@ -456,6 +488,162 @@ conversation_match_element_list(gconstpointer v1, gconstpointer v2)
     return TRUE;
 }
 
+/*
+ * Builds the index key for an address/port pair. Returns FALSE if the
+ * addresses cannot be stored inline. "dir" is set to 1 if the endpoints
+ * were swapped to put them in canonical order.
+ */
+static gboolean
+conversation_flat_key(conv_flat_key_t *key, guint *dir, const address *addr1, const guint32 port1,
+                      const address *addr2, const guint32 port2, const conversation_type ctype)
+{
+    int cmp;
+
+    if (addr1->type != addr2->type || (addr1->type != AT_IPv4 && addr1->type != AT_IPv6) ||
+            addr1->len != addr2->len || addr1->len > CONV_FLAT_ADDR_LEN) {
+        return FALSE;
+    }
+
+    cmp = memcmp(addr1->data, addr2->data, addr1->len);
+    if (cmp == 0) {
+        cmp = (port1 > port2) - (port1 < port2);
+    }
+    *dir = cmp > 0;
+
+    /* Clear the padding as well, keys are compared with memcmp. */
+    memset(key, 0, sizeof(*key));
+    memcpy(key->addr[*dir], addr1->data, addr1->len);
+    memcpy(key->addr[!*dir], addr2->data, addr2->len);
+    key->port[*dir] = port1;
+    key->port[!*dir] = port2;
+    key->ctype = ctype;
+    key->addr_type = addr1->type;
+    return TRUE;
+}
+
+static guint32
+conversation_flat_hash(const conv_flat_key_t *key)
+{
+    const guint8 *data = (const guint8 *)key;
+    guint64 hash = G_GUINT64_CONSTANT(0x9e3779b97f4a7c15);
+    guint64 word;
+    size_t i;
+
+    for (i = 0; i + sizeof(word) <= sizeof(*key); i += sizeof(word)) {
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+        hash ^= hash >> 32;
+    }
+    if (i < sizeof(*key)) {
+        word = 0;
+        memcpy(&word, data + i, sizeof(*key) - i);
+        hash = (hash ^ word) * G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+        hash ^= hash >> 32;
+    }
+    hash ^= hash >> 29;
+
+    /* 0 marks empty slots. */
+    return (guint32)hash ? (guint32)hash : 1;
+}
+
+/*
+ * Returns the slot of the key, or the empty slot where it should be
+ * inserted. The table must not be full.
+ */
+static conv_flat_slot_t *
+conversation_flat_probe(conv_flat_slot_t *slots, guint32 mask, const conv_flat_key_t *key, guint32 hash)
+{
+    for (guint32 i = hash & mask; ; i = (i + 1) & mask) {
+        conv_flat_slot_t *slot = &slots[i];
+
+        if (slot->hash == 0 ||
+                (slot->hash == hash && memcmp(&slot->key, key, sizeof(*key)) == 0)) {
+            return slot;
+        }
+    }
+}
+
+static conv_flat_slot_t *
+conversation_flat_lookup(const conv_flat_key_t *key)
+{
+    conv_flat_slot_t *slot;
+
+    if (!conversation_flat_slots) {
+        return NULL;
+    }
+    slot = conversation_flat_probe(conversation_flat_slots, conversation_flat_mask, key, conversation_flat_hash(key));
+    return slot->hash ? slot : NULL;
+}
+
+static void
+conversation_flat_grow(void)
+{
+    conv_flat_slot_t *old_slots = conversation_flat_slots;
+    guint32 old_size = old_slots ? conversation_flat_mask + 1 : 0;
+    guint32 new_size = old_size ? old_size * 2 : CONV_FLAT_MIN_SLOTS;
+
+    conversation_flat_slots = wmem_alloc0_array(wmem_file_scope(), conv_flat_slot_t, new_size);
+    conversation_flat_mask = new_size - 1;
+    for (guint32 i = 0; i < old_size; i++) {
+        if (old_slots[i].hash) {
+            *conversation_flat_probe(conversation_flat_slots, conversation_flat_mask,
+                                     &old_slots[i].key, old_slots[i].hash) = old_slots[i];
+        }
+    }
+    wmem_free(wmem_file_scope(), old_slots);
+}
+
+/*
+ * Copies the chain head of an exact address/port key from
+ * conversation_hashtable_exact_addr_port into the index. Must be called
+ * whenever that chain head changes.
+ */
+static void
+conversation_flat_update(const conversation_element_t *key_ptr)
+{
+    conv_flat_key_t key;
+    conv_flat_slot_t *slot;
+    conversation_t *chain_head;
+    guint32 hash;
+    guint dir;
+
+    if (!conversation_flat_key(&key, &dir, &key_ptr[ADDR1_IDX].addr_val, key_ptr[PORT1_IDX].port_val,
+                               &key_ptr[ADDR2_IDX].addr_val, key_ptr[PORT2_IDX].port_val,
+                               key_ptr[ENDP_EXACT_IDX].conversation_type_val)) {
+        return;
+    }
+    chain_head = (conversation_t *)wmem_map_lookup(conversation_hashtable_exact_addr_port, key_ptr);
+    hash = conversation_flat_hash(&key);
+
+    slot = conversation_flat_slots ?
+        conversation_flat_probe(conversation_flat_slots, conversation_flat_mask, &key, hash) : NULL;
+    if (!slot || !slot->hash) {
+        if (!chain_head) {
+            return;
+        }
+        /* Keep the load factor at or below 1/2. */
+        if (!conversation_flat_slots || (conversation_flat_count + 1) * 2 > conversation_flat_mask + 1) {
+            conversation_flat_grow();
+            slot = conversation_flat_probe(conversation_flat_slots, conversation_flat_mask, &key, hash);
+        }
+        slot->hash = hash;
+        slot->key = key;
+        conversation_flat_count++;
+    }
+    slot->chain[dir] = chain_head;
+}
+
+static gboolean
+conversation_flat_reset_cb(wmem_allocator_t *allocator _U_, wmem_cb_event_t event _U_, void *user_data _U_)
+{
+    /* The slots were allocated in the file scope. */
+    conversation_flat_slots = NULL;
+    conversation_flat_mask = 0;
+    conversation_flat_count = 0;
+
+    return TRUE;
+}
+
 /**
  * Create a new hash tables for conversations.
  */
@@ -534,6 +722,8 @@ conversation_init(void)
                                                        conversation_match_element_list);
     wmem_map_insert(conversation_hashtable_element_list, wmem_strdup(wmem_epan_scope(), id_map_key),
                     conversation_hashtable_id);
+
+    wmem_register_callback(wmem_file_scope(), conversation_flat_reset_cb, NULL);
 }
 
 /**
@@ -605,6 +795,10 @@ conversation_insert_into_hashtable(wmem_map_t *hashtable, conversation_t *conv)
             }
         }
     }
+
+    if (hashtable == conversation_hashtable_exact_addr_port) {
+        conversation_flat_update(conv->key_ptr);
+    }
 }
 
 /*
@@ -665,6 +859,10 @@ conversation_remove_from_hashtable(wmem_map_t *hashtable, conversation_t *conv)
         if (chain_head->latest_found == conv)
             chain_head->latest_found = prev;
     }
+
+    if (hashtable == conversation_hashtable_exact_addr_port) {
+        conversation_flat_update(conv->key_ptr);
+    }
 }
 
 conversation_t *conversation_new_full(const guint32 setup_frame, conversation_element_t *elements)
@@ -997,12 +1195,14 @@ conversation_set_addr2(conversation_t *conv, const address *addr)
     DENDENT();
 }
 
-static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const guint32 frame_num, conversation_element_t *conv_key)
+/*
+ * Returns the conversation of a chain that was set up last, at or before
+ * frame_num.
+ */
+static conversation_t *conversation_lookup_chain(conversation_t *chain_head, const guint32 frame_num)
 {
     conversation_t* convo = NULL;
     conversation_t* match = NULL;
-    conversation_t* chain_head = NULL;
-    chain_head = (conversation_t *)wmem_map_lookup(conversation_hashtable, conv_key);
 
     if (chain_head && (chain_head->setup_frame <= frame_num)) {
         match = chain_head;
@@ -1027,6 +1227,11 @@ static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_ha
     return match;
 }
 
+static conversation_t *conversation_lookup_hashtable(wmem_map_t *conversation_hashtable, const guint32 frame_num, conversation_element_t *conv_key)
+{
+    return conversation_lookup_chain((conversation_t *)wmem_map_lookup(conversation_hashtable, conv_key), frame_num);
+}
+
 conversation_t *find_conversation_full(const guint32 frame_num, conversation_element_t *elements)
 {
     char *el_list_map_key = conversation_element_list_name(NULL, elements);
@@ -1171,9 +1376,9 @@ find_conversation(const guint32 frame_num, const address *addr_a, const address
          * Neither search address B nor search port B are wildcarded,
          * start out with an exact match.
          */
-        DPRINT(("trying exact match: %s:%d -> %s:%d",
-                    addr_a_str, port_a, addr_b_str, port_b));
-        conversation = conversation_lookup_exact(frame_num, addr_a, port_a, addr_b, port_b, ctype);
+        conv_flat_key_t flat_key;
+        guint flat_dir;
+
         /*
          * Look for an alternate conversation in the opposite direction, which
          * might fit better. Note that using the helper functions such as
@@ -1182,10 +1387,26 @@ find_conversation(const guint32 frame_num, const address *addr_a, const address
          * If oriented conversations had to be implemented, amend this code or
          * create new functions.
          */
+        if (conversation_flat_key(&flat_key, &flat_dir, addr_a, port_a, addr_b, port_b, ctype)) {
+            /* A single probe finds both directions. */
+            conv_flat_slot_t *slot = conversation_flat_lookup(&flat_key);
+
+            DPRINT(("trying exact match in both directions: %s:%d <-> %s:%d",
+                        addr_a_str, port_a, addr_b_str, port_b));
+            conversation = other_conv = NULL;
+            if (slot) {
+                conversation = conversation_lookup_chain(slot->chain[flat_dir], frame_num);
+                other_conv = conversation_lookup_chain(slot->chain[!flat_dir], frame_num);
+            }
+        } else {
+            DPRINT(("trying exact match: %s:%d -> %s:%d",
+                        addr_a_str, port_a, addr_b_str, port_b));
+            conversation = conversation_lookup_exact(frame_num, addr_a, port_a, addr_b, port_b, ctype);
 
-        DPRINT(("trying exact match: %s:%d -> %s:%d",
-                    addr_b_str, port_b, addr_a_str, port_a));
-        other_conv = conversation_lookup_exact(frame_num, addr_b, port_b, addr_a, port_a, ctype);
+            DPRINT(("trying exact match: %s:%d -> %s:%d",
+                        addr_b_str, port_b, addr_a_str, port_a));
+            other_conv = conversation_lookup_exact(frame_num, addr_b, port_b, addr_a, port_a, ctype);
+        }
         if (other_conv != NULL) {
             if (conversation != NULL) {
                 if(other_conv->conv_index > conversation->conv_index) {
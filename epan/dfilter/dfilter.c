@@ -15,6 +15,7 @@
 #include "dfilter-int.h"
 #include "syntax-tree.h"
 #include "gencode.h"
+#include "optimize.h"
 #include "semcheck.h"
 #include "dfvm.h"
 #include <epan/epan_dissect.h>
@@ -469,7 +470,16 @@ dfwork_build(dfwork_t *dfw)
 
 	/* Cache tree representation in tree_str. */
 	tree_str = NULL;
-	log_syntax_tree(LOG_LEVEL_NOISY, dfw->st_root, "Syntax tree after successful semantic check", &tree_str);
+	if (dfw->flags & DF_OPTIMIZE) {
+		log_syntax_tree(LOG_LEVEL_NOISY, dfw->st_root, "Syntax tree after successful semantic check", NULL);
+
+		/* Rewrite the tree for cheaper bytecode */
+		dfw_optimize(dfw);
+		log_syntax_tree(LOG_LEVEL_NOISY, dfw->st_root, "Syntax tree after optimization", &tree_str);
+	}
+	else {
+		log_syntax_tree(LOG_LEVEL_NOISY, dfw->st_root, "Syntax tree after successful semantic check", &tree_str);
+	}
 
 	if ((dfw->flags & DF_SAVE_TREE) && tree_str == NULL) {
 		tree_str = dump_syntax_tree_str(dfw->st_root);
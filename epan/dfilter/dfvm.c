@@ -50,6 +50,7 @@ dfvm_opcode_tostr(dfvm_opcode_t code)
 		case DFVM_ANY_MATCHES:		return "ANY_MATCHES";
 		case DFVM_ALL_IN_RANGE:		return "ALL_IN_RANGE";
 		case DFVM_ANY_IN_RANGE:		return "ANY_IN_RANGE";
+		case DFVM_ANY_IN_SET:		return "ANY_IN_SET";
 		case DFVM_SLICE:		return "SLICE";
 		case DFVM_LENGTH:		return "LENGTH";
 		case DFVM_BITWISE_AND:		return "BITWISE_AND";
@@ -93,6 +94,9 @@ dfvm_value_free(dfvm_value_t *v)
 		case PCRE:
 			ws_regex_free(v->value.pcre);
 			break;
+		case FVALUE_SET:
+			dfvm_set_free(v->value.set);
+			break;
 		case EMPTY:
 		case HFINFO:
 		case RAW_HFINFO:
@@ -212,6 +216,117 @@ dfvm_value_new_guint(guint num)
 	return v;
 }
 
+dfvm_value_t*
+dfvm_value_new_set(dfvm_set_t *set)
+{
+	dfvm_value_t *v = dfvm_value_new(FVALUE_SET);
+	v->value.set = set;
+	return v;
+}
+
+/* Types for which equality is exact, so that values can be hashed, or
+ * for which it is a prefix match that can be looked up in a trie. */
+gboolean
+dfvm_set_supports_ftype(ftenum_t ftype)
+{
+	switch (ftype) {
+		case FT_CHAR:
+		case FT_UINT8:
+		case FT_UINT16:
+		case FT_UINT24:
+		case FT_UINT32:
+		case FT_UINT40:
+		case FT_UINT48:
+		case FT_UINT56:
+		case FT_UINT64:
+		case FT_INT8:
+		case FT_INT16:
+		case FT_INT24:
+		case FT_INT32:
+		case FT_INT40:
+		case FT_INT48:
+		case FT_INT56:
+		case FT_INT64:
+		case FT_FRAMENUM:
+		case FT_ETHER:
+		case FT_BYTES:
+		case FT_GUID:
+		case FT_IPv4:
+		case FT_IPv6:
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+dfvm_set_t *
+dfvm_set_new(ftenum_t ftype)
+{
+	dfvm_set_t *set;
+
+	ws_assert(dfvm_set_supports_ftype(ftype));
+
+	set = g_new0(dfvm_set_t, 1);
+	set->ftype = ftype;
+	set->fvalues = g_ptr_array_new_with_free_func((GDestroyNotify)fvalue_free);
+	if (ftype == FT_IPv4)
+		set->prefixes = prefix_trie_new(32, NULL);
+	else if (ftype == FT_IPv6)
+		set->prefixes = prefix_trie_new(128, NULL);
+	else
+		set->hash = g_hash_table_new((GHashFunc)fvalue_hash, (GEqualFunc)fvalue_equal);
+	return set;
+}
+
+/* Takes ownership of the value. */
+void
+dfvm_set_add(dfvm_set_t *set, fvalue_t *fv)
+{
+	guint8		addr[16];
+	unsigned	prefix;
+
+	ws_assert(fvalue_type_ftenum(fv) == set->ftype);
+
+	g_ptr_array_add(set->fvalues, fv);
+	if (set->prefixes) {
+		prefix = fvalue_get_ip_prefix(fv, addr);
+		prefix_trie_insert(set->prefixes, addr, prefix, fv);
+	}
+	else {
+		g_hash_table_add(set->hash, fv);
+	}
+}
+
+void
+dfvm_set_free(dfvm_set_t *set)
+{
+	if (set->prefixes)
+		prefix_trie_free(set->prefixes);
+	if (set->hash)
+		g_hash_table_destroy(set->hash);
+	g_ptr_array_free(set->fvalues, TRUE);
+	g_free(set);
+}
+
+static char *
+dfvm_set_tostr(const dfvm_set_t *set)
+{
+	GString	*repr = g_string_new("{");
+	char	*s;
+	guint	i;
+
+	/* Sets can be very large, only show the first elements. */
+	for (i = 0; i < set->fvalues->len && i < 8; i++) {
+		s = fvalue_to_debug_repr(NULL, set->fvalues->pdata[i]);
+		g_string_append_printf(repr, " %s", s);
+		g_free(s);
+	}
+	if (i < set->fvalues->len)
+		g_string_append_printf(repr, " ... (%u in total)", set->fvalues->len);
+	g_string_append(repr, " }");
+	return g_string_free(repr, FALSE);
+}
+
 static char *
 dfvm_value_tostr(dfvm_value_t *v)
 {
@@ -236,6 +351,9 @@ dfvm_value_tostr(dfvm_value_t *v)
 		case PCRE:
 			s = ws_strdup(ws_regex_pattern(v->value.pcre));
 			break;
+		case FVALUE_SET:
+			s = dfvm_set_tostr(v->value.set);
+			break;
 		case REGISTER:
 			s = ws_strdup_printf("R%"G_GUINT32_FORMAT, v->value.numeric);
 			break;
@@ -267,6 +385,9 @@ value_type_tostr(dfvm_value_t *v, gboolean show_ftype)
 		case FVALUE:
 			s = fvalue_type_name(v->value.fvalue);
 			break;
+		case FVALUE_SET:
+			s = ftype_name(v->value.set->ftype);
+			break;
 		default:
 			return ws_strdup("");
 			break;
@@ -494,6 +615,11 @@ append_op_args(wmem_strbuf_t *buf, dfvm_insn_t *insn, GSList **stack_print,
 						arg1_str, arg1_str_type, arg2_str, arg2_str_type, arg3_str, arg3_str_type);
 			break;
 
+		case DFVM_ANY_IN_SET:
+			wmem_strbuf_append_printf(buf, "%s%s in %s%s",
+						arg1_str, arg1_str_type, arg2_str, arg2_str_type);
+			break;
+
 		case DFVM_BITWISE_AND:
 			wmem_strbuf_append_printf(buf, "%s%s & %s%s",
 						arg1_str, arg1_str_type, arg2_str, arg2_str_type);
@@ -1163,6 +1289,48 @@ all_in_range(dfilter_t *df, dfvm_value_t *arg1,
 	return match_in_range(df, MATCH_ALL, arg1, arg_low, arg_high);
 }
 
+static gboolean
+set_contains(const dfvm_set_t *set, fvalue_t *fv)
+{
+	guint8		addr[16];
+	unsigned	prefix;
+	guint		i;
+
+	if (fvalue_type_ftenum(fv) == set->ftype) {
+		if (set->hash) {
+			return g_hash_table_contains(set->hash, fv);
+		}
+		prefix = fvalue_get_ip_prefix(fv, addr);
+		if (prefix == (set->ftype == FT_IPv4 ? 32 : 128)) {
+			return prefix_trie_lookup(set->prefixes, addr, NULL) != NULL;
+		}
+	}
+
+	/* A value of another type (from a field with the same name) or a
+	 * network; compare with each element like ANY_EQ does. */
+	for (i = 0; i < set->fvalues->len; i++) {
+		if (fvalue_eq(fv, set->fvalues->pdata[i]) == FT_TRUE) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static gboolean
+any_in_set(dfilter_t *df, dfvm_value_t *arg1, dfvm_value_t *arg2)
+{
+	GSList *list1 = df->registers[arg1->value.numeric];
+	dfvm_set_t *set = arg2->value.set;
+
+	while (list1) {
+		if (set_contains(set, list1->data)) {
+			return TRUE;
+		}
+		list1 = g_slist_next(list1);
+	}
+	return FALSE;
+}
+
 /* Clear registers that were populated during evaluation.
  * If we created the values, then these will be freed as well. */
 static void
@@ -1671,6 +1839,10 @@ dfvm_apply(dfilter_t *df, proto_tree *tree)
 				accum = any_in_range(df, arg1, arg2, arg3);
 				break;
 
+			case DFVM_ANY_IN_SET:
+				accum = any_in_set(df, arg1, arg2);
+				break;
+
 			case DFVM_UNARY_MINUS:
 				mk_minus(df, arg1, arg2);
 				break;
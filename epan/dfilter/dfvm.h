@@ -11,6 +11,7 @@
 #define DFVM_H
 
 #include <wsutil/regex.h>
+#include <wsutil/prefix_trie.h>
 #include <epan/proto.h>
 #include "dfilter-int.h"
 #include "syntax-tree.h"
@@ -27,9 +28,19 @@ typedef enum {
 	INTEGER,
 	DRANGE,
 	FUNCTION_DEF,
-	PCRE
+	PCRE,
+	FVALUE_SET
 } dfvm_value_type_t;
 
+/* A set of constant values, tested with a single lookup instead of one
+ * comparison per element. Addresses are matched with their prefix. */
+typedef struct {
+	ftenum_t	ftype;		/* Type of all the values. */
+	GPtrArray	*fvalues;	/* All values, owned by the set. */
+	GHashTable	*hash;		/* Values of other types than addresses. */
+	prefix_trie_t	*prefixes;	/* FT_IPv4 and FT_IPv6 values. */
+} dfvm_set_t;
+
 typedef struct {
 	dfvm_value_type_t	type;
 
@@ -40,6 +51,7 @@ typedef struct {
 		header_field_info	*hfinfo;
 		df_func_def_t		*funcdef;
 		ws_regex_t		*pcre;
+		dfvm_set_t		*set;
 	} value;
 
 	int ref_count;
@@ -77,6 +89,7 @@ typedef enum {
 	DFVM_ANY_MATCHES,
 	DFVM_ALL_IN_RANGE,
 	DFVM_ANY_IN_RANGE,
+	DFVM_ANY_IN_SET,
 	DFVM_SLICE,
 	DFVM_LENGTH,
 	DFVM_BITWISE_AND,
@@ -139,6 +152,21 @@ dfvm_value_new_pcre(ws_regex_t *re);
 dfvm_value_t*
 dfvm_value_new_guint(guint num);
 
+dfvm_value_t*
+dfvm_value_new_set(dfvm_set_t *set);
+
+gboolean
+dfvm_set_supports_ftype(ftenum_t ftype);
+
+dfvm_set_t *
+dfvm_set_new(ftenum_t ftype);
+
+void
+dfvm_set_add(dfvm_set_t *set, fvalue_t *fv);
+
+void
+dfvm_set_free(dfvm_set_t *set);
+
 void
 dfvm_dump(FILE *f, dfilter_t *df, uint16_t flags);
 
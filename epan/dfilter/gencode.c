@@ -22,6 +22,9 @@
 static void
 fixup_jumps(gpointer data, gpointer user_data);
 
+/* Minimum number of constants in a set to test them with a lookup. */
+#define SET_LOOKUP_MIN	8
+
 static void
 gencode(dfwork_t *dfw, stnode_t *st_node);
 
@@ -55,6 +58,7 @@ select_opcode(dfvm_opcode_t op, stmatch_t how)
 		case DFVM_ANY_MATCHES:
 		case DFVM_ANY_IN_RANGE:
 			return how == STNODE_MATCH_ANY ? op : op - 1;
+		case DFVM_ANY_IN_SET:
 		case DFVM_NOT_ALL_ZERO:
 		case DFVM_IF_TRUE_GOTO:
 		case DFVM_IF_FALSE_GOTO:
@@ -416,6 +420,51 @@ fixup_jumps(gpointer data, gpointer user_data)
 	}
 }
 
+/* Move the single constant elements of a set into a dfvm_set_t, if
+ * there are enough of them to make a lookup cheaper than comparing
+ * with each one. Ranges and other elements are left in the list. */
+static dfvm_set_t *
+gen_constant_set(GSList **nodelist_ptr)
+{
+	GSList		*nodelist, *rest = NULL;
+	stnode_t	*node1, *node2;
+	dfvm_set_t	*set;
+	ftenum_t	ftype = FT_NONE;
+	guint		count = 0;
+
+	for (nodelist = *nodelist_ptr; nodelist; nodelist = nodelist->next->next) {
+		node1 = nodelist->data;
+		node2 = nodelist->next->data;
+		if (node2 != NULL || stnode_type_id(node1) != STTYPE_FVALUE)
+			continue;
+		if (count == 0)
+			ftype = fvalue_type_ftenum(stnode_data(node1));
+		else if (fvalue_type_ftenum(stnode_data(node1)) != ftype)
+			return NULL;
+		count++;
+	}
+
+	if (count < SET_LOOKUP_MIN || !dfvm_set_supports_ftype(ftype))
+		return NULL;
+
+	set = dfvm_set_new(ftype);
+	for (nodelist = *nodelist_ptr; nodelist; nodelist = nodelist->next->next) {
+		node1 = nodelist->data;
+		node2 = nodelist->next->data;
+		if (node2 == NULL && stnode_type_id(node1) == STTYPE_FVALUE) {
+			dfvm_set_add(set, stnode_steal_data(node1));
+			stnode_free(node1);
+		}
+		else {
+			rest = g_slist_prepend(rest, node1);
+			rest = g_slist_prepend(rest, node2);
+		}
+	}
+	g_slist_free(*nodelist_ptr);
+	*nodelist_ptr = g_slist_reverse(rest);
+	return set;
+}
+
 /* Generate the code for the in operator.  It behaves much like an OR-ed
  * series of == tests, but without the redundant existence checks. */
 static void
@@ -430,12 +479,34 @@ gen_relation_in(dfwork_t *dfw, stmatch_t how,
 	stnode_t	*node1, *node2;
 	dfvm_opcode_t	op;
 	GSList		*nodelist_head, *nodelist;
+	dfvm_set_t	*set = NULL;
 
 	/* Create code for the LHS of the relation */
 	val1 = gen_entity(dfw, st_arg1, &jumps);
 
 	/* Create code for the set on the RHS of the relation */
-	nodelist_head = nodelist = stnode_steal_data(st_arg2);
+	nodelist_head = stnode_steal_data(st_arg2);
+
+	/* Test the constants with one lookup. "all" keeps the per element
+	 * semantics, see select_opcode(). */
+	if (how != STNODE_MATCH_ALL) {
+		set = gen_constant_set(&nodelist_head);
+	}
+	if (set != NULL) {
+		val2 = dfvm_value_new_set(set);
+		gen_relation_insn(dfw, DFVM_ANY_IN_SET, val1, val2, NULL);
+
+		/* Exit if it matched; test the remaining elements otherwise */
+		if (nodelist_head) {
+			insn = dfvm_insn_new(DFVM_IF_TRUE_GOTO);
+			jmp = dfvm_value_new(INSN_NUMBER);
+			insn->arg1 = dfvm_value_ref(jmp);
+			dfw_append_insn(dfw, insn);
+			jumps = g_slist_prepend(jumps, jmp);
+		}
+	}
+
+	nodelist = nodelist_head;
 	while (nodelist) {
 		node1 = nodelist->data;
 		nodelist = g_slist_next(nodelist);
@@ -0,0 +1,460 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#define WS_LOG_DOMAIN LOG_DOMAIN_DFILTER
+
+#include "dfilter-int.h"
+#include "optimize.h"
+#include "syntax-tree.h"
+#include "sttype-field.h"
+#include "sttype-slice.h"
+#include "sttype-op.h"
+#include "sttype-set.h"
+#include "sttype-function.h"
+
+#include <wsutil/ws_assert.h>
+#include <wsutil/wslog.h>
+
+#include <ftypes/ftypes.h>
+
+/*
+ * The optimizer works on the syntax tree between the semantic check and
+ * code generation. Tests have no side effects so it is free to change
+ * the order and shape of logical expressions, as long as the result for
+ * every packet stays the same:
+ *
+ *  - Arithmetic on constants is computed once at compile time.
+ *  - Equality tests for the same field joined with "or" are merged into
+ *    a single membership test, which loads the field once and stops at
+ *    the first match.
+ *  - The operands of a chain of "and" or "or" are ordered by their
+ *    estimated cost, so that cheap tests short-circuit expensive ones.
+ *
+ * Fields read more than once are already loaded into a shared register
+ * by the code generator.
+ */
+
+static stnode_t *
+optimize_test(stnode_t *st_node);
+
+static void
+fold_constants(stnode_t *st_node);
+
+/* Replace arithmetic on constant values with the result. Errors are
+ * left to be reported when the filter is run. */
+static void
+fold_arithmetic(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	fvalue_t	*fv1, *fv2, *result;
+	char		*err_msg = NULL;
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	fold_constants(st_arg1);
+	if (st_arg2)
+		fold_constants(st_arg2);
+
+	if (stnode_type_id(st_arg1) != STTYPE_FVALUE)
+		return;
+	if (st_arg2 && stnode_type_id(st_arg2) != STTYPE_FVALUE)
+		return;
+
+	fv1 = stnode_data(st_arg1);
+	fv2 = st_arg2 ? stnode_data(st_arg2) : NULL;
+
+	switch (st_op) {
+		case STNODE_OP_UNARY_MINUS:
+			result = fvalue_unary_minus(fv1, &err_msg);
+			break;
+		case STNODE_OP_ADD:
+			result = fvalue_add(fv1, fv2, &err_msg);
+			break;
+		case STNODE_OP_SUBTRACT:
+			result = fvalue_subtract(fv1, fv2, &err_msg);
+			break;
+		case STNODE_OP_MULTIPLY:
+			result = fvalue_multiply(fv1, fv2, &err_msg);
+			break;
+		case STNODE_OP_DIVIDE:
+			result = fvalue_divide(fv1, fv2, &err_msg);
+			break;
+		case STNODE_OP_MODULO:
+			result = fvalue_modulo(fv1, fv2, &err_msg);
+			break;
+		case STNODE_OP_BITWISE_AND:
+			result = fvalue_bitwise_and(fv1, fv2, &err_msg);
+			break;
+		default:
+			ws_assert_not_reached();
+	}
+
+	if (result == NULL) {
+		ws_noisy("Not folding %s: %s", stnode_todisplay(st_node), err_msg);
+		g_free(err_msg);
+		return;
+	}
+
+	ws_noisy("Folded %s", stnode_todisplay(st_node));
+	stnode_replace(st_node, STTYPE_FVALUE, result);
+}
+
+/* Fold constants in an entity (an operand of a relation). */
+static void
+fold_constants(stnode_t *st_node)
+{
+	GSList		*list;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_ARITHMETIC:
+			fold_arithmetic(st_node);
+			break;
+		case STTYPE_SLICE:
+			fold_constants(sttype_slice_entity(st_node));
+			break;
+		case STTYPE_FUNCTION:
+			for (list = sttype_function_params(st_node); list; list = list->next) {
+				fold_constants(list->data);
+			}
+			break;
+		case STTYPE_SET:
+			/* Elements are stored as (lower, upper) pairs, upper may be null. */
+			for (list = stnode_data(st_node); list; list = list->next) {
+				if (list->data)
+					fold_constants(list->data);
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* Rough relative cost of loading or computing an entity. */
+static unsigned
+entity_cost(stnode_t *st_node)
+{
+	stnode_t	*st_arg1, *st_arg2;
+	GSList		*list;
+	unsigned	cost;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_FIELD:
+			return sttype_field_drange(st_node) ? 2 : 1;
+		case STTYPE_REFERENCE:
+			return 2;
+		case STTYPE_SLICE:
+			return 2 + entity_cost(sttype_slice_entity(st_node));
+		case STTYPE_FUNCTION:
+			cost = 4;
+			for (list = sttype_function_params(st_node); list; list = list->next) {
+				cost += entity_cost(list->data);
+			}
+			return cost;
+		case STTYPE_ARITHMETIC:
+			sttype_oper_get(st_node, NULL, &st_arg1, &st_arg2);
+			cost = 1 + entity_cost(st_arg1);
+			if (st_arg2)
+				cost += entity_cost(st_arg2);
+			return cost;
+		case STTYPE_SET:
+			/* One comparison per element, large sets of constants
+			 * are a single lookup (see gen_relation_in()). */
+			return MIN(g_slist_length(stnode_data(st_node)) / 2, 8);
+		case STTYPE_PCRE:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+/* Rough relative cost of evaluating a test. Existence tests are the
+ * cheapest, regular expressions and function calls the most expensive. */
+static unsigned
+test_cost(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_FIELD:
+			return 1;
+		case STTYPE_SLICE:
+		case STTYPE_ARITHMETIC:
+			return 1 + entity_cost(st_node);
+		case STTYPE_TEST:
+			break;
+		default:
+			ws_assert_not_reached();
+	}
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	switch (st_op) {
+		case STNODE_OP_NOT:
+			return test_cost(st_arg1);
+		case STNODE_OP_AND:
+		case STNODE_OP_OR:
+			return test_cost(st_arg1) + test_cost(st_arg2);
+		case STNODE_OP_CONTAINS:
+			return 3 + entity_cost(st_arg1) + entity_cost(st_arg2);
+		default:
+			return 1 + entity_cost(st_arg1) + entity_cost(st_arg2);
+	}
+}
+
+/* If the test is an equality or membership test of a field that can be
+ * expressed as a set membership test, return the field. */
+static stnode_t *
+membership_field(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+
+	if (stnode_type_id(st_node) != STTYPE_TEST)
+		return NULL;
+	if (sttype_test_get_match(st_node) == STNODE_MATCH_ALL)
+		return NULL;
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+	if (st_op == STNODE_OP_ANY_EQ) {
+		if (stnode_type_id(st_arg2) != STTYPE_FVALUE)
+			return NULL;
+	}
+	else if (st_op != STNODE_OP_IN) {
+		return NULL;
+	}
+
+	/* Layer ranges are not merged. */
+	if (stnode_type_id(st_arg1) != STTYPE_FIELD || sttype_field_drange(st_arg1) != NULL)
+		return NULL;
+
+	return st_arg1;
+}
+
+static gboolean
+same_field(stnode_t *field1, stnode_t *field2)
+{
+	return sttype_field_hfinfo(field1) == sttype_field_hfinfo(field2) &&
+		sttype_field_raw(field1) == sttype_field_raw(field2);
+}
+
+/* Take the set elements out of a membership test, leaving the field. */
+static GSList *
+steal_set_elements(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+	GSList		*nodelist;
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+	sttype_oper_set2_args(st_node, st_arg1, NULL);
+
+	if (st_op == STNODE_OP_IN) {
+		nodelist = stnode_steal_data(st_arg2);
+		stnode_free(st_arg2);
+		return nodelist;
+	}
+
+	/* Single value: (value, NULL). */
+	nodelist = g_slist_append(NULL, st_arg2);
+	return g_slist_append(nodelist, NULL);
+}
+
+/* Merge two membership tests of the same field into a new test, which
+ * takes over the nodes of both. */
+static stnode_t *
+merge_membership_tests(stnode_t *st_node1, stnode_t *st_node2)
+{
+	stnode_t	*st_field, *st_set, *st_test;
+	GSList		*nodelist;
+
+	nodelist = steal_set_elements(st_node1);
+	nodelist = g_slist_concat(nodelist, steal_set_elements(st_node2));
+
+	sttype_oper_get(st_node1, NULL, &st_field, NULL);
+	sttype_oper_set2_args(st_node1, NULL, NULL);
+
+	st_set = stnode_new(STTYPE_SET, nodelist, NULL, stnode_location(st_node2));
+	st_test = stnode_new_empty(STTYPE_TEST);
+	sttype_oper_set2(st_test, STNODE_OP_IN, st_field, st_set);
+	stnode_merge_location(st_test, st_node1, st_node2);
+
+	stnode_free(st_node1);
+	stnode_free(st_node2);
+	return st_test;
+}
+
+/* Merge the operands of an "or" chain that test the same field for
+ * equality. The merged test takes the place of the first one. */
+static void
+merge_or_operands(GPtrArray *operands)
+{
+	stnode_t	*st_field, *st_other;
+	guint		i, j;
+
+	for (i = 0; i < operands->len; i++) {
+		st_field = membership_field(g_ptr_array_index(operands, i));
+		if (st_field == NULL)
+			continue;
+
+		j = i + 1;
+		while (j < operands->len) {
+			st_other = membership_field(g_ptr_array_index(operands, j));
+			if (st_other == NULL || !same_field(st_field, st_other)) {
+				j++;
+				continue;
+			}
+			g_ptr_array_index(operands, i) = merge_membership_tests(
+					g_ptr_array_index(operands, i),
+					g_ptr_array_index(operands, j));
+			g_ptr_array_remove_index(operands, j);
+			st_field = membership_field(g_ptr_array_index(operands, i));
+		}
+	}
+}
+
+/* Stable insertion sort by cost; the chains are short and the original
+ * order is kept for tests of equal cost. */
+static void
+sort_operands(GPtrArray *operands)
+{
+	unsigned	*costs;
+	stnode_t	*st_node;
+	unsigned	cost;
+	guint		i, j;
+
+	costs = g_new(unsigned, operands->len);
+	for (i = 0; i < operands->len; i++) {
+		costs[i] = test_cost(g_ptr_array_index(operands, i));
+	}
+
+	for (i = 1; i < operands->len; i++) {
+		st_node = g_ptr_array_index(operands, i);
+		cost = costs[i];
+		for (j = i; j > 0 && costs[j - 1] > cost; j--) {
+			g_ptr_array_index(operands, j) = g_ptr_array_index(operands, j - 1);
+			costs[j] = costs[j - 1];
+		}
+		g_ptr_array_index(operands, j) = st_node;
+		costs[j] = cost;
+	}
+
+	g_free(costs);
+}
+
+/* Flatten a chain of the same logical operator, e.g. ((a || b) || c),
+ * into a list of optimized operands. The operator nodes are freed. */
+static void
+collect_operands(stnode_t *st_node, stnode_op_t st_op, GPtrArray *operands)
+{
+	stnode_op_t	node_op;
+	stnode_t	*st_arg1, *st_arg2;
+
+	if (stnode_type_id(st_node) == STTYPE_TEST) {
+		sttype_oper_get(st_node, &node_op, &st_arg1, &st_arg2);
+		if (node_op == st_op) {
+			sttype_oper_set2_args(st_node, NULL, NULL);
+			stnode_free(st_node);
+			collect_operands(st_arg1, st_op, operands);
+			collect_operands(st_arg2, st_op, operands);
+			return;
+		}
+	}
+
+	g_ptr_array_add(operands, optimize_test(st_node));
+}
+
+static stnode_t *
+optimize_logical(stnode_t *st_node, stnode_op_t st_op)
+{
+	GPtrArray	*operands;
+	stnode_t	*st_result, *st_test;
+	guint		i;
+
+	operands = g_ptr_array_new();
+	collect_operands(st_node, st_op, operands);
+
+	if (st_op == STNODE_OP_OR) {
+		merge_or_operands(operands);
+	}
+	sort_operands(operands);
+
+	/* Rebuild the chain, associating to the left like the parser. */
+	st_result = g_ptr_array_index(operands, 0);
+	for (i = 1; i < operands->len; i++) {
+		st_test = stnode_new_empty(STTYPE_TEST);
+		sttype_oper_set2(st_test, st_op, st_result, g_ptr_array_index(operands, i));
+		stnode_merge_location(st_test, st_result, g_ptr_array_index(operands, i));
+		st_result = st_test;
+	}
+
+	g_ptr_array_free(operands, TRUE);
+	return st_result;
+}
+
+/* Optimize a node in test position and return its replacement. */
+static stnode_t *
+optimize_test(stnode_t *st_node)
+{
+	stnode_op_t	st_op;
+	stnode_t	*st_arg1, *st_arg2;
+
+	switch (stnode_type_id(st_node)) {
+		case STTYPE_TEST:
+			break;
+		case STTYPE_ARITHMETIC:
+			/* A test for non-zero; the node itself must stay arithmetic. */
+			sttype_oper_get(st_node, NULL, &st_arg1, &st_arg2);
+			fold_constants(st_arg1);
+			if (st_arg2)
+				fold_constants(st_arg2);
+			return st_node;
+		case STTYPE_SLICE:
+			fold_constants(sttype_slice_entity(st_node));
+			return st_node;
+		default:
+			return st_node;
+	}
+
+	sttype_oper_get(st_node, &st_op, &st_arg1, &st_arg2);
+
+	switch (st_op) {
+		case STNODE_OP_AND:
+		case STNODE_OP_OR:
+			return optimize_logical(st_node, st_op);
+		case STNODE_OP_NOT:
+			sttype_oper_set1_args(st_node, optimize_test(st_arg1));
+			return st_node;
+		default:
+			fold_constants(st_arg1);
+			fold_constants(st_arg2);
+			return st_node;
+	}
+}
+
+void
+dfw_optimize(dfwork_t *dfw)
+{
+	dfw->st_root = optimize_test(dfw->st_root);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: t
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 noexpandtab:
+ * :indentSize=8:tabSize=8:noTabs=false:
+ */
@@ -0,0 +1,21 @@
+/** @file
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 2001 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "dfilter-int.h"
+
+/* Rewrite the syntax tree after a successful semantic check so that
+ * the generated code does less work per packet. The result of the
+ * filter is not changed. */
+void
+dfw_optimize(dfwork_t *dfw);
+
+#endif
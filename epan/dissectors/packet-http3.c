@@ -12,6 +12,7 @@
 /*
  * https://tools.ietf.org/html/draft-ietf-quic-http-29
  * https://tools.ietf.org/html/draft-ietf-quic-qpack-16
+ * https://www.rfc-editor.org/rfc/rfc9204 (QPACK)
  *
  * Depends on the QUIC dissector for providing a reassembled stream of data, see
  * packet-quic.c for details about supported QUIC draft versions.
@@ -46,12 +47,29 @@ static int hf_http3_settings_h3_datagram = -1;
 static int hf_http3_settings_h3_datagram_draft04 = -1;
 static int hf_http3_priority_update_element_id = -1;
 static int hf_http3_priority_update_field_value = -1;
+static int hf_http3_qpack_encoder_opcode = -1;
+static int hf_http3_qpack_decoder_opcode = -1;
+static int hf_http3_qpack_capacity = -1;
+static int hf_http3_qpack_static = -1;
+static int hf_http3_qpack_name_index = -1;
+static int hf_http3_qpack_name = -1;
+static int hf_http3_qpack_value = -1;
+static int hf_http3_qpack_stream_id = -1;
+static int hf_http3_qpack_increment = -1;
+static int hf_http3_qpack_required_insert_count = -1;
+static int hf_http3_qpack_base = -1;
+static int hf_http3_header = -1;
+static int hf_http3_header_name = -1;
+static int hf_http3_header_value = -1;
 
 static expert_field ei_http3_unknown_stream_type = EI_INIT;
+static expert_field ei_http3_qpack_failed = EI_INIT;
 
 /* Initialize the subtree pointers */
 static gint ett_http3 = -1;
 static gint ett_http3_settings = -1;
+static gint ett_http3_qpack_instruction = -1;
+static gint ett_http3_header = -1;
 
 /**
  * Unidirectional stream types.
@@ -212,9 +230,1049 @@ http3_check_frame_size(tvbuff_t *tvb, packet_info *pinfo, int offset)
     return FALSE;
 }
 
+/*
+ * QPACK: Field Compression for HTTP/3
+ * https://www.rfc-editor.org/rfc/rfc9204
+ *
+ * Each endpoint has an encoder which maintains a dynamic table through
+ * instructions on its encoder stream. The field sections (HEADERS and
+ * PUSH_PROMISE) sent by that endpoint reference this table. The tables are
+ * updated while the encoder stream is dissected in the first pass, decoded
+ * field sections are cached such that later passes do not decode them again.
+ *
+ * Limitations:
+ * - A field section which references entries that are inserted later in the
+ *   capture ("blocked stream") is not decoded.
+ * - If SETTINGS_QPACK_MAX_TABLE_CAPACITY was not captured, the largest
+ *   capacity set by the encoder is assumed for decoding the Required Insert
+ *   Count.
+ */
+
+/** A name-value pair of the QPACK static table. */
+typedef struct _http3_qpack_field {
+    const char *name;
+    const char *value;
+} http3_qpack_field;
+
+/* RFC 9204 Appendix A */
+static const http3_qpack_field http3_qpack_static_table[] = {
+    { ":authority", "" },
+    { ":path", "/" },
+    { "age", "0" },
+    { "content-disposition", "" },
+    { "content-length", "0" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "referer", "" },
+    { "set-cookie", "" },
+    { ":method", "CONNECT" },
+    { ":method", "DELETE" },
+    { ":method", "GET" },
+    { ":method", "HEAD" },
+    { ":method", "OPTIONS" },
+    { ":method", "POST" },
+    { ":method", "PUT" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "103" },
+    { ":status", "200" },
+    { ":status", "304" },
+    { ":status", "404" },
+    { ":status", "503" },
+    { "accept", "*/*" },
+    { "accept", "application/dns-message" },
+    { "accept-encoding", "gzip, deflate, br" },
+    { "accept-ranges", "bytes" },
+    { "access-control-allow-headers", "cache-control" },
+    { "access-control-allow-headers", "content-type" },
+    { "access-control-allow-origin", "*" },
+    { "cache-control", "max-age=0" },
+    { "cache-control", "max-age=2592000" },
+    { "cache-control", "max-age=604800" },
+    { "cache-control", "no-cache" },
+    { "cache-control", "no-store" },
+    { "cache-control", "public, max-age=31536000" },
+    { "content-encoding", "br" },
+    { "content-encoding", "gzip" },
+    { "content-type", "application/dns-message" },
+    { "content-type", "application/javascript" },
+    { "content-type", "application/json" },
+    { "content-type", "application/x-www-form-urlencoded" },
+    { "content-type", "image/gif" },
+    { "content-type", "image/jpeg" },
+    { "content-type", "image/png" },
+    { "content-type", "text/css" },
+    { "content-type", "text/html; charset=utf-8" },
+    { "content-type", "text/plain" },
+    { "content-type", "text/plain;charset=utf-8" },
+    { "range", "bytes=0-" },
+    { "strict-transport-security", "max-age=31536000" },
+    { "strict-transport-security", "max-age=31536000; includesubdomains" },
+    { "strict-transport-security", "max-age=31536000; includesubdomains; preload" },
+    { "vary", "accept-encoding" },
+    { "vary", "origin" },
+    { "x-content-type-options", "nosniff" },
+    { "x-xss-protection", "1; mode=block" },
+    { ":status", "100" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "302" },
+    { ":status", "400" },
+    { ":status", "403" },
+    { ":status", "421" },
+    { ":status", "425" },
+    { ":status", "500" },
+    { "accept-language", "" },
+    { "access-control-allow-credentials", "FALSE" },
+    { "access-control-allow-credentials", "TRUE" },
+    { "access-control-allow-headers", "*" },
+    { "access-control-allow-methods", "get" },
+    { "access-control-allow-methods", "get, post, options" },
+    { "access-control-allow-methods", "options" },
+    { "access-control-expose-headers", "content-length" },
+    { "access-control-request-headers", "content-type" },
+    { "access-control-request-method", "get" },
+    { "access-control-request-method", "post" },
+    { "alt-svc", "clear" },
+    { "authorization", "" },
+    { "content-security-policy", "script-src 'none'; object-src 'none'; base-uri 'none'" },
+    { "early-data", "1" },
+    { "expect-ct", "" },
+    { "forwarded", "" },
+    { "if-range", "" },
+    { "origin", "" },
+    { "purpose", "prefetch" },
+    { "server", "" },
+    { "timing-allow-origin", "*" },
+    { "upgrade-insecure-requests", "1" },
+    { "user-agent", "" },
+    { "x-forwarded-for", "" },
+    { "x-frame-options", "deny" },
+    { "x-frame-options", "sameorigin" },
+};
+
+/**
+ * Entry of a QPACK dynamic table. The name and value are NUL-terminated for
+ * display, but may contain NULs as well.
+ */
+typedef struct _http3_qpack_entry {
+    const char *name;
+    const char *value;
+    guint32     name_len;
+    guint32     value_len;
+    guint64     size;           /**< Entry size, RFC 9204 Section 3.2.1. */
+    guint64     stream_offset;  /**< Encoder stream offset of the instruction that inserted it. */
+} http3_qpack_entry;
+
+/**
+ * QPACK dynamic table maintained by the encoder of one endpoint. The entries
+ * that were not evicted are kept in a ring buffer indexed by their absolute
+ * index, so it only grows with the number of entries that fit in the table.
+ * Entries remain available by their encoder stream offset for displaying the
+ * encoder instructions in later passes.
+ */
+typedef struct _http3_qpack_table {
+    http3_qpack_entry **ring;   /**< Entries [dropped, insert_count), by absolute index modulo ring_size. */
+    guint       ring_size;      /**< Zero or a power of two. */
+    guint64     insert_count;   /**< Number of inserted entries. */
+    guint64     dropped;        /**< Absolute index of the oldest entry that was not evicted. */
+    guint64     size;           /**< Size of the entries that were not evicted. */
+    guint64     capacity;       /**< Set by the encoder, at most max_capacity. */
+    guint64     max_capacity;   /**< SETTINGS_QPACK_MAX_TABLE_CAPACITY of the peer. */
+    gboolean    has_max_capacity;   /**< The SETTINGS with max_capacity were captured. */
+    guint64     next_offset;    /**< Encoder stream offset following the last applied instruction. */
+    gboolean    missing_data;   /**< Part of the encoder stream was not captured. */
+    wmem_map_t *inserted;       /**< Encoder stream offset -> http3_qpack_entry */
+} http3_qpack_table;
+
+/** Per-connection HTTP/3 state. */
+typedef struct _http3_conn_info {
+    http3_qpack_table qpack[2]; /**< Dynamic table of the client [0] and server [1] encoder. */
+} http3_conn_info;
+
+/** A decoded field line. */
+typedef struct _http3_header_field {
+    const char *name;
+    const char *value;
+    guint32     offset;         /**< Offset of the field line in the field section. */
+    guint32     length;
+} http3_header_field;
+
+/** A decoded field section of a HEADERS or PUSH_PROMISE frame. */
+typedef struct _http3_header_section {
+    guint64     required_insert_count;
+    guint64     base;
+    guint32     prefix_length;
+    guint32     field_count;
+    http3_header_field *fields;
+    const char *error;          /**< If not NULL, decoding failed after "fields". */
+    guint32     error_offset;
+} http3_header_section;
+
+typedef struct _http3_header_section_key {
+    guint32     frame_num;
+    guint64     stream_id;
+    guint64     stream_offset;  /**< Stream offset of the field section. */
+} http3_header_section_key;
+
+static wmem_map_t *http3_connections;       /* quic_info -> http3_conn_info */
+static wmem_map_t *http3_header_sections;   /* http3_header_section_key -> http3_header_section */
+
+typedef enum {
+    HTTP3_QPACK_OK,
+    HTTP3_QPACK_INCOMPLETE,     /**< More data is needed. */
+    HTTP3_QPACK_INVALID,
+} http3_qpack_status;
+
+/* Encoder instructions, RFC 9204 Section 4.3 */
+#define HTTP3_QPACK_ENC_SET_CAPACITY        0
+#define HTTP3_QPACK_ENC_INSERT_NAME_REF     1
+#define HTTP3_QPACK_ENC_INSERT_LITERAL      2
+#define HTTP3_QPACK_ENC_DUPLICATE           3
+
+static const value_string http3_qpack_encoder_opcode_vals[] = {
+    { HTTP3_QPACK_ENC_SET_CAPACITY, "Set Dynamic Table Capacity" },
+    { HTTP3_QPACK_ENC_INSERT_NAME_REF, "Insert With Name Reference" },
+    { HTTP3_QPACK_ENC_INSERT_LITERAL, "Insert With Literal Name" },
+    { HTTP3_QPACK_ENC_DUPLICATE, "Duplicate" },
+    { 0, NULL }
+};
+
+/* Decoder instructions, RFC 9204 Section 4.4 */
+#define HTTP3_QPACK_DEC_SECTION_ACK         0
+#define HTTP3_QPACK_DEC_STREAM_CANCEL       1
+#define HTTP3_QPACK_DEC_INSERT_COUNT_INC    2
+
+static const value_string http3_qpack_decoder_opcode_vals[] = {
+    { HTTP3_QPACK_DEC_SECTION_ACK, "Section Acknowledgment" },
+    { HTTP3_QPACK_DEC_STREAM_CANCEL, "Stream Cancellation" },
+    { HTTP3_QPACK_DEC_INSERT_COUNT_INC, "Insert Count Increment" },
+    { 0, NULL }
+};
+
+/** Huffman code for QPACK string literals, RFC 7541 Appendix B (without EOS). */
+static const struct {
+    guint32     code;
+    guint8      len;
+} http3_huffman_codes[256] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+    { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+    { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+    { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+    { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+    { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+    { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+    { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+    { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+    { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+    { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+    { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+    { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+    { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+    { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+    { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+    { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+    { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+};
+
+/*
+ * The Huffman decoder consumes four bits at a time. Its states are the inner
+ * nodes of the code tree (the root being state 0), there are 255 of them.
+ * Since the shortest code has five bits, at most one symbol is emitted per
+ * transition. The table is built on registration.
+ */
+#define HTTP3_HUFFMAN_EMIT      0x01    /* "symbol" is decoded. */
+#define HTTP3_HUFFMAN_FAIL      0x02    /* EOS or invalid code. */
+#define HTTP3_HUFFMAN_ACCEPT    0x04    /* Valid end, at most 7 bits of EOS padding are pending. */
+
+typedef struct _http3_huffman_transition {
+    guint8      state;
+    guint8      flags;
+    guint8      symbol;
+} http3_huffman_transition;
+
+static http3_huffman_transition http3_huffman_table[256][16];
+
+static void
+http3_huffman_init(void)
+{
+    /* Child node of an inner node: > 0 for an inner node, < 0 for the leaf
+     * of symbol -(child + 1), 0 if not present (EOS). */
+    gint16 children[256][2];
+    guint8 depth[256];
+    gboolean all_ones[256];
+    guint nodes = 1;
+
+    memset(children, 0, sizeof(children));
+    depth[0] = 0;
+    all_ones[0] = TRUE;
+    for (guint sym = 0; sym < 256; sym++) {
+        guint node = 0;
+        for (int bit = http3_huffman_codes[sym].len - 1; bit >= 0; bit--) {
+            guint b = (http3_huffman_codes[sym].code >> bit) & 1;
+            if (bit == 0) {
+                children[node][b] = -(gint16)(sym + 1);
+            } else {
+                if (children[node][b] == 0) {
+                    DISSECTOR_ASSERT(nodes < G_N_ELEMENTS(children));
+                    children[node][b] = (gint16)nodes;
+                    depth[nodes] = depth[node] + 1;
+                    all_ones[nodes] = all_ones[node] && b;
+                    nodes++;
+                }
+                node = children[node][b];
+            }
+        }
+    }
+
+    for (guint state = 0; state < nodes; state++) {
+        for (guint nibble = 0; nibble < 16; nibble++) {
+            http3_huffman_transition *t = &http3_huffman_table[state][nibble];
+            guint node = state;
+
+            t->flags = 0;
+            for (int bit = 3; bit >= 0; bit--) {
+                gint16 child = children[node][(nibble >> bit) & 1];
+                if (child == 0) {
+                    t->flags = HTTP3_HUFFMAN_FAIL;
+                    break;
+                }
+                if (child < 0) {
+                    t->flags |= HTTP3_HUFFMAN_EMIT;
+                    t->symbol = (guint8)(-child - 1);
+                    node = 0;
+                } else {
+                    node = child;
+                }
+            }
+            if (!(t->flags & HTTP3_HUFFMAN_FAIL)) {
+                t->state = (guint8)node;
+                if (all_ones[node] && depth[node] <= 7) {
+                    t->flags |= HTTP3_HUFFMAN_ACCEPT;
+                }
+            }
+        }
+    }
+}
+
+/** Returns the decoded string and its length, or NULL if the encoding is invalid. */
+static char *
+http3_huffman_decode(wmem_allocator_t *scope, const guint8 *data, guint length, guint *decoded_len)
+{
+    char *str = (char *)wmem_alloc(scope, length * 8 / 5 + 1);
+    guint str_len = 0;
+    guint8 state = 0;
+    guint8 flags = HTTP3_HUFFMAN_ACCEPT;
+
+    for (guint i = 0; i < length; i++) {
+        for (int shift = 4; shift >= 0; shift -= 4) {
+            const http3_huffman_transition *t = &http3_huffman_table[state][(data[i] >> shift) & 0xf];
+            flags = t->flags;
+            if (flags & HTTP3_HUFFMAN_FAIL) {
+                wmem_free(scope, str);
+                return NULL;
+            }
+            if (flags & HTTP3_HUFFMAN_EMIT) {
+                str[str_len++] = t->symbol;
+            }
+            state = t->state;
+        }
+    }
+    if (!(flags & HTTP3_HUFFMAN_ACCEPT)) {
+        wmem_free(scope, str);
+        return NULL;
+    }
+    str[str_len] = '\0';
+    *decoded_len = str_len;
+    return str;
+}
+
+/** Decodes a prefixed integer, RFC 9204 Section 4.1.1. */
+static http3_qpack_status
+http3_qpack_get_int(const guint8 *buf, guint length, guint *pos, int prefix, guint64 *value)
+{
+    const guint64 max_prefix = (1U << prefix) - 1;
+    guint64 v;
+    guint8 b;
+    int shift = 0;
+
+    if (*pos >= length) {
+        return HTTP3_QPACK_INCOMPLETE;
+    }
+    v = buf[(*pos)++] & max_prefix;
+    if (v == max_prefix) {
+        do {
+            if (*pos >= length) {
+                return HTTP3_QPACK_INCOMPLETE;
+            }
+            if (shift > 56) {
+                return HTTP3_QPACK_INVALID;
+            }
+            b = buf[(*pos)++];
+            v += (guint64)(b & 0x7f) << shift;
+            shift += 7;
+        } while (b & 0x80);
+    }
+    *value = v;
+    return HTTP3_QPACK_OK;
+}
+
+/**
+ * Decodes a string literal, RFC 9204 Section 4.1.2. The Huffman flag precedes
+ * the prefixed length. If "scope" is NULL, the string is skipped. The decoded
+ * length is returned in "decoded_len" (if not NULL) since the string may
+ * contain NULs.
+ */
+static http3_qpack_status
+http3_qpack_get_string(wmem_allocator_t *scope, const guint8 *buf, guint length, guint *pos, int prefix,
+                       const char **str, guint *decoded_len)
+{
+    http3_qpack_status status;
+    gboolean huffman;
+    guint64 str_len;
+    guint s_len;
+    char *s;
+
+    if (*pos >= length) {
+        return HTTP3_QPACK_INCOMPLETE;
+    }
+    huffman = (buf[*pos] >> prefix) & 1;
+    status = http3_qpack_get_int(buf, length, pos, prefix, &str_len);
+    if (status != HTTP3_QPACK_OK) {
+        return status;
+    }
+    if (str_len > length - *pos) {
+        return HTTP3_QPACK_INCOMPLETE;
+    }
+    if (scope) {
+        if (huffman) {
+            s = http3_huffman_decode(scope, buf + *pos, (guint)str_len, &s_len);
+            if (!s) {
+                return HTTP3_QPACK_INVALID;
+            }
+        } else {
+            s_len = (guint)str_len;
+            s = (char *)wmem_alloc(scope, (size_t)str_len + 1);
+            memcpy(s, buf + *pos, (size_t)str_len);
+            s[str_len] = '\0';
+        }
+        *str = s;
+        if (decoded_len) {
+            *decoded_len = s_len;
+        }
+    }
+    *pos += (guint)str_len;
+    return HTTP3_QPACK_OK;
+}
+
+static guint64
+http3_qpack_insert_count(const http3_qpack_table *table)
+{
+    return table->insert_count;
+}
+
+/** Returns the entry with the absolute index, or NULL if it was evicted or not inserted. */
+static const http3_qpack_entry *
+http3_qpack_get_entry(const http3_qpack_table *table, guint64 abs_index)
+{
+    if (abs_index < table->dropped || abs_index >= table->insert_count) {
+        return NULL;
+    }
+    return table->ring[abs_index & (table->ring_size - 1)];
+}
+
+/** Returns the entry inserted by the encoder instruction at "stream_offset", if any. */
+static const http3_qpack_entry *
+http3_qpack_find_inserted(const http3_qpack_table *table, guint64 stream_offset)
+{
+    return (const http3_qpack_entry *)wmem_map_lookup(table->inserted, &stream_offset);
+}
+
+/** Evicts the oldest entries until the table size is at most "size". */
+static void
+http3_qpack_evict(http3_qpack_table *table, guint64 size)
+{
+    while (table->size > size && table->dropped < table->insert_count) {
+        const http3_qpack_entry *entry = table->ring[table->dropped & (table->ring_size - 1)];
+        table->size -= entry->size;
+        table->dropped++;
+    }
+}
+
+static gboolean
+http3_qpack_insert(http3_qpack_table *table, const char *name, guint name_len,
+                   const char *value, guint value_len, guint64 stream_offset)
+{
+    http3_qpack_entry *entry;
+    guint64 size = (guint64)name_len + value_len + 32;
+
+    if (size > table->capacity) {
+        return FALSE;
+    }
+    http3_qpack_evict(table, table->capacity - size);
+
+    if (table->insert_count - table->dropped == table->ring_size) {
+        /* Full, double the ring and move the entries to their new slots. */
+        guint new_size = table->ring_size ? 2 * table->ring_size : 16;
+        http3_qpack_entry **ring = wmem_alloc_array(wmem_file_scope(), http3_qpack_entry *, new_size);
+
+        for (guint64 i = table->dropped; i < table->insert_count; i++) {
+            ring[i & (new_size - 1)] = table->ring[i & (table->ring_size - 1)];
+        }
+        wmem_free(wmem_file_scope(), table->ring);
+        table->ring = ring;
+        table->ring_size = new_size;
+    }
+
+    entry = wmem_new(wmem_file_scope(), http3_qpack_entry);
+    entry->name = name;
+    entry->value = value;
+    entry->name_len = name_len;
+    entry->value_len = value_len;
+    entry->size = size;
+    entry->stream_offset = stream_offset;
+    table->ring[table->insert_count & (table->ring_size - 1)] = entry;
+    table->insert_count++;
+    table->size += size;
+    wmem_map_insert(table->inserted, &entry->stream_offset, entry);
+    return TRUE;
+}
+
+static http3_conn_info *
+http3_get_conn_info(quic_stream_info *stream_info)
+{
+    http3_conn_info *conn = (http3_conn_info *)wmem_map_lookup(http3_connections, stream_info->quic_info);
+
+    if (!conn) {
+        conn = wmem_new0(wmem_file_scope(), http3_conn_info);
+        conn->qpack[0].inserted = wmem_map_new(wmem_file_scope(), wmem_int64_hash, g_int64_equal);
+        conn->qpack[1].inserted = wmem_map_new(wmem_file_scope(), wmem_int64_hash, g_int64_equal);
+        wmem_map_insert(http3_connections, stream_info->quic_info, conn);
+    }
+    return conn;
+}
+
+static guint
+http3_header_section_hash(gconstpointer key)
+{
+    const http3_header_section_key *k = (const http3_header_section_key *)key;
+    guint64 h = k->frame_num;
+
+    h = h * 0x100000001b3ULL ^ k->stream_id;
+    h = h * 0x100000001b3ULL ^ k->stream_offset;
+    return (guint)(h ^ (h >> 32));
+}
+
+static gboolean
+http3_header_section_equal(gconstpointer key1, gconstpointer key2)
+{
+    const http3_header_section_key *k1 = (const http3_header_section_key *)key1;
+    const http3_header_section_key *k2 = (const http3_header_section_key *)key2;
+
+    return k1->frame_num == k2->frame_num && k1->stream_id == k2->stream_id &&
+           k1->stream_offset == k2->stream_offset;
+}
+
+/**
+ * Requests more data for an instruction which is not complete. Returns FALSE
+ * if reassembly is not possible.
+ */
+static gboolean
+http3_qpack_desegment(packet_info *pinfo, int offset)
+{
+    if (!pinfo->can_desegment) {
+        return FALSE;
+    }
+    pinfo->desegment_offset = offset;
+    pinfo->desegment_len = DESEGMENT_ONE_MORE_SEGMENT;
+    return TRUE;
+}
+
+static int
+dissect_http3_qpack_encoder_stream(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int offset, quic_stream_info *stream_info)
+{
+    http3_qpack_table *table = &http3_get_conn_info(stream_info)->qpack[stream_info->from_server];
+    guint length = tvb_captured_length_remaining(tvb, offset);
+    const guint8 *buf = tvb_get_ptr(tvb, offset, length);
+    /* Strings are only decoded once, when the instructions are applied. */
+    wmem_allocator_t *scope = PINFO_FD_VISITED(pinfo) ? NULL : wmem_file_scope();
+    guint pos = 0;
+
+    while (pos < length) {
+        guint start = pos;
+        guint64 stream_offset = stream_info->offset + offset + start;
+        gboolean apply = !PINFO_FD_VISITED(pinfo) && stream_offset >= table->next_offset;
+        guint8 b = buf[pos];
+        guint opcode;
+        guint64 value = 0;
+        gboolean is_static = FALSE;
+        const char *name = NULL, *str = NULL;
+        guint name_len = 0, str_len = 0;
+        http3_qpack_status status;
+
+        if (b & 0x80) {
+            opcode = HTTP3_QPACK_ENC_INSERT_NAME_REF;
+            is_static = (b & 0x40) != 0;
+            status = http3_qpack_get_int(buf, length, &pos, 6, &value);
+            if (status == HTTP3_QPACK_OK) {
+                status = http3_qpack_get_string(scope, buf, length, &pos, 7, &str, &str_len);
+            }
+        } else if (b & 0x40) {
+            opcode = HTTP3_QPACK_ENC_INSERT_LITERAL;
+            status = http3_qpack_get_string(scope, buf, length, &pos, 5, &name, &name_len);
+            if (status == HTTP3_QPACK_OK) {
+                status = http3_qpack_get_string(scope, buf, length, &pos, 7, &str, &str_len);
+            }
+        } else if (b & 0x20) {
+            opcode = HTTP3_QPACK_ENC_SET_CAPACITY;
+            status = http3_qpack_get_int(buf, length, &pos, 5, &value);
+        } else {
+            opcode = HTTP3_QPACK_ENC_DUPLICATE;
+            status = http3_qpack_get_int(buf, length, &pos, 5, &value);
+        }
+
+        if (status == HTTP3_QPACK_INCOMPLETE && http3_qpack_desegment(pinfo, offset + start)) {
+            return tvb_captured_length(tvb);
+        }
+        if (status != HTTP3_QPACK_OK) {
+            proto_tree_add_expert_format(tree, pinfo, &ei_http3_qpack_failed, tvb, offset + start, length - start,
+                                         "Invalid QPACK encoder instruction");
+            if (!PINFO_FD_VISITED(pinfo)) {
+                table->missing_data = TRUE;
+            }
+            return tvb_captured_length(tvb);
+        }
+
+        if (apply) {
+            if (stream_offset > table->next_offset) {
+                table->missing_data = TRUE;
+            }
+            table->next_offset = stream_offset + (pos - start);
+            switch (opcode) {
+                case HTTP3_QPACK_ENC_SET_CAPACITY:
+                    table->capacity = value;
+                    http3_qpack_evict(table, value);
+                    break;
+                case HTTP3_QPACK_ENC_INSERT_NAME_REF:
+                    if (is_static) {
+                        if (value < G_N_ELEMENTS(http3_qpack_static_table)) {
+                            name = http3_qpack_static_table[value].name;
+                            name_len = (guint)strlen(name);
+                        }
+                    } else if (value < http3_qpack_insert_count(table)) {
+                        const http3_qpack_entry *entry = http3_qpack_get_entry(table, http3_qpack_insert_count(table) - 1 - value);
+                        if (entry) {
+                            name = entry->name;
+                            name_len = entry->name_len;
+                        }
+                    }
+                    break;
+                case HTTP3_QPACK_ENC_DUPLICATE:
+                    if (value < http3_qpack_insert_count(table)) {
+                        const http3_qpack_entry *entry = http3_qpack_get_entry(table, http3_qpack_insert_count(table) - 1 - value);
+                        if (entry) {
+                            name = entry->name;
+                            name_len = entry->name_len;
+                            str = entry->value;
+                            str_len = entry->value_len;
+                        }
+                    }
+                    break;
+            }
+            if (opcode != HTTP3_QPACK_ENC_SET_CAPACITY) {
+                if (!name || !str || !http3_qpack_insert(table, name, name_len, str, str_len, stream_offset)) {
+                    table->missing_data = TRUE;
+                }
+            }
+        }
+
+        proto_item *ti = proto_tree_add_uint(tree, hf_http3_qpack_encoder_opcode, tvb, offset + start, pos - start, opcode);
+        proto_tree *ins_tree = proto_item_add_subtree(ti, ett_http3_qpack_instruction);
+        if (opcode == HTTP3_QPACK_ENC_SET_CAPACITY) {
+            proto_tree_add_uint64(ins_tree, hf_http3_qpack_capacity, tvb, offset + start, pos - start, value);
+            proto_item_append_text(ti, ": %" PRIu64, value);
+        } else {
+            const http3_qpack_entry *entry = http3_qpack_find_inserted(table, stream_offset);
+
+            if (opcode == HTTP3_QPACK_ENC_INSERT_NAME_REF) {
+                proto_tree_add_boolean(ins_tree, hf_http3_qpack_static, tvb, offset + start, 1, is_static);
+                proto_tree_add_uint64(ins_tree, hf_http3_qpack_name_index, tvb, offset + start, pos - start, value);
+            } else if (opcode == HTTP3_QPACK_ENC_DUPLICATE) {
+                proto_tree_add_uint64(ins_tree, hf_http3_qpack_name_index, tvb, offset + start, pos - start, value);
+            }
+            if (entry) {
+                proto_tree_add_string(ins_tree, hf_http3_qpack_name, tvb, offset + start, pos - start, entry->name);
+                proto_tree_add_string(ins_tree, hf_http3_qpack_value, tvb, offset + start, pos - start, entry->value);
+                proto_item_append_text(ti, ": %s: %s", entry->name, entry->value);
+            } else {
+                proto_tree_add_expert(ins_tree, pinfo, &ei_http3_qpack_failed, tvb, offset + start, pos - start);
+            }
+        }
+    }
+
+    return tvb_captured_length(tvb);
+}
+
+static int
+dissect_http3_qpack_decoder_stream(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int offset)
+{
+    guint length = tvb_captured_length_remaining(tvb, offset);
+    const guint8 *buf = tvb_get_ptr(tvb, offset, length);
+    guint pos = 0;
+
+    while (pos < length) {
+        guint start = pos;
+        guint8 b = buf[pos];
+        guint opcode;
+        guint64 value = 0;
+        http3_qpack_status status;
+        int hf_value;
+
+        if (b & 0x80) {
+            opcode = HTTP3_QPACK_DEC_SECTION_ACK;
+            hf_value = hf_http3_qpack_stream_id;
+            status = http3_qpack_get_int(buf, length, &pos, 7, &value);
+        } else if (b & 0x40) {
+            opcode = HTTP3_QPACK_DEC_STREAM_CANCEL;
+            hf_value = hf_http3_qpack_stream_id;
+            status = http3_qpack_get_int(buf, length, &pos, 6, &value);
+        } else {
+            opcode = HTTP3_QPACK_DEC_INSERT_COUNT_INC;
+            hf_value = hf_http3_qpack_increment;
+            status = http3_qpack_get_int(buf, length, &pos, 6, &value);
+        }
+
+        if (status == HTTP3_QPACK_INCOMPLETE && http3_qpack_desegment(pinfo, offset + start)) {
+            return tvb_captured_length(tvb);
+        }
+        if (status != HTTP3_QPACK_OK) {
+            proto_tree_add_expert_format(tree, pinfo, &ei_http3_qpack_failed, tvb, offset + start, length - start,
+                                         "Invalid QPACK decoder instruction");
+            return tvb_captured_length(tvb);
+        }
+
+        proto_item *ti = proto_tree_add_uint(tree, hf_http3_qpack_decoder_opcode, tvb, offset + start, pos - start, opcode);
+        proto_tree *ins_tree = proto_item_add_subtree(ti, ett_http3_qpack_instruction);
+        proto_tree_add_uint64(ins_tree, hf_value, tvb, offset + start, pos - start, value);
+        proto_item_append_text(ti, ": %" PRIu64, value);
+    }
+
+    return tvb_captured_length(tvb);
+}
+
+/** Resolves a reference to the dynamic table from a field line. */
+static const http3_qpack_entry *
+http3_qpack_get_field_entry(const http3_qpack_table *table, guint64 required_insert_count,
+                            guint64 abs_index, const char **error)
+{
+    const http3_qpack_entry *entry;
+
+    if (abs_index >= required_insert_count) {
+        *error = "Dynamic table reference beyond the Required Insert Count";
+        return NULL;
+    }
+    entry = http3_qpack_get_entry(table, abs_index);
+    if (!entry) {
+        *error = wmem_strdup_printf(wmem_file_scope(), "Dynamic table entry %" PRIu64 " is not available", abs_index);
+    }
+    return entry;
+}
+
+/**
+ * Decodes the Required Insert Count, RFC 9204 Section 4.5.1.1. Returns NULL on
+ * success and an error message otherwise. Decoding requires the maximum table
+ * capacity from the SETTINGS of the decoder, so a non-zero value cannot be
+ * decoded if they were not captured.
+ */
+static const char *
+http3_qpack_decode_ric(const http3_qpack_table *table, guint64 encoded, guint64 *required_insert_count)
+{
+    guint64 max_entries = table->max_capacity / 32;
+    guint64 full_range = 2 * max_entries;
+    guint64 max_value, max_wrapped, ric;
+
+    if (encoded == 0) {
+        *required_insert_count = 0;
+        return NULL;
+    }
+    if (!table->has_max_capacity) {
+        return "Required Insert Count cannot be decoded, the maximum table capacity (SETTINGS) is unknown";
+    }
+    if (encoded > full_range) {
+        return "Invalid Required Insert Count";
+    }
+    max_value = http3_qpack_insert_count(table) + max_entries;
+    max_wrapped = (max_value / full_range) * full_range;
+    ric = max_wrapped + encoded - 1;
+    if (ric > max_value) {
+        if (ric <= full_range) {
+            return "Invalid Required Insert Count";
+        }
+        ric -= full_range;
+    }
+    if (ric == 0) {
+        return "Invalid Required Insert Count";
+    }
+    *required_insert_count = ric;
+    return NULL;
+}
+
+/** Decodes a field section (RFC 9204 Section 4.5) in the first pass. */
+static http3_header_section *
+http3_qpack_decode_section(http3_qpack_table *table, const guint8 *buf, guint length)
+{
+    http3_header_section *section = wmem_new0(wmem_file_scope(), http3_header_section);
+    wmem_array_t *fields = wmem_array_new(wmem_file_scope(), sizeof(http3_header_field));
+    guint64 encoded_ric, delta_base;
+    gboolean sign;
+    guint pos = 0;
+
+    if (http3_qpack_get_int(buf, length, &pos, 8, &encoded_ric) != HTTP3_QPACK_OK || pos >= length) {
+        section->error = "Truncated field section prefix";
+        return section;
+    }
+    sign = (buf[pos] & 0x80) != 0;
+    if (http3_qpack_get_int(buf, length, &pos, 7, &delta_base) != HTTP3_QPACK_OK) {
+        section->error = "Truncated field section prefix";
+        return section;
+    }
+    section->prefix_length = pos;
+    section->error = http3_qpack_decode_ric(table, encoded_ric, &section->required_insert_count);
+    if (section->error) {
+        return section;
+    }
+    if (sign) {
+        if (delta_base >= section->required_insert_count) {
+            section->error = "Invalid Base";
+            return section;
+        }
+        section->base = section->required_insert_count - delta_base - 1;
+    } else {
+        section->base = section->required_insert_count + delta_base;
+        if (section->base < delta_base) {
+            section->error = "Invalid Base";
+            return section;
+        }
+    }
+    if (section->required_insert_count > http3_qpack_insert_count(table)) {
+        section->error = wmem_strdup_printf(wmem_file_scope(),
+                "Blocked, Required Insert Count %" PRIu64 " exceeds the %" PRIu64 " entries inserted so far",
+                section->required_insert_count, http3_qpack_insert_count(table));
+        section->error_offset = pos;
+        return section;
+    }
+    if (section->required_insert_count > 0 && table->missing_data) {
+        section->error = "Dynamic table is incomplete, encoder stream data is missing";
+        section->error_offset = pos;
+        return section;
+    }
+
+    while (pos < length && !section->error) {
+        http3_header_field field = { .offset = pos };
+        const http3_qpack_entry *entry = NULL;
+        const char *error = NULL;
+        guint8 b = buf[pos];
+        guint64 index;
+        http3_qpack_status status;
+
+        if (b & 0x80) {
+            /* Indexed Field Line */
+            status = http3_qpack_get_int(buf, length, &pos, 6, &index);
+            if (status == HTTP3_QPACK_OK) {
+                if (b & 0x40) {
+                    if (index < G_N_ELEMENTS(http3_qpack_static_table)) {
+                        field.name = http3_qpack_static_table[index].name;
+                        field.value = http3_qpack_static_table[index].value;
+                    } else {
+                        error = "Invalid static table index";
+                    }
+                } else if (index < section->base) {
+                    entry = http3_qpack_get_field_entry(table, section->required_insert_count, section->base - 1 - index, &error);
+                } else {
+                    error = "Invalid relative index";
+                }
+                if (entry) {
+                    field.name = entry->name;
+                    field.value = entry->value;
+                }
+            }
+        } else if (b & 0x40) {
+            /* Literal Field Line with Name Reference */
+            status = http3_qpack_get_int(buf, length, &pos, 4, &index);
+            if (status == HTTP3_QPACK_OK) {
+                status = http3_qpack_get_string(wmem_file_scope(), buf, length, &pos, 7, &field.value, NULL);
+            }
+            if (status == HTTP3_QPACK_OK) {
+                if (b & 0x10) {
+                    if (index < G_N_ELEMENTS(http3_qpack_static_table)) {
+                        field.name = http3_qpack_static_table[index].name;
+                    } else {
+                        error = "Invalid static table index";
+                    }
+                } else if (index < section->base) {
+                    entry = http3_qpack_get_field_entry(table, section->required_insert_count, section->base - 1 - index, &error);
+                    field.name = entry ? entry->name : NULL;
+                } else {
+                    error = "Invalid relative index";
+                }
+            }
+        } else if (b & 0x20) {
+            /* Literal Field Line with Literal Name */
+            status = http3_qpack_get_string(wmem_file_scope(), buf, length, &pos, 3, &field.name, NULL);
+            if (status == HTTP3_QPACK_OK) {
+                status = http3_qpack_get_string(wmem_file_scope(), buf, length, &pos, 7, &field.value, NULL);
+            }
+        } else if (b & 0x10) {
+            /* Indexed Field Line with Post-Base Index */
+            status = http3_qpack_get_int(buf, length, &pos, 4, &index);
+            if (status == HTTP3_QPACK_OK) {
+                if (index > G_MAXUINT64 - section->base || section->base + index >= section->required_insert_count) {
+                    error = "Invalid post-base index";
+                } else {
+                    entry = http3_qpack_get_field_entry(table, section->required_insert_count, section->base + index, &error);
+                }
+                if (entry) {
+                    field.name = entry->name;
+                    field.value = entry->value;
+                }
+            }
+        } else {
+            /* Literal Field Line with Post-Base Name Reference */
+            status = http3_qpack_get_int(buf, length, &pos, 3, &index);
+            if (status == HTTP3_QPACK_OK) {
+                status = http3_qpack_get_string(wmem_file_scope(), buf, length, &pos, 7, &field.value, NULL);
+            }
+            if (status == HTTP3_QPACK_OK) {
+                if (index > G_MAXUINT64 - section->base || section->base + index >= section->required_insert_count) {
+                    error = "Invalid post-base index";
+                } else {
+                    entry = http3_qpack_get_field_entry(table, section->required_insert_count, section->base + index, &error);
+                }
+                field.name = entry ? entry->name : NULL;
+            }
+        }
+
+        if (status != HTTP3_QPACK_OK) {
+            error = "Invalid field line";
+        }
+        if (error) {
+            section->error = error;
+            section->error_offset = field.offset;
+        } else {
+            field.length = pos - field.offset;
+            wmem_array_append_one(fields, field);
+        }
+    }
+
+    section->field_count = wmem_array_get_count(fields);
+    section->fields = (http3_header_field *)wmem_array_get_raw(fields);
+    return section;
+}
+
+static void
+dissect_http3_header_section(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int offset, int length, quic_stream_info *stream_info)
+{
+    http3_header_section_key key = {
+        .frame_num = pinfo->num,
+        .stream_id = stream_info->stream_id,
+        .stream_offset = stream_info->offset + offset,
+    };
+    http3_header_section *section;
+    proto_item *ti;
+    proto_tree *header_tree;
+
+    section = (http3_header_section *)wmem_map_lookup(http3_header_sections, &key);
+    if (!section) {
+        if (PINFO_FD_VISITED(pinfo)) {
+            return;
+        }
+        http3_qpack_table *table = &http3_get_conn_info(stream_info)->qpack[stream_info->from_server];
+        section = http3_qpack_decode_section(table, tvb_get_ptr(tvb, offset, length), length);
+        wmem_map_insert(http3_header_sections, wmem_memdup(wmem_file_scope(), &key, sizeof(key)), section);
+    }
+
+    if (section->prefix_length) {
+        ti = proto_tree_add_uint64(tree, hf_http3_qpack_required_insert_count, tvb, offset, section->prefix_length, section->required_insert_count);
+        proto_item_set_generated(ti);
+        ti = proto_tree_add_uint64(tree, hf_http3_qpack_base, tvb, offset, section->prefix_length, section->base);
+        proto_item_set_generated(ti);
+    }
+
+    for (guint i = 0; i < section->field_count; i++) {
+        const http3_header_field *field = &section->fields[i];
+
+        ti = proto_tree_add_string(tree, hf_http3_header, tvb, offset + field->offset, field->length,
+                                   wmem_strdup_printf(pinfo->pool, "%s: %s", field->name, field->value));
+        header_tree = proto_item_add_subtree(ti, ett_http3_header);
+        proto_tree_add_string(header_tree, hf_http3_header_name, tvb, offset + field->offset, field->length, field->name);
+        proto_tree_add_string(header_tree, hf_http3_header_value, tvb, offset + field->offset, field->length, field->value);
+
+        if (!strcmp(field->name, ":method") || !strcmp(field->name, ":path") || !strcmp(field->name, ":status")) {
+            col_append_fstr(pinfo->cinfo, COL_INFO, " %s", format_text(pinfo->pool, field->value, strlen(field->value)));
+        }
+    }
+
+    if (section->error) {
+        proto_tree_add_expert_format(tree, pinfo, &ei_http3_qpack_failed, tvb, offset + section->error_offset,
+                                     length - section->error_offset, "QPACK decoding failed: %s", section->error);
+    }
+}
+
 /* Settings */
 static int
-dissect_http3_settings(tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* http3_tree, guint offset)
+dissect_http3_settings(tvbuff_t* tvb, packet_info* pinfo, proto_tree* http3_tree, guint offset, quic_stream_info *stream_info)
 {
     guint64 settingsid, value;
     proto_item *ti_settings, *pi;
@@ -241,6 +1299,13 @@ dissect_http3_settings(tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree* http3_
             case HTTP3_QPACK_MAX_TABLE_CAPACITY:
                 proto_tree_add_item_ret_varint(settings_tree, hf_http3_settings_qpack_max_table_capacity, tvb, offset, -1, ENC_VARINT_QUIC, &value, &lenvar);
                 proto_item_append_text(ti_settings, ": %" PRIu64, value );
+                if (!PINFO_FD_VISITED(pinfo)) {
+                    /* Limits the dynamic table of the peer's encoder. */
+                    http3_qpack_table *table = &http3_get_conn_info(stream_info)->qpack[!stream_info->from_server];
+
+                    table->max_capacity = value;
+                    table->has_max_capacity = TRUE;
+                }
             break;
             case HTTP3_SETTINGS_MAX_FIELD_SECTION_SIZE:
                 proto_tree_add_item_ret_varint(settings_tree, hf_http3_settings_max_field_section_size, tvb, offset, -1, ENC_VARINT_QUIC, &value, &lenvar);
@@ -293,7 +1358,7 @@ dissect_http3_priority_update(tvbuff_t* tvb, packet_info* pinfo _U_, proto_tree*
 }
 
 static int
-dissect_http3_frame(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int offset)
+dissect_http3_frame(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int offset, quic_stream_info *stream_info)
 {
     guint64 frame_type, frame_length;
     int lenvar;
@@ -314,9 +1379,20 @@ dissect_http3_frame(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, int off
         proto_tree_add_item(tree, hf_http3_frame_payload, tvb, offset, (int)frame_length, ENC_NA);
 
         switch (frame_type) {
+            case HTTP3_HEADERS:
+                dissect_http3_header_section(tvb, pinfo, tree, offset, (int)frame_length, stream_info);
+            break;
+            case HTTP3_PUSH_PROMISE: {
+                int push_id_len;
+                proto_tree_add_item_ret_varint(tree, hf_http3_push_id, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &push_id_len);
+                if ((guint64)push_id_len < frame_length) {
+                    dissect_http3_header_section(tvb, pinfo, tree, offset + push_id_len, (int)frame_length - push_id_len, stream_info);
+                }
+            }
+            break;
             case HTTP3_SETTINGS: { /* Settings Frame */
                 tvbuff_t *next_tvb = tvb_new_subset_length(tvb, offset, (int)frame_length);
-                dissect_http3_settings(next_tvb, pinfo,tree, 0);
+                dissect_http3_settings(next_tvb, pinfo,tree, 0, stream_info);
             }
             break;
             case HTTP3_PRIORITY_UPDATE_REQUEST_STREAM:
@@ -378,12 +1454,10 @@ dissect_http3_uni_stream(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, in
             }
             break;
         case HTTP3_STREAM_TYPE_QPACK_ENCODER:
-            // TODO
-            offset = tvb_captured_length(tvb);
+            offset = dissect_http3_qpack_encoder_stream(tvb, pinfo, tree, offset, stream_info);
             break;
         case HTTP3_STREAM_TYPE_QPACK_DECODER:
-            // TODO
-            offset = tvb_captured_length(tvb);
+            offset = dissect_http3_qpack_decoder_stream(tvb, pinfo, tree, offset);
             break;
         default:
             // Unknown or reserved stream type, consume everything.
@@ -471,7 +1545,7 @@ dissect_http3(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, void *data)
         if (!http3_check_frame_size(tvb, pinfo, offset)) {
             return tvb_captured_length(tvb);
         }
-        offset = dissect_http3_frame(tvb, pinfo, http3_tree, offset);
+        offset = dissect_http3_frame(tvb, pinfo, http3_tree, offset, stream_info);
     }
 
     return tvb_captured_length(tvb);
@@ -573,11 +1647,84 @@ proto_register_http3(void)
               NULL, HFILL }
         },
 
+        /* QPACK */
+        { &hf_http3_qpack_encoder_opcode,
+            { "Encoder Instruction", "http3.qpack.encoder.opcode",
+              FT_UINT8, BASE_DEC, VALS(http3_qpack_encoder_opcode_vals), 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_qpack_decoder_opcode,
+            { "Decoder Instruction", "http3.qpack.decoder.opcode",
+              FT_UINT8, BASE_DEC, VALS(http3_qpack_decoder_opcode_vals), 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_qpack_capacity,
+            { "Capacity", "http3.qpack.encoder.capacity",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              "Dynamic Table Capacity", HFILL }
+        },
+        { &hf_http3_qpack_static,
+            { "Static Table", "http3.qpack.encoder.static",
+              FT_BOOLEAN, BASE_NONE, NULL, 0x0,
+              "Whether the name references the static table", HFILL }
+        },
+        { &hf_http3_qpack_name_index,
+            { "Index", "http3.qpack.encoder.index",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              "Static or relative dynamic table index", HFILL }
+        },
+        { &hf_http3_qpack_name,
+            { "Name", "http3.qpack.encoder.name",
+              FT_STRING, BASE_NONE, NULL, 0x0,
+              "Name of the inserted entry", HFILL }
+        },
+        { &hf_http3_qpack_value,
+            { "Value", "http3.qpack.encoder.value",
+              FT_STRING, BASE_NONE, NULL, 0x0,
+              "Value of the inserted entry", HFILL }
+        },
+        { &hf_http3_qpack_stream_id,
+            { "Stream ID", "http3.qpack.decoder.stream_id",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_qpack_increment,
+            { "Increment", "http3.qpack.decoder.increment",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              "Insert Count Increment", HFILL }
+        },
+        { &hf_http3_qpack_required_insert_count,
+            { "Required Insert Count", "http3.qpack.required_insert_count",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_qpack_base,
+            { "Base", "http3.qpack.base",
+              FT_UINT64, BASE_DEC, NULL, 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_header,
+            { "Header", "http3.header",
+              FT_STRING, BASE_NONE, NULL, 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_header_name,
+            { "Name", "http3.header.name",
+              FT_STRING, BASE_NONE, NULL, 0x0,
+              NULL, HFILL }
+        },
+        { &hf_http3_header_value,
+            { "Value", "http3.header.value",
+              FT_STRING, BASE_NONE, NULL, 0x0,
+              NULL, HFILL }
+        },
     };
 
     static gint *ett[] = {
         &ett_http3,
         &ett_http3_settings,
+        &ett_http3_qpack_instruction,
+        &ett_http3_header,
     };
 
     static ei_register_info ei[] = {
@@ -585,6 +1732,10 @@ proto_register_http3(void)
           { "http3.unknown_stream_type", PI_UNDECODED, PI_WARN,
             "An unknown stream type was encountered", EXPFILL }
         },
+        { &ei_http3_qpack_failed,
+          { "http3.qpack.failed", PI_UNDECODED, PI_NOTE,
+            "QPACK decoding failed", EXPFILL }
+        },
     };
 
     proto_http3 = proto_register_protocol("Hypertext Transfer Protocol Version 3", "HTTP3", "http3");
@@ -594,6 +1745,11 @@ proto_register_http3(void)
 
     expert_http3 = expert_register_protocol(proto_http3);
     expert_register_field_array(expert_http3, ei, array_length(ei));
+
+    http3_connections = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(), g_direct_hash, g_direct_equal);
+    http3_header_sections = wmem_map_new_autoreset(wmem_epan_scope(), wmem_file_scope(),
+                                                   http3_header_section_hash, http3_header_section_equal);
+    http3_huffman_init();
 }
 
 void
@@ -39,10 +39,11 @@
  * https://gitlab.com/wireshark/wireshark/-/issues/13881
  *
  * Limitations:
- * - STREAM offsets larger than 32-bit are unsupported.
- * - STREAM with sizes larger than 32 bit are unsupported. STREAM sizes can be
- *   up to 62 bit in QUIC, but the TVB and reassembly API is limited to 32 bit.
- * - Out-of-order and overlapping STREAM frame data is not handled.
+ * - Reassembled STREAM PDUs larger than 32 bit are unsupported. STREAM offsets
+ *   can be up to 62 bit in QUIC, but the TVB and reassembly API is limited to
+ *   32 bit.
+ * - Out-of-order STREAM frame data is buffered until the gap before it is
+ *   filled. Data after a gap that is never filled is not dissected.
  * - "Follow QUIC Stream" doesn't work with STREAM IDs larger than 32 bit
  */
 
@@ -71,6 +72,7 @@ void proto_reg_handoff_quic(void);
 void proto_register_quic(void);
 
 static int quic_follow_tap = -1;
+static int quic_tap = -1;
 
 /* Initialize the protocol and registered fields */
 static int proto_quic = -1;
@@ -216,7 +218,9 @@ static expert_field ei_quic_bad_retry = EI_INIT;
 static expert_field ei_quic_coalesced_padding_data = EI_INIT;
 static expert_field ei_quic_retransmission = EI_INIT;
 static expert_field ei_quic_overlap = EI_INIT;
+static expert_field ei_quic_out_of_order = EI_INIT;
 static expert_field ei_quic_data_after_forcing_vn = EI_INIT;
+static expert_field ei_quic_state_evicted = EI_INIT;
 
 static gint ett_quic = -1;
 static gint ett_quic_af = -1;
@@ -324,8 +328,9 @@ static const fragment_items quic_crypto_fragment_items = {
 
 typedef struct quic_decrypt_result {
     const guchar   *error;      /**< Error message or NULL for success. */
-    const guint8   *data;       /**< Decrypted result on success (file-scoped). */
+    const guint8   *data;       /**< Decrypted result on success (file-scoped), NULL for plaintext payloads. */
     guint           data_len;   /**< Size of decrypted data. */
+    bool            plaintext : 1; /**< Payload is not protected and is read back from the frame on every pass. */
 } quic_decrypt_result_t;
 
 /** QUIC decryption context. */
@@ -361,6 +366,16 @@ struct quic_cid_item {
     quic_cid_t              data;
 };
 
+typedef struct quic_info_data quic_info_data_t;
+
+/**
+ * Entry in the Connection ID index, see quic_cid_index.
+ */
+typedef struct quic_cid_entry {
+    quic_cid_t          cid;        /**< Key (the reset token is not considered). */
+    quic_info_data_t   *conns[2];   /**< Connection for which this CID was chosen by the client [0] or by the server [1]. */
+} quic_cid_entry_t;
+
 /**
  * CRYPTO stream state.
  *
@@ -372,6 +387,59 @@ typedef struct _quic_crypto_state {
     wmem_map_t     *retrans_offsets;
 } quic_crypto_state;
 
+/**
+ * PDU of a STREAM that spans multiple STREAM frames. This is the equivalent of
+ * the TCP "struct tcp_multisegment_pdu", but with 62-bit stream offsets.
+ */
+typedef struct _quic_stream_msp {
+    guint64         seq;            /**< Stream offset of the first byte of the PDU. */
+    guint64         nxtpdu;         /**< Stream offset following the PDU. */
+    guint64         indexed_end;    /**< Offsets [seq, indexed_end) are indexed in "multisegment_pdus". */
+    guint32         first_frame;
+    guint32         flags;          /**< MSP_FLAGS_* from packet-tcp.h */
+    gboolean        delivered;      /**< Reassembled and passed to the subdissector. */
+} quic_stream_msp;
+
+/**
+ * Value of the "multisegment_pdus" interval tree. Interval keys are unique by
+ * their start, so PDUs that are indexed from the same stream offset share the
+ * interval of the first one.
+ */
+typedef struct _quic_stream_msp_node {
+    guint64         low;            /**< Interval of the tree node, inclusive. */
+    guint64         high;
+    quic_stream_msp *msp;
+    struct _quic_stream_msp_node *next; /**< Next PDU indexed in the same interval. */
+} quic_stream_msp_node;
+
+/**
+ * STREAM frame data that was received after a gap in the stream. It is passed
+ * to the reassembly once the data before it is complete.
+ */
+typedef struct _quic_stream_segment {
+    guint64         seq;            /**< Stream offset of the first byte. */
+    guint32         length;
+    gboolean        drained;        /**< Passed to the reassembly. */
+    guint8         *data;
+} quic_stream_segment;
+
+/** Buffered STREAM data that is passed to the reassembly in a frame. */
+typedef struct _quic_stream_replay {
+    quic_stream_segment *segment;
+    guint32         skip;           /**< Leading bytes that were passed before. */
+    struct _quic_stream_replay *next;
+} quic_stream_replay;
+
+/**
+ * How the data of a STREAM frame was ordered in the first pass. Only frames
+ * that were not passed to the reassembly as is have this.
+ */
+typedef struct _quic_stream_frame_order {
+    guint32         skip;           /**< Leading bytes that were passed before (retransmission). */
+    gboolean        buffered;       /**< Follows a gap, see quic_stream_segment. */
+    quic_stream_replay *replays;    /**< Buffered data that follows this frame. */
+} quic_stream_frame_order;
+
 /**
  * Per-STREAM state, identified by QUIC Stream ID.
  *
@@ -381,7 +449,14 @@ typedef struct _quic_crypto_state {
  */
 typedef struct _quic_stream_state {
     guint64         stream_id;
-    wmem_tree_t    *multisegment_pdus;
+    wmem_itree_t   *multisegment_pdus;  /**< Stream offset ranges -> quic_stream_msp_node */
+    guint32         msp_count;          /**< PDUs in "multisegment_pdus". */
+    guint32         msp_delivered_count;    /**< Delivered PDUs in "multisegment_pdus". */
+    guint32         msp_release_at;     /**< Delivered PDUs that trigger the next release. */
+    guint64         released_offset;    /**< Stream data before this offset was delivered and released. */
+    guint64         next_offset;        /**< Stream data before this offset was passed to the reassembly. */
+    wmem_itree_t   *segments;           /**< Stream offset ranges -> quic_stream_segment, created on demand. */
+    wmem_tree_t    *frame_order;        /**< (frame, stream offset) -> quic_stream_frame_order, created on demand. */
     void           *subdissector_private;
 } quic_stream_state;
 
@@ -403,7 +478,6 @@ typedef struct quic_follow_tap_data {
  * State for a single QUIC connection, identified by one or more Destination
  * Connection IDs (DCID).
  */
-typedef struct quic_info_data quic_info_data_t;
 struct quic_info_data {
     guint32         number;         /** Similar to "udp.stream", but for identifying QUIC connections across migrations. */
     guint32         version;
@@ -415,6 +489,10 @@ struct quic_info_data {
     bool            client_loss_bits_send : 1; /**< The client wants to send loss bits info */
     bool            server_loss_bits_recv : 1; /**< The server is able to read loss bits info */
     bool            server_loss_bits_send : 1; /**< The server wants to send loss bits info */
+    bool            closed : 1;     /**< Set to 1 if a CONNECTION_CLOSE frame was seen. */
+    bool            state_evicted : 1; /**< Set to 1 if the STREAM and CRYPTO state was released. */
+    guint8          client_ack_delay_exponent; /**< Scale of the ACK Delay in ACK frames sent by the client. */
+    guint8          server_ack_delay_exponent; /**< Scale of the ACK Delay in ACK frames sent by the server. */
     int             hash_algo;      /**< Libgcrypt hash algorithm for key derivation. */
     int             cipher_algo;    /**< Cipher algorithm for packet number and packet encryption. */
     int             cipher_mode;    /**< Cipher mode for packet encryption. */
@@ -437,6 +515,10 @@ struct quic_info_data {
     wmem_map_t     *streams_map;    /**< Map pinfo->num --> First stream in that frame (guint -> quic_follow_stream). Used by "Follow QUIC Stream" functionality */
     wmem_map_t     *client_crypto;
     wmem_map_t     *server_crypto;
+    wmem_allocator_t *state_pool;   /**< Allocator for the streams and crypto state above (NULL until needed). */
+    nstime_t        last_seen;      /**< Time of the most recent packet (first pass only). */
+    quic_info_data_t *lru_prev;     /**< Less recently active connection with state (eviction only). */
+    quic_info_data_t *lru_next;     /**< More recently active connection with state (eviction only). */
     gquic_info_data_t *gquic_info; /**< GQUIC info for >Q050 flows. */
     quic_info_data_t *prev; /**< The previous QUIC connection multiplexed on the same network 5-tuple. Used by checking Stateless Reset tokens */
 };
@@ -470,21 +552,59 @@ typedef struct quic_datagram {
 } quic_datagram;
 
 /**
- * Maps CID (quic_cid_t *) to a QUIC Connection (quic_info_data_t *).
- * This assumes that the CIDs are not shared between two different connections
- * (potentially with different versions) as that would break dissection.
+ * Maps CID (quic_cid_t *) to the QUIC Connections (quic_cid_entry_t *) for
+ * which it was chosen by the client and/or the server, such that a single
+ * lookup resolves both directions. This assumes that the CIDs are not shared
+ * between two different connections (potentially with different versions) as
+ * that would break dissection.
+ *
+ * These mappings are authoritative. For example, Initial.SCID is stored as a
+ * client CID while Retry.SCID is stored as a server CID. Retry.DCID should
+ * normally correspond to a client CID.
  *
- * These mappings are authoritative. For example, Initial.SCID is stored in
- * quic_client_connections while Retry.SCID is stored in
- * quic_server_connections. Retry.DCID should normally correspond to an entry in
- * quic_client_connections.
+ * Short header packets do not carry the DCID length. A DCID of unknown length
+ * is therefore looked up once for every CID length in use (quic_cid_lengths),
+ * longest first. That is at most QUIC_MAX_CID_LENGTH hash lookups, regardless
+ * of how many CIDs share a common prefix (as with QUIC-LB encoded CIDs).
  */
-static wmem_map_t *quic_client_connections, *quic_server_connections;
+static wmem_map_t *quic_cid_index;
 static wmem_map_t *quic_initial_connections;    /* Initial.DCID -> connection */
 static wmem_list_t *quic_connections;   /* All unique connections. */
 static guint32 quic_cid_lengths;        /* Bitmap of CID lengths. */
+static guint quic_cid_length_counts[QUIC_MAX_CID_LENGTH + 1]; /* Number of CIDs in quic_cid_index per length. */
 static guint quic_connections_count;
 
+/**
+ * Cache of UDP flows (by address/port tuple, per direction) for which the
+ * heuristic dissector rejected a short header packet. Short header packets
+ * have no version field, so recognizing them requires conversation lookups
+ * for the connections on the address/port tuple, and a CID lookup. Most UDP
+ * traffic is not QUIC, so remember that the flow has no connection and only
+ * look up the DCID of further packets of the flow.
+ *
+ * The DCID of every packet is still looked up, so a CID that is added later
+ * is found. A connection that is added later on the same address/port tuple
+ * removes the flow from the cache (quic_heur_flow_forget). Flows that are
+ * recognized as QUIC get a conversation dissector and do not reach the
+ * heuristics anymore.
+ *
+ * The cache is direct-mapped by a hash of the flow and never allocates; a
+ * collision just evicts the previous flow. The addresses and ports are
+ * compared exactly, only IPv4 and IPv6 flows are cached.
+ */
+#define QUIC_HEUR_CACHE_SIZE    4096    /* Must be a power of two. */
+
+typedef struct quic_heur_flow {
+    guint32     src_port;
+    guint32     dst_port;
+    guint8      addr_type;      /**< AT_IPv4 or AT_IPv6 of both addresses. */
+    guint8      addr_len;       /**< Length of both addresses, 0 if unused. */
+    guint8      src_addr[16];
+    guint8      dst_addr[16];
+} quic_heur_flow_t;
+
+static quic_heur_flow_t quic_heur_cache[QUIC_HEUR_CACHE_SIZE];
+
 /* Returns the QUIC draft version or 0 if not applicable. */
 static inline guint8 quic_draft_version(guint32 version) {
     /* IETF Draft versions */
@@ -826,18 +946,18 @@ quic_is_hp_cipher_initialized(quic_hp_cipher *hp_cipher)
 {
     return hp_cipher && hp_cipher->hp_cipher;
 }
-// static gboolean
-// quic_is_pp_cipher_initialized(quic_pp_cipher *pp_cipher)
-// {
-//     return pp_cipher && pp_cipher->pp_cipher;
-// }
-// static gboolean
-// quic_are_ciphers_initialized(quic_ciphers *ciphers)
-// {
-//     return ciphers &&
-//            quic_is_hp_cipher_initialized(&ciphers->hp_cipher) &&
-//            quic_is_pp_cipher_initialized(&ciphers->pp_cipher);
-// }
+static gboolean
+quic_is_pp_cipher_initialized(quic_pp_cipher *pp_cipher)
+{
+    return pp_cipher && pp_cipher->pp_cipher;
+}
+static gboolean
+quic_are_ciphers_initialized(quic_ciphers *ciphers)
+{
+    return ciphers &&
+           quic_is_hp_cipher_initialized(&ciphers->hp_cipher) &&
+           quic_is_pp_cipher_initialized(&ciphers->pp_cipher);
+}
 
 /* Inspired from ngtcp2 */
 static guint64 quic_pkt_adjust_pkt_num(guint64 max_pkt_num, guint64 pkt_num,
@@ -1000,37 +1120,87 @@ quic_connection_equal(gconstpointer a, gconstpointer b)
     return cid1->len == cid2->len && !memcmp(cid1->cid, cid2->cid, cid1->len);
 }
 
-static gboolean
-quic_cids_has_match(const quic_cid_item_t *items, const quic_cid_t *raw_cid)
+static inline gboolean
+quic_cids_is_known_length(const quic_cid_t *cid)
 {
-    while (items) {
-        const quic_cid_t *cid = &items->data;
-        // "raw_cid" potentially has some trailing data that is not part of the
-        // actual CID, so accept any prefix match against "cid".
-        // Note that this explicitly matches an empty CID.
-        if (raw_cid->len >= cid->len && !memcmp(raw_cid->cid, cid->cid, cid->len)) {
-            return TRUE;
+    return (quic_cid_lengths & (1ULL << cid->len)) != 0;
+}
+
+/**
+ * Finds the longest CID which is a prefix of "raw_cid" (which potentially has
+ * some trailing data that is not part of the actual CID). If "conn" is given,
+ * only CIDs which were chosen for it by the client (from_server == FALSE) or
+ * the server are considered.
+ */
+static const quic_cid_entry_t *
+quic_cids_find_prefix(const quic_cid_t *raw_cid, const quic_info_data_t *conn, gboolean from_server)
+{
+    const quic_cid_entry_t *entry;
+    quic_cid_t cid;
+
+    cid = *raw_cid;
+    for (guint8 len = MIN(raw_cid->len, QUIC_MAX_CID_LENGTH); len > 0; len--) {
+        cid.len = len;
+        if (!quic_cids_is_known_length(&cid)) {
+            continue;
+        }
+        entry = (const quic_cid_entry_t *)wmem_map_lookup(quic_cid_index, &cid);
+        if (entry && (conn ? entry->conns[!!from_server] == conn : entry->conns[0] || entry->conns[1])) {
+            return entry;
         }
-        items = items->next;
     }
-    return FALSE;
+    return NULL;
+}
+
+/**
+ * Returns TRUE if one of the CIDs chosen by the client (from_server == FALSE)
+ * or the server for connection "conn" matches "raw_cid".
+ */
+static gboolean
+quic_cids_has_match(const quic_info_data_t *conn, gboolean from_server, const quic_cid_t *raw_cid)
+{
+    const quic_cid_item_t *first = from_server ? &conn->server_cids : &conn->client_cids;
+
+    // Note that this explicitly matches an empty CID.
+    if (first->data.len == 0) {
+        return TRUE;
+    }
+
+    return quic_cids_find_prefix(raw_cid, conn, from_server) != NULL;
 }
 
 static void
 quic_cids_insert(quic_cid_t *cid, quic_info_data_t *conn, gboolean from_server)
 {
-    wmem_map_t *connections = from_server ? quic_server_connections : quic_client_connections;
-    // Replace any previous CID key with the new one.
-    wmem_map_remove(connections, cid);
-    wmem_map_insert(connections, cid, conn);
-    G_STATIC_ASSERT(QUIC_MAX_CID_LENGTH <= 8 * sizeof(quic_cid_lengths));
-    quic_cid_lengths |= (1ULL << cid->len);
+    quic_cid_entry_t *entry = (quic_cid_entry_t *)wmem_map_lookup(quic_cid_index, cid);
+    if (!entry) {
+        entry = wmem_new0(wmem_file_scope(), quic_cid_entry_t);
+        entry->cid = *cid;
+        wmem_map_insert(quic_cid_index, &entry->cid, entry);
+        G_STATIC_ASSERT(QUIC_MAX_CID_LENGTH <= 8 * sizeof(quic_cid_lengths));
+        quic_cid_lengths |= (1ULL << cid->len);
+        quic_cid_length_counts[cid->len]++;
+    }
+    // Replace any previous connection for this CID with the new one.
+    entry->conns[!!from_server] = conn;
 }
 
-static inline gboolean
-quic_cids_is_known_length(const quic_cid_t *cid)
+static void
+quic_cids_remove(const quic_cid_t *cid, gboolean from_server)
 {
-    return (quic_cid_lengths & (1ULL << cid->len)) != 0;
+    quic_cid_entry_t *entry = (quic_cid_entry_t *)wmem_map_lookup(quic_cid_index, cid);
+    if (entry) {
+        entry->conns[!!from_server] = NULL;
+        if (!entry->conns[0] && !entry->conns[1]) {
+            // No connection uses this CID anymore, drop it from the index
+            // such that it no longer costs a lookup for its length.
+            wmem_map_remove(quic_cid_index, &entry->cid);
+            if (--quic_cid_length_counts[entry->cid.len] == 0) {
+                quic_cid_lengths &= ~(1U << entry->cid.len);
+            }
+            wmem_free(wmem_file_scope(), entry);
+        }
+    }
 }
 
 /**
@@ -1052,6 +1222,34 @@ quic_connection_from_conv(packet_info *pinfo)
     return NULL;
 }
 
+/**
+ * Returns the connection of an entry of the CID index (if any), and sets
+ * "from_server" accordingly.
+ */
+static quic_info_data_t *
+quic_connection_from_cid_entry(packet_info *pinfo, const quic_cid_entry_t *entry, gboolean *from_server)
+{
+    quic_info_data_t *conn = NULL;
+
+    if (entry && entry->conns[0]) {
+        conn = entry->conns[0];
+        // DCID recognized by client, so it was from server.
+        *from_server = TRUE;
+        // On collision (both client and server choose the same CID), check
+        // the port to learn about the side.
+        // This is required for supporting draft -10 which has a single CID.
+        if (entry->conns[1]) {
+            *from_server = conn->server_port == pinfo->srcport &&
+                    addresses_equal(&conn->server_address, &pinfo->src);
+        }
+    } else if (entry && entry->conns[1]) {
+        conn = entry->conns[1];
+        // DCID recognized by server, so it was from client.
+        *from_server = FALSE;
+    }
+    return conn;
+}
+
 /**
  * Tries to lookup a matching connection (if Connection ID is NULL, the
  * most recent connection on the network 5-tuple is returned, if any).
@@ -1076,21 +1274,8 @@ quic_connection_find_dcid(packet_info *pinfo, const quic_cid_t *dcid, gboolean *
         if (!quic_cids_is_known_length(dcid)) {
             return NULL;
         }
-        conn = (quic_info_data_t *) wmem_map_lookup(quic_client_connections, dcid);
-        if (conn) {
-            // DCID recognized by client, so it was from server.
-            *from_server = TRUE;
-            // On collision (both client and server choose the same CID), check
-            // the port to learn about the side.
-            // This is required for supporting draft -10 which has a single CID.
-            check_ports = !!wmem_map_lookup(quic_server_connections, dcid);
-        } else {
-            conn = (quic_info_data_t *) wmem_map_lookup(quic_server_connections, dcid);
-            if (conn) {
-                // DCID recognized by server, so it was from client.
-                *from_server = FALSE;
-            }
-        }
+        const quic_cid_entry_t *entry = (const quic_cid_entry_t *) wmem_map_lookup(quic_cid_index, dcid);
+        return quic_connection_from_cid_entry(pinfo, entry, from_server);
     } else {
         conn = quic_connection_from_conv(pinfo);
         if (conn) {
@@ -1143,7 +1328,7 @@ quic_connection_find(packet_info *pinfo, guint8 long_packet_type,
         }
         if (long_packet_type == QUIC_LPT_INITIAL && conn && !*from_server && dcid->len > 0 &&
             !quic_connection_equal(dcid, &conn->client_dcid_initial) &&
-            !quic_cids_has_match(&conn->server_cids, dcid)) {
+            !quic_cids_has_match(conn, TRUE, dcid)) {
             // If the Initial Packet is from the client, it must either match
             // the DCID from the first Client Initial, or the DCID that was
             // assigned by the server. Otherwise this must be considered a fresh
@@ -1159,8 +1344,7 @@ quic_connection_find(packet_info *pinfo, guint8 long_packet_type,
         /* Since we don't know the DCID, check all connections multiplexed
          * on the same 5-tuple for a match. */
         while (conn) {
-            if ((*from_server && quic_cids_has_match(&conn->client_cids, dcid)) ||
-                (!*from_server && quic_cids_has_match(&conn->server_cids, dcid))) {
+            if (quic_cids_has_match(conn, !*from_server, dcid)) {
                 // Connection matches packet.
                 break;
             }
@@ -1168,11 +1352,13 @@ quic_connection_find(packet_info *pinfo, guint8 long_packet_type,
         }
 
         // No match found so far, potentially connection migration. Length of
-        // actual DCID is unknown, so just keep decrementing until found.
-        while (!conn && dcid->len > 1) {
-            dcid->len--;
-            if (quic_cids_is_known_length(dcid)) {
-                conn = quic_connection_find_dcid(pinfo, dcid, from_server);
+        // actual DCID is unknown, so look for the longest known CID that is a
+        // prefix of it.
+        if (!conn) {
+            const quic_cid_entry_t *entry = quic_cids_find_prefix(dcid, NULL, FALSE);
+            conn = quic_connection_from_cid_entry(pinfo, entry, from_server);
+            if (conn) {
+                dcid->len = entry->cid.len;
             }
         }
         if (!conn) {
@@ -1184,6 +1370,64 @@ quic_connection_find(packet_info *pinfo, guint8 long_packet_type,
     return conn;
 }
 
+/** Returns the cache entry for a UDP flow. */
+static quic_heur_flow_t *
+quic_heur_flow_slot(const address *src, guint32 src_port, const address *dst, guint32 dst_port)
+{
+    guint32 hash = (src_port << 16) | dst_port;
+
+    hash = add_address_to_hash(hash, src);
+    hash = add_address_to_hash(hash, dst);
+    hash += hash << 3;
+    hash ^= hash >> 11;
+    hash += hash << 15;
+    return &quic_heur_cache[hash & (QUIC_HEUR_CACHE_SIZE - 1)];
+}
+
+/** Returns TRUE if "flow" holds the given UDP flow. */
+static gboolean
+quic_heur_flow_matches(const quic_heur_flow_t *flow, const address *src, guint32 src_port, const address *dst, guint32 dst_port)
+{
+    return flow->addr_len != 0 &&
+        flow->src_port == src_port && flow->dst_port == dst_port &&
+        src->type == flow->addr_type && src->len == flow->addr_len &&
+        dst->type == flow->addr_type && dst->len == flow->addr_len &&
+        !memcmp(src->data, flow->src_addr, flow->addr_len) &&
+        !memcmp(dst->data, flow->dst_addr, flow->addr_len);
+}
+
+static void
+quic_heur_flow_set(quic_heur_flow_t *flow, packet_info *pinfo)
+{
+    if ((pinfo->src.type != AT_IPv4 && pinfo->src.type != AT_IPv6) ||
+            pinfo->dst.type != pinfo->src.type || pinfo->dst.len != pinfo->src.len ||
+            pinfo->src.len > (int)sizeof(flow->src_addr)) {
+        return;
+    }
+    flow->src_port = pinfo->srcport;
+    flow->dst_port = pinfo->destport;
+    flow->addr_type = (guint8)pinfo->src.type;
+    flow->addr_len = (guint8)pinfo->src.len;
+    memcpy(flow->src_addr, pinfo->src.data, pinfo->src.len);
+    memcpy(flow->dst_addr, pinfo->dst.data, pinfo->dst.len);
+}
+
+/** Removes both directions of the UDP flow of the current packet from the cache. */
+static void
+quic_heur_flow_forget(packet_info *pinfo)
+{
+    quic_heur_flow_t *flow;
+
+    flow = quic_heur_flow_slot(&pinfo->src, pinfo->srcport, &pinfo->dst, pinfo->destport);
+    if (quic_heur_flow_matches(flow, &pinfo->src, pinfo->srcport, &pinfo->dst, pinfo->destport)) {
+        flow->addr_len = 0;
+    }
+    flow = quic_heur_flow_slot(&pinfo->dst, pinfo->destport, &pinfo->src, pinfo->srcport);
+    if (quic_heur_flow_matches(flow, &pinfo->dst, pinfo->destport, &pinfo->src, pinfo->srcport)) {
+        flow->addr_len = 0;
+    }
+}
+
 /** Create a new QUIC Connection based on a Client Initial packet. */
 static quic_info_data_t *
 quic_connection_create(packet_info *pinfo, guint32 version)
@@ -1194,7 +1438,12 @@ quic_connection_create(packet_info *pinfo, guint32 version)
     conn = wmem_new0(wmem_file_scope(), quic_info_data_t);
     wmem_list_append(quic_connections, conn);
     conn->number = quic_connections_count++;
+    // The 5-tuple (and zero-length CIDs) may now match short headers.
+    quic_heur_flow_forget(pinfo);
     conn->version = version;
+    /* Default value from RFC 9000 Section 18.2 */
+    conn->client_ack_delay_exponent = 3;
+    conn->server_ack_delay_exponent = 3;
     copy_address_wmem(wmem_file_scope(), &conn->server_address, &pinfo->dst);
     conn->server_port = pinfo->destport;
 
@@ -1258,7 +1507,7 @@ quic_connection_add_cid(quic_info_data_t *conn, const quic_cid_t *new_cid, gbool
     DISSECTOR_ASSERT(new_cid->len > 0);
     quic_cid_item_t *items = from_server ? &conn->server_cids : &conn->client_cids;
 
-    if (quic_cids_has_match(items, new_cid)) {
+    if (quic_cids_has_match(conn, from_server, new_cid)) {
         // CID is already known for this connection.
         return;
     }
@@ -1296,7 +1545,7 @@ quic_connection_create_or_update(quic_info_data_t **conn_p,
                 // the next server Initial Packet can link the connection with
                 // that new SCID.
                 quic_connection_update_initial(conn, scid, dcid);
-                wmem_map_remove(quic_server_connections, &conn->server_cids.data);
+                quic_cids_remove(&conn->server_cids.data, TRUE);
                 memset(&conn->server_cids, 0, sizeof(quic_cid_t));
             }
             break;
@@ -1343,6 +1592,145 @@ quic_connection_destroy(gpointer data, gpointer user_data _U_)
     quic_hp_cipher_reset(&conn->server_pp.hp_cipher);
     quic_pp_cipher_reset(&conn->server_pp.pp_ciphers[0]);
     quic_pp_cipher_reset(&conn->server_pp.pp_ciphers[1]);
+
+    if (conn->state_pool && conn->state_pool != wmem_file_scope()) {
+        wmem_destroy_allocator(conn->state_pool);
+    }
+    conn->state_pool = NULL;
+}
+
+/*
+ * Eviction of connection state for long running (live) captures.
+ *
+ * The STREAM, CRYPTO and "Follow QUIC Stream" state of a connection grows
+ * with the connection and is normally kept until the capture file is closed.
+ * When eviction is enabled, this state is allocated per connection and
+ * released once the connection is closed (CONNECTION_CLOSE), idle for longer
+ * than the timeout, or when more connections have state than the limit
+ * (least recently active first).
+ *
+ * The connection itself is kept as tombstone, such that later packets are
+ * still attributed to it (CIDs, quic.connection.number), but their STREAM
+ * and CRYPTO data is no longer reassembled. Since released state is not
+ * available to a second pass either, this is meant for single pass
+ * dissection only (tshark without -2).
+ */
+static gboolean quic_evict_state = FALSE;
+static guint quic_evict_idle_timeout = 60;          /* Seconds, 0 to disable. */
+static guint quic_evict_max_connections = 10000;    /* 0 for no limit. */
+
+static quic_info_data_t *quic_lru_head;     /* Least recently active connection with state. */
+static quic_info_data_t *quic_lru_tail;     /* Most recently active connection with state. */
+static guint32 quic_live_connections_count;     /* Connections in the LRU list. */
+static guint32 quic_evicted_connections_count;
+
+/**
+ * Returns the allocator for the STREAM, CRYPTO and follow state of "conn".
+ * With eviction, every connection gets its own block allocator, which is
+ * destroyed at once when the connection is evicted. Its frees and reallocs
+ * (map growth, released stream PDUs, reassembly) take constant time, unlike
+ * the simple allocator, whose cost grows with the number of allocations.
+ */
+static wmem_allocator_t *
+quic_connection_state_pool(quic_info_data_t *conn)
+{
+    if (!conn->state_pool) {
+        conn->state_pool = quic_evict_state ? wmem_allocator_new(WMEM_ALLOCATOR_BLOCK) : wmem_file_scope();
+    }
+    return conn->state_pool;
+}
+
+static void
+quic_lru_remove(quic_info_data_t *conn)
+{
+    if (conn->lru_prev) {
+        conn->lru_prev->lru_next = conn->lru_next;
+    } else {
+        quic_lru_head = conn->lru_next;
+    }
+    if (conn->lru_next) {
+        conn->lru_next->lru_prev = conn->lru_prev;
+    } else {
+        quic_lru_tail = conn->lru_prev;
+    }
+    conn->lru_prev = conn->lru_next = NULL;
+}
+
+static void
+quic_lru_append(quic_info_data_t *conn)
+{
+    conn->lru_prev = quic_lru_tail;
+    conn->lru_next = NULL;
+    if (quic_lru_tail) {
+        quic_lru_tail->lru_next = conn;
+    } else {
+        quic_lru_head = conn;
+    }
+    quic_lru_tail = conn;
+}
+
+/** Releases the STREAM, CRYPTO and follow state, keeping "conn" as tombstone. */
+static void
+quic_connection_evict(quic_info_data_t *conn)
+{
+    quic_lru_remove(conn);
+    quic_live_connections_count--;
+    quic_evicted_connections_count++;
+
+    conn->client_streams = NULL;
+    conn->server_streams = NULL;
+    conn->streams_list = NULL;
+    conn->streams_map = NULL;
+    conn->client_crypto = NULL;
+    conn->server_crypto = NULL;
+    if (conn->state_pool && conn->state_pool != wmem_file_scope()) {
+        wmem_destroy_allocator(conn->state_pool);
+    }
+    conn->state_pool = NULL;
+    conn->state_evicted = TRUE;
+}
+
+/**
+ * Records activity on "conn" after a datagram was dissected (first pass) and
+ * evicts the state of closed, idle and excess connections.
+ */
+static void
+quic_connection_update_activity(packet_info *pinfo, quic_info_data_t *conn)
+{
+    if (!quic_evict_state) {
+        return;
+    }
+
+    if (conn && !conn->state_evicted) {
+        if (conn->lru_prev || conn->lru_next || quic_lru_head == conn) {
+            quic_lru_remove(conn);
+        } else {
+            quic_live_connections_count++;
+        }
+        quic_lru_append(conn);
+        conn->last_seen = pinfo->abs_ts;
+        if (conn->closed) {
+            quic_connection_evict(conn);
+        }
+    }
+
+    while (quic_lru_head) {
+        quic_info_data_t *oldest = quic_lru_head;
+
+        if (quic_evict_max_connections && quic_live_connections_count > quic_evict_max_connections) {
+            quic_connection_evict(oldest);
+        } else if (quic_evict_idle_timeout &&
+                   pinfo->abs_ts.secs - oldest->last_seen.secs > (time_t)quic_evict_idle_timeout) {
+            quic_connection_evict(oldest);
+        } else {
+            break;
+        }
+    }
+}
+
+guint32 get_quic_evicted_connections_count(void)
+{
+    return quic_evicted_connections_count;
 }
 /* QUIC Connection tracking. }}} */
 
@@ -1366,15 +1754,15 @@ quic_get_stream_state(packet_info *pinfo, quic_info_data_t *quic_info, gboolean
 
     // Initialize per-connection and per-stream state.
     if (!streams) {
-        streams = wmem_map_new(wmem_file_scope(), wmem_int64_hash, g_int64_equal);
+        streams = wmem_map_new(quic_connection_state_pool(quic_info), wmem_int64_hash, g_int64_equal);
         *streams_p = streams;
     } else {
         stream = (quic_stream_state *)wmem_map_lookup(streams, &stream_id);
     }
     if (!stream) {
-        stream = wmem_new0(wmem_file_scope(), quic_stream_state);
+        stream = wmem_new0(quic_connection_state_pool(quic_info), quic_stream_state);
         stream->stream_id = stream_id;
-        stream->multisegment_pdus = wmem_tree_new(wmem_file_scope());
+        stream->multisegment_pdus = wmem_itree_new(quic_connection_state_pool(quic_info));
         wmem_map_insert(streams, &stream->stream_id, stream);
     }
     return stream;
@@ -1394,10 +1782,231 @@ process_quic_stream(tvbuff_t *tvb, int offset, packet_info *pinfo, proto_tree *t
 }
 
 /**
- * Reassemble stream data within a STREAM frame.
+ * Returns the PDU which contains the stream offset "seq". A PDU starting at
+ * "seq" is preferred, otherwise the PDU with the highest start is returned.
+ */
+static quic_stream_msp *
+quic_stream_msp_lookup(packet_info *pinfo, quic_stream_state *stream, guint64 seq)
+{
+    quic_stream_msp *found = NULL;
+    wmem_list_t *results;
+
+    results = wmem_itree_find_intervals(stream->multisegment_pdus, pinfo->pool, seq, seq);
+    for (wmem_list_frame_t *item = wmem_list_head(results); item; item = wmem_list_frame_next(item)) {
+        for (quic_stream_msp_node *node = (quic_stream_msp_node *)wmem_list_frame_data(item); node; node = node->next) {
+            quic_stream_msp *msp = node->msp;
+
+            // The interval keys are not updated when a PDU shrinks, check the
+            // current bounds.
+            if (msp->seq > seq || msp->nxtpdu <= seq) {
+                continue;
+            }
+            if (!found || msp->seq > found->seq) {
+                found = msp;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * Indexes the stream offsets [low, high] for a PDU. If another interval starts
+ * at "low", the PDU is added to that interval, and only the remainder (if any)
+ * gets an interval of its own.
+ */
+static void
+quic_stream_msp_index(packet_info *pinfo, wmem_allocator_t *allocator, wmem_itree_t *tree,
+                      quic_stream_msp *msp, guint64 low, guint64 high)
+{
+    quic_stream_msp_node *node, *head;
+    wmem_list_t *results;
+
+    while (low <= high) {
+        head = NULL;
+        results = wmem_itree_find_intervals(tree, pinfo->pool, low, low);
+        for (wmem_list_frame_t *item = wmem_list_head(results); item; item = wmem_list_frame_next(item)) {
+            node = (quic_stream_msp_node *)wmem_list_frame_data(item);
+            if (node->low == low) {
+                head = node;
+                break;
+            }
+        }
+
+        node = wmem_new(allocator, quic_stream_msp_node);
+        node->msp = msp;
+        if (!head) {
+            node->low = low;
+            node->high = high;
+            node->next = NULL;
+            wmem_itree_insert(tree, low, high, node);
+            return;
+        }
+        node->low = head->low;
+        node->high = head->high;
+        node->next = head->next;
+        head->next = node;
+        if (high <= head->high) {
+            return;
+        }
+        low = head->high + 1;
+    }
+}
+
+/**
+ * Updates the end of a PDU, indexing any stream offsets that were not covered
+ * before. Interval keys cannot be modified, so a PDU that grows gets another
+ * interval for its new part.
+ */
+static void
+quic_stream_msp_set_nxtpdu(packet_info *pinfo, quic_info_data_t *quic_info, quic_stream_state *stream,
+                           quic_stream_msp *msp, guint64 nxtpdu)
+{
+    msp->nxtpdu = nxtpdu;
+    if (nxtpdu <= msp->indexed_end) {
+        return;
+    }
+    quic_stream_msp_index(pinfo, quic_connection_state_pool(quic_info), stream->multisegment_pdus,
+            msp, msp->indexed_end, nxtpdu - 1);
+    msp->indexed_end = nxtpdu;
+}
+
+static quic_stream_msp *
+quic_stream_msp_new(packet_info *pinfo, quic_info_data_t *quic_info, quic_stream_state *stream, guint64 seq, guint64 nxtpdu)
+{
+    quic_stream_msp *msp = wmem_new0(quic_connection_state_pool(quic_info), quic_stream_msp);
+
+    msp->seq = seq;
+    msp->indexed_end = seq;
+    msp->first_frame = pinfo->num;
+    quic_stream_msp_set_nxtpdu(pinfo, quic_info, stream, msp, nxtpdu);
+    stream->msp_count++;
+    return msp;
+}
+
+/*
+ * Release of delivered STREAM PDUs.
+ *
+ * A long-lived stream accumulates one PDU per multi-segment message of the
+ * application protocol. The second pass relies on them, but with state
+ * eviction (single pass only, see quic_evict_state) a PDU is no longer needed
+ * once it was delivered and no PDU that is still incomplete starts before it.
+ * When at least half of the PDUs of a stream are delivered, the index is
+ * rebuilt with the remaining ones and the released PDUs are freed. Data before
+ * the end of the released PDUs is treated as retransmission afterwards.
+ */
+#define QUIC_STREAM_MSP_RELEASE_MIN 64
+
+typedef struct {
+    packet_info        *pinfo;
+    wmem_allocator_t   *allocator;
+    wmem_itree_t       *tree;           /**< New index. */
+    guint64             open_seq;       /**< Lowest start of an undelivered PDU. */
+    quic_stream_state  *stream;
+    wmem_list_t        *released;
+} quic_stream_msp_release_data;
+
+static gboolean
+quic_stream_msp_find_open(const void *key _U_, void *value, void *userdata)
+{
+    quic_stream_msp_release_data *data = (quic_stream_msp_release_data *)userdata;
+
+    for (quic_stream_msp_node *node = (quic_stream_msp_node *)value; node; node = node->next) {
+        // Mark the PDU as not yet indexed in the new tree.
+        node->msp->indexed_end = node->msp->seq;
+        if (!node->msp->delivered) {
+            data->open_seq = MIN(data->open_seq, node->msp->seq);
+        }
+    }
+    return FALSE;
+}
+
+static gboolean
+quic_stream_msp_reindex(const void *key _U_, void *value, void *userdata)
+{
+    quic_stream_msp_release_data *data = (quic_stream_msp_release_data *)userdata;
+    quic_stream_msp_node *node = (quic_stream_msp_node *)value, *next;
+
+    for (; node; node = next) {
+        quic_stream_msp *msp = node->msp;
+
+        next = node->next;
+        wmem_free(data->allocator, node);
+        if (msp->indexed_end != msp->seq) {
+            // Released or indexed already (via another interval).
+            continue;
+        }
+        if (msp->delivered && msp->nxtpdu <= data->open_seq) {
+            data->stream->released_offset = MAX(data->stream->released_offset, msp->nxtpdu);
+            data->stream->msp_count--;
+            data->stream->msp_delivered_count--;
+            msp->indexed_end = msp->nxtpdu;
+            wmem_list_prepend(data->released, msp);
+            continue;
+        }
+        quic_stream_msp_index(data->pinfo, data->allocator, data->tree, msp, msp->seq, msp->nxtpdu - 1);
+        msp->indexed_end = msp->nxtpdu;
+    }
+    return FALSE;
+}
+
+static void
+quic_stream_msp_delivered(packet_info *pinfo, quic_info_data_t *quic_info, quic_stream_state *stream, quic_stream_msp *msp)
+{
+    quic_stream_msp_release_data data;
+    wmem_list_frame_t *item;
+
+    if (msp->delivered) {
+        return;
+    }
+    msp->delivered = TRUE;
+    stream->msp_delivered_count++;
+
+    if (!quic_evict_state || stream->msp_delivered_count < MAX(stream->msp_release_at, QUIC_STREAM_MSP_RELEASE_MIN) ||
+            stream->msp_delivered_count < stream->msp_count / 2) {
+        return;
+    }
+
+    data.pinfo = pinfo;
+    data.allocator = quic_connection_state_pool(quic_info);
+    data.tree = wmem_itree_new(data.allocator);
+    data.open_seq = G_MAXUINT64;
+    data.stream = stream;
+    data.released = wmem_list_new(pinfo->pool);
+    wmem_tree_foreach(stream->multisegment_pdus, quic_stream_msp_find_open, &data);
+    wmem_tree_foreach(stream->multisegment_pdus, quic_stream_msp_reindex, &data);
+    wmem_tree_destroy(stream->multisegment_pdus, TRUE, FALSE);
+    stream->multisegment_pdus = data.tree;
+    // Delivered PDUs after an incomplete one cannot be released yet, do not
+    // rebuild the index for each of them.
+    stream->msp_release_at = 2 * stream->msp_delivered_count;
+
+    for (item = wmem_list_head(data.released); item; item = wmem_list_frame_next(item)) {
+        wmem_free(data.allocator, wmem_list_frame_data(item));
+    }
+}
+
+/**
+ * Reassembly ID of a PDU. Buffered data that is passed on later can complete a
+ * PDU and start the next one in the same frame, so the ID includes the start of
+ * the PDU besides its first frame.
+ */
+static guint32
+quic_stream_reassembly_id(quic_stream_state *stream, quic_stream_msp *msp)
+{
+    guint64 reassembly_id_data[3];
+
+    reassembly_id_data[0] = stream->stream_id;
+    reassembly_id_data[1] = msp->first_frame;
+    reassembly_id_data[2] = msp->seq;
+    return wmem_strong_hash((const guint8 *)&reassembly_id_data, sizeof(reassembly_id_data));
+}
+
+/**
+ * Reassemble stream data at stream offset "seq" within a STREAM frame. The data
+ * must be passed in stream order, see dissect_quic_stream_payload.
  */
 static void
-desegment_quic_stream(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
+desegment_quic_stream(tvbuff_t *tvb, int offset, int length, guint64 seq, packet_info *pinfo,
                       proto_tree *tree, quic_info_data_t *quic_info,
                       quic_stream_info *stream_info,
                       quic_stream_state *stream)
@@ -1408,9 +2017,8 @@ desegment_quic_stream(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
     gboolean called_dissector;
     int another_pdu_follows;
     int deseg_offset;
-    struct tcp_multisegment_pdu *msp;
-    guint32 seq = (guint32)stream_info->stream_offset;
-    const guint32 nxtseq = seq + (guint32)length;
+    quic_stream_msp *msp;
+    const guint64 nxtseq = seq + length;
     guint32 reassembly_id = 0;
 
     // XXX fix the tvb accessors below such that no new tvb is needed.
@@ -1440,11 +2048,18 @@ again:
      */
     deseg_offset = offset;
 
+    /* Data of released PDUs was delivered before. */
+    if (nxtseq <= stream->released_offset && !PINFO_FD_VISITED(pinfo)) {
+        return;
+    }
+
+    /* Find the PDU which contains this segment, if any. */
+    msp = quic_stream_msp_lookup(pinfo, stream, seq);
+
     /* Have we seen this PDU before (and is it the start of a multi-
      * segment PDU)?
      */
-    if ((msp = (struct tcp_multisegment_pdu *)wmem_tree_lookup32(stream->multisegment_pdus, seq)) &&
-            nxtseq <= msp->nxtpdu) {
+    if (msp && msp->seq == seq && nxtseq <= msp->nxtpdu) {
         // XXX: This also happens the second time through the data for an MSP normally
         // TODO show expert info for retransmission? Additional checks may be
         // necessary here to tell a retransmission apart from other (normal?)
@@ -1455,44 +2070,11 @@ again:
 #endif
         return;
     }
-    /* Else, find the most previous PDU starting before this sequence number */
-    if (!msp && seq > 0) {
-        msp = (struct tcp_multisegment_pdu *)wmem_tree_lookup32_le(stream->multisegment_pdus, seq-1);
-        /* Unless if we already fully reassembled the msp that covers seq-1
-         * and seq is beyond the end of that msp. In that case this segment
-         * will be the start of a new msp.
-         */
-        if (msp && (msp->flags & MSP_FLAGS_GOT_ALL_SEGMENTS) &&
-            seq >= msp->nxtpdu) {
-            msp = NULL;
-        }
-    }
 
-    {
-        // A single stream can contain multiple fragments (e.g. for HTTP/3
-        // HEADERS and DATA frames). Let's hope that a single stream within a
-        // QUIC packet does not contain multiple partial fragments, that would
-        // result in a reassembly ID collision here. If that collision becomes
-        // an issue, we would have to replace "msp->first_frame" with a new
-        // field in "msp" that is initialized with "stream_info->stream_offset".
-#if 0
-        guint64 reassembly_id_data[2];
-        reassembly_id_data[0] = stream_info->stream_id;
-        reassembly_id_data[1] = msp ? msp->first_frame : pinfo->num;
-        reassembly_id = wmem_strong_hash((const guint8 *)&reassembly_id_data, sizeof(reassembly_id_data));
-#else
-        // XXX for debug (visibility) purposes, do not use a hash but concatenate
-        reassembly_id = ((msp ? msp->first_frame : pinfo->num) << 16) | (guint32)stream_info->stream_id;
-#endif
-    }
-
-    if (msp && msp->seq <= seq && msp->nxtpdu > seq) {
+    if (msp) {
         int len;
 
-        if (!PINFO_FD_VISITED(pinfo)) {
-            msp->last_frame=pinfo->num;
-            msp->last_frame_time=pinfo->abs_ts;
-        }
+        reassembly_id = quic_stream_reassembly_id(stream, msp);
 
         /* OK, this PDU was found, which means the segment continues
          * a higher-level PDU and that we must desegment it.
@@ -1501,13 +2083,13 @@ again:
             /* The dissector asked for the entire segment */
             len = tvb_captured_length_remaining(tvb, offset);
         } else {
-            len = MIN(nxtseq, msp->nxtpdu) - seq;
+            len = (int)(MIN(nxtseq, msp->nxtpdu) - seq);
         }
         last_fragment_len = len;
 
         fh = fragment_add(&quic_reassembly_table, tvb, offset,
                           pinfo, reassembly_id, NULL,
-                          seq - msp->seq, len,
+                          (guint32)(seq - msp->seq), len,
                           nxtseq < msp->nxtpdu);
         if (fh) {
             msp->flags |= MSP_FLAGS_GOT_ALL_SEGMENTS;
@@ -1530,7 +2112,7 @@ again:
         if( (msp->nxtpdu < nxtseq)
         &&  (msp->nxtpdu >= seq)
         &&  (len > 0)) {
-            another_pdu_follows=msp->nxtpdu - seq;
+            another_pdu_follows = (int)(msp->nxtpdu - seq);
         }
     } else {
         /* This segment was not found in our table, so it doesn't
@@ -1587,7 +2169,7 @@ again:
 
             tvbuff_t *next_tvb = tvb_new_chain(tvb, fh->tvb_data);
             add_new_data_source(pinfo, next_tvb, "Reassembled QUIC");
-            stream_info->offset = seq;
+            stream_info->offset = msp->seq;
             process_quic_stream(next_tvb, 0, pinfo, tree, quic_info, stream_info);
             called_dissector = TRUE;
 
@@ -1621,7 +2203,8 @@ again:
                      * is only one single byte in length.
                      * If this is an OoO segment, then increment the MSP end.
                      */
-                    msp->nxtpdu = MAX(seq + tvb_reported_length_remaining(tvb, offset), msp->nxtpdu) + 1;
+                    quic_stream_msp_set_nxtpdu(pinfo, quic_info, stream, msp,
+                            MAX(seq + tvb_reported_length_remaining(tvb, offset), msp->nxtpdu) + 1);
                     msp->flags |= MSP_FLAGS_REASSEMBLE_ENTIRE_SEGMENT;
 #if 0
                 } else if (pinfo->desegment_len == DESEGMENT_UNTIL_FIN) {
@@ -1630,14 +2213,16 @@ again:
                 } else {
                     if (seq + last_fragment_len >= msp->nxtpdu) {
                         /* This is the segment (overlapping) the end of the MSP. */
-                        msp->nxtpdu = seq + last_fragment_len + pinfo->desegment_len;
+                        quic_stream_msp_set_nxtpdu(pinfo, quic_info, stream, msp,
+                                seq + last_fragment_len + pinfo->desegment_len);
                     } else {
                         /* This is a segment before the end of the MSP, so it
                          * must be an out-of-order segmented that completed the
                          * MSP. The requested additional data is relative to
                          * that end.
                          */
-                        msp->nxtpdu += pinfo->desegment_len;
+                        quic_stream_msp_set_nxtpdu(pinfo, quic_info, stream, msp,
+                                msp->nxtpdu + pinfo->desegment_len);
                     }
                 }
 
@@ -1666,6 +2251,8 @@ again:
                     /* See packet-tcp.h for details about this. */
                     deseg_offset = fh->datalen - pinfo->desegment_offset;
                     deseg_offset = tvb_reported_length(tvb) - deseg_offset;
+                } else if (!PINFO_FD_VISITED(pinfo)) {
+                    quic_stream_msp_delivered(pinfo, quic_info, stream, msp);
                 }
             }
         }
@@ -1674,7 +2261,7 @@ again:
     if (must_desegment && !PINFO_FD_VISITED(pinfo)) {
         // TODO handle DESEGMENT_UNTIL_FIN if needed, maybe use the FIN bit?
 
-        guint32 deseg_seq = seq + (deseg_offset - offset);
+        guint64 deseg_seq = seq + (deseg_offset - offset);
 
         if (((nxtseq - deseg_seq) <= 1024*1024)
             && (!PINFO_FD_VISITED(pinfo))) {
@@ -1685,18 +2272,17 @@ again:
                  * but set this msp flag so we can pick it up
                  * above.
                  */
-                msp = pdu_store_sequencenumber_of_next_pdu(pinfo, deseg_seq,
-                    nxtseq+1, stream->multisegment_pdus);
+                msp = quic_stream_msp_new(pinfo, quic_info, stream, deseg_seq, nxtseq+1);
                 msp->flags |= MSP_FLAGS_REASSEMBLE_ENTIRE_SEGMENT;
             } else {
-                msp = pdu_store_sequencenumber_of_next_pdu(pinfo,
-                    deseg_seq, nxtseq+pinfo->desegment_len, stream->multisegment_pdus);
+                msp = quic_stream_msp_new(pinfo, quic_info, stream, deseg_seq, nxtseq+pinfo->desegment_len);
             }
+            reassembly_id = quic_stream_reassembly_id(stream, msp);
 
             /* add this segment as the first one for this new pdu */
             fragment_add(&quic_reassembly_table, tvb, deseg_offset,
                          pinfo, reassembly_id, NULL,
-                         0, nxtseq - deseg_seq,
+                         0, (guint32)(nxtseq - deseg_seq),
                          nxtseq < msp->nxtpdu);
         }
     }
@@ -1726,23 +2312,239 @@ again:
     }
 }
 
+/*
+ * Ordering of STREAM data.
+ *
+ * The reassembly above expects the data of a stream in order. In the first
+ * pass, data that follows a gap is copied to "segments" and passed on once the
+ * data before it arrived, in the frame that filled the gap. Data that was
+ * passed on before (retransmission) is skipped, which also trims frames that
+ * overlap it. Frames that are not passed on as is record this in "frame_order",
+ * so that later passes pass the same data in the same frames.
+ *
+ * With state eviction (single pass only, see quic_evict_state) the copy of the
+ * buffered data is released once it was passed on.
+ */
+static quic_stream_frame_order *
+quic_stream_frame_order_lookup(quic_stream_state *stream, guint32 frame, guint64 seq)
+{
+    guint32 seq_high = (guint32)(seq >> 32);
+    guint32 seq_low = (guint32)seq;
+    wmem_tree_key_t key[] = {
+        { 1, &frame },
+        { 1, &seq_high },
+        { 1, &seq_low },
+        { 0, NULL }
+    };
+
+    if (!stream->frame_order) {
+        return NULL;
+    }
+    return (quic_stream_frame_order *)wmem_tree_lookup32_array(stream->frame_order, key);
+}
+
+static quic_stream_frame_order *
+quic_stream_frame_order_new(quic_info_data_t *quic_info, quic_stream_state *stream, guint32 frame, guint64 seq)
+{
+    wmem_allocator_t *allocator = quic_connection_state_pool(quic_info);
+    quic_stream_frame_order *order = wmem_new0(allocator, quic_stream_frame_order);
+    guint32 seq_high = (guint32)(seq >> 32);
+    guint32 seq_low = (guint32)seq;
+    wmem_tree_key_t key[] = {
+        { 1, &frame },
+        { 1, &seq_high },
+        { 1, &seq_low },
+        { 0, NULL }
+    };
+
+    if (!stream->frame_order) {
+        stream->frame_order = wmem_tree_new(allocator);
+    }
+    wmem_tree_insert32_array(stream->frame_order, key, order);
+    return order;
+}
+
+/**
+ * Buffers data that follows a gap. Leading data that is buffered already is
+ * skipped. Returns FALSE if all of the data was buffered before.
+ */
+static gboolean
+quic_stream_buffer_segment(tvbuff_t *tvb, int offset, int length, guint64 seq, packet_info *pinfo,
+                           quic_info_data_t *quic_info, quic_stream_state *stream)
+{
+    wmem_allocator_t *allocator = quic_connection_state_pool(quic_info);
+    const guint64 nxtseq = seq + length;
+    quic_stream_segment *segment;
+    wmem_list_t *results;
+    gboolean found;
+
+    if (!stream->segments) {
+        stream->segments = wmem_itree_new(allocator);
+    }
+
+    // Interval keys are unique by their start, so a new segment must not start
+    // within another one.
+    do {
+        found = FALSE;
+        results = wmem_itree_find_intervals(stream->segments, pinfo->pool, seq, seq);
+        for (wmem_list_frame_t *item = wmem_list_head(results); item; item = wmem_list_frame_next(item)) {
+            segment = (quic_stream_segment *)wmem_list_frame_data(item);
+            if (segment->seq + segment->length > seq) {
+                seq = segment->seq + segment->length;
+                found = TRUE;
+            }
+        }
+    } while (found && seq < nxtseq);
+    if (seq >= nxtseq) {
+        return FALSE;
+    }
+
+    offset += (int)(seq - (nxtseq - length));
+    segment = wmem_new(allocator, quic_stream_segment);
+    segment->seq = seq;
+    segment->length = (guint32)(nxtseq - seq);
+    segment->drained = FALSE;
+    segment->data = (guint8 *)tvb_memdup(allocator, tvb, offset, segment->length);
+    wmem_itree_insert(stream->segments, seq, nxtseq - 1, segment);
+    return TRUE;
+}
+
+/**
+ * Returns the buffered data that can be passed on after "next_offset" advanced
+ * from "drain_from", in stream order, and advances "next_offset" past it.
+ */
+static quic_stream_replay *
+quic_stream_drain_segments(packet_info *pinfo, quic_info_data_t *quic_info, quic_stream_state *stream,
+                           guint64 drain_from)
+{
+    quic_stream_replay *replays = NULL, **last = &replays;
+    quic_stream_segment *segment, *next;
+    wmem_list_t *results;
+
+    if (!stream->segments) {
+        return NULL;
+    }
+
+    for (;;) {
+        // Segments that start at "next_offset" or before can be passed on,
+        // the one with the lowest start first. Segments that were not passed
+        // on before start after "drain_from".
+        next = NULL;
+        results = wmem_itree_find_intervals(stream->segments, pinfo->pool, drain_from, stream->next_offset);
+        for (wmem_list_frame_t *item = wmem_list_head(results); item; item = wmem_list_frame_next(item)) {
+            segment = (quic_stream_segment *)wmem_list_frame_data(item);
+            if (!segment->drained && (!next || segment->seq < next->seq)) {
+                next = segment;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        next->drained = TRUE;
+        if (next->seq + next->length > stream->next_offset) {
+            quic_stream_replay *replay = wmem_new(quic_connection_state_pool(quic_info), quic_stream_replay);
+            replay->segment = next;
+            replay->skip = (guint32)(stream->next_offset - next->seq);
+            replay->next = NULL;
+            *last = replay;
+            last = &replay->next;
+            stream->next_offset = next->seq + next->length;
+        } else if (quic_evict_state) {
+            wmem_free(quic_connection_state_pool(quic_info), next->data);
+            next->data = NULL;
+        }
+    }
+    return replays;
+}
+
 static void
 dissect_quic_stream_payload(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
                             proto_tree *tree, quic_info_data_t *quic_info,
                             quic_stream_info *stream_info,
                             quic_stream_state *stream)
 {
+    const guint64 seq = stream_info->stream_offset;
+    quic_stream_frame_order *order = NULL;
+    quic_stream_replay *replays = NULL;
+    guint32 skip = 0;
+
+    if (!PINFO_FD_VISITED(pinfo)) {
+        if (length == 0) {
+            // Nothing to order (e.g. only FIN).
+        } else if (seq + length <= stream->next_offset) {
+            skip = length;
+        } else if (seq > stream->next_offset) {
+            if (quic_stream_buffer_segment(tvb, offset, length, seq, pinfo, quic_info, stream)) {
+                order = quic_stream_frame_order_new(quic_info, stream, pinfo->num, seq);
+                order->buffered = TRUE;
+            } else {
+                // Buffered before.
+                skip = length;
+            }
+        } else {
+            guint64 drain_from = stream->next_offset;
+
+            skip = (guint32)(stream->next_offset - seq);
+            stream->next_offset = seq + length;
+            replays = quic_stream_drain_segments(pinfo, quic_info, stream, drain_from);
+        }
+        if (skip || replays) {
+            order = quic_stream_frame_order_new(quic_info, stream, pinfo->num, seq);
+            order->skip = skip;
+            order->replays = replays;
+        }
+    } else {
+        order = quic_stream_frame_order_lookup(stream, pinfo->num, seq);
+        if (order) {
+            skip = order->skip;
+            replays = order->replays;
+        }
+    }
+
+    if (order && order->buffered) {
+        proto_tree_add_expert(tree, pinfo, &ei_quic_out_of_order, tvb, offset, length);
+        return;
+    }
+    if (length > 0 && skip == (guint32)length) {
+        proto_tree_add_expert(tree, pinfo, &ei_quic_retransmission, tvb, offset, length);
+        return;
+    }
+    if (skip) {
+        proto_tree_add_expert(tree, pinfo, &ei_quic_overlap, tvb, offset, length);
+    }
+
     /* QUIC application data is most likely not properly dissected when
      * reassembly is not enabled. Therefore we do not even offer "desegment"
      * preference to disable reassembly.
      */
 
     pinfo->can_desegment = 2;
-    desegment_quic_stream(tvb, offset, length, pinfo, tree, quic_info, stream_info, stream);
+    desegment_quic_stream(tvb, offset + (int)skip, length - (int)skip, seq + skip, pinfo, tree, quic_info, stream_info, stream);
+
+    for (; replays; replays = replays->next) {
+        quic_stream_segment *segment = replays->segment;
+        tvbuff_t *next_tvb;
+
+        if (quic_evict_state) {
+            // The copy is released below.
+            next_tvb = tvb_new_child_real_data(tvb, (guint8 *)wmem_memdup(pinfo->pool, segment->data, segment->length),
+                    segment->length, segment->length);
+            wmem_free(quic_connection_state_pool(quic_info), segment->data);
+            segment->data = NULL;
+        } else {
+            next_tvb = tvb_new_child_real_data(tvb, segment->data, segment->length, segment->length);
+        }
+        add_new_data_source(pinfo, next_tvb, "Out-of-order QUIC STREAM");
+        pinfo->can_desegment = 2;
+        desegment_quic_stream(next_tvb, (int)replays->skip, (int)(segment->length - replays->skip), segment->seq + replays->skip,
+                              pinfo, tree, quic_info, stream_info, stream);
+    }
 }
 /* QUIC Streams tracking and reassembly. }}} */
 
 static gboolean quic_crypto_out_of_order = TRUE;
+static gboolean quic_null_cipher = TRUE;
 
 static reassembly_table quic_crypto_reassembly_table;
 
@@ -1795,15 +2597,15 @@ quic_get_crypto_state(packet_info *pinfo, quic_info_data_t *quic_info, gboolean
 
     // Initialize per-connection and per-stream state.
     if (!cryptos) {
-        cryptos = wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+        cryptos = wmem_map_new(quic_connection_state_pool(quic_info), g_direct_hash, g_direct_equal);
         *cryptos_p = cryptos;
     } else {
         crypto = (quic_crypto_state *)wmem_map_lookup(cryptos, GUINT_TO_POINTER(encryption_level));
     }
     if (!crypto) {
-        crypto = wmem_new0(wmem_file_scope(), quic_crypto_state);
-        crypto->multisegment_pdus = wmem_tree_new(wmem_file_scope());
-        crypto->retrans_offsets = wmem_map_new(wmem_file_scope(),
+        crypto = wmem_new0(quic_connection_state_pool(quic_info), quic_crypto_state);
+        crypto->multisegment_pdus = wmem_tree_new(quic_connection_state_pool(quic_info));
+        crypto->retrans_offsets = wmem_map_new(quic_connection_state_pool(quic_info),
                 quic_crypto_retrans_hash, quic_crypto_retrans_equal);
         crypto->encryption_level = encryption_level;
         wmem_map_insert(cryptos, GUINT_TO_POINTER(encryption_level), crypto);
@@ -1849,7 +2651,7 @@ process_quic_crypto(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
 
 static void
 desegment_quic_crypto(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
-                      proto_tree *tree, quic_info_data_t *quic_info _U_,
+                      proto_tree *tree, quic_info_data_t *quic_info,
                       quic_crypto_info *crypto_info,
                       quic_crypto_state *crypto)
 {
@@ -1898,9 +2700,9 @@ desegment_quic_crypto(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
         if (crypto_info->crypto_offset + length <= crypto->max_contiguous_offset) {
             /* No new data. Remember this. */
             proto_tree_add_expert(tree, pinfo, &ei_quic_retransmission, tvb, offset, length);
-            guint64* contiguous_offset = wmem_new(wmem_file_scope(), guint64);
+            guint64* contiguous_offset = wmem_new(quic_connection_state_pool(quic_info), guint64);
             *contiguous_offset = crypto->max_contiguous_offset;
-            quic_crypto_retrans_key *fkey = wmem_new(wmem_file_scope(), quic_crypto_retrans_key);
+            quic_crypto_retrans_key *fkey = wmem_new(quic_connection_state_pool(quic_info), quic_crypto_retrans_key);
             *fkey = *tmp_key;
             wmem_map_insert(crypto->retrans_offsets, fkey, contiguous_offset);
             return;
@@ -1912,9 +2714,9 @@ desegment_quic_crypto(tvbuff_t *tvb, int offset, int length, packet_info *pinfo,
             seq = (guint32)(crypto->max_contiguous_offset);
             offset += (guint32)(overlap);
             /* Store this offset */
-            guint64* contiguous_offset = wmem_new(wmem_file_scope(), guint64);
+            guint64* contiguous_offset = wmem_new(quic_connection_state_pool(quic_info), guint64);
             *contiguous_offset = crypto->max_contiguous_offset;
-            quic_crypto_retrans_key *fkey = wmem_new(wmem_file_scope(), quic_crypto_retrans_key);
+            quic_crypto_retrans_key *fkey = wmem_new(quic_connection_state_pool(quic_info), quic_crypto_retrans_key);
             *fkey = *tmp_key;
             wmem_map_insert(crypto->retrans_offsets, fkey, contiguous_offset);
         }
@@ -2143,14 +2945,40 @@ void *quic_stream_get_proto_data(packet_info *pinfo, quic_stream_info *stream_in
     return stream->subdissector_private;
 }
 
+static void
+quic_tap_add_ack_range(quic_tap_info_t *tap_info, guint64 smallest, guint64 largest)
+{
+    if (tap_info->ack_range_count < QUIC_TAP_MAX_ACK_RANGES) {
+        tap_info->ack_ranges[tap_info->ack_range_count].smallest = smallest;
+        tap_info->ack_ranges[tap_info->ack_range_count].largest = largest;
+        tap_info->ack_range_count++;
+    }
+}
+
+static quic_tap_frame_t *
+quic_tap_add_frame(quic_tap_info_t *tap_info, guint64 frame_type)
+{
+    quic_tap_frame_t *tap_frame;
+
+    if (tap_info->frame_count >= QUIC_TAP_MAX_FRAMES) {
+        tap_info->frames_truncated = TRUE;
+        return NULL;
+    }
+    tap_frame = &tap_info->frames[tap_info->frame_count++];
+    tap_frame->frame_type = frame_type;
+    return tap_frame;
+}
+
 static int
-dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree, guint offset, quic_info_data_t *quic_info, const quic_packet_info_t *quic_packet, gboolean from_server)
+dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree, guint offset, quic_info_data_t *quic_info, const quic_packet_info_t *quic_packet, gboolean from_server,
+                        quic_tap_info_t *tap_info)
 {
     proto_item *ti_ft, *ti_ftflags, *ti_ftid, *ti;
     proto_tree *ft_tree, *ftflags_tree, *ftid_tree;
     guint64 frame_type;
     gint32 lenft;
     guint   orig_offset = offset;
+    quic_tap_frame_t *tap_frame = NULL;
 
     ti_ft = proto_tree_add_item(quic_tree, hf_quic_frame, tvb, offset, 1, ENC_NA);
     ft_tree = proto_item_add_subtree(ti_ft, ett_quic_ft);
@@ -2159,6 +2987,10 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
     proto_item_set_text(ti_ft, "%s", rval_to_str_const((guint32)frame_type, quic_frame_type_vals, "Unknown"));
     offset += lenft;
 
+    if (tap_info) {
+        tap_frame = quic_tap_add_frame(tap_info, frame_type);
+    }
+
     switch(frame_type){
         case FT_PADDING:{
             guint32 pad_len;
@@ -2172,6 +3004,9 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             proto_item_set_generated(ti);
             proto_item_append_text(ti_ft, " Length: %u", pad_len);
             offset += pad_len - 1;
+            if (tap_frame) {
+                tap_frame->length = pad_len;
+            }
         }
         break;
         case FT_PING:{
@@ -2183,6 +3018,9 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
         case FT_MP_ACK:
         case FT_MP_ACK_ECN:{
             guint64 ack_range_count;
+            guint64 largest_acknowledged, ack_delay, ack_range, gap;
+            guint64 smallest = 0;
+            gboolean valid_ranges;
             gint32 lenvar;
 
             switch(frame_type){
@@ -2204,28 +3042,54 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
                 break;
             }
 
-            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_largest_acknowledged, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &lenvar);
+            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_largest_acknowledged, tvb, offset, -1, ENC_VARINT_QUIC, &largest_acknowledged, &lenvar);
             offset += lenvar;
 
-            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_ack_delay, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &lenvar);
+            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_ack_delay, tvb, offset, -1, ENC_VARINT_QUIC, &ack_delay, &lenvar);
             offset += lenvar;
 
             proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_ack_range_count, tvb, offset, -1, ENC_VARINT_QUIC, &ack_range_count, &lenvar);
             offset += lenvar;
 
-            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_first_ack_range, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &lenvar);
+            proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_first_ack_range, tvb, offset, -1, ENC_VARINT_QUIC, &ack_range, &lenvar);
             offset += lenvar;
 
+            /* Multipath ACKs are per uniflow, only pass plain ACKs to the tap. */
+            if (frame_type != FT_ACK && frame_type != FT_ACK_ECN) {
+                tap_info = NULL;
+            }
+            valid_ranges = ack_range <= largest_acknowledged;
+            if (valid_ranges) {
+                smallest = largest_acknowledged - ack_range;
+            }
+            if (tap_info && valid_ranges) {
+                guint8 exponent = from_server ? quic_info->server_ack_delay_exponent : quic_info->client_ack_delay_exponent;
+                tap_info->has_ack = TRUE;
+                tap_info->ack_delay_us = ack_delay << exponent;
+                tap_info->ack_range_count = 0;
+                quic_tap_add_ack_range(tap_info, smallest, largest_acknowledged);
+            }
+
             /* ACK Ranges - Repeated "Ack Range Count" */
             while (ack_range_count) {
 
                 /* Gap To Next Block */
-                proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_gap, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &lenvar);
+                proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_gap, tvb, offset, -1, ENC_VARINT_QUIC, &gap, &lenvar);
                 offset += lenvar;
 
-                proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_ack_range, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &lenvar);
+                proto_tree_add_item_ret_varint(ft_tree, hf_quic_ack_ack_range, tvb, offset, -1, ENC_VARINT_QUIC, &ack_range, &lenvar);
                 offset += lenvar;
 
+                /* https://www.rfc-editor.org/rfc/rfc9000.html#section-19.3.1 */
+                valid_ranges = valid_ranges && gap + 2 <= smallest && ack_range <= smallest - gap - 2;
+                if (valid_ranges) {
+                    guint64 largest = smallest - gap - 2;
+                    smallest = largest - ack_range;
+                    if (tap_info) {
+                        quic_tap_add_ack_range(tap_info, smallest, largest);
+                    }
+                }
+
                 ack_range_count--;
             }
 
@@ -2261,6 +3125,10 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             offset += len_finalsize;
 
             proto_item_append_text(ti_ft, " Error code: %#" PRIx64, error_code);
+            if (tap_frame) {
+                tap_frame->stream_id = stream_id;
+                tap_frame->value = error_code;
+            }
         }
         break;
         case FT_STOP_SENDING:{
@@ -2280,6 +3148,10 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             offset += len_error_code;
 
             proto_item_append_text(ti_ft, " Error code: %#" PRIx64, error_code);
+            if (tap_frame) {
+                tap_frame->stream_id = stream_id;
+                tap_frame->value = error_code;
+            }
         }
         break;
         case FT_CRYPTO: {
@@ -2291,13 +3163,21 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             proto_tree_add_item_ret_varint(ft_tree, hf_quic_crypto_length, tvb, offset, -1, ENC_VARINT_QUIC, &crypto_length, &lenvar);
             offset += lenvar;
             proto_tree_add_item(ft_tree, hf_quic_crypto_crypto_data, tvb, offset, (guint32)crypto_length, ENC_NA);
-            quic_crypto_state *crypto = quic_get_crypto_state(pinfo, quic_info, from_server, quic_packet->packet_type);
-            quic_crypto_info crypto_info = {
-                .packet_number = quic_packet->packet_number,
-                .crypto_offset = crypto_offset,
-                .from_server = from_server,
-            };
-            dissect_quic_crypto_payload(tvb, offset, (int)crypto_length, pinfo, ft_tree, quic_info, &crypto_info, crypto);
+            if (tap_frame) {
+                tap_frame->offset = crypto_offset;
+                tap_frame->length = crypto_length;
+            }
+            if (quic_info->state_evicted) {
+                expert_add_info(pinfo, ti_ft, &ei_quic_state_evicted);
+            } else {
+                quic_crypto_state *crypto = quic_get_crypto_state(pinfo, quic_info, from_server, quic_packet->packet_type);
+                quic_crypto_info crypto_info = {
+                    .packet_number = quic_packet->packet_number,
+                    .crypto_offset = crypto_offset,
+                    .from_server = from_server,
+                };
+                dissect_quic_crypto_payload(tvb, offset, (int)crypto_length, pinfo, ft_tree, quic_info, &crypto_info, crypto);
+            }
             offset += (guint32)crypto_length;
         }
         break;
@@ -2346,7 +3226,7 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
 
             proto_item_append_text(ti_ft, " fin=%d", !!(frame_type & FTFLAGS_STREAM_FIN));
 
-            if (!PINFO_FD_VISITED(pinfo)) {
+            if (!PINFO_FD_VISITED(pinfo) && !quic_info->state_evicted) {
                 quic_streams_add(pinfo, quic_info, stream_id);
             }
 
@@ -2367,6 +3247,12 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
                                    val64_to_str_const(!!(stream_id & FTFLAGS_STREAM_INITIATOR), quic_frame_id_initiator, "unknown"));
 
             proto_tree_add_item(ft_tree, hf_quic_stream_data, tvb, offset, (int)length, ENC_NA);
+            if (tap_frame) {
+                tap_frame->stream_id = stream_id;
+                tap_frame->offset = stream_offset;
+                tap_frame->length = length;
+                tap_frame->fin = !!(frame_type & FTFLAGS_STREAM_FIN);
+            }
             if (have_tap_listener(quic_follow_tap)) {
                 quic_follow_tap_data_t *follow_data = wmem_new0(pinfo->pool, quic_follow_tap_data_t);
 
@@ -2376,29 +3262,37 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
 
                 tap_queue_packet(quic_follow_tap, pinfo, follow_data);
             }
-            quic_stream_state *stream = quic_get_stream_state(pinfo, quic_info, from_server, stream_id);
-            quic_stream_info stream_info = {
-                .stream_id = stream_id,
-                .stream_offset = stream_offset,
-                .quic_info = quic_info,
-                .from_server = from_server,
-            };
-            dissect_quic_stream_payload(tvb, offset, (int)length, pinfo, ft_tree, quic_info, &stream_info, stream);
+            if (quic_info->state_evicted) {
+                expert_add_info(pinfo, ti_ft, &ei_quic_state_evicted);
+            } else {
+                quic_stream_state *stream = quic_get_stream_state(pinfo, quic_info, from_server, stream_id);
+                quic_stream_info stream_info = {
+                    .stream_id = stream_id,
+                    .stream_offset = stream_offset,
+                    .quic_info = quic_info,
+                    .from_server = from_server,
+                };
+                dissect_quic_stream_payload(tvb, offset, (int)length, pinfo, ft_tree, quic_info, &stream_info, stream);
+            }
             offset += (int)length;
         }
         break;
         case FT_MAX_DATA:{
             gint32 len_maximumdata;
+            guint64 maximum_data;
 
             col_append_fstr(pinfo->cinfo, COL_INFO, ", MD");
 
-            proto_tree_add_item_ret_varint(ft_tree, hf_quic_md_maximum_data, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &len_maximumdata);
+            proto_tree_add_item_ret_varint(ft_tree, hf_quic_md_maximum_data, tvb, offset, -1, ENC_VARINT_QUIC, &maximum_data, &len_maximumdata);
             offset += len_maximumdata;
+            if (tap_frame) {
+                tap_frame->value = maximum_data;
+            }
         }
         break;
         case FT_MAX_STREAM_DATA:{
             gint32 len_streamid, len_maximumstreamdata;
-            guint64 stream_id;
+            guint64 stream_id, maximum_stream_data;
 
             col_append_fstr(pinfo->cinfo, COL_INFO, ", MSD");
 
@@ -2408,8 +3302,12 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             proto_item_append_text(ti_ft, " id=%" PRIu64, stream_id);
             col_append_fstr(pinfo->cinfo, COL_INFO, "(%" PRIu64 ")", stream_id);
 
-            proto_tree_add_item_ret_varint(ft_tree, hf_quic_msd_maximum_stream_data, tvb, offset, -1, ENC_VARINT_QUIC, NULL, &len_maximumstreamdata);
+            proto_tree_add_item_ret_varint(ft_tree, hf_quic_msd_maximum_stream_data, tvb, offset, -1, ENC_VARINT_QUIC, &maximum_stream_data, &len_maximumstreamdata);
             offset += len_maximumstreamdata;
+            if (tap_frame) {
+                tap_frame->stream_id = stream_id;
+                tap_frame->value = maximum_stream_data;
+            }
         }
         break;
         case FT_MAX_STREAMS_BIDI:
@@ -2549,6 +3447,9 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
             const char *tls_alert = NULL;
 
             col_append_fstr(pinfo->cinfo, COL_INFO, ", CC");
+            if (!PINFO_FD_VISITED(pinfo)) {
+                quic_info->closed = TRUE;
+            }
 
             if (frame_type == FT_CONNECTION_CLOSE_TPT) {
                 proto_tree_add_item_ret_varint(ft_tree, hf_quic_cc_error_code, tvb, offset, -1, ENC_VARINT_QUIC, &error_code, &len_error_code);
@@ -2573,6 +3474,9 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
 
             proto_tree_add_item(ft_tree, hf_quic_cc_reason_phrase, tvb, offset, (guint32)len_reason, ENC_ASCII);
             offset += (guint32)len_reason;
+            if (tap_frame) {
+                tap_frame->value = error_code;
+            }
 
             // Transport Error codes higher than 0x3fff are for Private Use.
             if (frame_type == FT_CONNECTION_CLOSE_TPT && error_code <= 0x3fff) {
@@ -2766,6 +3670,24 @@ dissect_quic_frame_type(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tree
         break;
     }
 
+    if (tap_info) {
+        /* https://www.rfc-editor.org/rfc/rfc9002.html#section-2 */
+        switch (frame_type) {
+            case FT_PADDING:
+            case FT_ACK:
+            case FT_ACK_ECN:
+            case FT_CONNECTION_CLOSE_TPT:
+            case FT_CONNECTION_CLOSE_APP:
+            break;
+            case FT_HANDSHAKE_DONE:
+                tap_info->handshake_done = TRUE;
+                /* fallthrough */
+            default:
+                tap_info->ack_eliciting = TRUE;
+            break;
+        }
+    }
+
     proto_item_set_len(ti_ft, offset - orig_offset);
 
     return offset;
@@ -2777,84 +3699,117 @@ static gboolean
 quic_pp_cipher_init(quic_pp_cipher *pp_cipher, int hash_algo, guint8 key_length, guint8 *secret, guint32 version);
 
 
+/**
+ * Given a QUIC message (header + non-empty payload) whose payload is not
+ * protected (null cipher), record the payload location such that it can be
+ * exposed as a subset of the frame without copying it.
+ *
+ * Unlike decrypted payloads, nothing is stored in file scope except for the
+ * payload length: the payload is re-read from the frame on later passes, so
+ * memory usage does not grow with the number of captured bytes.
+ */
+static void
+quic_plaintext_message(tvbuff_t *head, guint header_length,
+                       guint pkn_len, quic_decrypt_result_t *result)
+{
+    guint           buffer_length;
+
+    DISSECTOR_ASSERT(pkn_len < header_length);
+    DISSECTOR_ASSERT(1 <= pkn_len && pkn_len <= 4);
+
+    buffer_length = tvb_captured_length_remaining(head, header_length);
+    if (buffer_length == 0) {
+        result->error = "Payload is empty";
+        return;
+    }
+
+    result->error = NULL;
+    result->data = NULL;
+    result->data_len = buffer_length;
+    result->plaintext = TRUE;
+}
+
 /**
  * Given a QUIC message (header + non-empty payload), the actual packet number,
  * try to decrypt it using the PP cipher.
  * As the header points to the original buffer with an encrypted packet number,
  * the (encrypted) packet number length is also included.
  *
+ * The PP cipher handle is prepared once per key phase and reused for every
+ * packet; only the nonce changes. Setting the IV reinitializes the AEAD state,
+ * so no explicit reset is needed. The ciphertext is decrypted straight from
+ * the frame into its final (file-scoped) buffer.
+ *
  * The actual packet number must be constructed according to
  * https://tools.ietf.org/html/draft-ietf-quic-transport-22#section-12.3
  */
-// static void
-// quic_decrypt_message(quic_pp_cipher *pp_cipher, tvbuff_t *head, guint header_length,
-//                      guint8 first_byte, guint pkn_len, guint64 packet_number, quic_decrypt_result_t *result, wmem_allocator_t *pool)
-static void // mycode
-quic_decrypt_message(tvbuff_t *head, guint header_length,
-                     guint8 first_byte, guint pkn_len, quic_decrypt_result_t *result)
+static void
+quic_decrypt_message(quic_pp_cipher *pp_cipher, tvbuff_t *head, guint header_length,
+                     guint8 first_byte, guint pkn_len, guint64 packet_number, quic_decrypt_result_t *result, wmem_allocator_t *pool)
 {
-    // gcry_error_t    err;
-    // guint8         *header;
-    // guint8          nonce[TLS13_AEAD_NONCE_LENGTH];
+    gcry_error_t    err;
+    guint8         *header;
+    guint8          nonce[TLS13_AEAD_NONCE_LENGTH];
     guint8         *buffer;
-    // guint8          atag[16];
+    const guint8   *ciphertext;
+    guint8          atag[16];
     guint           buffer_length;
     const guchar  **error = &result->error;
 
-    // DISSECTOR_ASSERT(pp_cipher != NULL);
-    // DISSECTOR_ASSERT(pp_cipher->pp_cipher != NULL);
+    DISSECTOR_ASSERT(pp_cipher != NULL);
+    DISSECTOR_ASSERT(pp_cipher->pp_cipher != NULL);
     DISSECTOR_ASSERT(pkn_len < header_length);
     DISSECTOR_ASSERT(1 <= pkn_len && pkn_len <= 4);
     // copy header, but replace encrypted first byte and PKN by plaintext.
-    // header = (guint8 *)tvb_memdup(pool, head, 0, header_length);
-    // header[0] = first_byte;
-    // for (guint i = 0; i < pkn_len; i++) {
-    //     header[header_length - 1 - i] = (guint8)(packet_number >> (8 * i));
-    // }
+    header = (guint8 *)tvb_memdup(pool, head, 0, header_length);
+    header[0] = first_byte;
+    for (guint i = 0; i < pkn_len; i++) {
+        header[header_length - 1 - i] = (guint8)(packet_number >> (8 * i));
+    }
 
     /* Input is "header || ciphertext (buffer) || auth tag (16 bytes)" */
-    // buffer_length = tvb_captured_length_remaining(head, header_length + 16);
-    buffer_length = tvb_captured_length_remaining(head, header_length);
+    buffer_length = tvb_captured_length_remaining(head, header_length + 16);
     if (buffer_length == 0) {
         *error = "Decryption not possible, ciphertext is too short";
         return;
     }
-    buffer = (guint8 *)tvb_memdup(wmem_file_scope(), head, header_length, buffer_length);
-    // tvb_memcpy(head, atag, header_length + buffer_length, 16);
+    ciphertext = tvb_get_ptr(head, header_length, buffer_length);
+    tvb_memcpy(head, atag, header_length + buffer_length, 16);
 
-    // memcpy(nonce, pp_cipher->pp_iv, TLS13_AEAD_NONCE_LENGTH);
+    memcpy(nonce, pp_cipher->pp_iv, TLS13_AEAD_NONCE_LENGTH);
     /* Packet number is left-padded with zeroes and XORed with write_iv */
-    // phton64(nonce + sizeof(nonce) - 8, pntoh64(nonce + sizeof(nonce) - 8) ^ packet_number);
+    phton64(nonce + sizeof(nonce) - 8, pntoh64(nonce + sizeof(nonce) - 8) ^ packet_number);
 
-    // gcry_cipher_reset(pp_cipher->pp_cipher);
-    // err = gcry_cipher_setiv(pp_cipher->pp_cipher, nonce, TLS13_AEAD_NONCE_LENGTH);
-    // if (err) {
-    //     *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (setiv) failed: %s", gcry_strerror(err));
-    //     return;
-    // }
+    err = gcry_cipher_setiv(pp_cipher->pp_cipher, nonce, TLS13_AEAD_NONCE_LENGTH);
+    if (err) {
+        *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (setiv) failed: %s", gcry_strerror(err));
+        return;
+    }
 
     /* associated data (A) is the contents of QUIC header */
-    // err = gcry_cipher_authenticate(pp_cipher->pp_cipher, header, header_length);
-    // if (err) {
-    //     *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (authenticate) failed: %s", gcry_strerror(err));
-    //     return;
-    // }
-
-    /* Output ciphertext (C) */
-    // err = gcry_cipher_decrypt(pp_cipher->pp_cipher, buffer, buffer_length, NULL, 0);
-    // if (err) {
-    //     *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (decrypt) failed: %s", gcry_strerror(err));
-    //     return;
-    // }
-
-    // err = gcry_cipher_checktag(pp_cipher->pp_cipher, atag, 16);
-    // if (err) {
-    //     *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (checktag) failed: %s", gcry_strerror(err));
-    //     return;
-    // }
+    err = gcry_cipher_authenticate(pp_cipher->pp_cipher, header, header_length);
+    if (err) {
+        *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (authenticate) failed: %s", gcry_strerror(err));
+        return;
+    }
+
+    /* Output plaintext (P) from ciphertext (C) */
+    buffer = (guint8 *)wmem_alloc(wmem_file_scope(), buffer_length);
+    err = gcry_cipher_decrypt(pp_cipher->pp_cipher, buffer, buffer_length, ciphertext, buffer_length);
+    if (err) {
+        wmem_free(wmem_file_scope(), buffer);
+        *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (decrypt) failed: %s", gcry_strerror(err));
+        return;
+    }
+
+    err = gcry_cipher_checktag(pp_cipher->pp_cipher, atag, 16);
+    if (err) {
+        wmem_free(wmem_file_scope(), buffer);
+        *error = wmem_strdup_printf(wmem_file_scope(), "Decryption (checktag) failed: %s", gcry_strerror(err));
+        return;
+    }
 
     result->error = NULL;
-    result->data = &first_byte;
     result->data = buffer;
     result->data_len = buffer_length;
 }
@@ -3078,8 +4033,8 @@ quic_create_initial_decoders(const quic_cid_t *cid, const gchar **error, quic_in
     guint8          server_secret[HASH_SHA2_256_LENGTH];
 
     if (!quic_derive_initial_secrets(cid, client_secret, server_secret, quic_info->version, error)) {
-        // return FALSE; mycode
-        return TRUE;
+        /* Unprotected payloads do not need the Initial secrets. */
+        return quic_null_cipher;
     }
 
     /* Packet numbers are protected with AES128-CTR,
@@ -3122,32 +4077,32 @@ quic_create_0rtt_decoder(guint i, gchar *early_data_secret, guint early_data_sec
     return TRUE;
 }
 
-// static gboolean
-// quic_create_decoders(packet_info *pinfo, quic_info_data_t *quic_info, quic_ciphers *ciphers,
-//                      gboolean from_server, TLSRecordType type, const char **error)
-// {
-//     if (!quic_info->hash_algo) {
-//         if (!tls_get_cipher_info(pinfo, 0, &quic_info->cipher_algo, &quic_info->cipher_mode, &quic_info->hash_algo)) {
-//             *error = "Unable to retrieve cipher information";
-//             return FALSE;
-//         }
-//     }
-
-//     guint hash_len = gcry_md_get_algo_dlen(quic_info->hash_algo);
-//     char *secret = (char *)wmem_alloc0(pinfo->pool, hash_len);
-
-//     if (!tls13_get_quic_secret(pinfo, from_server, type, hash_len, hash_len, secret)) {
-//         *error = "Secrets are not available";
-//         return FALSE;
-//     }
-
-//     if (!quic_ciphers_prepare(ciphers, quic_info->hash_algo,
-//                               quic_info->cipher_algo, quic_info->cipher_mode, secret, error, quic_info->version)) {
-//         return FALSE;
-//     }
-
-//     return TRUE;
-// }
+static gboolean
+quic_create_decoders(packet_info *pinfo, quic_info_data_t *quic_info, quic_ciphers *ciphers,
+                     gboolean from_server, TLSRecordType type, const char **error)
+{
+    if (!quic_info->hash_algo) {
+        if (!tls_get_cipher_info(pinfo, 0, &quic_info->cipher_algo, &quic_info->cipher_mode, &quic_info->hash_algo)) {
+            *error = "Unable to retrieve cipher information";
+            return FALSE;
+        }
+    }
+
+    guint hash_len = gcry_md_get_algo_dlen(quic_info->hash_algo);
+    char *secret = (char *)wmem_alloc0(pinfo->pool, hash_len);
+
+    if (!tls13_get_quic_secret(pinfo, from_server, type, hash_len, hash_len, secret)) {
+        *error = "Secrets are not available";
+        return FALSE;
+    }
+
+    if (!quic_ciphers_prepare(ciphers, quic_info->hash_algo,
+                              quic_info->cipher_algo, quic_info->cipher_mode, secret, error, quic_info->version)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
 
 /**
  * Tries to obtain the QUIC application traffic secrets.
@@ -3372,7 +4327,8 @@ quic_get_pp_cipher(gboolean key_phase, quic_info_data_t *quic_info, gboolean fro
 static void
 quic_process_payload(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, proto_item *ti, guint offset,
                      quic_info_data_t *quic_info, quic_packet_info_t *quic_packet, gboolean from_server,
-                     quic_pp_cipher *pp_cipher, guint8 first_byte, guint pkn_len)
+                     quic_pp_cipher *pp_cipher, guint8 first_byte, guint pkn_len,
+                     const quic_cid_t *dcid, const quic_cid_t *scid)
 {
     quic_decrypt_result_t *decryption = &quic_packet->decryption;
     quic_info->skip_decryption = FALSE;
@@ -3382,34 +4338,71 @@ quic_process_payload(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree, proto_
      * pass and store the result for later use.
      */
     if (!PINFO_FD_VISITED(pinfo)) {
-        // if (!quic_packet->decryption.error && quic_is_pp_cipher_initialized(pp_cipher)) {
-        //     quic_decrypt_message(pp_cipher, tvb, offset, first_byte, pkn_len, quic_packet->packet_number, &quic_packet->decryption, pinfo->pool);
-        // }
-
-        quic_decrypt_message(tvb, offset, first_byte, pkn_len, &quic_packet->decryption); // mycode
-    }
-    if(pp_cipher == NULL){
-        expert_add_info_format(pinfo, tree, &ei_quic_coalesced_padding_data, "PP CIPHER NULL");
+        if (quic_null_cipher) {
+            quic_plaintext_message(tvb, offset, pkn_len, &quic_packet->decryption);
+        } else if (!quic_packet->decryption.error && quic_is_pp_cipher_initialized(pp_cipher)) {
+            quic_decrypt_message(pp_cipher, tvb, offset, first_byte, pkn_len, quic_packet->packet_number, &quic_packet->decryption, pinfo->pool);
+        }
     }
 
-    expert_add_info_format(pinfo, tree, &ei_quic_coalesced_padding_data, "Dec Data len: %d", decryption->data_len);
-
     if (decryption->error) {
         expert_add_info_format(pinfo, ti, &ei_quic_decryption_failed,
                                "Decryption failed: %s", decryption->error);
     } else if (decryption->data_len) {
-        tvbuff_t *decrypted_tvb = tvb_new_child_real_data(tvb, decryption->data,
-                decryption->data_len, decryption->data_len);
-        add_new_data_source(pinfo, decrypted_tvb, "Decrypted QUIC");
+        tvbuff_t *decrypted_tvb;
+        if (decryption->plaintext) {
+            /* Zero-copy: the payload is part of the frame. */
+            decrypted_tvb = tvb_new_subset_length(tvb, offset, decryption->data_len);
+        } else {
+            decrypted_tvb = tvb_new_child_real_data(tvb, decryption->data,
+                    decryption->data_len, decryption->data_len);
+            add_new_data_source(pinfo, decrypted_tvb, "Decrypted QUIC");
+        }
+
+        quic_tap_info_t *tap_info = NULL;
+        if (have_tap_listener(quic_tap)) {
+            tap_info = wmem_new0(pinfo->pool, quic_tap_info_t);
+            tap_info->connection_number = quic_info->number;
+            tap_info->from_server = from_server;
+            tap_info->packet_number = quic_packet->packet_number;
+            tap_info->length = tvb_reported_length(tvb);
+            tap_info->payload_length = decryption->data_len;
+            tap_info->dcid = *dcid;
+            if (scid) {
+                tap_info->scid = *scid;
+            }
+            switch (quic_packet->packet_type) {
+                case QUIC_LPT_INITIAL:
+                    tap_info->packet_type = QUIC_TAP_PACKET_INITIAL;
+                    tap_info->pn_space = QUIC_PN_SPACE_INITIAL;
+                break;
+                case QUIC_LPT_HANDSHAKE:
+                    tap_info->packet_type = QUIC_TAP_PACKET_HANDSHAKE;
+                    tap_info->pn_space = QUIC_PN_SPACE_HANDSHAKE;
+                break;
+                case QUIC_LPT_0RTT:
+                    tap_info->packet_type = QUIC_TAP_PACKET_0RTT;
+                    tap_info->pn_space = QUIC_PN_SPACE_APPDATA;
+                break;
+                default:
+                    tap_info->packet_type = QUIC_TAP_PACKET_1RTT;
+                    tap_info->pn_space = QUIC_PN_SPACE_APPDATA;
+                break;
+            }
+        }
 
         guint decrypted_offset = 0;
         while (tvb_reported_length_remaining(decrypted_tvb, decrypted_offset) > 0) {
             if (quic_info->version == 0x51303530 || quic_info->version == 0x54303530 || quic_info->version == 0x54303531) {
                 decrypted_offset = dissect_gquic_frame_type(decrypted_tvb, pinfo, tree, decrypted_offset, pkn_len, quic_info->gquic_info);
             } else {
-                decrypted_offset = dissect_quic_frame_type(decrypted_tvb, pinfo, tree, decrypted_offset, quic_info, quic_packet, from_server);
+                decrypted_offset = dissect_quic_frame_type(decrypted_tvb, pinfo, tree, decrypted_offset, quic_info, quic_packet, from_server, tap_info);
             }
         }
+
+        if (tap_info) {
+            tap_queue_packet(quic_tap, pinfo, tap_info);
+        }
     } else if (quic_info->skip_decryption) {
         expert_add_info_format(pinfo, ti, &ei_quic_decryption_failed,
                                "Decryption skipped because keys are not available.");
@@ -3566,6 +4559,27 @@ quic_find_stateless_reset_token(packet_info *pinfo, tvbuff_t *tvb, gboolean *fro
     return NULL;
 }
 
+void
+quic_add_ack_delay_exponent(packet_info *pinfo, guint64 value)
+{
+    quic_datagram *dgram_info;
+    quic_info_data_t *conn;
+
+    /* Values above 20 are invalid, RFC 9000 Section 18.2 */
+    if (value > 20) {
+        return;
+    }
+    dgram_info = (quic_datagram *)p_get_proto_data(wmem_file_scope(), pinfo, proto_quic, 0);
+    if (dgram_info && dgram_info->conn) {
+        conn = dgram_info->conn;
+        if (dgram_info->from_server) {
+            conn->server_ack_delay_exponent = (guint8)value;
+        } else {
+            conn->client_ack_delay_exponent = (guint8)value;
+        }
+    }
+}
+
 void
 quic_add_stateless_reset_token(packet_info *pinfo, tvbuff_t *tvb, gint offset, const quic_cid_t *cid)
 {
@@ -3808,17 +4822,18 @@ dissect_quic_long_header(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tre
                 error = "Secrets are not available";
             }
         } else if (long_packet_type == QUIC_LPT_HANDSHAKE) {
-            // if (!quic_are_ciphers_initialized(ciphers)) {
-            //     quic_create_decoders(pinfo, conn, ciphers, from_server, TLS_SECRET_HANDSHAKE, &error);
-            // }
+            if (!quic_null_cipher && !quic_are_ciphers_initialized(ciphers)) {
+                quic_create_decoders(pinfo, conn, ciphers, from_server, TLS_SECRET_HANDSHAKE, &error);
+            }
+        }
+        if (quic_null_cipher) {
+            /* Unprotected payloads: missing secrets are not an error. */
+            error = NULL;
+            conn->cipher_algo = GCRY_CIPHER_AES128;
         }
-        error = NULL;
         if (!error) {
             guint32 pkn32 = 0;
-            
-            // int hp_cipher_algo = long_packet_type != QUIC_LPT_INITIAL && conn ? conn->cipher_algo : GCRY_CIPHER_AES128;
-            int hp_cipher_algo = GCRY_CIPHER_AES128;
-            conn->cipher_algo = GCRY_CIPHER_AES128;  // mycode
+            int hp_cipher_algo = long_packet_type != QUIC_LPT_INITIAL && conn ? conn->cipher_algo : GCRY_CIPHER_AES128;
 
             // PKN is after type(1) + version(4) + DCIL+DCID + SCIL+SCID
             guint pn_offset = 1 + 4 + 1 + dcid.len + 1 + scid.len;
@@ -3829,8 +4844,7 @@ dissect_quic_long_header(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tre
             pn_offset += tvb_get_varint(tvb, pn_offset, 8, &payload_length, ENC_VARINT_QUIC);
 
             // Assume failure unless proven otherwise.
-            // error = "Header deprotection failed";
-            error = NULL;
+            error = quic_null_cipher ? NULL : "Header deprotection failed";
             if (long_packet_type != QUIC_LPT_0RTT) {
                 if (quic_decrypt_header(tvb, pn_offset, &ciphers->hp_cipher, hp_cipher_algo, &first_byte, &pkn32, FALSE)) {
                     error = NULL;
@@ -3845,14 +4859,12 @@ dissect_quic_long_header(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tre
                 }
             }
             if (!error) {
-                if(long_packet_type == QUIC_LPT_INITIAL){ // mycode
-                    quic_packet->packet_number = *quic_max_packet_number(conn, from_server, first_byte);
+                if (quic_null_cipher && long_packet_type == QUIC_LPT_INITIAL) {
                     quic_packet->pkn_len = 1;
                     quic_packet->packet_number = 0;
-                }
-                else
+                } else {
                     quic_set_full_packet_number(conn, quic_packet, from_server, first_byte, pkn32);
-                
+                }
                 quic_packet->first_byte = first_byte;
             }
         }
@@ -3912,7 +4924,8 @@ dissect_quic_long_header(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tre
 
     if (conn) {
         quic_process_payload(tvb, pinfo, quic_tree, ti, offset,
-                             conn, quic_packet, from_server, &ciphers->pp_cipher, first_byte, quic_packet->pkn_len);
+                             conn, quic_packet, from_server, &ciphers->pp_cipher, first_byte, quic_packet->pkn_len,
+                             &dcid, &scid);
     }
     if (!PINFO_FD_VISITED(pinfo) && !quic_packet->decryption.error) {
         // Packet number is verified to be valid, remember it.
@@ -4028,7 +5041,8 @@ dissect_quic_short_header(tvbuff_t *tvb, packet_info *pinfo, proto_tree *quic_tr
 
     if (conn) {
         quic_process_payload(tvb, pinfo, quic_tree, ti, offset,
-                             conn, quic_packet, from_server, pp_cipher, first_byte, quic_packet->pkn_len);
+                             conn, quic_packet, from_server, pp_cipher, first_byte, quic_packet->pkn_len,
+                             &dcid, NULL);
         if (!PINFO_FD_VISITED(pinfo) && !quic_packet->decryption.error) {
             // Packet number is verified to be valid, remember it.
             *quic_max_packet_number(conn, from_server, first_byte) = quic_packet->packet_number;
@@ -4387,28 +5401,62 @@ dissect_quic(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree,
         offset += tvb_reported_length(next_tvb);
     } while (tvb_reported_length_remaining(tvb, offset));
 
+    if (!PINFO_FD_VISITED(pinfo)) {
+        quic_connection_update_activity(pinfo, dgram_info->conn);
+    }
+
     return offset;
 }
 
-static gboolean
-dissect_quic_short_header_heur(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
+/**
+ * Checks the first bytes of a UDP datagram of "len" (>= 13) bytes for
+ * something that could be QUIC, before any lookup is done.
+ */
+static inline gboolean
+quic_heur_prefilter(const guint8 *data, guint len)
 {
-    // If this capture does not contain QUIC, skip the more expensive checks.
-    if (quic_cid_lengths == 0) {
-        return FALSE;
+    if ((data[0] & 0x80) == 0) {
+        // Is this a SH packet after connection migration? SH (since draft -22):
+        // Flag (1) + DCID (1-20) + PKN (1/2/4) + encrypted payload (>= 16).
+        // Note that the Fixed bit might be greased, so only the DCID can
+        // tell: at least one known CID length must fit (if this capture
+        // contains QUIC at all).
+        if (len < 1 + 1 + 1 + 16) {
+            return FALSE;
+        }
+        guint max_cid_len = MIN(len - 1 - 1 - 16, QUIC_MAX_CID_LENGTH);
+        return (quic_cid_lengths & ((2U << max_cid_len) - 1)) != 0;
     }
 
-    // Is this a SH packet after connection migration? SH (since draft -22):
-    // Flag (1) + DCID (1-20) + PKN (1/2/4) + encrypted payload (>= 16).
-    if (tvb_captured_length(tvb) < 1 + 1 + 1 + 16) {
+    // Long header: Flag (1) + Version (4) + DCID length (1) + DCID +
+    // SCID length (1) + SCID. QUIC v1 and v2 are checked first.
+    guint32 version = pntoh32(data + 1);
+    if (version != 0x00000001 && version != 0x6b3343cf && quic_draft_version(version) < 11) {
         return FALSE;
     }
+    guint dcid_len = data[5];
+    return dcid_len <= QUIC_MAX_CID_LENGTH && 6 + dcid_len < len &&
+        data[6 + dcid_len] <= QUIC_MAX_CID_LENGTH;
+}
 
+static gboolean
+dissect_quic_short_header_heur(tvbuff_t *tvb, packet_info *pinfo, proto_tree *tree)
+{
     // DCID length is unknown, so extract the maximum and look for a match.
     quic_cid_t dcid = {.len = MIN(QUIC_MAX_CID_LENGTH, tvb_captured_length(tvb) - 1 - 1 - 16)};
     tvb_memcpy(tvb, dcid.cid, 1, dcid.len);
+
+    // A flow that was rejected before has no connection on its address/port
+    // tuple (see quic_heur_flow_forget), so only its DCID can match.
+    quic_heur_flow_t *flow = quic_heur_flow_slot(&pinfo->src, pinfo->srcport, &pinfo->dst, pinfo->destport);
+    if (quic_heur_flow_matches(flow, &pinfo->src, pinfo->srcport, &pinfo->dst, pinfo->destport) &&
+            !quic_cids_find_prefix(&dcid, NULL, FALSE)) {
+        return FALSE;
+    }
+
     gboolean from_server;
     if (!quic_connection_find(pinfo, QUIC_SHORT_PACKET, &dcid, &from_server)) {
+        quic_heur_flow_set(flow, pinfo);
         return FALSE;
     }
 
@@ -4431,45 +5479,25 @@ static gboolean dissect_quic_heur(tvbuff_t *tvb, packet_info *pinfo, proto_tree
      * Supported Version (multiple of 4 bytes.)
      */
     conversation_t *conversation = NULL;
-    int offset = 0;
-    guint8 flags, dcid, scid;
-    guint32 version;
-    gboolean is_quic = FALSE;
+    guint len = tvb_captured_length(tvb);
 
     /* Verify packet size  (Flag (1 byte) + Connection ID (8 bytes) + Version (4 bytes)) */
-    if (tvb_captured_length(tvb) < 13)
+    if (len < 13)
     {
         return FALSE;
     }
 
-    flags = tvb_get_guint8(tvb, offset);
-    /* Check if long Packet is set */
-    if((flags & 0x80) == 0) {
-        // Perhaps this is a short header, check it.
-        return dissect_quic_short_header_heur(tvb, pinfo, tree);
-    }
-    offset += 1;
-
-    // check for draft QUIC version (for draft -11 and newer)
-    version = tvb_get_ntohl(tvb, offset);
-    is_quic = (quic_draft_version(version) >= 11);
-    if (!is_quic) {
+    /* Reject most other UDP traffic on its first bytes: the version (for
+     * draft -11 and newer) and CID lengths of a long header, the DCID of a
+     * short header. */
+    if (!quic_heur_prefilter(tvb_get_ptr(tvb, 0, len), len)) {
         return FALSE;
     }
 
-    /* Check that CIDs lengths are valid */
-    offset += 4;
-    dcid = tvb_get_guint8(tvb, offset);
-    if (dcid > QUIC_MAX_CID_LENGTH) {
-        return FALSE;
-    }
-    offset += 1 + dcid;
-    if (offset >= (int)tvb_captured_length(tvb)) {
-        return FALSE;
-    }
-    scid = tvb_get_guint8(tvb, offset);
-    if (scid > QUIC_MAX_CID_LENGTH) {
-        return FALSE;
+    /* Check if long Packet is set */
+    if ((tvb_get_guint8(tvb, 0) & 0x80) == 0) {
+        // Perhaps this is a short header, check it.
+        return dissect_quic_short_header_heur(tvb, pinfo, tree);
     }
 
     /* Ok! */
@@ -4488,9 +5516,14 @@ quic_init(void)
     quic_connections = wmem_list_new(wmem_file_scope());
     quic_connections_count = 0;
     quic_initial_connections = wmem_map_new(wmem_file_scope(), quic_connection_hash, quic_connection_equal);
-    quic_client_connections = wmem_map_new(wmem_file_scope(), quic_connection_hash, quic_connection_equal);
-    quic_server_connections = wmem_map_new(wmem_file_scope(), quic_connection_hash, quic_connection_equal);
+    quic_cid_index = wmem_map_new(wmem_file_scope(), quic_connection_hash, quic_connection_equal);
     quic_cid_lengths = 0;
+    memset(quic_cid_length_counts, 0, sizeof(quic_cid_length_counts));
+    memset(quic_heur_cache, 0, sizeof(quic_heur_cache));
+    quic_lru_head = NULL;
+    quic_lru_tail = NULL;
+    quic_live_connections_count = 0;
+    quic_evicted_connections_count = 0;
 }
 
 /** Release QUIC dissection state on closing a capture file. */
@@ -4499,8 +5532,7 @@ quic_cleanup(void)
 {
     wmem_list_foreach(quic_connections, quic_connection_destroy, NULL);
     quic_initial_connections = NULL;
-    quic_client_connections = NULL;
-    quic_server_connections = NULL;
+    quic_cid_index = NULL;
 }
 
 /* Follow QUIC Stream functionality {{{ */
@@ -4509,7 +5541,7 @@ quic_streams_add(packet_info *pinfo, quic_info_data_t *quic_info, guint64 stream
 {
     /* List: ordered list of Stream IDs in this connection */
     if (!quic_info->streams_list) {
-        quic_info->streams_list = wmem_list_new(wmem_file_scope());
+        quic_info->streams_list = wmem_list_new(quic_connection_state_pool(quic_info));
     }
     if (!wmem_list_find(quic_info->streams_list, GUINT_TO_POINTER(stream_id))) {
         wmem_list_insert_sorted(quic_info->streams_list, GUINT_TO_POINTER(stream_id),
@@ -4519,11 +5551,11 @@ quic_streams_add(packet_info *pinfo, quic_info_data_t *quic_info, guint64 stream
     /* Map: first Stream ID for each UDP payload */
     quic_follow_stream *stream;
     if (!quic_info->streams_map) {
-        quic_info->streams_map = wmem_map_new(wmem_file_scope(), g_direct_hash, g_direct_equal);
+        quic_info->streams_map = wmem_map_new(quic_connection_state_pool(quic_info), g_direct_hash, g_direct_equal);
     }
     stream = wmem_map_lookup(quic_info->streams_map, GUINT_TO_POINTER(pinfo->num));
     if (!stream) {
-        stream = wmem_new0(wmem_file_scope(), quic_follow_stream);
+        stream = wmem_new0(quic_connection_state_pool(quic_info), quic_follow_stream);
         stream->num = pinfo->num;
         stream->stream_id = stream_id;
         wmem_map_insert(quic_info->streams_map, GUINT_TO_POINTER(stream->num), stream);
@@ -5453,10 +6485,18 @@ proto_register_quic(void)
           { "quic.overlap", PI_SEQUENCE, PI_NOTE,
             "This QUIC frame overlaps a previous frame in the stream", EXPFILL }
         },
+        { &ei_quic_out_of_order,
+          { "quic.out_of_order", PI_SEQUENCE, PI_NOTE,
+            "This QUIC frame follows a gap in the stream, its data is buffered", EXPFILL }
+        },
         { &ei_quic_data_after_forcing_vn,
           { "quic.data_after_forcing_vn", PI_PROTOCOL, PI_NOTE,
             "Unexpected data on a Forcing Version Negotiation paket", EXPFILL }
         },
+        { &ei_quic_state_evicted,
+          { "quic.state_evicted", PI_UNDECODED, PI_NOTE,
+            "Connection state was released, data is not reassembled", EXPFILL }
+        },
     };
 
     proto_quic = proto_register_protocol("QUIC IETF", "QUIC", "quic");
@@ -5474,6 +6514,31 @@ proto_register_quic(void)
         "passing them to the TLS handshake dissector.",
         &quic_crypto_out_of_order);
 
+    prefs_register_bool_preference(quic_module, "null_cipher",
+        "Payloads are not encrypted (null cipher)",
+        "Whether QUIC packet payloads are sent in the clear. When disabled, "
+        "payloads are decrypted with the TLS 1.3 secrets from the TLS Key Log File.",
+        &quic_null_cipher);
+    prefs_register_bool_preference(quic_module, "evict_state",
+        "Release state of closed and idle connections",
+        "Whether the STREAM and CRYPTO reassembly state of a connection should be "
+        "released once it is closed, idle, or the connection limit is reached, "
+        "and reassembled STREAM data once it was delivered. "
+        "Later packets are still attributed to the connection, but their data is "
+        "not reassembled anymore. Intended for long running single pass (live) "
+        "captures, the state is not available for a second pass either.",
+        &quic_evict_state);
+    prefs_register_uint_preference(quic_module, "evict_idle_timeout",
+        "Idle timeout (seconds)",
+        "Release the state of connections without packets for this long "
+        "(0 to keep idle connections).",
+        10, &quic_evict_idle_timeout);
+    prefs_register_uint_preference(quic_module, "evict_max_connections",
+        "Maximum connections with state",
+        "Release the state of the least recently active connections when more "
+        "connections are tracked (0 for no limit).",
+        10, &quic_evict_max_connections);
+
     quic_handle = register_dissector("quic", dissect_quic, proto_quic);
 
     register_init_routine(quic_init);
@@ -5507,6 +6572,7 @@ proto_reg_handoff_quic(void)
     dissector_add_uint_with_preference("udp.port", 0, quic_handle);
     heur_dissector_add("udp", dissect_quic_heur, "QUIC", "quic", proto_quic, HEURISTIC_ENABLE);
     quic_follow_tap = register_tap("quic_follow");
+    quic_tap = register_tap("quic");
 }
 
 /*
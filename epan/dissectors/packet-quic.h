@@ -25,7 +25,7 @@ extern "C" {
 typedef struct _quic_stream_info {
     guint64     stream_id;      /**< 62-bit Stream ID. */
     guint64     stream_offset;  /**< 62-bit stream offset. */
-    guint32     offset;         /**< Offset within the stream (different for reassembled data). */
+    guint64     offset;         /**< Offset within the stream (different for reassembled data). */
     struct quic_info_data *quic_info;    /**< Opaque data structure to find the QUIC session. */
     gboolean    from_server;
 } quic_stream_info;
@@ -53,6 +53,63 @@ typedef struct quic_cid {
 #define QUIC_STREAM_CLIENT_UNI  2
 #define QUIC_STREAM_SERVER_UNI  3
 
+/** Maximum number of ACK Ranges of an ACK frame that are passed to the tap. */
+#define QUIC_TAP_MAX_ACK_RANGES 32
+
+/** Packet number spaces. */
+#define QUIC_PN_SPACE_INITIAL   0
+#define QUIC_PN_SPACE_HANDSHAKE 1
+#define QUIC_PN_SPACE_APPDATA   2
+
+typedef struct _quic_ack_range {
+    guint64     smallest;       /**< Smallest acknowledged packet number. */
+    guint64     largest;        /**< Largest acknowledged packet number. */
+} quic_ack_range_t;
+
+/** Maximum number of frames of a packet that are passed to the tap. */
+#define QUIC_TAP_MAX_FRAMES     32
+
+/** Packet types passed to the tap. */
+#define QUIC_TAP_PACKET_INITIAL     0
+#define QUIC_TAP_PACKET_0RTT        1
+#define QUIC_TAP_PACKET_HANDSHAKE   2
+#define QUIC_TAP_PACKET_1RTT        3
+
+/** A frame of a packet. Fields which do not apply to the frame type are zero. */
+typedef struct _quic_tap_frame {
+    guint64     frame_type;
+    guint64     stream_id;      /**< STREAM, RESET_STREAM, STOP_SENDING, MAX_STREAM_DATA. */
+    guint64     offset;         /**< STREAM, CRYPTO. */
+    guint64     length;         /**< Data length of STREAM and CRYPTO, length of PADDING. */
+    guint64     value;          /**< Error code of RESET_STREAM, STOP_SENDING and CONNECTION_CLOSE, maximum of MAX_DATA and MAX_STREAM_DATA. */
+    gboolean    fin;            /**< STREAM */
+} quic_tap_frame_t;
+
+/**
+ * Information passed to the "quic" tap for every QUIC packet whose packet
+ * number could be recovered.
+ */
+typedef struct _quic_tap_info {
+    guint32     connection_number;  /**< Same as quic.connection.number. */
+    gboolean    from_server;
+    guint8      packet_type;    /**< QUIC_TAP_PACKET_* */
+    guint8      pn_space;       /**< QUIC_PN_SPACE_* */
+    guint64     packet_number;  /**< Reconstructed full packet number. */
+    guint32     length;         /**< Length of the QUIC packet. */
+    guint32     payload_length; /**< Length of the decrypted payload. */
+    quic_cid_t  dcid;
+    quic_cid_t  scid;           /**< Only for long header packets. */
+    gboolean    ack_eliciting;  /**< Contains frames other than ACK, PADDING and CONNECTION_CLOSE. */
+    gboolean    handshake_done; /**< Contains a HANDSHAKE_DONE frame. */
+    gboolean    has_ack;        /**< Contains an ACK frame; the fields below are valid. */
+    guint64     ack_delay_us;   /**< ACK Delay, scaled by the ack_delay_exponent of the sender (microseconds). */
+    guint       ack_range_count;    /**< Number of valid items in ack_ranges, largest first. */
+    quic_ack_range_t ack_ranges[QUIC_TAP_MAX_ACK_RANGES];
+    guint       frame_count;    /**< Number of valid items in frames. */
+    gboolean    frames_truncated;   /**< More than QUIC_TAP_MAX_FRAMES frames. */
+    quic_tap_frame_t frames[QUIC_TAP_MAX_FRAMES];
+} quic_tap_info_t;
+
 /** Set/Get protocol-specific data for the QUIC STREAM. */
 
 void    quic_stream_add_proto_data(struct _packet_info *pinfo, quic_stream_info *stream_info, void *proto_data);
@@ -61,6 +118,9 @@ void   *quic_stream_get_proto_data(struct _packet_info *pinfo, quic_stream_info
 /** Returns the number of items for quic.connection.number. */
 WS_DLL_PUBLIC guint32 get_quic_connections_count(void);
 
+/** Returns the number of connections whose stream state was released (see the "evict_state" preference). */
+WS_DLL_PUBLIC guint32 get_quic_evicted_connections_count(void);
+
 typedef struct gquic_info_data {
     guint8 version;
     gboolean version_valid;
@@ -78,6 +138,8 @@ quic_add_connection(packet_info *pinfo, const quic_cid_t *cid);
 void
 quic_add_loss_bits(packet_info *pinfo, guint64 value);
 void
+quic_add_ack_delay_exponent(packet_info *pinfo, guint64 value);
+void
 quic_add_stateless_reset_token(packet_info *pinfo, tvbuff_t *tvb, gint offset, const quic_cid_t *cid);
 void
 quic_proto_tree_add_version(tvbuff_t *tvb, proto_tree *tree, int hfindex, guint offset);
@@ -7960,8 +7960,11 @@ ssl_dissect_hnd_hello_ext_quic_transport_parameters(ssl_common_dissect_t *hf, tv
             break;
             case SSL_HND_QUIC_TP_ACK_DELAY_EXPONENT:
                 proto_tree_add_item_ret_varint(parameter_tree, hf->hf.hs_ext_quictp_parameter_ack_delay_exponent,
-                                               tvb, offset, -1, ENC_VARINT_QUIC, NULL, &len);
+                                               tvb, offset, -1, ENC_VARINT_QUIC, &value, &len);
                 /*TODO display multiplier (x8) and expert info about invalid value (> 20) ? */
+                if (len > 0) {
+                    quic_add_ack_delay_exponent(pinfo, value);
+                }
                 offset += len;
             break;
             case SSL_HND_QUIC_TP_MAX_ACK_DELAY:
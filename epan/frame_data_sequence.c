@@ -10,6 +10,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include <glib.h>
 
 #include <epan/packet.h>
@@ -29,9 +31,82 @@
 #define LOG2_NODES_PER_LEVEL    10
 #define NODES_PER_LEVEL         (1<<LOG2_NODES_PER_LEVEL)
 
+/*
+ * The compact store keeps the frequently used fields of the frames in
+ * packed columns, in chunks of NODES_PER_LEVEL frames. File offsets and
+ * time stamps are stored as deltas from the first frame of the chunk and
+ * the bit fields are packed into 16 bits, which takes 26 bytes (and one bit)
+ * per frame instead of sizeof(frame_data).
+ *
+ * Per frame protocol data and dependent frames are kept in a pointer column
+ * that a chunk only allocates once one of its frames has either. The slot
+ * of a frame holds its pfd list or, if the frame has dependent frames
+ * (FDC_DEPENDENT), a frame_data_side with both. Nearly every frame of a TCP,
+ * UDP or QUIC capture has protocol data, so its chunks take 8 bytes more
+ * per frame.
+ *
+ * A full frame_data is only built ("materialized") for the frames returned
+ * by frame_data_sequence_add() and frame_data_sequence_find(). It stays
+ * valid until it is given back with frame_data_sequence_release(), which
+ * packs it again unless it has state that the columns cannot hold (a color
+ * filter, a time shift, ...). Frames with such state stay materialized.
+ * The materialized frames of a chunk are found through another pointer
+ * column, which is freed again when none of them is left, and released
+ * entries are reused, so sequential access does not allocate per frame.
+ */
+#define FDC_PASSED_DFILTER          0x0001
+#define FDC_DEPENDENT_OF_DISPLAYED  0x0002
+#define FDC_ENCODING                0x0004
+#define FDC_VISITED                 0x0008
+#define FDC_MARKED                  0x0010
+#define FDC_REF_TIME                0x0020
+#define FDC_IGNORED                 0x0040
+#define FDC_HAS_TS                  0x0080
+#define FDC_HAS_MODIFIED_BLOCK      0x0100
+#define FDC_NEED_COLORIZE           0x0200
+#define FDC_OWN_REF                 0x0400  /* frame_ref_num is 0 */
+#define FDC_DEPENDENT               0x0800  /* The side slot is a frame_data_side */
+#define FDC_TSPREC_SHIFT            12      /* tsprec in the upper 4 bits */
+
+#define NS_PER_S                    G_GINT64_CONSTANT(1000000000)
+
+/* Number of released frame_data_materialized kept for reuse */
+#define SPARE_ENTRIES_MAX           64
+
+typedef struct {
+  frame_data   fdata;           /* Must be first */
+  guint        refs;            /* Number of unreleased add/find results */
+} frame_data_materialized;
+
+typedef struct {
+  GSList      *pfd;
+  GHashTable  *dependent_frames;
+} frame_data_side;
+
+typedef struct {
+  gint64       file_off_base;   /* File offset of the first frame */
+  nstime_t     ts_base;         /* Time stamp of the first frame */
+  guint32      frame_ref_num;   /* Reference frame of the frames without FDC_OWN_REF */
+  gboolean     frame_ref_set;   /* frame_ref_num is valid */
+  frame_data_materialized **materialized; /* NULL if no frame is materialized */
+  guint        materialized_count;
+  gpointer    *side;            /* pfd or frame_data_side of packed frames, NULL if there are none */
+  guint32      file_off_delta[NODES_PER_LEVEL];
+  guint32      pkt_len[NODES_PER_LEVEL];
+  guint32      cum_bytes[NODES_PER_LEVEL];
+  gint64       ts_delta[NODES_PER_LEVEL];       /* Nanoseconds after ts_base */
+  guint16      cap_len_diff[NODES_PER_LEVEL];   /* pkt_len - cap_len */
+  guint16      prev_dis_delta[NODES_PER_LEVEL]; /* num - prev_dis_num, 0 if there is none */
+  guint16      flags[NODES_PER_LEVEL];          /* FDC_ */
+} frame_data_chunk;
+
 struct _frame_data_sequence {
   guint32      count;           /* Total number of frames */
   void        *ptree_root;      /* Pointer to the root node */
+  gboolean     compact;         /* Frames are in "chunks" rather than the tree */
+  GPtrArray   *chunks;          /* frame_data_chunk for every NODES_PER_LEVEL frames */
+  GPtrArray   *spare;           /* Released frame_data_materialized for reuse */
+  nstime_t     ts_scratch;      /* Returned by frame_data_sequence_find_ts */
 };
 
 /*
@@ -52,12 +127,328 @@ new_frame_data_sequence(void)
 {
   frame_data_sequence *fds;
 
-  fds = (frame_data_sequence *)g_malloc(sizeof *fds);
+  fds = (frame_data_sequence *)g_malloc0(sizeof *fds);
   fds->count = 0;
   fds->ptree_root = NULL;
   return fds;
 }
 
+frame_data_sequence *
+new_frame_data_sequence_compact(void)
+{
+  frame_data_sequence *fds;
+
+  fds = new_frame_data_sequence();
+  fds->compact = TRUE;
+  fds->chunks = g_ptr_array_new();
+  fds->spare = g_ptr_array_new();
+  return fds;
+}
+
+static inline frame_data_materialized *
+compact_get_materialized(const frame_data_chunk *chunk, guint idx)
+{
+  return chunk->materialized ? chunk->materialized[idx] : NULL;
+}
+
+static void
+compact_set_materialized(frame_data_chunk *chunk, guint idx, frame_data_materialized *entry)
+{
+  if (entry) {
+    if (!chunk->materialized)
+      chunk->materialized = g_new0(frame_data_materialized *, NODES_PER_LEVEL);
+    chunk->materialized[idx] = entry;
+    chunk->materialized_count++;
+  } else {
+    chunk->materialized[idx] = NULL;
+    if (--chunk->materialized_count == 0) {
+      g_free(chunk->materialized);
+      chunk->materialized = NULL;
+    }
+  }
+}
+
+static frame_data_materialized *
+compact_entry_new(frame_data_sequence *fds)
+{
+  if (fds->spare->len > 0)
+    return (frame_data_materialized *)g_ptr_array_remove_index_fast(fds->spare, fds->spare->len - 1);
+  return g_new(frame_data_materialized, 1);
+}
+
+static void
+compact_entry_free(frame_data_sequence *fds, frame_data_materialized *entry)
+{
+  if (fds->spare->len < SPARE_ENTRIES_MAX)
+    g_ptr_array_add(fds->spare, entry);
+  else
+    g_free(entry);
+}
+
+/*
+ * Stores a frame in the columns of its chunk and moves its per frame
+ * protocol data and dependent frames to the side column. Returns FALSE if
+ * the frame has state or values that the columns cannot hold.
+ */
+static gboolean
+compact_pack(frame_data_chunk *chunk, guint idx, frame_data *fdata)
+{
+  gint64 secs_delta;
+  guint16 flags;
+
+  if (fdata->color_filter || fdata->subnum || fdata->tcp_snd_manual_analysis ||
+      fdata->shift_offset.secs || fdata->shift_offset.nsecs)
+    return FALSE;
+
+  if (fdata->file_off < chunk->file_off_base ||
+      fdata->file_off - chunk->file_off_base > G_MAXUINT32)
+    return FALSE;
+
+  if (fdata->cap_len > fdata->pkt_len || fdata->pkt_len - fdata->cap_len > G_MAXUINT16)
+    return FALSE;
+
+  if (fdata->prev_dis_num >= fdata->num || fdata->num - fdata->prev_dis_num > G_MAXUINT16)
+    return FALSE;
+
+  /* The delta in nanoseconds must fit in a gint64 (about 292 years). */
+  secs_delta = (gint64)fdata->abs_ts.secs - (gint64)chunk->ts_base.secs;
+  if (secs_delta > G_MAXINT64 / NS_PER_S - 1 || secs_delta < G_MININT64 / NS_PER_S + 1 ||
+      fdata->abs_ts.nsecs < 0 || fdata->abs_ts.nsecs >= NS_PER_S)
+    return FALSE;
+
+  flags = (guint16)(fdata->tsprec << FDC_TSPREC_SHIFT);
+  if (fdata->frame_ref_num == 0) {
+    flags |= FDC_OWN_REF;
+  } else if (!chunk->frame_ref_set) {
+    chunk->frame_ref_num = fdata->frame_ref_num;
+    chunk->frame_ref_set = TRUE;
+  } else if (chunk->frame_ref_num != fdata->frame_ref_num) {
+    return FALSE;
+  }
+
+  if (fdata->passed_dfilter)          flags |= FDC_PASSED_DFILTER;
+  if (fdata->dependent_of_displayed)  flags |= FDC_DEPENDENT_OF_DISPLAYED;
+  if (fdata->encoding)                flags |= FDC_ENCODING;
+  if (fdata->visited)                 flags |= FDC_VISITED;
+  if (fdata->marked)                  flags |= FDC_MARKED;
+  if (fdata->ref_time)                flags |= FDC_REF_TIME;
+  if (fdata->ignored)                 flags |= FDC_IGNORED;
+  if (fdata->has_ts)                  flags |= FDC_HAS_TS;
+  if (fdata->has_modified_block)      flags |= FDC_HAS_MODIFIED_BLOCK;
+  if (fdata->need_colorize)           flags |= FDC_NEED_COLORIZE;
+
+  if (fdata->pfd || fdata->dependent_frames) {
+    if (!chunk->side)
+      chunk->side = g_new0(gpointer, NODES_PER_LEVEL);
+    if (fdata->dependent_frames) {
+      frame_data_side *side = g_new(frame_data_side, 1);
+
+      side->pfd = fdata->pfd;
+      side->dependent_frames = fdata->dependent_frames;
+      chunk->side[idx] = side;
+      flags |= FDC_DEPENDENT;
+    } else {
+      chunk->side[idx] = fdata->pfd;
+    }
+    fdata->pfd = NULL;
+    fdata->dependent_frames = NULL;
+  }
+
+  chunk->file_off_delta[idx] = (guint32)(fdata->file_off - chunk->file_off_base);
+  chunk->pkt_len[idx] = fdata->pkt_len;
+  chunk->cum_bytes[idx] = fdata->cum_bytes;
+  chunk->ts_delta[idx] = secs_delta * NS_PER_S + (fdata->abs_ts.nsecs - chunk->ts_base.nsecs);
+  chunk->cap_len_diff[idx] = (guint16)(fdata->pkt_len - fdata->cap_len);
+  chunk->prev_dis_delta[idx] = fdata->prev_dis_num ? (guint16)(fdata->num - fdata->prev_dis_num) : 0;
+  chunk->flags[idx] = flags;
+  return TRUE;
+}
+
+static void
+compact_unpack_ts(const frame_data_chunk *chunk, guint idx, nstime_t *ts)
+{
+  gint64 nsecs = chunk->ts_delta[idx] + chunk->ts_base.nsecs;
+  gint64 secs = nsecs / NS_PER_S;
+
+  nsecs %= NS_PER_S;
+  if (nsecs < 0) {
+    nsecs += NS_PER_S;
+    secs--;
+  }
+  ts->secs = (time_t)(chunk->ts_base.secs + secs);
+  ts->nsecs = (int)nsecs;
+}
+
+/*
+ * Builds the frame_data of a packed frame. Its protocol data and dependent
+ * frames are moved out of the side column, the materialized frame owns them
+ * until it is packed again.
+ */
+static void
+compact_unpack(frame_data_chunk *chunk, guint idx, guint32 num, frame_data *fdata)
+{
+  guint16 flags = chunk->flags[idx];
+
+  memset(fdata, 0, sizeof *fdata);
+  fdata->num = num;
+  fdata->pkt_len = chunk->pkt_len[idx];
+  fdata->cap_len = chunk->pkt_len[idx] - chunk->cap_len_diff[idx];
+  fdata->cum_bytes = chunk->cum_bytes[idx];
+  fdata->file_off = chunk->file_off_base + chunk->file_off_delta[idx];
+  fdata->passed_dfilter = !!(flags & FDC_PASSED_DFILTER);
+  fdata->dependent_of_displayed = !!(flags & FDC_DEPENDENT_OF_DISPLAYED);
+  fdata->encoding = !!(flags & FDC_ENCODING);
+  fdata->visited = !!(flags & FDC_VISITED);
+  fdata->marked = !!(flags & FDC_MARKED);
+  fdata->ref_time = !!(flags & FDC_REF_TIME);
+  fdata->ignored = !!(flags & FDC_IGNORED);
+  fdata->has_ts = !!(flags & FDC_HAS_TS);
+  fdata->has_modified_block = !!(flags & FDC_HAS_MODIFIED_BLOCK);
+  fdata->need_colorize = !!(flags & FDC_NEED_COLORIZE);
+  fdata->tsprec = flags >> FDC_TSPREC_SHIFT;
+  compact_unpack_ts(chunk, idx, &fdata->abs_ts);
+  fdata->frame_ref_num = (flags & FDC_OWN_REF) ? 0 : chunk->frame_ref_num;
+  fdata->prev_dis_num = chunk->prev_dis_delta[idx] ? num - chunk->prev_dis_delta[idx] : 0;
+
+  if (chunk->side && chunk->side[idx]) {
+    if (flags & FDC_DEPENDENT) {
+      frame_data_side *side = (frame_data_side *)chunk->side[idx];
+
+      fdata->pfd = side->pfd;
+      fdata->dependent_frames = side->dependent_frames;
+      g_free(side);
+    } else {
+      fdata->pfd = (GSList *)chunk->side[idx];
+    }
+    chunk->side[idx] = NULL;
+  }
+}
+
+static frame_data *
+compact_add(frame_data_sequence *fds, frame_data *fdata)
+{
+  frame_data_chunk *chunk;
+  frame_data_materialized *entry;
+  guint idx = LEAF_INDEX(fds->count);
+
+  if (idx == 0) {
+    chunk = g_new0(frame_data_chunk, 1);
+    chunk->file_off_base = fdata->file_off;
+    chunk->ts_base = fdata->abs_ts;
+    g_ptr_array_add(fds->chunks, chunk);
+  } else {
+    chunk = (frame_data_chunk *)g_ptr_array_index(fds->chunks, fds->count >> LOG2_NODES_PER_LEVEL);
+  }
+
+  /* The frame is packed when the caller releases it. */
+  entry = compact_entry_new(fds);
+  entry->fdata = *fdata;
+  entry->refs = 1;
+  compact_set_materialized(chunk, idx, entry);
+
+  fds->count++;
+  return &entry->fdata;
+}
+
+static frame_data *
+compact_find(frame_data_sequence *fds, guint32 index)
+{
+  frame_data_chunk *chunk = (frame_data_chunk *)g_ptr_array_index(fds->chunks, index >> LOG2_NODES_PER_LEVEL);
+  guint idx = LEAF_INDEX(index);
+  frame_data_materialized *entry;
+
+  entry = compact_get_materialized(chunk, idx);
+  if (!entry) {
+    entry = compact_entry_new(fds);
+    compact_unpack(chunk, idx, index + 1, &entry->fdata);
+    entry->refs = 0;
+    compact_set_materialized(chunk, idx, entry);
+  }
+  entry->refs++;
+  return &entry->fdata;
+}
+
+void
+frame_data_sequence_release(frame_data_sequence *fds, frame_data *fdata)
+{
+  frame_data_materialized *entry = (frame_data_materialized *)fdata;
+  frame_data_chunk *chunk;
+  guint32 index;
+
+  if (fds == NULL || !fds->compact || fdata == NULL)
+    return;
+
+  if (entry->refs > 0)
+    entry->refs--;
+  if (entry->refs > 0)
+    return;
+
+  index = fdata->num - 1;
+  chunk = (frame_data_chunk *)g_ptr_array_index(fds->chunks, index >> LOG2_NODES_PER_LEVEL);
+  if (!compact_pack(chunk, LEAF_INDEX(index), fdata)) {
+    /* Keep it materialized. */
+    return;
+  }
+  compact_set_materialized(chunk, LEAF_INDEX(index), NULL);
+  compact_entry_free(fds, entry);
+}
+
+const nstime_t *
+frame_data_sequence_find_ts(frame_data_sequence *fds, guint32 num)
+{
+  frame_data_chunk *chunk;
+  frame_data_materialized *entry;
+  frame_data *fdata;
+
+  if (fds == NULL || num == 0 || num > fds->count)
+    return NULL;
+
+  if (!fds->compact) {
+    fdata = frame_data_sequence_find(fds, num);
+    return &fdata->abs_ts;
+  }
+
+  chunk = (frame_data_chunk *)g_ptr_array_index(fds->chunks, (num - 1) >> LOG2_NODES_PER_LEVEL);
+  entry = compact_get_materialized(chunk, LEAF_INDEX(num - 1));
+  if (entry)
+    return &entry->fdata.abs_ts;
+  compact_unpack_ts(chunk, LEAF_INDEX(num - 1), &fds->ts_scratch);
+  return &fds->ts_scratch;
+}
+
+static void
+compact_free_chunk(frame_data_chunk *chunk)
+{
+  guint i;
+
+  if (chunk->materialized) {
+    for (i = 0; i < NODES_PER_LEVEL; i++) {
+      if (chunk->materialized[i]) {
+        frame_data_destroy(&chunk->materialized[i]->fdata);
+        g_free(chunk->materialized[i]);
+      }
+    }
+    g_free(chunk->materialized);
+  }
+  if (chunk->side) {
+    for (i = 0; i < NODES_PER_LEVEL; i++) {
+      if (!chunk->side[i])
+        continue;
+      if (chunk->flags[i] & FDC_DEPENDENT) {
+        frame_data_side *side = (frame_data_side *)chunk->side[i];
+
+        g_slist_free(side->pfd);
+        g_hash_table_destroy(side->dependent_frames);
+        g_free(side);
+      } else {
+        g_slist_free((GSList *)chunk->side[i]);
+      }
+    }
+    g_free(chunk->side);
+  }
+  g_free(chunk);
+}
+
 /*
  * Add a new frame_data structure to a frame_data_sequence.
  */
@@ -70,6 +461,9 @@ frame_data_sequence_add(frame_data_sequence *fds, frame_data *fdata)
   frame_data ****level3;
   frame_data *node;
 
+  if (fds->compact)
+    return compact_add(fds, fdata);
+
   /*
    * The current value of fds->count is the index value for the new frame,
    * because the index value for a frame is the frame number - 1, and
@@ -195,6 +589,9 @@ frame_data_sequence_find(frame_data_sequence *fds, guint32 num)
     return NULL;
   }
 
+  if (fds->compact)
+    return compact_find(fds, num);
+
   if (fds->count <= NODES_PER_LEVEL) {
     /* It's a 1-level tree. */
     leaf = (frame_data *)fds->ptree_root;
@@ -281,6 +678,19 @@ free_frame_data_sequence(frame_data_sequence *fds)
 {
   guint   levels;
 
+  if (fds->compact) {
+    guint i;
+
+    for (i = 0; i < fds->chunks->len; i++)
+      compact_free_chunk((frame_data_chunk *)g_ptr_array_index(fds->chunks, i));
+    g_ptr_array_free(fds->chunks, TRUE);
+    for (i = 0; i < fds->spare->len; i++)
+      g_free(g_ptr_array_index(fds->spare, i));
+    g_ptr_array_free(fds->spare, TRUE);
+    g_free(fds);
+    return;
+  }
+
   /* calculate how many levels we have */
   if (fds->count == 0) {
     /* The tree is empty; there are no levels. */
@@ -329,6 +739,7 @@ find_and_mark_frame_depended_upon(gpointer key, gpointer value _U_, gpointer use
         g_hash_table_foreach(dependent_fd->dependent_frames, find_and_mark_frame_depended_upon, frames);
       }
     }
+    frame_data_sequence_release(frames, dependent_fd);
   }
 }
 
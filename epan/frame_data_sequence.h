@@ -19,6 +19,19 @@ typedef struct _frame_data_sequence frame_data_sequence;
 
 WS_DLL_PUBLIC frame_data_sequence *new_frame_data_sequence(void);
 
+/*
+ * Create a frame_data_sequence that keeps most frames in a packed form,
+ * for programs that only need a few frames at a time. Every frame_data
+ * returned by frame_data_sequence_add() or frame_data_sequence_find()
+ * must be given back with frame_data_sequence_release() once it is no
+ * longer used, the pointer is not valid afterwards.
+ *
+ * Only two-pass TShark uses it. Wireshark (file.c) keeps a frame_data
+ * pointer in every packet list row and in many dialogs for as long as the
+ * file is open, so it cannot release frames and keeps the full store.
+ */
+WS_DLL_PUBLIC frame_data_sequence *new_frame_data_sequence_compact(void);
+
 WS_DLL_PUBLIC frame_data *frame_data_sequence_add(frame_data_sequence *fds,
     frame_data *fdata);
 
@@ -28,6 +41,22 @@ WS_DLL_PUBLIC frame_data *frame_data_sequence_add(frame_data_sequence *fds,
 WS_DLL_PUBLIC frame_data *frame_data_sequence_find(frame_data_sequence *fds,
     guint32 num);
 
+/*
+ * Release a frame_data returned by frame_data_sequence_add() or
+ * frame_data_sequence_find(). Does nothing unless the sequence was created
+ * with new_frame_data_sequence_compact().
+ */
+WS_DLL_PUBLIC void frame_data_sequence_release(frame_data_sequence *fds,
+    frame_data *fdata);
+
+/*
+ * Find the absolute time stamp of the specified frame number, without
+ * keeping the frame_data. With a compact sequence, the result is only
+ * valid until the next call.
+ */
+WS_DLL_PUBLIC const nstime_t *frame_data_sequence_find_ts(frame_data_sequence *fds,
+    guint32 num);
+
 /*
  * Free a frame_data_sequence and all the frame_data structures in it.
  */
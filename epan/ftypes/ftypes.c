@@ -10,6 +10,7 @@
 
 #include "ftypes-int.h"
 
+#include <wsutil/bits_count_ones.h>
 #include <wsutil/ws_assert.h>
 
 /* Keep track of ftype_t's via their ftenum number */
@@ -984,6 +985,21 @@ fvalue_get_ipv6(fvalue_t *fv)
 	return fv->ftype->get_value.get_value_ipv6(fv);
 }
 
+unsigned
+fvalue_get_ip_prefix(const fvalue_t *fv, guint8 *addr)
+{
+	guint32 addr_net;
+
+	if (fv->ftype->ftype == FT_IPv4) {
+		addr_net = g_htonl(fv->value.ipv4.addr);
+		memcpy(addr, &addr_net, 4);
+		return ws_count_ones(fv->value.ipv4.nmask);
+	}
+	ws_assert(fv->ftype->ftype == FT_IPv6);
+	memcpy(addr, fv->value.ipv6.addr.bytes, 16);
+	return MIN(fv->value.ipv6.prefix, 128);
+}
+
 ft_bool_t
 fvalue_eq(const fvalue_t *a, const fvalue_t *b)
 {
@@ -448,6 +448,11 @@ fvalue_get_floating(fvalue_t *fv);
 WS_DLL_PUBLIC const ws_in6_addr *
 fvalue_get_ipv6(fvalue_t *fv);
 
+/* Copies the address of an FT_IPv4 or FT_IPv6 value to addr, in network
+ * byte order (4 or 16 bytes), and returns the prefix length in bits. */
+unsigned
+fvalue_get_ip_prefix(const fvalue_t *fv, guint8 *addr);
+
 ft_bool_t
 fvalue_eq(const fvalue_t *a, const fvalue_t *b);
 
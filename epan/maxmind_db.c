@@ -41,6 +41,7 @@ static mmdb_lookup_t mmdb_not_found;
 #include <wsutil/ws_pipe.h>
 #include <wsutil/strtoi.h>
 #include <wsutil/glib-compat.h>
+#include <wsutil/pint.h>
 
 // To do:
 // - Add RBL lookups? Along with the "is this a spammer" information that most RBL databases
@@ -107,6 +108,8 @@ UAT_DIRECTORYNAME_CB_DEF(maxmind_mod, path, maxmind_db_path_t)
 static GPtrArray *mmdb_file_arr; // .mmdb files
 
 static gboolean resolve_synchronously = FALSE;
+static gboolean resolve_in_process = FALSE;
+static gboolean started_in_process = FALSE;
 
 static void mmdb_resolve_stop(void);
 
@@ -152,6 +155,501 @@ static void init_lookup(mmdb_lookup_t *lookup) {
     *lookup = empty_lookup;
 }
 
+/*
+ * In-process lookups.
+ *
+ * libmaxminddb is not GPL-2 compatible, so we read databases ourselves
+ * when nameres.maxmind_in_process is set. The format is described at
+ * https://maxmind.github.io/MaxMind-DB/. A database is a binary tree
+ * that is walked one address bit at a time, followed by a data section
+ * and a metadata map. The data section uses a compact type-length-value
+ * encoding with pointers that let entries share values.
+ */
+
+#define MMDB_METADATA_MARKER    "\xAB\xCD\xEFMaxMind.com"
+#define MMDB_METADATA_MAX_SIZE  (128 * 1024)
+#define MMDB_DATA_SECTION_SEP   16
+#define MMDB_MAX_DEPTH          32
+
+enum {
+    MMDB_TYPE_EXTENDED = 0,
+    MMDB_TYPE_POINTER = 1,
+    MMDB_TYPE_UTF8_STRING = 2,
+    MMDB_TYPE_DOUBLE = 3,
+    MMDB_TYPE_BYTES = 4,
+    MMDB_TYPE_UINT16 = 5,
+    MMDB_TYPE_UINT32 = 6,
+    MMDB_TYPE_MAP = 7,
+    MMDB_TYPE_INT32 = 8,
+    MMDB_TYPE_UINT64 = 9,
+    MMDB_TYPE_UINT128 = 10,
+    MMDB_TYPE_ARRAY = 11,
+    MMDB_TYPE_CONTAINER = 12,
+    MMDB_TYPE_END_MARKER = 13,
+    MMDB_TYPE_BOOLEAN = 14,
+    MMDB_TYPE_FLOAT = 15
+};
+
+typedef struct {
+    GMappedFile *mapped;
+    const guint8 *tree;
+    const guint8 *data;         // Data section
+    gsize data_size;
+    const guint8 *metadata;     // Metadata map, after the marker
+    gsize metadata_size;
+    guint32 node_count;
+    guint record_size;          // Bits per record: 24, 28 or 32
+    guint ip_version;
+    guint32 ipv4_start_node;    // Node of ::/96 in an IPv6 tree
+} mmdb_db_t;
+
+// A decoded value. Maps and arrays have size members starting at offset.
+typedef struct {
+    guint type;
+    guint32 size;
+    gsize offset;
+    gboolean pointer;           // Stored elsewhere, see mmdb_decode
+} mmdb_value_t;
+
+static GPtrArray *mmdb_db_arr; // mmdb_db_t *, NULL unless resolving in process
+
+static const char *mmdb_co_iso_key[]     = {"country", "iso_code", NULL};
+static const char *mmdb_co_name_key[]    = {"country", "names", "en", NULL};
+static const char *mmdb_ci_name_key[]    = {"city", "names", "en", NULL};
+static const char *mmdb_asn_o_key[]      = {"autonomous_system_organization", NULL};
+static const char *mmdb_asn_key[]        = {"autonomous_system_number", NULL};
+static const char *mmdb_l_lat_key[]      = {"location", "latitude", NULL};
+static const char *mmdb_l_lon_key[]      = {"location", "longitude", NULL};
+static const char *mmdb_l_accuracy_key[] = {"location", "accuracy_radius", NULL};
+static const char *mmdb_node_count_key[] = {"node_count", NULL};
+static const char *mmdb_record_size_key[] = {"record_size", NULL};
+static const char *mmdb_ip_version_key[] = {"ip_version", NULL};
+
+/*
+ * Decode the value at offset. A pointer is followed, in which case
+ * value describes its target and *next is the offset after the pointer.
+ * Otherwise *next is the offset after the value, or the offset of the
+ * first member of a map or array.
+ */
+static gboolean
+mmdb_decode(const guint8 *base, gsize len, gsize offset, mmdb_value_t *value, gsize *next)
+{
+    static const guint32 ptr_bias[] = { 0, 2048, 526336, 0 };
+    guint8 ctrl;
+    guint32 size;
+    guint i, n;
+
+    value->pointer = FALSE;
+    for (;;) {
+        if (offset >= len) {
+            return FALSE;
+        }
+        ctrl = base[offset++];
+        value->type = ctrl >> 5;
+        if (value->type != MMDB_TYPE_POINTER) {
+            break;
+        }
+        if (value->pointer) {
+            // Pointers to pointers are not allowed.
+            return FALSE;
+        }
+
+        n = ((ctrl >> 3) & 0x3) + 1;
+        if (offset + n > len) {
+            return FALSE;
+        }
+        size = n == 4 ? 0 : ctrl & 0x7;
+        for (i = 0; i < n; i++) {
+            size = (size << 8) | base[offset++];
+        }
+        *next = offset;
+        value->pointer = TRUE;
+        offset = (gsize)size + ptr_bias[n - 1];
+    }
+
+    if (value->type == MMDB_TYPE_EXTENDED) {
+        if (offset >= len) {
+            return FALSE;
+        }
+        value->type = 7 + base[offset++];
+        if (value->type < MMDB_TYPE_INT32 || value->type > MMDB_TYPE_FLOAT) {
+            return FALSE;
+        }
+    }
+
+    size = ctrl & 0x1f;
+    if (size >= 29) {
+        n = size - 28;
+        if (offset + n > len) {
+            return FALSE;
+        }
+        size = 0;
+        for (i = 0; i < n; i++) {
+            size = (size << 8) | base[offset++];
+        }
+        size += n == 1 ? 29 : n == 2 ? 285 : 65821;
+    }
+    value->size = size;
+    value->offset = offset;
+
+    switch (value->type) {
+    case MMDB_TYPE_MAP:
+    case MMDB_TYPE_ARRAY:
+    case MMDB_TYPE_BOOLEAN:
+        break;
+    default:
+        if (size > len - offset) {
+            return FALSE;
+        }
+        offset += size;
+        break;
+    }
+    if (!value->pointer) {
+        *next = offset;
+    }
+    return TRUE;
+}
+
+// Skip the value at offset, including any members.
+static gboolean
+mmdb_skip(const guint8 *base, gsize len, gsize offset, guint depth, gsize *next)
+{
+    mmdb_value_t value;
+    guint64 members;
+
+    if (depth > MMDB_MAX_DEPTH || !mmdb_decode(base, len, offset, &value, next)) {
+        return FALSE;
+    }
+    if (value.pointer) {
+        return TRUE;
+    }
+    if (value.type == MMDB_TYPE_MAP) {
+        members = (guint64)value.size * 2;
+    } else if (value.type == MMDB_TYPE_ARRAY) {
+        members = value.size;
+    } else {
+        return TRUE;
+    }
+    for (; members > 0; members--) {
+        if (!mmdb_skip(base, len, *next, depth + 1, next)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Find the value at path, starting with the map at offset.
+static gboolean
+mmdb_get_value(const guint8 *base, gsize len, gsize offset, const char **path, mmdb_value_t *value)
+{
+    mmdb_value_t key;
+    gsize next;
+    guint32 pair;
+
+    for (; *path; path++) {
+        if (!mmdb_decode(base, len, offset, value, &next) || value->type != MMDB_TYPE_MAP) {
+            return FALSE;
+        }
+        offset = value->offset;
+        for (pair = 0; pair < value->size; pair++) {
+            if (!mmdb_decode(base, len, offset, &key, &offset) || key.type != MMDB_TYPE_UTF8_STRING) {
+                return FALSE;
+            }
+            if (key.size == strlen(*path) && memcmp(base + key.offset, *path, key.size) == 0) {
+                break;
+            }
+            if (!mmdb_skip(base, len, offset, 0, &offset)) {
+                return FALSE;
+            }
+        }
+        if (pair == value->size) {
+            return FALSE;
+        }
+    }
+    return mmdb_decode(base, len, offset, value, &next);
+}
+
+static gboolean
+mmdb_value_uint(const guint8 *base, const mmdb_value_t *value, guint64 *uint_val)
+{
+    guint32 i;
+
+    switch (value->type) {
+    case MMDB_TYPE_UINT16:
+    case MMDB_TYPE_UINT32:
+    case MMDB_TYPE_UINT64:
+        break;
+    default:
+        return FALSE;
+    }
+    if (value->size > 8) {
+        return FALSE;
+    }
+    *uint_val = 0;
+    for (i = 0; i < value->size; i++) {
+        *uint_val = (*uint_val << 8) | base[value->offset + i];
+    }
+    return TRUE;
+}
+
+static gboolean
+mmdb_value_double(const guint8 *base, const mmdb_value_t *value, double *double_val)
+{
+    if (value->type == MMDB_TYPE_DOUBLE && value->size == 8) {
+        guint64 bits = pntoh64(base + value->offset);
+        memcpy(double_val, &bits, sizeof(*double_val));
+        return TRUE;
+    }
+    if (value->type == MMDB_TYPE_FLOAT && value->size == 4) {
+        guint32 bits = pntoh32(base + value->offset);
+        float float_val;
+        memcpy(&float_val, &bits, sizeof(float_val));
+        *double_val = float_val;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static guint32
+mmdb_read_record(const mmdb_db_t *db, guint32 node, guint bit)
+{
+    const guint8 *rec = db->tree + (gsize)node * (db->record_size / 4);
+
+    switch (db->record_size) {
+    case 24:
+        return pntoh24(rec + bit * 3);
+    case 28:
+        if (bit) {
+            return ((guint32)(rec[3] & 0x0f) << 24) | pntoh24(rec + 4);
+        }
+        return ((guint32)(rec[3] & 0xf0) << 20) | pntoh24(rec);
+    default:
+        return pntoh32(rec + bit * 4);
+    }
+}
+
+static void
+mmdb_db_close(gpointer data)
+{
+    mmdb_db_t *db = (mmdb_db_t *)data;
+
+    g_mapped_file_unref(db->mapped);
+    g_free(db);
+}
+
+static mmdb_db_t *
+mmdb_db_open(const char *path)
+{
+    GError *err = NULL;
+    GMappedFile *mapped;
+    mmdb_db_t *db;
+    const guint8 *base;
+    gsize len, marker_len, min_offset, offset, tree_size;
+    mmdb_value_t value;
+    guint64 node_count, record_size, ip_version;
+    guint i;
+
+    mapped = g_mapped_file_new(path, FALSE, &err);
+    if (!mapped) {
+        ws_debug("can't map %s: %s", path, err->message);
+        g_clear_error(&err);
+        return NULL;
+    }
+    base = (const guint8 *)g_mapped_file_get_contents(mapped);
+    len = g_mapped_file_get_length(mapped);
+
+    // The metadata follows the last marker, near the end of the file.
+    marker_len = sizeof(MMDB_METADATA_MARKER) - 1;
+    if (base == NULL || len < marker_len) {
+        g_mapped_file_unref(mapped);
+        return NULL;
+    }
+    min_offset = len > MMDB_METADATA_MAX_SIZE ? len - MMDB_METADATA_MAX_SIZE : 0;
+    offset = len - marker_len;
+    while (memcmp(base + offset, MMDB_METADATA_MARKER, marker_len) != 0) {
+        if (offset == min_offset) {
+            ws_debug("%s has no metadata", path);
+            g_mapped_file_unref(mapped);
+            return NULL;
+        }
+        offset--;
+    }
+
+    db = g_new0(mmdb_db_t, 1);
+    db->mapped = mapped;
+    db->metadata = base + offset + marker_len;
+    db->metadata_size = len - offset - marker_len;
+
+    if (!mmdb_get_value(db->metadata, db->metadata_size, 0, mmdb_node_count_key, &value) ||
+            !mmdb_value_uint(db->metadata, &value, &node_count) ||
+            !mmdb_get_value(db->metadata, db->metadata_size, 0, mmdb_record_size_key, &value) ||
+            !mmdb_value_uint(db->metadata, &value, &record_size) ||
+            !mmdb_get_value(db->metadata, db->metadata_size, 0, mmdb_ip_version_key, &value) ||
+            !mmdb_value_uint(db->metadata, &value, &ip_version)) {
+        ws_debug("%s has invalid metadata", path);
+        mmdb_db_close(db);
+        return NULL;
+    }
+
+    tree_size = (gsize)(record_size / 4) * node_count;
+    if ((record_size != 24 && record_size != 28 && record_size != 32) ||
+            (ip_version != 4 && ip_version != 6) ||
+            node_count > G_MAXUINT32 ||
+            tree_size + MMDB_DATA_SECTION_SEP > offset) {
+        ws_debug("%s has an unsupported search tree", path);
+        mmdb_db_close(db);
+        return NULL;
+    }
+
+    db->tree = base;
+    db->data = base + tree_size + MMDB_DATA_SECTION_SEP;
+    db->data_size = offset - tree_size - MMDB_DATA_SECTION_SEP;
+    db->node_count = (guint32)node_count;
+    db->record_size = (guint)record_size;
+    db->ip_version = (guint)ip_version;
+
+    db->ipv4_start_node = 0;
+    if (db->ip_version == 6) {
+        for (i = 0; i < 96 && db->ipv4_start_node < db->node_count; i++) {
+            db->ipv4_start_node = mmdb_read_record(db, db->ipv4_start_node, 0);
+        }
+    }
+
+    ws_debug("mapped %s, %u nodes", path, db->node_count);
+    return db;
+}
+
+// Find the data section offset of the entry for an address of 32 or 128 bits.
+static gboolean
+mmdb_db_lookup(const mmdb_db_t *db, const guint8 *addr, guint bits, gsize *offset)
+{
+    guint32 node = 0;
+    guint i;
+
+    if (bits == 32 && db->ip_version == 6) {
+        node = db->ipv4_start_node;
+    } else if (bits == 128 && db->ip_version == 4) {
+        return FALSE;
+    }
+
+    for (i = 0; i < bits && node < db->node_count; i++) {
+        node = mmdb_read_record(db, node, (addr[i / 8] >> (7 - i % 8)) & 1);
+    }
+
+    // node_count means no entry, less means we ran out of bits.
+    if (node <= db->node_count) {
+        return FALSE;
+    }
+    if (node - db->node_count < MMDB_DATA_SECTION_SEP) {
+        return FALSE;
+    }
+    *offset = (gsize)(node - db->node_count) - MMDB_DATA_SECTION_SEP;
+    return *offset < db->data_size;
+}
+
+static const char *
+mmdb_chunkify_value(const mmdb_db_t *db, const mmdb_value_t *value)
+{
+    char *str = g_strndup((const char *)db->data + value->offset, value->size);
+    const char *chunk_string = chunkify_string(str);
+
+    g_free(str);
+    return chunk_string;
+}
+
+/*
+ * Look up an address in all databases. Like mmdbresolve, values from
+ * later databases replace those from earlier ones.
+ */
+static mmdb_lookup_t *
+mmdb_lookup_in_process(const guint8 *addr, guint bits)
+{
+    mmdb_lookup_t lookup;
+    mmdb_value_t value;
+    gsize offset;
+    guint64 uint_val;
+    double double_val;
+
+    init_lookup(&lookup);
+
+    for (guint i = 0; i < mmdb_db_arr->len; i++) {
+        const mmdb_db_t *db = (const mmdb_db_t *)g_ptr_array_index(mmdb_db_arr, i);
+
+        if (!mmdb_db_lookup(db, addr, bits, &offset)) {
+            continue;
+        }
+
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_co_iso_key, &value) && value.type == MMDB_TYPE_UTF8_STRING) {
+            lookup.found = TRUE;
+            lookup.country_iso = mmdb_chunkify_value(db, &value);
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_co_name_key, &value) && value.type == MMDB_TYPE_UTF8_STRING) {
+            lookup.found = TRUE;
+            lookup.country = mmdb_chunkify_value(db, &value);
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_ci_name_key, &value) && value.type == MMDB_TYPE_UTF8_STRING) {
+            lookup.found = TRUE;
+            lookup.city = mmdb_chunkify_value(db, &value);
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_asn_o_key, &value) && value.type == MMDB_TYPE_UTF8_STRING) {
+            lookup.found = TRUE;
+            lookup.as_org = mmdb_chunkify_value(db, &value);
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_asn_key, &value) && mmdb_value_uint(db->data, &value, &uint_val) && uint_val <= G_MAXUINT32) {
+            lookup.found = TRUE;
+            lookup.as_number = (guint32)uint_val;
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_l_lat_key, &value) && mmdb_value_double(db->data, &value, &double_val)) {
+            lookup.found = TRUE;
+            lookup.latitude = double_val;
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_l_lon_key, &value) && mmdb_value_double(db->data, &value, &double_val)) {
+            lookup.found = TRUE;
+            lookup.longitude = double_val;
+        }
+        if (mmdb_get_value(db->data, db->data_size, offset, mmdb_l_accuracy_key, &value) && mmdb_value_uint(db->data, &value, &uint_val) && uint_val <= G_MAXUINT16) {
+            lookup.found = TRUE;
+            lookup.accuracy = (guint16)uint_val;
+        }
+    }
+
+    if (!lookup.found) {
+        return &mmdb_not_found;
+    }
+    return (mmdb_lookup_t *) wmem_memdup(wmem_epan_scope(), &lookup, sizeof(mmdb_lookup_t));
+}
+
+/*
+ * Open all databases in process. If any of them can't be read, close
+ * them and leave it to mmdbresolve.
+ */
+static gboolean
+mmdb_open_in_process(void)
+{
+    mmdb_db_arr = g_ptr_array_new_with_free_func(mmdb_db_close);
+    for (guint i = 0; i < mmdb_file_arr->len; i++) {
+        const char *path = (const char *)g_ptr_array_index(mmdb_file_arr, i);
+        mmdb_db_t *db = mmdb_db_open(path);
+        if (!db) {
+            ws_info("can't read %s in process, using mmdbresolve", path);
+            g_ptr_array_free(mmdb_db_arr, TRUE);
+            mmdb_db_arr = NULL;
+            return FALSE;
+        }
+        g_ptr_array_add(mmdb_db_arr, db);
+    }
+    return TRUE;
+}
+
+static void
+mmdb_close_in_process(void)
+{
+    if (mmdb_db_arr) {
+        g_ptr_array_free(mmdb_db_arr, TRUE);
+        mmdb_db_arr = NULL;
+    }
+}
+
 static gboolean mmdbr_pipe_valid(void) {
     g_rw_lock_reader_lock(&mmdbr_pipe_mtx);
     gboolean pipe_valid = ws_pipe_valid(&mmdbr_pipe);
@@ -365,13 +863,15 @@ read_mmdbr_stdout_worker(gpointer data _U_) {
 }
 
 /**
- * Stop our mmdbresolve process.
+ * Stop our mmdbresolve process and close databases read in process.
  * Main thread only.
  */
 static void mmdb_resolve_stop(void) {
     char *request;
     mmdb_response_t *response;
 
+    mmdb_close_in_process();
+
     while (mmdbr_request_q && (request = (char *) g_async_queue_try_pop(mmdbr_request_q)) != NULL) {
         g_free(request);
     }
@@ -445,7 +945,7 @@ static void mmdb_resolve_stop(void) {
 }
 
 /**
- * Start an mmdbresolve process.
+ * Open the databases in process or start an mmdbresolve process.
  */
 static void mmdb_resolve_start(void) {
     if (!mmdbr_request_q) {
@@ -484,6 +984,11 @@ static void mmdb_resolve_start(void) {
         return;
     }
 
+    started_in_process = resolve_in_process;
+    if (resolve_in_process && mmdb_open_in_process()) {
+        return;
+    }
+
     GPtrArray *args = g_ptr_array_new();
     char *mmdbresolve = get_executable_path("mmdbresolve");
     g_ptr_array_add(args, mmdbresolve);
@@ -612,6 +1117,15 @@ maxmind_db_pref_init(module_t *nameres)
             "Lookup geolocation information for IPv4 and IPv6 addresses with configured MaxMind databases",
             &gbl_resolv_flags.maxmind_geoip);
 
+    prefs_register_bool_preference(nameres,
+            "maxmind_in_process",
+            "Read MaxMind databases in process",
+            "Look up addresses directly in the memory-mapped databases instead of"
+            " in the mmdbresolve child process. Results are available immediately,"
+            " including on the first pass of TShark. mmdbresolve is still used if"
+            " a database can't be read.",
+            &resolve_in_process);
+
     static uat_field_t maxmind_db_paths_fields[] = {
         UAT_FLD_DIRECTORYNAME(maxmind_mod, path, "MaxMind Database Directory", "The MaxMind database directory path"),
         UAT_END_FIELDS
@@ -649,11 +1163,11 @@ void maxmind_db_pref_cleanup(void)
 void maxmind_db_pref_apply(void)
 {
     if (gbl_resolv_flags.maxmind_geoip) {
-        if (!mmdbr_pipe_valid()) {
+        if ((!mmdbr_pipe_valid() && !mmdb_db_arr) || started_in_process != resolve_in_process) {
             mmdb_resolve_start();
         }
     } else {
-        if (mmdbr_pipe_valid()) {
+        if (mmdbr_pipe_valid() || mmdb_db_arr) {
             mmdb_resolve_stop();
         }
     }
@@ -735,7 +1249,10 @@ maxmind_db_lookup_ipv4(const ws_in4_addr *addr) {
 
     mmdb_lookup_t *result = (mmdb_lookup_t *) wmem_map_lookup(mmdb_ipv4_map, GUINT_TO_POINTER(*addr));
 
-    if (!result) {
+    if (!result && mmdb_db_arr) {
+        result = mmdb_lookup_in_process((const guint8 *) addr, 32);
+        wmem_map_insert(mmdb_ipv4_map, GUINT_TO_POINTER(*addr), result);
+    } else if (!result) {
         result = &mmdb_not_found;
         wmem_map_insert(mmdb_ipv4_map, GUINT_TO_POINTER(*addr), result);
 
@@ -762,7 +1279,10 @@ maxmind_db_lookup_ipv6(const ws_in6_addr *addr) {
 
     mmdb_lookup_t * result = (mmdb_lookup_t *) wmem_map_lookup(mmdb_ipv6_map, addr->bytes);
 
-    if (!result) {
+    if (!result && mmdb_db_arr) {
+        result = mmdb_lookup_in_process(addr->bytes, 128);
+        wmem_map_insert(mmdb_ipv6_map, chunkify_v6_addr(addr), result);
+    } else if (!result) {
         result = &mmdb_not_found;
         wmem_map_insert(mmdb_ipv6_map, chunkify_v6_addr(addr), result);
 
@@ -77,6 +77,8 @@ struct _output_fields {
     gchar         aggregator;
     GPtrArray    *fields;
     GHashTable   *field_indicies;
+    GArray       *field_hfids;
+    GHashTable   *hfid_indicies;
     GPtrArray   **field_values;
     gchar         quote;
     gboolean      includes_col_fields;
@@ -2069,6 +2071,14 @@ void output_fields_free(output_fields_t* fields)
             g_hash_table_destroy(fields->field_indicies);
         }
 
+        if (NULL != fields->field_hfids) {
+            g_array_free(fields->field_hfids, TRUE);
+        }
+
+        if (NULL != fields->hfid_indicies) {
+            g_hash_table_destroy(fields->hfid_indicies);
+        }
+
         if (NULL != fields->field_values) {
             g_free(fields->field_values);
         }
@@ -2262,6 +2272,90 @@ void output_fields_list_options(FILE *fh)
     fputs("quote=d|s|n   Print either d: double-quotes, s: single quotes or \n     n: no quotes around field values (def: n: none)\n", fh);
 }
 
+/*
+ * Returns the first of the header fields registered with the name of
+ * the field, or NULL if the field is a column or not known.
+ */
+static header_field_info *
+output_field_first_hfinfo(const gchar *field)
+{
+    header_field_info *hfinfo;
+
+    if (!strncmp(field, COLUMN_FIELD_FILTER, strlen(COLUMN_FIELD_FILTER)))
+        return NULL;
+
+    hfinfo = proto_registrar_get_byname(field);
+    if (hfinfo == NULL)
+        return NULL;
+
+    while (hfinfo->same_name_prev_id != -1)
+        hfinfo = proto_registrar_get_nth(hfinfo->same_name_prev_id);
+
+    return hfinfo;
+}
+
+gboolean output_fields_can_prime_edt(output_fields_t* fields)
+{
+    header_field_info *hfinfo;
+    gsize i;
+
+    ws_assert(fields);
+
+    if (NULL == fields->fields)
+        return FALSE;
+
+    for (i = 0; i < fields->fields->len; ++i) {
+        gchar *field = (gchar *)g_ptr_array_index(fields->fields, i);
+
+        for (hfinfo = output_field_first_hfinfo(field); hfinfo; hfinfo = hfinfo->same_name_next) {
+            /* get_node_field_value() writes text items and protocols
+             * (other than "data") using their representation, which is
+             * only filled in when the tree is visible. */
+            if (hfinfo->id == hf_text_only)
+                return FALSE;
+            if (hfinfo->type == FT_PROTOCOL && hfinfo->id != proto_data)
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void output_fields_prime_edt(output_fields_t* fields, epan_dissect_t *edt)
+{
+    header_field_info *hfinfo;
+    gsize i;
+
+    ws_assert(fields);
+    ws_assert(fields->fields);
+    ws_assert(edt);
+
+    if (NULL == edt->tree)
+        return;
+
+    if (NULL == fields->field_hfids) {
+        /* Map the id of every header field with the name of a field to
+         * the index of the field, stored +1 like field_indicies. As with
+         * field_indicies, a field given more than once gets the values
+         * at its last index. */
+        fields->field_hfids = g_array_new(FALSE, FALSE, sizeof(int));
+        fields->hfid_indicies = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        for (i = 0; i < fields->fields->len; ++i) {
+            gchar *field = (gchar *)g_ptr_array_index(fields->fields, i);
+
+            for (hfinfo = output_field_first_hfinfo(field); hfinfo; hfinfo = hfinfo->same_name_next) {
+                g_array_append_val(fields->field_hfids, hfinfo->id);
+                g_hash_table_insert(fields->hfid_indicies,
+                                    GINT_TO_POINTER(hfinfo->id), GUINT_TO_POINTER(i + 1));
+            }
+        }
+    }
+
+    epan_dissect_prime_with_hfid_array(edt, fields->field_hfids);
+    proto_tree_set_record_interesting_fields(edt->tree, TRUE);
+}
+
 gboolean output_fields_has_cols(output_fields_t* fields)
 {
     ws_assert(fields);
@@ -2431,8 +2525,27 @@ static void write_specified_fields(fields_format format, output_fields_t *fields
     if (NULL == fields->field_values)
         fields->field_values = g_new0(GPtrArray*, fields->fields->len);  /* free'd in output_fields_free() */
 
-    proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_values,
-                                &data);
+    if (NULL != fields->hfid_indicies && NULL != proto_get_interesting_finfos(edt->tree)) {
+        /* The tree was primed with the fields; take the values from the
+         * fields recorded while dissecting instead of searching through
+         * the tree. The array also holds any other primed fields, e.g.
+         * those of a display filter, so look each one up. */
+        GPtrArray *finfos = proto_get_interesting_finfos(edt->tree);
+        field_info *fi;
+
+        for (i = 0; i < finfos->len; ++i) {
+            fi = (field_info *)g_ptr_array_index(finfos, i);
+            field_index = g_hash_table_lookup(fields->hfid_indicies, GINT_TO_POINTER(fi->hfinfo->id));
+            if (NULL != field_index) {
+                format_field_values(fields, field_index,
+                                    get_node_field_value(fi, edt) /* g_ alloc'd string */
+                    );
+            }
+        }
+    } else {
+        proto_tree_children_foreach(edt->tree, proto_tree_get_node_field_values,
+                                    &data);
+    }
 
     /* Add columns to fields */
     if (fields->includes_col_fields) {
@@ -2703,6 +2816,8 @@ output_fields_t* output_fields_new(void)
     fields->aggregator          = ',';
     fields->fields              = NULL; /*Do lazy initialisation */
     fields->field_indicies      = NULL;
+    fields->field_hfids         = NULL;
+    fields->hfid_indicies       = NULL;
     fields->field_values        = NULL;
     fields->quote               ='\0';
     fields->includes_col_fields = FALSE;
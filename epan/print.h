@@ -70,6 +70,14 @@ WS_DLL_PUBLIC gsize output_fields_num_fields(output_fields_t* info);
 WS_DLL_PUBLIC gboolean output_fields_set_option(output_fields_t* info, gchar* option);
 WS_DLL_PUBLIC void output_fields_list_options(FILE *fh);
 WS_DLL_PUBLIC gboolean output_fields_has_cols(output_fields_t* info);
+/*
+ * Whether write_fields_proto_tree() can take the values of all the
+ * fields from a tree that is not visible, primed with
+ * output_fields_prime_edt(). Only the requested fields are then added
+ * to the tree, which is much cheaper than building a visible tree.
+ */
+WS_DLL_PUBLIC gboolean output_fields_can_prime_edt(output_fields_t* info);
+WS_DLL_PUBLIC void output_fields_prime_edt(output_fields_t* info, epan_dissect_t *edt);
 
 /*
  * Higher-level packet-printing code.
@@ -819,6 +819,9 @@ proto_tree_reset(proto_tree *tree)
 		g_hash_table_remove_all(tree_data->interesting_hfids);
 	}
 
+	if (tree_data->interesting_finfos)
+		g_ptr_array_set_size(tree_data->interesting_finfos, 0);
+
 	/* Reset track of the number of children */
 	tree_data->count = 0;
 
@@ -843,6 +846,9 @@ proto_tree_free(proto_tree *tree)
 		g_hash_table_destroy(tree_data->interesting_hfids);
 	}
 
+	if (tree_data->interesting_finfos)
+		g_ptr_array_free(tree_data->interesting_finfos, TRUE);
+
 	g_slice_free(tree_data_t, tree_data);
 
 	g_slice_free(proto_tree, tree);
@@ -868,6 +874,19 @@ proto_tree_set_fake_protocols(proto_tree *tree, gboolean fake_protocols)
 	PTREE_DATA(tree)->fake_protocols = fake_protocols;
 }
 
+void
+proto_tree_set_record_interesting_fields(proto_tree *tree, gboolean record)
+{
+	tree_data_t *tree_data = PTREE_DATA(tree);
+
+	if (record && tree_data->interesting_finfos == NULL) {
+		tree_data->interesting_finfos = g_ptr_array_new();
+	} else if (!record && tree_data->interesting_finfos != NULL) {
+		g_ptr_array_free(tree_data->interesting_finfos, TRUE);
+		tree_data->interesting_finfos = NULL;
+	}
+}
+
 /* Assume dissector set only its protocol fields.
    This function is called by dissectors and allows the speeding up of filtering
    in wireshark; if this function returns FALSE it is safe to reset tree to NULL
@@ -2530,6 +2549,9 @@ tree_data_add_maybe_interesting_field(tree_data_t *tree_data, field_info *fi)
 		}
 
 		g_ptr_array_add(ptrs, fi);
+
+		if (tree_data->interesting_finfos)
+			g_ptr_array_add(tree_data->interesting_finfos, fi);
 	}
 }
 
@@ -7253,6 +7275,7 @@ proto_tree_create_root(packet_info *pinfo)
 
 	/* Don't initialize the tree_data_t. Wait until we know we need it */
 	pnode->tree_data->interesting_hfids = NULL;
+	pnode->tree_data->interesting_finfos = NULL;
 
 	/* Set the default to FALSE so it's easier to
 	 * find errors; if we expect to see the protocol tree
@@ -10587,6 +10610,19 @@ proto_tracking_interesting_fields(const proto_tree *tree)
 	return (interesting_hfids != NULL) && g_hash_table_size(interesting_hfids);
 }
 
+/* Return GPtrArray* of field_info pointers for all primed fields that
+ * appear in the tree, in the order in which they were added. Like the
+ * arrays returned by proto_get_finfo_ptr_array(), it belongs to the tree
+ * and is emptied by proto_tree_reset(). */
+GPtrArray *
+proto_get_interesting_finfos(const proto_tree *tree)
+{
+	if (!tree)
+		return NULL;
+
+	return PTREE_DATA(tree)->interesting_finfos;
+}
+
 /* Helper struct for proto_find_info() and	proto_all_finfos() */
 typedef struct {
 	GPtrArray *array;
@@ -866,6 +866,7 @@ typedef struct
  * in the protocol tree points to the same copy. */
 typedef struct {
     GHashTable          *interesting_hfids;
+    GPtrArray           *interesting_finfos;
     gboolean             visible;
     gboolean             fake_protocols;
     guint                count;
@@ -1188,6 +1189,15 @@ proto_tree_set_visible(proto_tree *tree, gboolean visible);
 extern void
 proto_tree_set_fake_protocols(proto_tree *tree, gboolean fake_protocols);
 
+/** Keep the field_info of every primed field that is added to the tree
+ in a single array, in the order in which they were added, so that the
+ values of several fields can be read without searching through the tree
+ (default = FALSE). See proto_get_interesting_finfos().
+ @param tree the tree to be set
+ @param record TRUE if the primed fields should be recorded */
+WS_DLL_PUBLIC void
+proto_tree_set_record_interesting_fields(proto_tree *tree, gboolean record);
+
 /** Mark a field/protocol ID as "interesting".
  @param tree the tree to be set (currently ignored)
  @param hfid the interesting field id
@@ -2722,6 +2732,14 @@ WS_DLL_PUBLIC GPtrArray* proto_get_finfo_ptr_array(const proto_tree *tree, const
  @return TRUE if we're tracking interesting fields */
 WS_DLL_PUBLIC gboolean proto_tracking_interesting_fields(const proto_tree *tree);
 
+/** Return GPtrArray* of field_info pointers for all primed fields that
+    appear in tree, in the order in which they were added. Only works with
+    primed trees for which proto_tree_set_record_interesting_fields() was
+    called, and is fast.
+ @param tree tree of interest
+ @return GPtrArray pointer, or NULL if the fields are not recorded */
+WS_DLL_PUBLIC GPtrArray* proto_get_interesting_finfos(const proto_tree *tree);
+
 /** Return GPtrArray* of field_info pointers for all hfindex that appear in
     tree. Works with any tree, primed or unprimed, and is slower than
     proto_get_finfo_ptr_array because it has to search through the tree.
@@ -28,34 +28,39 @@ typedef struct _fragment_addresses_key {
 	address src;
 	address dst;
 	guint32 id;
+	guint hash;	/* computed when the key is made */
 } fragment_addresses_key;
 
 GList* reassembly_table_list = NULL;
 
+/*
+ * The hash covers the addresses as well as the ID, so that reassemblies
+ * from many hosts that happen to use the same IDs (e.g. tunnels, or
+ * hosts that all start counting at the same value) don't end up in the
+ * same bucket. It's computed once, when the key is made, rather than on
+ * each probe.
+ */
+static void
+fragment_addresses_set_key(fragment_addresses_key *key,
+			   const packet_info *pinfo, const guint32 id)
+{
+	/*
+	 * Do a shallow copy of the addresses.
+	 */
+	copy_address_shallow(&key->src, &pinfo->src);
+	copy_address_shallow(&key->dst, &pinfo->dst);
+	key->id = id;
+
+	key->hash = add_address_to_hash(id, &key->src);
+	key->hash = add_address_to_hash(key->hash, &key->dst);
+}
+
 static guint
 fragment_addresses_hash(gconstpointer k)
 {
 	const fragment_addresses_key* key = (const fragment_addresses_key*) k;
-	guint hash_val;
-/*
-	int i;
-*/
 
-	hash_val = 0;
-
-/*	More than likely: in most captures src and dst addresses are the
-	same, and would hash the same.
-	We only use id as the hash as an optimization.
-
-	for (i = 0; i < key->src.len; i++)
-		hash_val += key->src.data[i];
-	for (i = 0; i < key->dst.len; i++)
-		hash_val += key->dst.data[i];
-*/
-
-	hash_val += key->id;
-
-	return hash_val;
+	return key->hash;
 }
 
 static gint
@@ -70,6 +75,7 @@ fragment_addresses_equal(gconstpointer k1, gconstpointer k2)
 	 * the comparison of addresses.
 	 */
 	return (key1->id == key2->id) &&
+	       (key1->hash == key2->hash) &&
 	       (addresses_equal(&key1->src, &key2->src)) &&
 	       (addresses_equal(&key1->dst, &key2->dst));
 }
@@ -85,12 +91,7 @@ fragment_addresses_temporary_key(const packet_info *pinfo, const guint32 id,
 {
 	fragment_addresses_key *key = g_slice_new(fragment_addresses_key);
 
-	/*
-	 * Do a shallow copy of the addresses.
-	 */
-	copy_address_shallow(&key->src, &pinfo->src);
-	copy_address_shallow(&key->dst, &pinfo->dst);
-	key->id = id;
+	fragment_addresses_set_key(key, pinfo, id);
 
 	return (gpointer)key;
 }
@@ -105,12 +106,13 @@ fragment_addresses_persistent_key(const packet_info *pinfo, const guint32 id,
 {
 	fragment_addresses_key *key = g_slice_new(fragment_addresses_key);
 
+	fragment_addresses_set_key(key, pinfo, id);
+
 	/*
 	 * Do a deep copy of the addresses.
 	 */
 	copy_address(&key->src, &pinfo->src);
 	copy_address(&key->dst, &pinfo->dst);
-	key->id = id;
 
 	return (gpointer)key;
 }
@@ -158,34 +160,33 @@ typedef struct _fragment_addresses_ports_key {
 	guint32 src_port;
 	guint32 dst_port;
 	guint32 id;
+	guint hash;	/* computed when the key is made */
 } fragment_addresses_ports_key;
 
+static void
+fragment_addresses_ports_set_key(fragment_addresses_ports_key *key,
+				 const packet_info *pinfo, const guint32 id)
+{
+	/*
+	 * Do a shallow copy of the addresses.
+	 */
+	copy_address_shallow(&key->src_addr, &pinfo->src);
+	copy_address_shallow(&key->dst_addr, &pinfo->dst);
+	key->src_port = pinfo->srcport;
+	key->dst_port = pinfo->destport;
+	key->id = id;
+
+	key->hash = add_address_to_hash(id, &key->src_addr);
+	key->hash = add_address_to_hash(key->hash, &key->dst_addr);
+	key->hash += (key->src_port << 16) ^ key->dst_port;
+}
+
 static guint
 fragment_addresses_ports_hash(gconstpointer k)
 {
 	const fragment_addresses_ports_key* key = (const fragment_addresses_ports_key*) k;
-	guint hash_val;
-/*
-	int i;
-*/
-
-	hash_val = 0;
-
-/*	More than likely: in most captures src and dst addresses and ports
-	are the same, and would hash the same.
-	We only use id as the hash as an optimization.
 
-	for (i = 0; i < key->src.len; i++)
-		hash_val += key->src_addr.data[i];
-	for (i = 0; i < key->dst.len; i++)
-		hash_val += key->dst_addr.data[i];
-	hash_val += key->src_port;
-	hash_val += key->dst_port;
-*/
-
-	hash_val += key->id;
-
-	return hash_val;
+	return key->hash;
 }
 
 static gint
@@ -200,6 +201,7 @@ fragment_addresses_ports_equal(gconstpointer k1, gconstpointer k2)
 	 * the comparison of addresses and ports.
 	 */
 	return (key1->id == key2->id) &&
+	       (key1->hash == key2->hash) &&
 	       (addresses_equal(&key1->src_addr, &key2->src_addr)) &&
 	       (addresses_equal(&key1->dst_addr, &key2->dst_addr)) &&
 	       (key1->src_port == key2->src_port) &&
@@ -217,14 +219,7 @@ fragment_addresses_ports_temporary_key(const packet_info *pinfo, const guint32 i
 {
 	fragment_addresses_ports_key *key = g_slice_new(fragment_addresses_ports_key);
 
-	/*
-	 * Do a shallow copy of the addresses.
-	 */
-	copy_address_shallow(&key->src_addr, &pinfo->src);
-	copy_address_shallow(&key->dst_addr, &pinfo->dst);
-	key->src_port = pinfo->srcport;
-	key->dst_port = pinfo->destport;
-	key->id = id;
+	fragment_addresses_ports_set_key(key, pinfo, id);
 
 	return (gpointer)key;
 }
@@ -239,14 +234,13 @@ fragment_addresses_ports_persistent_key(const packet_info *pinfo,
 {
 	fragment_addresses_ports_key *key = g_slice_new(fragment_addresses_ports_key);
 
+	fragment_addresses_ports_set_key(key, pinfo, id);
+
 	/*
 	 * Do a deep copy of the addresses.
 	 */
 	copy_address(&key->src_addr, &pinfo->src);
 	copy_address(&key->dst_addr, &pinfo->dst);
-	key->src_port = pinfo->srcport;
-	key->dst_port = pinfo->destport;
-	key->id = id;
 
 	return (gpointer)key;
 }
@@ -316,6 +310,46 @@ reassembled_key_free(gpointer ptr)
 	g_slice_free(reassembled_key, (reassembled_key *)ptr);
 }
 
+/*
+ * Fragment items are recycled through a free list rather than being
+ * allocated and freed one by one; a capture with a lot of fragmented
+ * traffic goes through them at a high rate. The list is shared by all
+ * tables, as the reassembled table frees its entries through a
+ * GDestroyNotify that doesn't know which table they belong to.
+ */
+static fragment_item *fragment_item_free_list = NULL;
+
+static fragment_item *
+fragment_item_new(void)
+{
+	fragment_item *fd = fragment_item_free_list;
+
+	if (fd != NULL) {
+		fragment_item_free_list = fd->next;
+	} else {
+		fd = g_slice_new(fragment_item);
+	}
+	return fd;
+}
+
+static void
+fragment_item_free(fragment_item *fd)
+{
+	fd->next = fragment_item_free_list;
+	fragment_item_free_list = fd;
+}
+
+static void
+fragment_item_free_list_clear(void)
+{
+	fragment_item *fd;
+
+	while ((fd = fragment_item_free_list) != NULL) {
+		fragment_item_free_list = fd->next;
+		g_slice_free(fragment_item, fd);
+	}
+}
+
 /*
  * For a fragment hash table entry, free the associated fragments.
  * The entry value (fd_chain) is freed herein and the entry is freed
@@ -344,7 +378,7 @@ free_all_fragments(gpointer key_arg _U_, gpointer value, gpointer user_data _U_)
 
 		if(fd_i->tvb_data && !(fd_i->flags&FD_SUBSET_TVB))
 			tvb_free(fd_i->tvb_data);
-		g_slice_free(fragment_item, fd_i);
+		fragment_item_free(fd_i);
 	}
 
 	return TRUE;
@@ -384,7 +418,7 @@ free_fd_head(fragment_head *fd_head)
 		if (fd_i->tvb_data) {
 			tvb_free(fd_i->tvb_data);
 		}
-		g_slice_free(fragment_item, fd_i);
+		fragment_item_free(fd_i);
 	}
 	g_slice_free(fragment_head, fd_head);
 }
@@ -550,6 +584,12 @@ reassembly_table_destroy(reassembly_table *table)
 		g_hash_table_destroy(table->reassembled_table);
 		table->reassembled_table = NULL;
 	}
+
+	/*
+	 * Tables are destroyed when the capture file is closed, so
+	 * give the recycled fragment items back as well.
+	 */
+	fragment_item_free_list_clear();
 }
 
 /*
@@ -560,11 +600,27 @@ static fragment_head *
 lookup_fd_head(reassembly_table *table, const packet_info *pinfo,
 	       const guint32 id, const void *data, gpointer *orig_keyp)
 {
+	union {
+		fragment_addresses_key addresses;
+		fragment_addresses_ports_key addresses_ports;
+	} stack_key;
 	gpointer key;
 	gpointer value;
 
-	/* Create key to search hash with */
-	key = table->temporary_key_func(pinfo, id, data);
+	/*
+	 * Create key to search hash with. The keys of the tables that
+	 * use our own functions are filled in on the stack, which saves
+	 * an allocation for every fragment.
+	 */
+	if (table->temporary_key_func == fragment_addresses_temporary_key) {
+		fragment_addresses_set_key(&stack_key.addresses, pinfo, id);
+		key = &stack_key.addresses;
+	} else if (table->temporary_key_func == fragment_addresses_ports_temporary_key) {
+		fragment_addresses_ports_set_key(&stack_key.addresses_ports, pinfo, id);
+		key = &stack_key.addresses_ports;
+	} else {
+		key = table->temporary_key_func(pinfo, id, data);
+	}
 
 	/*
 	 * Look up the reassembly in the fragment table.
@@ -573,7 +629,8 @@ lookup_fd_head(reassembly_table *table, const packet_info *pinfo,
 					  &value))
 		value = NULL;
 	/* Free the key */
-	table->free_temporary_key_func(key);
+	if (key != &stack_key)
+		table->free_temporary_key_func(key);
 
 	return (fragment_head *)value;
 }
@@ -631,7 +688,7 @@ fragment_delete(reassembly_table *table, const packet_info *pinfo,
 
 		if (fd->tvb_data && !(fd->flags & FD_SUBSET_TVB))
 			tvb_free(fd->tvb_data);
-		g_slice_free(fragment_item, fd);
+		fragment_item_free(fd);
 		fd=tmp_fd;
 	}
 	g_slice_free(fragment_head, fd_head);
@@ -949,7 +1006,7 @@ fragment_truncate(reassembly_table *table, const packet_info *pinfo,
 
 		if (fd_i->tvb_data && !(fd_i->flags & FD_SUBSET_TVB))
 			tvb_free(fd_i->tvb_data);
-		g_slice_free(fragment_item, fd_i);
+		fragment_item_free(fd_i);
 	}
 }
 
@@ -1207,7 +1264,7 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 	guint8 *data;
 
 	/* create new fd describing this fragment */
-	fd = g_slice_new(fragment_item);
+	fd = fragment_item_new();
 	fd->next = NULL;
 	fd->flags = 0;
 	fd->frame = frag_frame;
@@ -1243,7 +1300,7 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 				 * we'll run past the end of a buffer sooner
 				 * or later).
 				 */
-				g_slice_free(fragment_item, fd);
+				fragment_item_free(fd);
 
 				/*
 				 * This is an attempt to add a fragment to a
@@ -1274,7 +1331,7 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 			 * No.  That means it still overlaps that, so report
 			 * this as a problem, possibly a retransmission.
 			 */
-			g_slice_free(fragment_item, fd);
+			fragment_item_free(fd);
 			THROW_MESSAGE(ReassemblyError, "New fragment overlaps old data (retransmission?)");
 		}
 	}
@@ -1347,7 +1404,7 @@ fragment_add_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 	 * Save all payload in a buffer until we can defragment.
 	 */
 	if (!tvb_bytes_exist(tvb, offset, fd->len)) {
-		g_slice_free(fragment_item, fd);
+		fragment_item_free(fd);
 		THROW(BoundsError);
 	}
 	fd->tvb_data = tvb_clone_offset_len(tvb, offset, fd->len);
@@ -1983,7 +2040,7 @@ fragment_add_seq_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 
 
 	/* create new fd describing this fragment */
-	fd = g_slice_new(fragment_item);
+	fd = fragment_item_new();
 	fd->next = NULL;
 	fd->flags = 0;
 	fd->frame = pinfo->num;
@@ -2119,7 +2176,7 @@ fragment_add_seq_work(fragment_head *fd_head, tvbuff_t *tvb, const int offset,
 		if (!tvb_bytes_exist(tvb, offset, fd->len)) {
 			/* abort if we didn't capture the entire fragment due
 			 * to a too-short snapshot length */
-			g_slice_free(fragment_item, fd);
+			fragment_item_free(fd);
 			return FALSE;
 		}
 
@@ -2638,7 +2695,7 @@ fragment_add_seq_single_work(reassembly_table *table, tvbuff_t *tvb,
 
 				if (fd->tvb_data && !(fd->flags & FD_SUBSET_TVB))
 					tvb_free(fd->tvb_data);
-				g_slice_free(fragment_item, fd);
+				fragment_item_free(fd);
 				fd=tmp_fd;
 			}
 		}
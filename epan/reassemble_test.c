@@ -3246,6 +3246,94 @@ test_fragment_add_check_duplicate_conflict(void)
         print_fragment_table();
     }
 }
+/**********************************************************************************
+ *
+ * fragment_add_check with many reassemblies in progress
+ *
+ *********************************************************************************/
+
+/* Reassemblies of MANY_FLOWS_FRAGS fragments from MANY_FLOWS_COUNT hosts,
+ * which all use the same ID, interleaved the way they would be in a busy
+ * capture. Every reassembly must complete on its last fragment, and be
+ * found again by frame number on the second pass. The elapsed time of
+ * the first pass is printed so that it can be compared between builds.
+ */
+#define MANY_FLOWS_COUNT    2000
+#define MANY_FLOWS_FRAGS    4
+#define MANY_FLOWS_FRAG_LEN 16
+
+static void
+test_fragment_add_check_many_flows_work(reassembly_table *table)
+{
+    fragment_head *fd_head;
+    address saved_src;
+    guint8 src[4];
+    guint32 flow, frag;
+    gint64 start_time;
+
+    copy_address_shallow(&saved_src, &pinfo.src);
+    set_address(&pinfo.src, AT_IPv4, 4, src);
+
+    start_time = g_get_monotonic_time();
+    pinfo.num = 0;
+    for (frag = 0; frag < MANY_FLOWS_FRAGS; frag++) {
+        for (flow = 0; flow < MANY_FLOWS_COUNT; flow++) {
+            src[0] = 10;
+            src[1] = (flow >> 16) & 0xFF;
+            src[2] = (flow >> 8) & 0xFF;
+            src[3] = flow & 0xFF;
+            pinfo.srcport = 1024 + flow % 7;
+            pinfo.num++;
+            fd_head = fragment_add_check(table, tvb, frag * MANY_FLOWS_FRAG_LEN,
+                                         &pinfo, 42, NULL,
+                                         frag * MANY_FLOWS_FRAG_LEN, MANY_FLOWS_FRAG_LEN,
+                                         frag < MANY_FLOWS_FRAGS - 1);
+            if (frag < MANY_FLOWS_FRAGS - 1) {
+                ASSERT_EQ_POINTER(NULL, fd_head);
+            } else {
+                ASSERT_NE_POINTER(NULL, fd_head);
+                ASSERT_EQ(pinfo.num, fd_head->reassembled_in);
+                ASSERT_EQ(MANY_FLOWS_FRAGS * MANY_FLOWS_FRAG_LEN, fd_head->datalen);
+                ASSERT(!tvb_memeql(fd_head->tvb_data, 0, data,
+                                   MANY_FLOWS_FRAGS * MANY_FLOWS_FRAG_LEN));
+            }
+        }
+    }
+    printf("    %u reassemblies of %u fragments in %" PRId64 " us\n",
+           MANY_FLOWS_COUNT, MANY_FLOWS_FRAGS, g_get_monotonic_time() - start_time);
+
+    ASSERT_EQ(0, g_hash_table_size(table->fragment_table));
+    ASSERT_EQ(MANY_FLOWS_COUNT * MANY_FLOWS_FRAGS, g_hash_table_size(table->reassembled_table));
+
+    /* second pass */
+    pinfo.fd->visited = TRUE;
+    for (pinfo.num = 1; pinfo.num <= MANY_FLOWS_COUNT * MANY_FLOWS_FRAGS; pinfo.num++) {
+        fd_head = fragment_add_check(table, tvb, 0, &pinfo, 42, NULL,
+                                     0, MANY_FLOWS_FRAG_LEN, TRUE);
+        ASSERT_NE_POINTER(NULL, fd_head);
+        ASSERT_EQ(pinfo.num + (MANY_FLOWS_FRAGS - 1 - (pinfo.num - 1) / MANY_FLOWS_COUNT) * MANY_FLOWS_COUNT,
+                  fd_head->reassembled_in);
+    }
+    pinfo.fd->visited = FALSE;
+    pinfo.srcport = 0;
+
+    copy_address_shallow(&pinfo.src, &saved_src);
+}
+
+static void
+test_fragment_add_check_many_flows(void)
+{
+    reassembly_table ports_table = { 0 };
+
+    printf("Starting test test_fragment_add_check_many_flows\n");
+
+    test_fragment_add_check_many_flows_work(&test_reassembly_table);
+
+    reassembly_table_init(&ports_table, &addresses_ports_reassembly_table_functions);
+    test_fragment_add_check_many_flows_work(&ports_table);
+    reassembly_table_destroy(&ports_table);
+}
+
 /**********************************************************************************
  *
  * main
@@ -3294,6 +3382,7 @@ main(int argc _U_, char **argv _U_)
         test_fragment_add_check_duplicate_last,
 #endif
         test_fragment_add_check_duplicate_conflict,
+        test_fragment_add_check_many_flows,
     };
 
     /* a tvbuff for testing with */
@@ -700,6 +700,99 @@ varint_tests(void)
 	tvb_free_chain(tvb_parent);  /* should free all tvb's and associated data */
 }
 
+#define COMPOSITE_MEMBERS	1000
+
+/* Reads a composite made of many small members byte by byte, forwards and
+ * backwards, and across member boundaries. The elapsed time of the
+ * sequential walk is printed so that it can be compared between builds. */
+static void
+composite_member_tests(void)
+{
+	tvbuff_t	*tvb_parent, *tvb_comp, *tvb_member;
+	guint8		*data, *copy;
+	guint		len, offset, i, member_len;
+	gint64		start_time;
+	gboolean	ok = TRUE;
+
+	/* Members are 1 to 7 bytes long. */
+	len = 0;
+	for (i = 0; i < COMPOSITE_MEMBERS; i++) {
+		len += i % 7 + 1;
+	}
+	data = (guint8 *)g_malloc(len);
+	for (offset = 0; offset < len; offset++) {
+		data[offset] = (guint8)(offset * 7 + 3);
+	}
+
+	tvb_parent = tvb_new_real_data((const guint8*)"", 0, 0);
+	tvb_comp = tvb_new_composite();
+	offset = 0;
+	for (i = 0; i < COMPOSITE_MEMBERS; i++) {
+		member_len = i % 7 + 1;
+		tvb_member = tvb_new_child_real_data(tvb_parent, data + offset, member_len, member_len);
+		tvb_composite_append(tvb_comp, tvb_member);
+		offset += member_len;
+	}
+	tvb_composite_finalize(tvb_comp);
+
+	if (tvb_captured_length(tvb_comp) != len) {
+		printf("Failed composite of %u members, length=%u while expected length=%u\n",
+		       COMPOSITE_MEMBERS, tvb_captured_length(tvb_comp), len);
+		failed = TRUE;
+		g_free(data);
+		tvb_free_chain(tvb_parent);
+		return;
+	}
+
+	start_time = g_get_monotonic_time();
+	for (offset = 0; offset < len && ok; offset++) {
+		ok = tvb_get_guint8(tvb_comp, offset) == data[offset];
+	}
+	if (ok) {
+		printf("Passed composite of %u members, sequential read of %u bytes in %" PRId64 " us\n",
+		       COMPOSITE_MEMBERS, len, g_get_monotonic_time() - start_time);
+	}
+	else {
+		printf("Failed composite of %u members, sequential read at offset %u\n",
+		       COMPOSITE_MEMBERS, offset - 1);
+		failed = TRUE;
+	}
+
+	for (offset = len; offset > 0 && ok; offset--) {
+		ok = tvb_get_guint8(tvb_comp, offset - 1) == data[offset - 1];
+	}
+	if (!ok) {
+		printf("Failed composite of %u members, reverse read at offset %u\n",
+		       COMPOSITE_MEMBERS, offset);
+		failed = TRUE;
+		g_free(data);
+		tvb_free_chain(tvb_parent);
+		return;
+	}
+
+	/* Spans of 1 to 16 bytes starting at every offset, most of which
+	 * cross one or more member boundaries. */
+	copy = (guint8 *)g_malloc(16);
+	for (offset = 0; offset < len && ok; offset++) {
+		member_len = MIN(offset % 16 + 1, len - offset);
+		tvb_memcpy(tvb_comp, copy, offset, member_len);
+		ok = memcmp(copy, data + offset, member_len) == 0;
+	}
+	g_free(copy);
+
+	if (!ok) {
+		printf("Failed composite of %u members, multi-member read at offset %u\n",
+		       COMPOSITE_MEMBERS, offset - 1);
+		failed = TRUE;
+	}
+	else {
+		printf("Passed composite of %u members, reverse and multi-member reads\n", COMPOSITE_MEMBERS);
+	}
+
+	g_free(data);
+	tvb_free_chain(tvb_parent);  /* should free all tvb's and associated data */
+}
+
 #define DATA_AND_LEN(X) .data = X, .len = sizeof(X) - 1
 
 static void
@@ -814,6 +907,7 @@ main(void)
 	except_init();
 	run_tests();
 	varint_tests();
+	composite_member_tests();
 	zstd_tests ();
 	except_deinit();
 	exit(failed?1:0);
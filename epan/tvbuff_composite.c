@@ -16,7 +16,7 @@
 #include "proto.h"	/* XXX - only used for DISSECTOR_ASSERT, probably a new header file? */
 
 typedef struct {
-	GSList		*tvbs;
+	GPtrArray	*tvbs;
 
 	/* Used for quick testing to see if this
 	 * is the tvbuff that a COMPOSITE is
@@ -24,6 +24,9 @@ typedef struct {
 	guint		*start_offsets;
 	guint		*end_offsets;
 
+	/* Member that satisfied the last lookup. */
+	guint		last_member;
+
 } tvb_comp_t;
 
 struct tvb_composite {
@@ -38,7 +41,7 @@ composite_free(tvbuff_t *tvb)
 	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
 	tvb_comp_t *composite = &composite_tvb->composite;
 
-	g_slist_free(composite->tvbs);
+	g_ptr_array_free(composite->tvbs, TRUE);
 
 	g_free(composite->start_offsets);
 	g_free(composite->end_offsets);
@@ -51,6 +54,45 @@ composite_offset(const tvbuff_t *tvb _U_, const guint counter)
 	return counter;
 }
 
+/*
+ * Returns the index of the member that contains abs_offset, or the number
+ * of members if abs_offset is the end of the composite.
+ *
+ * Dissectors mostly walk a composite from start to end, so try the member
+ * of the previous lookup and the one after it before doing a binary search
+ * over the end offsets.
+ */
+static guint
+composite_find_member(tvb_comp_t *composite, guint abs_offset)
+{
+	guint num_members = composite->tvbs->len;
+	guint low, high, mid;
+
+	mid = composite->last_member;
+	if (abs_offset >= composite->start_offsets[mid]) {
+		if (abs_offset <= composite->end_offsets[mid])
+			return mid;
+		if (mid + 1 < num_members && abs_offset <= composite->end_offsets[mid + 1]) {
+			composite->last_member = mid + 1;
+			return mid + 1;
+		}
+	}
+
+	low = 0;
+	high = num_members;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (abs_offset > composite->end_offsets[mid])
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < num_members)
+		composite->last_member = low;
+	return low;
+}
+
 static const guint8*
 composite_get_ptr(tvbuff_t *tvb, guint abs_offset, guint abs_length)
 {
@@ -59,21 +101,17 @@ composite_get_ptr(tvbuff_t *tvb, guint abs_offset, guint abs_length)
 	tvb_comp_t *composite;
 	tvbuff_t   *member_tvb = NULL;
 	guint	    member_offset;
-	GSList	   *slist;
 
 	/* DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops); */
 
 	/* Maybe the range specified by offset/length
 	 * is contiguous inside one of the member tvbuffs */
 	composite = &composite_tvb->composite;
-	num_members = g_slist_length(composite->tvbs);
+	num_members = composite->tvbs->len;
 
-	for (i = 0; i < num_members; i++) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			slist = g_slist_nth(composite->tvbs, i);
-			member_tvb = (tvbuff_t *)slist->data;
-			break;
-		}
+	i = composite_find_member(composite, abs_offset);
+	if (i < num_members) {
+		member_tvb = (tvbuff_t *)g_ptr_array_index(composite->tvbs, i);
 	}
 
 	/* special case */
@@ -112,21 +150,17 @@ composite_memcpy(tvbuff_t *tvb, void* _target, guint abs_offset, guint abs_lengt
 	tvb_comp_t *composite;
 	tvbuff_t   *member_tvb = NULL;
 	guint	    member_offset, member_length;
-	GSList	   *slist;
 
 	/* DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops); */
 
 	/* Maybe the range specified by offset/length
 	 * is contiguous inside one of the member tvbuffs */
 	composite   = &composite_tvb->composite;
-	num_members = g_slist_length(composite->tvbs);
+	num_members = composite->tvbs->len;
 
-	for (i = 0; i < num_members; i++) {
-		if (abs_offset <= composite->end_offsets[i]) {
-			slist = g_slist_nth(composite->tvbs, i);
-			member_tvb = (tvbuff_t *)slist->data;
-			break;
-		}
+	i = composite_find_member(composite, abs_offset);
+	if (i < num_members) {
+		member_tvb = (tvbuff_t *)g_ptr_array_index(composite->tvbs, i);
 	}
 
 	/* special case */
@@ -198,9 +232,10 @@ tvb_new_composite(void)
 	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
 	tvb_comp_t *composite = &composite_tvb->composite;
 
-	composite->tvbs		 = NULL;
+	composite->tvbs		 = g_ptr_array_new();
 	composite->start_offsets = NULL;
 	composite->end_offsets	 = NULL;
+	composite->last_member	 = 0;
 
 	return tvb;
 }
@@ -218,12 +253,12 @@ tvb_composite_append(tvbuff_t *tvb, tvbuff_t *member)
 	 * and anyway it makes no sense.
 	 */
 	if (member && member->length) {
-		composite       = &composite_tvb->composite;
-		composite->tvbs = g_slist_append(composite->tvbs, member);
+		composite = &composite_tvb->composite;
+		g_ptr_array_add(composite->tvbs, member);
 
 		/* Attach the composite TVB to the first TVB only. */
-		if (!composite->tvbs->next) {
-			tvb_add_to_chain((tvbuff_t *)composite->tvbs->data, tvb);
+		if (composite->tvbs->len == 1) {
+			tvb_add_to_chain(member, tvb);
 		}
 	}
 }
@@ -241,12 +276,12 @@ tvb_composite_prepend(tvbuff_t *tvb, tvbuff_t *member)
 	 * and anyway it makes no sense.
 	 */
 	if (member && member->length) {
-		composite       = &composite_tvb->composite;
-		composite->tvbs = g_slist_prepend(composite->tvbs, member);
+		composite = &composite_tvb->composite;
+		g_ptr_array_insert(composite->tvbs, 0, member);
 
 		/* Attach the composite TVB to the first TVB only. */
-		if (!composite->tvbs->next) {
-			tvb_add_to_chain((tvbuff_t *)composite->tvbs->data, tvb);
+		if (composite->tvbs->len == 1) {
+			tvb_add_to_chain(member, tvb);
 		}
 	}
 }
@@ -255,11 +290,10 @@ void
 tvb_composite_finalize(tvbuff_t *tvb)
 {
 	struct tvb_composite *composite_tvb = (struct tvb_composite *) tvb;
-	GSList	   *slist;
 	guint	    num_members;
 	tvbuff_t   *member_tvb;
 	tvb_comp_t *composite;
-	int	    i = 0;
+	guint	    i;
 
 	DISSECTOR_ASSERT(tvb && !tvb->initialized);
 	DISSECTOR_ASSERT(tvb->ops == &tvb_composite_ops);
@@ -268,7 +302,7 @@ tvb_composite_finalize(tvbuff_t *tvb)
 	DISSECTOR_ASSERT(tvb->contained_length == 0);
 
 	composite   = &composite_tvb->composite;
-	num_members = g_slist_length(composite->tvbs);
+	num_members = composite->tvbs->len;
 
 	/* Dissectors should not create composite TVBs if they're not going to
 	 * put at least one TVB in them.
@@ -279,15 +313,13 @@ tvb_composite_finalize(tvbuff_t *tvb)
 	composite->start_offsets = g_new(guint, num_members);
 	composite->end_offsets = g_new(guint, num_members);
 
-	for (slist = composite->tvbs; slist != NULL; slist = slist->next) {
-		DISSECTOR_ASSERT((guint) i < num_members);
-		member_tvb = (tvbuff_t *)slist->data;
+	for (i = 0; i < num_members; i++) {
+		member_tvb = (tvbuff_t *)g_ptr_array_index(composite->tvbs, i);
 		composite->start_offsets[i] = tvb->length;
 		tvb->length += member_tvb->length;
 		tvb->reported_length += member_tvb->reported_length;
 		tvb->contained_length += member_tvb->contained_length;
 		composite->end_offsets[i] = tvb->length - 1;
-		i++;
 	}
 
 	tvb->initialized = TRUE;
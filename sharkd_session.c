@@ -55,6 +55,7 @@
 #include <ui/rtp_stream.h>
 #include <ui/tap-rtp-common.h>
 #include <ui/tap-rtp-analysis.h>
+#include <ui/tap-quic-analysis.h>
 #include <wsutil/version_info.h>
 #include <epan/to_str.h>
 
@@ -79,6 +80,11 @@ struct sharkd_filter_item
 
 static GHashTable *filter_table = NULL;
 
+/* Graphs of earlier iograph requests, see sharkd_session_process_iograph() */
+static GHashTable *iograph_table = NULL;
+static GQueue iograph_lru = G_QUEUE_INIT;   /* Cached graphs, most recently used first */
+static gsize iograph_cached_bytes = 0;
+
 static int mode;
 static guint32 rpcid;
 
@@ -1068,6 +1074,8 @@ sharkd_session_process_load(const char *buf, const jsmntok_t *tokens, int count)
 
     fprintf(stderr, "load: filename=%s\n", tok_file);
 
+    g_hash_table_remove_all(iograph_table);
+
     if (sharkd_cf_open(tok_file, WTAP_TYPE_AUTO, FALSE, &err) != CF_OK)
     {
         sharkd_json_error(
@@ -2774,6 +2782,97 @@ sharkd_session_process_tap_rtp_cb(void *arg)
     json_dumper_end_object(&dumper);
 }
 
+/**
+ * sharkd_session_process_tap_quic_cb()
+ *
+ * Output QUIC connections tap:
+ *   (m) tap        - tap name
+ *   (m) type       - tap output type
+ *   (m) conns      - array of object with attributes:
+ *                  (m) conn        - QUIC connection number (quic.connection.number)
+ *                  (m) frame       - first frame of the connection
+ *                  (m) duration    - time between the first and last packet (ms)
+ *                  (o) handshake   - time from the first packet to HANDSHAKE_DONE (ms)
+ *                  (m) client      - packets sent by the client, see below
+ *                  (m) server      - packets sent by the server, see below
+ *
+ * Per sender object with attributes:
+ *                  (m) pkts        - packets count
+ *                  (m) ack_eliciting - ack-eliciting packets count
+ *                  (m) acked       - packets acknowledged by the peer
+ *                  (m) lost        - packets declared lost
+ *                  (m) spurious    - packets declared lost but acknowledged later
+ *                  (m) rtt_samples - number of RTT samples
+ *                  (o) min_rtt     - minimum RTT (ms)
+ *                  (o) srtt        - smoothed RTT (ms)
+ *                  (o) rttvar      - RTT variation (ms)
+ *                  (o) latest_rtt  - latest RTT (ms)
+ *                  (o) ack_delay   - mean ACK Delay reported by the peer (ms)
+ *                  (o) max_ack_delay - maximum ACK Delay reported by the peer (ms)
+ */
+static void
+sharkd_session_process_tap_quic_dir(const char *name, const quic_dir_analysis_t *dir)
+{
+    sharkd_json_object_open(name);
+    sharkd_json_value_anyf("pkts", "%" PRIu64, dir->packets);
+    sharkd_json_value_anyf("ack_eliciting", "%" PRIu64, dir->ack_eliciting);
+    sharkd_json_value_anyf("acked", "%" PRIu64, dir->acked);
+    sharkd_json_value_anyf("lost", "%" PRIu64, dir->lost);
+    sharkd_json_value_anyf("spurious", "%" PRIu64, dir->spurious);
+    sharkd_json_value_anyf("rtt_samples", "%u", dir->rtt_samples);
+    if (dir->rtt_samples)
+    {
+        sharkd_json_value_anyf("min_rtt", "%f", dir->min_rtt * 1000);
+        sharkd_json_value_anyf("srtt", "%f", dir->smoothed_rtt * 1000);
+        sharkd_json_value_anyf("rttvar", "%f", dir->rttvar * 1000);
+        sharkd_json_value_anyf("latest_rtt", "%f", dir->latest_rtt * 1000);
+    }
+    if (dir->ack_delay_samples)
+    {
+        sharkd_json_value_anyf("ack_delay", "%f", dir->ack_delay_sum / dir->ack_delay_samples * 1000);
+        sharkd_json_value_anyf("max_ack_delay", "%f", dir->max_ack_delay * 1000);
+    }
+    sharkd_json_object_close();
+}
+
+static void
+sharkd_session_process_tap_quic_cb(void *arg)
+{
+    quic_analysis_t *analysis = (quic_analysis_t *) arg;
+
+    json_dumper_begin_object(&dumper);
+    sharkd_json_value_string("tap", "quic-conn");
+    sharkd_json_value_string("type", "quic-conn");
+
+    sharkd_json_array_open("conns");
+    for (guint i = 0; i < analysis->conn_list->len; i++)
+    {
+        const quic_conn_analysis_t *conn = (const quic_conn_analysis_t *) g_ptr_array_index(analysis->conn_list, i);
+
+        json_dumper_begin_object(&dumper);
+        sharkd_json_value_anyf("conn", "%u", conn->number);
+        sharkd_json_value_anyf("frame", "%u", conn->first_frame);
+        sharkd_json_value_anyf("duration", "%f", (conn->last_time - conn->start_time) * 1000);
+        if (conn->handshake_done)
+            sharkd_json_value_anyf("handshake", "%f", conn->handshake_time * 1000);
+        sharkd_session_process_tap_quic_dir("client", &conn->dirs[0]);
+        sharkd_session_process_tap_quic_dir("server", &conn->dirs[1]);
+        json_dumper_end_object(&dumper);
+    }
+    sharkd_json_array_close();
+
+    json_dumper_end_object(&dumper);
+}
+
+static void
+sharkd_session_free_tap_quic_cb(void *arg)
+{
+    quic_analysis_t *analysis = (quic_analysis_t *) arg;
+
+    quic_analysis_cleanup(analysis);
+    g_free(analysis);
+}
+
 /**
  * sharkd_session_process_tap()
  *
@@ -2799,6 +2898,7 @@ sharkd_session_process_tap_rtp_cb(void *arg)
  *                  for type:rtd see sharkd_session_process_tap_rtd_cb()
  *                  for type:srt see sharkd_session_process_tap_srt_cb()
  *                  for type:flow see sharkd_session_process_tap_flow_cb()
+ *                  for type:quic-conn see sharkd_session_process_tap_quic_cb()
  *
  *   (m) err   - error code
  */
@@ -3101,6 +3201,16 @@ sharkd_session_process_tap(char *buf, const jsmntok_t *tokens, int count)
             tap_data = &rtp_tapinfo;
             tap_free = rtpstream_reset_cb;
         }
+        else if (!strcmp(tok_tap, "quic-conn"))
+        {
+            quic_analysis_t *analysis = g_new0(quic_analysis_t, 1);
+
+            quic_analysis_init(analysis);
+            tap_error = register_tap_listener("quic", analysis, tap_filter, 0, quic_analysis_reset, quic_analysis_packet, sharkd_session_process_tap_quic_cb, NULL);
+
+            tap_data = analysis;
+            tap_free = sharkd_session_free_tap_quic_cb;
+        }
         else if (!strncmp(tok_tap, "rtp-analyse:", 12))
         {
             struct sharkd_analyse_rtp *rtp_req;
@@ -3593,54 +3703,81 @@ sharkd_session_process_frame_cb(epan_dissect_t *edt, proto_tree *tree, struct ep
     sharkd_json_result_epilogue();
 }
 
-#define SHARKD_IOGRAPH_MAX_ITEMS 250000 /* 250k limit of items is taken from wireshark-qt, on x86_64 sizeof(io_graph_item_t) is 152, so single graph can take max 36 MB */
+#define SHARKD_IOGRAPH_MAX_ITEMS 250000 /* 250k limit of items per pyramid level is taken from wireshark-qt, on x86_64 sizeof(io_graph_item_t) is 152, so single level can take max 36 MB */
+#define SHARKD_IOGRAPH_MAX_CACHED_BYTES (256 * 1024 * 1024)
 
 struct sharkd_iograph
 {
     /* config */
     int hf_index;
     io_graph_item_unit_t calc_type;
-    guint32 interval;
 
     /* result */
-    int space_items;
-    int num_items;
-    io_graph_item_t *items;
+    io_graph_pyramid_t pyramid;
     GString *error;
+
+    /* cache, see sharkd_iograph_cache() */
+    const char *key;    /* owned by iograph_table */
+    GList lru_link;     /* data is NULL if the graph is not cached */
+    gsize size;
 };
 
-static tap_packet_status
-sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const void *dummy _U_, tap_flags_t flags _U_)
+static void
+sharkd_iograph_free(gpointer data)
 {
-    struct sharkd_iograph *graph = (struct sharkd_iograph *) g;
-    int idx;
-    gboolean update_succeeded;
-
-    idx = get_io_graph_index(pinfo, graph->interval);
-    if (idx < 0 || idx >= SHARKD_IOGRAPH_MAX_ITEMS)
-        return TAP_PACKET_DONT_REDRAW;
+    struct sharkd_iograph *graph = (struct sharkd_iograph *) data;
 
-    if (idx + 1 > graph->num_items)
+    if (graph->lru_link.data)
     {
-        if (idx + 1 > graph->space_items)
-        {
-            int new_size = idx + 1024;
+        g_queue_unlink(&iograph_lru, &graph->lru_link);
+        iograph_cached_bytes -= graph->size;
+    }
+    io_graph_pyramid_clear(&graph->pyramid);
+    g_free(graph);
+}
 
-            graph->items = (io_graph_item_t *) g_realloc(graph->items, sizeof(io_graph_item_t) * new_size);
-            reset_io_graph_items(&graph->items[graph->space_items], new_size - graph->space_items);
+/* Mark a cached graph as the most recently used one */
+static void
+sharkd_iograph_touch(struct sharkd_iograph *graph)
+{
+    g_queue_unlink(&iograph_lru, &graph->lru_link);
+    g_queue_push_head_link(&iograph_lru, &graph->lru_link);
+}
 
-            graph->space_items = new_size;
-        }
-        else if (graph->items == NULL)
-        {
-            graph->items = g_new(io_graph_item_t, graph->space_items);
-            reset_io_graph_items(graph->items, graph->space_items);
-        }
+/* Keep a graph for later requests, evicting the least recently used graphs
+ * while the items of all cached graphs take more than SHARKD_IOGRAPH_MAX_CACHED_BYTES */
+static void
+sharkd_iograph_cache(char *key, struct sharkd_iograph *graph)
+{
+    int level;
+
+    graph->size = sizeof(*graph);
+    for (level = 0; level < IO_GRAPH_PYRAMID_LEVELS; level++)
+        graph->size += (gsize) graph->pyramid.space_items[level] * sizeof(io_graph_item_t);
+
+    graph->key = key;
+    graph->lru_link.data = graph;
+    g_queue_push_head_link(&iograph_lru, &graph->lru_link);
+    iograph_cached_bytes += graph->size;
+    /* replace, the key of an equal graph of the same request is freed with it */
+    g_hash_table_replace(iograph_table, key, graph);
 
-        graph->num_items = idx + 1;
+    while (iograph_cached_bytes > SHARKD_IOGRAPH_MAX_CACHED_BYTES)
+    {
+        struct sharkd_iograph *oldest = (struct sharkd_iograph *) g_queue_peek_tail(&iograph_lru);
+
+        /* frees the graph, which removes it from iograph_lru */
+        g_hash_table_remove(iograph_table, oldest->key);
     }
+}
 
-    update_succeeded = update_io_graph_item(graph->items, idx, pinfo, edt, graph->hf_index, graph->calc_type, graph->interval);
+static tap_packet_status
+sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const void *dummy _U_, tap_flags_t flags _U_)
+{
+    struct sharkd_iograph *graph = (struct sharkd_iograph *) g;
+    gboolean update_succeeded;
+
+    update_succeeded = io_graph_pyramid_update(&graph->pyramid, pinfo, edt, graph->hf_index, graph->calc_type);
     /* XXX - TAP_PACKET_FAILED if the item couldn't be updated, with an error message? */
     return update_succeeded ? TAP_PACKET_REDRAW : TAP_PACKET_DONT_REDRAW;
 }
@@ -3664,29 +3801,41 @@ sharkd_iograph_packet(void *g, packet_info *pinfo, epan_dissect_t *edt, const vo
  *   (m) iograph - array of graph results with attributes:
  *                  errmsg - graph cannot be constructed
  *                  items  - graph values, zeros are skipped, if value is not a number it's next index encoded as hex string
+ *
+ * The graphs keep the items for all intervals (see io_graph_pyramid_t) and are kept
+ * until another file is loaded, so repeating a request with a different interval
+ * doesn't retap the file, unless the capture is too long for the pyramid to provide
+ * SHARKD_IOGRAPH_MAX_ITEMS items of that interval. The least recently used graphs are dropped when the
+ * cached graphs take more than SHARKD_IOGRAPH_MAX_CACHED_BYTES.
  */
 static void
 sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
 {
     const char *tok_interval = json_find_attr(buf, tokens, count, "interval");
-    struct sharkd_iograph graphs[10];
-    gboolean is_any_ok = FALSE;
+    struct sharkd_iograph *graphs[10];
+    char *new_graph_keys[10]; /* NULL for graphs of earlier requests */
+    gboolean is_any_new = FALSE;
     int graph_count;
 
     guint32 interval_ms = 1000; /* default: one per second */
+    gboolean is_interval_valid;
     int i;
 
     if (tok_interval)
         ws_strtou32(tok_interval, NULL, &interval_ms);
+    is_interval_valid = (interval_ms > 0 && interval_ms <= G_MAXINT);
 
     for (i = graph_count = 0; i < (int) G_N_ELEMENTS(graphs); i++)
     {
-        struct sharkd_iograph *graph = &graphs[graph_count];
+        struct sharkd_iograph *graph;
+        io_graph_item_unit_t calc_type;
 
         const char *tok_graph;
         const char *tok_filter;
         char tok_format_buf[32];
         const char *field_name;
+        char *graph_key;
+        int base_interval;
 
         snprintf(tok_format_buf, sizeof(tok_format_buf), "graph%d", i);
         tok_graph = json_find_attr(buf, tokens, count, tok_format_buf);
@@ -3697,25 +3846,25 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
         tok_filter = json_find_attr(buf, tokens, count, tok_format_buf);
 
         if (!strcmp(tok_graph, "packets"))
-            graph->calc_type = IOG_ITEM_UNIT_PACKETS;
+            calc_type = IOG_ITEM_UNIT_PACKETS;
         else if (!strcmp(tok_graph, "bytes"))
-            graph->calc_type = IOG_ITEM_UNIT_BYTES;
+            calc_type = IOG_ITEM_UNIT_BYTES;
         else if (!strcmp(tok_graph, "bits"))
-            graph->calc_type = IOG_ITEM_UNIT_BITS;
+            calc_type = IOG_ITEM_UNIT_BITS;
         else if (g_str_has_prefix(tok_graph, "sum:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_SUM;
+            calc_type = IOG_ITEM_UNIT_CALC_SUM;
         else if (g_str_has_prefix(tok_graph, "frames:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_FRAMES;
+            calc_type = IOG_ITEM_UNIT_CALC_FRAMES;
         else if (g_str_has_prefix(tok_graph, "fields:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_FIELDS;
+            calc_type = IOG_ITEM_UNIT_CALC_FIELDS;
         else if (g_str_has_prefix(tok_graph, "max:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_MAX;
+            calc_type = IOG_ITEM_UNIT_CALC_MAX;
         else if (g_str_has_prefix(tok_graph, "min:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_MIN;
+            calc_type = IOG_ITEM_UNIT_CALC_MIN;
         else if (g_str_has_prefix(tok_graph, "avg:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_AVERAGE;
+            calc_type = IOG_ITEM_UNIT_CALC_AVERAGE;
         else if (g_str_has_prefix(tok_graph, "load:"))
-            graph->calc_type = IOG_ITEM_UNIT_CALC_LOAD;
+            calc_type = IOG_ITEM_UNIT_CALC_LOAD;
         else
             break;
 
@@ -3723,20 +3872,31 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
         if (field_name)
             field_name = field_name + 1;
 
-        graph->interval = interval_ms;
+        /* The graph can't contain '|', so the key is unambiguous */
+        graph_key = g_strdup_printf("%s|%s", tok_graph, tok_filter ? tok_filter : "");
+        graph = (struct sharkd_iograph *) g_hash_table_lookup(iograph_table, graph_key);
+        if (graph && (!is_interval_valid || io_graph_pyramid_has_interval(&graph->pyramid, (int) interval_ms)))
+        {
+            sharkd_iograph_touch(graph);
+            g_free(graph_key);
+            new_graph_keys[graph_count] = NULL;
+            graphs[graph_count++] = graph;
+            continue;
+        }
+
+        /* A cached graph that can't provide this interval is replaced by one
+         * based on it, otherwise start with all intervals of 1 ms multiples */
+        base_interval = graph ? (int) interval_ms : 1;
+        graph = g_new0(struct sharkd_iograph, 1);
+        graph->calc_type = calc_type;
+        io_graph_pyramid_init(&graph->pyramid, SHARKD_IOGRAPH_MAX_ITEMS, base_interval);
 
         graph->hf_index = -1;
         graph->error = check_field_unit(field_name, &graph->hf_index, graph->calc_type);
 
-        graph->space_items = 0; /* TODO, can avoid realloc()s in sharkd_iograph_packet() by calculating: capture_time / interval */
-        graph->num_items = 0;
-        graph->items = NULL;
-
         if (!graph->error)
             graph->error = register_tap_listener("frame", graph, tok_filter, TL_REQUIRES_PROTO_TREE, NULL, sharkd_iograph_packet, NULL, NULL);
 
-        graph_count++;
-
         if (graph->error)
         {
             sharkd_json_error(
@@ -3744,23 +3904,70 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
                     "%s", graph->error->str
                     );
             g_string_free(graph->error, TRUE);
+            sharkd_iograph_free(graph);
+            g_free(graph_key);
+
+            for (i = 0; i < graph_count; i++)
+            {
+                if (new_graph_keys[i])
+                {
+                    remove_tap_listener(graphs[i]);
+                    sharkd_iograph_free(graphs[i]);
+                    g_free(new_graph_keys[i]);
+                }
+            }
             return;
         }
 
-        if (graph->error == NULL)
-            is_any_ok = TRUE;
+        new_graph_keys[graph_count] = graph_key;
+        graphs[graph_count++] = graph;
+        is_any_new = TRUE;
     }
 
-    /* retap only if we have at least one ok */
-    if (is_any_ok)
+    /* retap only if some graph isn't known from an earlier request */
+    if (is_any_new)
+    {
+        gboolean is_tapping[G_N_ELEMENTS(graphs)];
+
         sharkd_retap();
 
+        /* The level the interval is merged from may have been truncated on a
+         * long capture, tap those graphs once more based on the interval */
+        is_any_new = FALSE;
+        for (i = 0; i < graph_count; i++)
+        {
+            is_tapping[i] = FALSE;
+            if (!new_graph_keys[i])
+                continue;
+
+            if (!is_interval_valid || io_graph_pyramid_has_interval(&graphs[i]->pyramid, (int) interval_ms))
+            {
+                remove_tap_listener(graphs[i]);
+                continue;
+            }
+
+            io_graph_pyramid_clear(&graphs[i]->pyramid);
+            io_graph_pyramid_init(&graphs[i]->pyramid, SHARKD_IOGRAPH_MAX_ITEMS, (int) interval_ms);
+            is_tapping[i] = TRUE;
+            is_any_new = TRUE;
+        }
+
+        if (is_any_new)
+        {
+            sharkd_retap();
+
+            for (i = 0; i < graph_count; i++)
+                if (is_tapping[i])
+                    remove_tap_listener(graphs[i]);
+        }
+    }
+
     sharkd_json_result_prologue(rpcid);
 
     sharkd_json_array_open("iograph");
     for (i = 0; i < graph_count; i++)
     {
-        struct sharkd_iograph *graph = &graphs[i];
+        struct sharkd_iograph *graph = graphs[i];
 
         json_dumper_begin_object(&dumper);
 
@@ -3772,15 +3979,19 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
         }
         else
         {
+            io_graph_item_t *items;
+            int num_items;
             int idx;
             int next_idx = 0;
 
+            items = io_graph_pyramid_get_items(&graph->pyramid, (int) interval_ms, graph->calc_type, &num_items);
+
             sharkd_json_array_open("items");
-            for (idx = 0; idx < graph->num_items; idx++)
+            for (idx = 0; idx < num_items; idx++)
             {
                 double val;
 
-                val = get_io_graph_item(graph->items, graph->calc_type, idx, graph->hf_index, &cfile, graph->interval, graph->num_items);
+                val = get_io_graph_item(items, graph->calc_type, idx, graph->hf_index, &cfile, interval_ms, num_items);
 
                 /* if it's zero, don't display */
                 if (val == 0.0)
@@ -3794,15 +4005,18 @@ sharkd_session_process_iograph(char *buf, const jsmntok_t *tokens, int count)
                 next_idx = idx + 1;
             }
             sharkd_json_array_close();
+            g_free(items);
         }
         json_dumper_end_object(&dumper);
-
-        remove_tap_listener(graph);
-        g_free(graph->items);
     }
     sharkd_json_array_close();
 
     sharkd_json_result_epilogue();
+
+    /* Keep the new graphs for later requests */
+    for (i = 0; i < graph_count; i++)
+        if (new_graph_keys[i])
+            sharkd_iograph_cache(new_graph_keys[i], graphs[i]);
 }
 
 /**
@@ -4360,6 +4574,8 @@ sharkd_session_process_setcomment(char *buf, const jsmntok_t *tokens, int count)
     else
     {
         sharkd_set_modified_block(fdata, pkt_block);
+        /* Graphs filtering on comments are out of date. */
+        g_hash_table_remove_all(iograph_table);
         sharkd_json_simple_ok(rpcid);
     }
 }
@@ -4408,6 +4624,9 @@ sharkd_session_process_setconf(char *buf, const jsmntok_t *tokens, int count)
 
     ret = prefs_set_pref(pref, &errmsg);
 
+    /* The preference might change what the graphs count. */
+    g_hash_table_remove_all(iograph_table);
+
     switch (ret)
     {
         case PREFS_SET_OK:
@@ -5067,6 +5286,7 @@ sharkd_session_main(int mode_setting)
     dumper.output_file = stdout;
 
     filter_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_session_filter_free);
+    iograph_table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, sharkd_iograph_free);
 
 #ifdef HAVE_MAXMINDDB
     /* mmdbresolve was stopped before fork(), force starting it */
@@ -5115,6 +5335,7 @@ sharkd_session_main(int mode_setting)
     }
 
     g_hash_table_destroy(filter_table);
+    g_hash_table_destroy(iograph_table);
     g_free(tokens);
 
     return 0;
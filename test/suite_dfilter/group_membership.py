@@ -92,3 +92,31 @@ class case_membership(unittest.TestCase):
     def test_membership_12_value_string(self, checkDFilterCount):
         dfilter = 'tcp.checksum.status in {"Unverified", "Good"}'
         checkDFilterCount(dfilter, 1)
+
+    def test_membership_13_or_chain(self, checkDFilterCount):
+        # Merged into a single set by the optimizer.
+        dfilter = 'tcp.port == 443 || tcp.port == 8080 || tcp.port == 3267'
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_14_or_chain_no_match(self, checkDFilterCount):
+        dfilter = 'tcp.dstport == 1 || http || tcp.dstport in {2 .. 79} || tcp.dstport == 81'
+        checkDFilterCount(dfilter, 1)
+        dfilter = 'tcp.dstport == 1 || tcp.dstport in {2 .. 79} || tcp.dstport == 81'
+        checkDFilterCount(dfilter, 0)
+
+    def test_membership_15_constant_set(self, checkDFilterCount):
+        # Large enough to be tested with a single lookup.
+        dfilter = 'tcp.port in {1 2 3 4 5 6 7 8 9 80}'
+        checkDFilterCount(dfilter, 1)
+        dfilter = 'tcp.port in {1 2 3 4 5 6 7 8 9 10}'
+        checkDFilterCount(dfilter, 0)
+        dfilter = 'tcp.dstport in {1 2 3 4 5 6 7 8 9 10 79..81}'
+        checkDFilterCount(dfilter, 1)
+
+    def test_membership_16_constant_set_networks(self, checkDFilterCount):
+        dfilter = 'ip.addr in {1.1.1.1 2.2.2.2 3.3.3.3 4.4.4.4 5.5.5.5 6.6.6.6 7.7.7.7 207.46.0.0/16}'
+        checkDFilterCount(dfilter, 1)
+        dfilter = 'ip.addr in {1.1.1.1 2.2.2.2 3.3.3.3 4.4.4.4 5.5.5.5 6.6.6.6 7.7.7.7 207.47.0.0/16}'
+        checkDFilterCount(dfilter, 0)
+        dfilter = 'ip.dst in {1.1.1.1 2.2.2.2 3.3.3.3 4.4.4.4 5.5.5.5 6.6.6.6 7.7.7.7 207.46.134.94}'
+        checkDFilterCount(dfilter, 1)
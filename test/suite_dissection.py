@@ -8,6 +8,7 @@
 #
 '''Dissection tests'''
 
+import json
 import os.path
 import subprocesstest
 import unittest
@@ -783,6 +784,97 @@ class case_dissect_quic(subprocesstest.SubprocessTestCase):
         self.check_quic_tls_handshake_reassembly(
             cmd_tshark, capture_file, extraArgs=['-2'])
 
+    def check_quic_shards(self, cmd_tshark, capture_file, extraArgs=[]):
+        if sys.platform.startswith('win32'):
+            fixtures.skip('--quic-shards is not supported on Windows')
+        proc = self.assertRun([cmd_tshark,
+                               '-r', capture_file('quic_follow_multistream.pcapng'),
+                               ] + extraArgs)
+        unsharded = proc.stdout_str
+        proc = self.assertRun([cmd_tshark,
+                               '-r', capture_file('quic_follow_multistream.pcapng'),
+                               '--quic-shards', '4',
+                               ] + extraArgs)
+        self.assertNotEqual(unsharded, '')
+        self.assertEqual(proc.stdout_str, unsharded)
+
+    def test_quic_shards(self, cmd_tshark, capture_file):
+        '''Verify that sharded QUIC dissection matches the unsharded output.'''
+        self.check_quic_shards(cmd_tshark, capture_file)
+
+    def test_quic_shards_fields(self, cmd_tshark, capture_file):
+        '''Verify that sharded QUIC dissection matches the unsharded output (fields).'''
+        self.check_quic_shards(cmd_tshark, capture_file, extraArgs=[
+            '-Y', 'quic',
+            '-Tfields', '-eframe.number', '-equic.packet_number',
+            '-equic.stream.stream_id', '-ehttp3.frame_type'])
+
+    def test_quic_qlog(self, cmd_tshark, capture_file, result_file):
+        '''Verify the qlog export of QUIC packets.'''
+        qlog_file = result_file('quic.sqlog')
+        self.assertRun((cmd_tshark,
+                        '-r', capture_file('quic_follow_multistream.pcapng'),
+                        '-q', '-z', 'quic,qlog,' + qlog_file,
+                        ))
+        with open(qlog_file, encoding='utf-8') as f:
+            records = f.read().split('\x1e')
+        # JSON-SEQ: every record starts with a Record Separator.
+        self.assertEqual(records[0], '')
+        records = [json.loads(record) for record in records[1:]]
+        header, events = records[0], records[1:]
+        self.assertEqual(header['qlog_format'], 'JSON-SEQ')
+        self.assertEqual(header['trace']['vantage_point']['type'], 'network')
+
+        # One event per QUIC packet, coalesced packets included.
+        proc = self.assertRun((cmd_tshark,
+                               '-r', capture_file('quic_follow_multistream.pcapng'),
+                               '-Y', 'quic',
+                               '-Tfields', '-equic.packet_number', '-Eoccurrence=a',
+                               ))
+        packet_numbers = [int(pn) for line in proc.stdout_str.splitlines()
+                          for pn in line.split(',') if pn]
+        self.assertEqual(len(events), len(packet_numbers))
+        self.assertEqual([event['data']['header']['packet_number'] for event in events],
+                         packet_numbers)
+
+        # The connection starts with a client Initial carrying the ClientHello.
+        first = events[0]
+        self.assertEqual(first['name'], 'transport:packet_sent')
+        self.assertEqual(first['data']['header']['packet_type'], 'initial')
+        self.assertIn('crypto', [frame['frame_type'] for frame in first['data']['frames']])
+
+        packet_types = {event['data']['header']['packet_type'] for event in events}
+        self.assertTrue({'initial', 'handshake', '1RTT'} <= packet_types)
+        frames = [frame for event in events for frame in event['data']['frames']]
+        self.assertNotIn('unknown', {frame['frame_type'] for frame in frames})
+        self.assertIn(40, {frame['stream_id'] for frame in frames if frame['frame_type'] == 'stream'})
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_dissect_http3(subprocesstest.SubprocessTestCase):
+    def check_http3_qpack(self, cmd_tshark, capture_file, extraArgs=[]):
+        # The responses reference the QPACK dynamic table, which is only
+        # decoded if the encoder stream is applied in order.
+        proc = self.assertRun([cmd_tshark,
+                               '-r', capture_file('quic_follow_multistream.pcapng'),
+                               '-Y', 'http3.header.name == ":method"',
+                               '-Tfields', '-ehttp3.header.value',
+                               ] + extraArgs)
+        self.assertTrue(self.grepOutput('GET'))
+        proc = self.assertRun([cmd_tshark,
+                               '-r', capture_file('quic_follow_multistream.pcapng'),
+                               '-Y', 'http3.qpack.failed',
+                               ] + extraArgs)
+        self.assertEqual(proc.stdout_str, '')
+
+    def test_http3_qpack(self, cmd_tshark, capture_file):
+        '''Verify that HTTP/3 field sections are decoded with QPACK.'''
+        self.check_http3_qpack(cmd_tshark, capture_file)
+
+    def test_http3_qpack_2(self, cmd_tshark, capture_file):
+        '''Verify that HTTP/3 field sections are decoded with QPACK (second pass).'''
+        self.check_http3_qpack(cmd_tshark, capture_file, extraArgs=['-2'])
+
 @fixtures.mark_usefixtures('test_env')
 @fixtures.uses_fixtures
 class case_decompress_smb2(subprocesstest.SubprocessTestCase):
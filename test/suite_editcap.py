@@ -0,0 +1,103 @@
+#
+# Wireshark tests
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+'''Editcap tests'''
+
+import struct
+import subprocesstest
+import fixtures
+
+testin_pcap = 'testin.pcap'
+testout_pcap = 'testout.pcap'
+
+
+def ipv4_frame(payload, ttl=64):
+    '''Returns an Ethernet frame with an IPv4/UDP packet. The TTL is at
+    offset 22 and the IPv4 header checksum at offset 24.'''
+    udp = struct.pack('!HHHH', 5000, 5001, 8 + len(payload), 0) + payload
+    ip = bytearray(struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(udp), 1, 0,
+            ttl, 17, 0, bytes((10, 0, 0, 1)), bytes((10, 0, 0, 2))))
+    checksum = sum(struct.unpack('!10H', ip))
+    checksum = (checksum & 0xffff) + (checksum >> 16)
+    checksum = (checksum & 0xffff) + (checksum >> 16)
+    ip[10:12] = struct.pack('!H', ~checksum & 0xffff)
+    eth = bytes((2, 0, 0, 0, 0, 2, 2, 0, 0, 0, 0, 1, 8, 0))
+    return eth + bytes(ip) + udp
+
+
+def write_pcap(path, frames):
+    '''Writes (time in microseconds, frame) pairs to a pcap file.'''
+    with open(path, 'wb') as f:
+        f.write(struct.pack('<IHHiIII', 0xa1b2c3d4, 2, 4, 0, 0, 65535, 1))
+        for usecs, frame in frames:
+            f.write(struct.pack('<IIII', usecs // 1000000, usecs % 1000000, len(frame), len(frame)))
+            f.write(frame)
+
+
+@fixtures.fixture
+def dup_pcap(result_file):
+    '''A capture with the packets A A B C D E F B, 0.5 seconds apart.
+
+    The second A directly follows the first one, and there are five
+    packets between the first B and the second one.'''
+    payloads = (b'A', b'A', b'B', b'C', b'D', b'E', b'F', b'B')
+    path = result_file(testin_pcap)
+    write_pcap(path, [(i * 500000, ipv4_frame(payload * 20))
+            for i, payload in enumerate(payloads)])
+    return path
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_editcap_dedup(subprocesstest.SubprocessTestCase):
+    def check_dedup(self, cmd_editcap, result_file, infile, args, num_packets):
+        testout_file = result_file(testout_pcap)
+        self.assertRun([cmd_editcap] + args + [infile, testout_file])
+        self.checkPacketCount(num_packets, cap_file=testout_file)
+
+    def test_dedup_default_window(self, cmd_editcap, result_file, dup_pcap):
+        '''-d compares with the previous 4 packets'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-d'], 7)
+
+    def test_dedup_window_0(self, cmd_editcap, result_file, dup_pcap):
+        '''-D 0 removes nothing'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '0'], 8)
+
+    def test_dedup_window_1(self, cmd_editcap, result_file, dup_pcap):
+        '''-D 1 compares with no packet and removes nothing'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '1'], 8)
+
+    def test_dedup_window_2(self, cmd_editcap, result_file, dup_pcap):
+        '''-D 2 compares with the previous packet only'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '2'], 7)
+
+    def test_dedup_window_edge(self, cmd_editcap, result_file, dup_pcap):
+        '''-D 6 reaches back to the first B, -D 5 does not'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '5'], 7)
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '6'], 6)
+
+    def test_dedup_window_large(self, cmd_editcap, result_file, dup_pcap):
+        '''A window larger than the capture compares with all packets'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-D', '1000000'], 6)
+
+    def test_dedup_time_window(self, cmd_editcap, result_file, dup_pcap):
+        '''-w compares with the packets up to and including the window'''
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-w', '1'], 7)
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-w', '2.4'], 7)
+        self.check_dedup(cmd_editcap, result_file, dup_pcap, ['-w', '2.5'], 6)
+
+    def test_dedup_ignore_bytes(self, cmd_editcap, result_file):
+        '''--ignore-bytes finds a copy with a lower TTL'''
+        # The second packet was forwarded by a router, only the TTL and the
+        # IPv4 header checksum differ.
+        infile = result_file(testin_pcap)
+        first = ipv4_frame(b'X' * 20, ttl=64)
+        second = ipv4_frame(b'X' * 20, ttl=63)
+        self.assertNotEqual(first[24:26], second[24:26])
+        write_pcap(infile, [(0, first), (1000, second)])
+        self.check_dedup(cmd_editcap, result_file, infile, ['-d'], 2)
+        self.check_dedup(cmd_editcap, result_file, infile, ['-d', '--ignore-bytes', '22'], 2)
+        self.check_dedup(cmd_editcap, result_file, infile,
+                ['-d', '--ignore-bytes', '22', '--ignore-bytes', '24:2'], 1)
@@ -63,6 +63,33 @@ class case_fileformat_pcap(subprocesstest.SubprocessTestCase):
             )
         self.assertTrue(self.diffOutput(capture_proc.stdout_str, fileformats_baseline_str, 'tshark', baseline_file))
 
+    def test_pcap_zstd_multiframe(self, cmd_tshark, capture_file, features, fileformats_baseline_str):
+        '''Microsecond pcap direct vs microsecond pcap in several zstd frames'''
+        # Written like pzstd does, with a skippable frame in front of each
+        # zstd frame. The frames do not end at record boundaries.
+        if not features.have_zstd:
+            self.skipTest('Requires Zstandard.')
+        capture_proc = self.assertRun((cmd_tshark,
+                '-r', capture_file('dhcp-pzstd.pcap.zst'),
+                '-Tfields',
+                '-e', 'frame.number', '-e', 'frame.time_epoch', '-e', 'frame.time_delta',
+                ),
+            )
+        self.assertTrue(self.diffOutput(capture_proc.stdout_str, fileformats_baseline_str, 'tshark', baseline_file))
+
+    def test_pcap_zstd_multiframe_2pass(self, cmd_tshark, capture_file, features, fileformats_baseline_str):
+        '''Microsecond pcap direct vs random access to several zstd frames'''
+        if not features.have_zstd:
+            self.skipTest('Requires Zstandard.')
+        capture_proc = self.assertRun((cmd_tshark,
+                '-r', capture_file('dhcp-pzstd.pcap.zst'),
+                '-2',
+                '-Tfields',
+                '-e', 'frame.number', '-e', 'frame.time_epoch', '-e', 'frame.time_delta',
+                ),
+            )
+        self.assertTrue(self.diffOutput(capture_proc.stdout_str, fileformats_baseline_str, 'tshark', baseline_file))
+
 
 @fixtures.mark_usefixtures('test_env')
 @fixtures.uses_fixtures
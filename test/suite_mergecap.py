@@ -9,6 +9,7 @@
 '''Mergecap tests'''
 
 import re
+import sys
 import subprocesstest
 import fixtures
 
@@ -285,3 +286,15 @@ class case_mergecap_pcapng(subprocesstest.SubprocessTestCase):
         ))
         # check for 11 IDBs, 88*3=264 total pkts, 86*3=258 in first IDB
         check_mergecap(self, mergecap_proc, 'pcapng', 'Per packet', 264, 11, 258, result_file)
+
+    def test_mergecap_40_pcapng_file_limit_pcapng(self, cmd_mergecap, capture_file, result_file):
+        '''Merge more pcapng files than can be open at once to pcapng'''
+        if sys.platform.startswith('win32'):
+            self.skipTest('Requires a POSIX shell.')
+        testout_file = result_file(testout_pcapng)
+        # The files are merged in batches through temporary files.
+        mergecap_proc = self.assertRun('ulimit -n 24 && "{}" -V -w "{}" {}'.format(
+            cmd_mergecap, testout_file,
+            ' '.join(['"{}"'.format(capture_file('dhcp.pcapng'))] * 40)),
+            shell=True)
+        check_mergecap(self, mergecap_proc, 'pcapng', 'Ethernet', 160, 1, 160, result_file)
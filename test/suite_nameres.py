@@ -8,8 +8,10 @@
 #
 '''Name resolution tests'''
 
+import ipaddress
 import os.path
 import shutil
+import struct
 import subprocesstest
 import fixtures
 
@@ -17,6 +19,87 @@ tf_str = { True: 'TRUE', False: 'FALSE' }
 
 custom_profile_name = 'Custom Profile'
 
+
+def mmdb_encode(value):
+    '''Encode a value in the MaxMind DB data section format.'''
+    def encode(type_, size, payload=b''):
+        # Types above 7 are "extended" and have a second type byte.
+        first = (type_ << 5) if type_ <= 7 else 0
+        ext = bytes([type_ - 7]) if type_ > 7 else b''
+        if size < 29:
+            return bytes([first | size]) + ext + payload
+        assert size < 285
+        return bytes([first | 29]) + ext + bytes([size - 29]) + payload
+    if isinstance(value, str):
+        data = value.encode('utf-8')
+        return encode(2, len(data), data)
+    if isinstance(value, float):
+        return encode(3, 8, struct.pack('>d', value))
+    if isinstance(value, int):
+        data = struct.pack('>I', value).lstrip(b'\0')
+        return encode(5 if value < 0x10000 else 6, len(data), data)
+    if isinstance(value, dict):
+        return encode(7, len(value), b''.join(mmdb_encode(k) + mmdb_encode(v) for k, v in value.items()))
+    if isinstance(value, list):
+        return encode(11, len(value), b''.join(mmdb_encode(v) for v in value))
+    raise TypeError(value)
+
+
+def write_mmdb(path, networks):
+    '''Write an IPv6 MaxMind DB with 24 bit records. networks maps IPv4
+    and IPv6 networks to dictionaries. Networks must not overlap. Maps
+    that were already written are written again as pointers.'''
+    data = b''
+    written = {}
+    tree = {}
+    for network, record in networks.items():
+        net = ipaddress.ip_network(network)
+        bits = net.prefixlen + (96 if net.version == 4 else 0)
+        addr = int(net.network_address)
+        node = tree
+        for i in range(bits - 1):
+            node = node.setdefault((addr >> (127 - i)) & 1, {})
+        node[(addr >> (128 - bits)) & 1] = len(data)
+        data += bytes([0xe0 | len(record)])
+        for key, value in record.items():
+            data += mmdb_encode(key)
+            encoded = mmdb_encode(value)
+            if encoded in written:
+                offset = written[encoded]
+                assert offset < 2048
+                data += bytes([0x20 | (offset >> 8), offset & 0xff])
+            else:
+                written[encoded] = len(data)
+                data += encoded
+    nodes = [tree]
+    for node in nodes:
+        nodes.extend(child for child in node.values() if isinstance(child, dict))
+    index = {id(node): i for i, node in enumerate(nodes)}
+    tree_data = b''
+    for node in nodes:
+        for bit in (0, 1):
+            child = node.get(bit)
+            if child is None:
+                record = len(nodes)
+            elif isinstance(child, dict):
+                record = index[id(child)]
+            else:
+                record = len(nodes) + 16 + child
+            tree_data += struct.pack('>I', record)[1:]
+    metadata = mmdb_encode({
+        'binary_format_major_version': 2,
+        'binary_format_minor_version': 0,
+        'build_epoch': 0,
+        'database_type': 'Wireshark-Test',
+        'ip_version': 6,
+        'languages': ['en'],
+        'node_count': len(nodes),
+        'record_size': 24,
+    })
+    with open(path, 'wb') as f:
+        f.write(tree_data + bytes(16) + data + b'\xab\xcd\xefMaxMind.com' + metadata)
+
+
 @fixtures.fixture
 def nameres_env(test_env, program_path, conf_path):
     bundle_path = os.path.join(program_path, 'Wireshark.app', 'Contents', 'MacOS')
@@ -128,3 +211,97 @@ class case_name_resolution(subprocesstest.SubprocessTestCase):
                 ))
         self.assertTrue(self.grepOutput('fe80::6233:4bff:fe13:c558\tCrunch.local'))
         self.assertFalse(self.grepOutput('174.137.42.65\twww.wireshark.org'))
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_geoip(subprocesstest.SubprocessTestCase):
+
+    def test_geoip_in_process(self, cmd_tshark, capture_file, conf_path, features, test_env):
+        '''GeoIP fields are available on the first pass with in-process lookups.'''
+        if not features.have_maxminddb:
+            self.skipTest('Test requires MaxMind DB support.')
+        db_dir = os.path.join(conf_path, 'GeoIP')
+        os.makedirs(db_dir)
+        test_country = {'iso_code': 'ZZ', 'names': {'en': 'Test Country'}}
+        write_mmdb(os.path.join(db_dir, 'test.mmdb'), {
+            '8.8.8.0/24': {
+                'autonomous_system_number': 64496,
+                'autonomous_system_organization': 'Test AS',
+                'country': test_country,
+            },
+            '4.2.2.0/24': {
+                'city': {'names': {'en': 'Test City'}},
+                'country': test_country,
+                'location': {'latitude': 1.5, 'longitude': -2.5, 'accuracy_radius': 100},
+            },
+            '2001:db8::/32': {
+                'country': test_country,
+            },
+        })
+        with open(os.path.join(conf_path, 'maxmind_db_paths'), 'w') as f:
+            f.write('"{}"\n'.format(db_dir.replace('\\', '\\x5c')))
+        # No second pass (-2), so the results must be there immediately.
+        proc = self.assertRun((cmd_tshark,
+                '-r', capture_file('dns+icmp.pcapng.gz'),
+                '-o', 'nameres.maxmind_geoip: TRUE',
+                '-o', 'nameres.maxmind_in_process: TRUE',
+                '-Y', 'ip.geoip.dst_asnum == 64496 || ip.geoip.src_city == "Test City"',
+                '-T', 'fields', '-e', 'frame.number', '-e', 'ip.geoip.country_iso',
+                ), env=test_env)
+        self.assertEqual(proc.stdout_str.split(), [
+            '4', 'ZZ', '6', 'ZZ', '8', 'ZZ', '19', 'ZZ', '21', 'ZZ', '23', 'ZZ'])
+
+
+@fixtures.mark_usefixtures('test_env')
+@fixtures.uses_fixtures
+class case_subnets(subprocesstest.SubprocessTestCase):
+
+    def resolve_subnets(self, cmd_text2pcap, cmd_tshark, result_file, test_env, ip_args, fields):
+        '''Writes a UDP packet with the addresses in ip_args and returns
+        the resolved names of the fields.'''
+        text_file = result_file('subnets.txt')
+        pcap_file = result_file('subnets.pcap')
+        with open(text_file, 'w') as f:
+            f.write('0000  00 01 02 03\n')
+        self.assertRun((cmd_text2pcap, '-u', '1000,2000') + ip_args + (text_file, pcap_file))
+        tshark_cmd = (cmd_tshark,
+            '-r', pcap_file,
+            '-o', 'nameres.network_name: TRUE',
+            '-T', 'fields',
+            )
+        for field in fields:
+            tshark_cmd += ('-e', field)
+        proc = self.assertRun(tshark_cmd, env=test_env)
+        return proc.stdout_str.strip().split('\t')
+
+    def write_subnets(self, conf_path):
+        # Overlapping prefixes. A repeated prefix is ignored, also if its
+        # address has bits set beyond the mask length.
+        with open(os.path.join(conf_path, 'subnets'), 'w') as f:
+            f.write(
+                '10.0.0.0/8\tnet-a\n'
+                '10.1.0.0/16\tnet-b\n'
+                '10.1.2.3/8\tnet-c\n'
+                '2001:db8::/32\tdoc\n'
+                '2001:db8:1::/48\tsite\n'
+                '2001:db8:1:0:ffff::/48\tsite-dup\n'
+                '2001:db8:1::42/128\thost42\n'
+            )
+
+    def test_subnets_ipv4(self, cmd_text2pcap, cmd_tshark, result_file, conf_path, test_env):
+        '''IPv4 subnets, the longest prefix wins and the first of a repeated prefix is kept.'''
+        self.write_subnets(conf_path)
+        names = self.resolve_subnets(cmd_text2pcap, cmd_tshark, result_file, test_env,
+                ('-4', '10.1.2.3,10.200.0.1'), ('ip.src_host', 'ip.dst_host'))
+        self.assertEqual(names, ['net-b.2.3', 'net-a.200.0.1'])
+
+    def test_subnets_ipv6(self, cmd_text2pcap, cmd_tshark, result_file, conf_path, test_env):
+        '''IPv6 subnets are formatted as name::host, a /128 as the name alone.'''
+        self.write_subnets(conf_path)
+        names = self.resolve_subnets(cmd_text2pcap, cmd_tshark, result_file, test_env,
+                ('-6', '2001:db8:1::42,2001:db8:2::1'), ('ipv6.src_host', 'ipv6.dst_host'))
+        self.assertEqual(names, ['host42', 'doc::2:0:0:0:0:1'])
+        names = self.resolve_subnets(cmd_text2pcap, cmd_tshark, result_file, test_env,
+                ('-6', '2001:db8:1::7,2001:db9::1'), ('ipv6.src_host', 'ipv6.dst_host'))
+        self.assertEqual(names, ['site::7', '2001:db9::1'])
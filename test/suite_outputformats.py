@@ -93,3 +93,18 @@ class case_outputformats(subprocesstest.SubprocessTestCase):
         ''' Check that the option -j works with -Tek.'''
         check_outputformat("ek", extra_args=['-j', 'dhcp'], expected="dhcp-filter.ek",
             multiline=True)
+
+    def test_outputformat_fields_primed(self, cmd_tshark, capture_file):
+        '''Checks that -Tfields writes the same values whether or not the tree is visible.'''
+        fields = ['-eudp.srcport', '-edhcp.option.type', '-edhcp.option.request_list_item']
+        # Only the fields are added to the tree.
+        primed_proc = self.assertRun([cmd_tshark, '-r', capture_file('dhcp.pcap'),
+                                      '-Tfields'] + fields)
+        # A protocol is written using its representation, which needs
+        # the whole tree.
+        visible_proc = self.assertRun([cmd_tshark, '-r', capture_file('dhcp.pcap'),
+                                       '-Tfields', '-eip'] + fields)
+        visible_lines = [line.split('\t', 1)[1] for line in visible_proc.stdout_str.splitlines()]
+        primed_lines = primed_proc.stdout_str.splitlines()
+        self.assertEqual(primed_lines, visible_lines)
+        self.assertTrue(primed_lines[0].endswith('\t1,3,6,42'))
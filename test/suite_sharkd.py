@@ -403,6 +403,61 @@ class case_sharkd(subprocesstest.SubprocessTestCase):
             {"jsonrpc":"2.0","id":3,"error":{"code":-6001,"message":"Filter \"garbage filter\" is invalid - \"filter\" was unexpected in this context."}},
         ))
 
+    def test_sharkd_req_iograph_cached(self, check_sharkd_session, capture_file):
+        # Only the first request taps the file, the others are merged from
+        # the cached graphs. The items were recorded with a tap per interval.
+        graphs = {"graph0": "packets", "graph1": "bytes",
+                  "graph2": "max:frame.len", "filter2": "frame.len",
+                  "graph3": "avg:frame.len", "filter3": "frame.len",
+                  "graph4": "load:frame.time_delta", "filter4": "frame.time_delta < 2"}
+        check_sharkd_session((
+            {"jsonrpc":"2.0", "id":1, "method":"load",
+            "params":{"file": capture_file('dns+icmp.pcapng.gz')}
+            },
+            {"jsonrpc":"2.0", "id":2, "method":"iograph",
+            "params":dict(graphs, interval=1000)
+            },
+            {"jsonrpc":"2.0", "id":3, "method":"iograph",
+            "params":dict(graphs, interval=300)
+            },
+            {"jsonrpc":"2.0", "id":4, "method":"iograph",
+            "params":dict(graphs, interval=10000)
+            },
+        ), (
+            {"jsonrpc":"2.0","id":1,"result":{"status":"OK"}},
+            {"jsonrpc":"2.0","id":2,"result":{"iograph": [
+                {"items": [1.0, '5', 4.0, 2.0, 5.0, 1.0, 2.0, 'b', 1.0, 3.0, 2.0, 1.0, 6.0, 2.0, 2.0, 1.0]},
+                {"items": [80.0, '5', 400.0, 196.0, 498.0, 98.0, 196.0, 'b', 80.0, 312.0, 196.0, 98.0, 536.0, 196.0, 196.0, 98.0]},
+                {"items": [80.0, '5', 124.0, 98.0, 124.0, 98.0, 98.0, 'b', 80.0, 116.0, 98.0, 98.0, 98.0, 98.0, 98.0, 98.0]},
+                {"items": [80.0, '5', 100.0, 98.0, 99.6, 98.0, 98.0, 'b', 80.0, 104.0, 98.0, 98.0, 89.333333, 98.0, 98.0, 98.0]},
+                {"items": ['5', 0.998991, 1.0, 1.0, 1.0, 0.985425, 'b', 0.000635, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.138642]},
+            ]}},
+            {"jsonrpc":"2.0","id":3,"result":{"iograph": [
+                {"items": [1.0, '10', 3.0, '12', 1.0, '14', 2.0, '17', 1.0, '19', 2.0, 2.0, '1d', 1.0, '1f', 1.0,
+                           '21', 1.0, '27', 1.0, 3.0, '2b', 1.0, 1.0, '2e', 1.0, '32', 2.0, '34', 4.0,
+                           '37', 1.0, 1.0, 1.0, '3b', 1.0, 1.0]},
+                {"items": [80.0, '10', 302.0, '12', 98.0, '14', 196.0, '17', 98.0, '19', 178.0, 222.0, '1d', 98.0, '1f', 98.0,
+                           '21', 98.0, '27', 80.0, 312.0, '2b', 98.0, 98.0, '2e', 98.0, '32', 175.0, '34', 361.0,
+                           '37', 98.0, 98.0, 98.0, '3b', 98.0, 98.0]},
+                {"items": [80.0, '10', 124.0, '12', 98.0, '14', 98.0, '17', 98.0, '19', 98.0, 124.0, '1d', 98.0, '1f', 98.0,
+                           '21', 98.0, '27', 80.0, 116.0, '2b', 98.0, 98.0, '2e', 98.0, '32', 98.0, '34', 98.0,
+                           '37', 98.0, 98.0, 98.0, '3b', 98.0, 98.0]},
+                {"items": [80.0, '10', 100.666667, '12', 98.0, '14', 98.0, '17', 98.0, '19', 89.0, 111.0, '1d', 98.0, '1f', 98.0,
+                           '21', 98.0, '27', 80.0, 104.0, '2b', 98.0, 98.0, '2e', 98.0, '32', 87.5, '34', 90.25,
+                           '37', 98.0, 98.0, 98.0, '3b', 98.0, 98.0]},
+                {"items": ['10', 0.32997, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 0.28475,
+                           '27', 0.002117, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0,
+                           1.0, 1.0, 1.0, 1.0, 1.0, 0.46214]},
+            ]}},
+            {"jsonrpc":"2.0","id":4,"result":{"iograph": [
+                {"items": [15.0, 18.0]},
+                {"items": [1468.0, 1712.0]},
+                {"items": [124.0, 116.0]},
+                {"items": [97.866667, 95.111111]},
+                {"items": [0.498442, 0.613928]},
+            ]}},
+        ))
+
     def test_sharkd_req_intervals_bad(self, check_sharkd_session, capture_file):
         check_sharkd_session((
             {"jsonrpc":"2.0", "id":1, "method":"load",
@@ -57,6 +57,12 @@ class case_unittests(subprocesstest.SubprocessTestCase):
             '--verbose'
         ), env=base_env)
 
+    def test_unit_io_graph_item_test(self, program, base_env):
+        '''I/O graph item unit tests'''
+        self.assertRun((program('io_graph_item_test'),
+            '--verbose'
+        ), env=base_env)
+
     def test_unit_fieldcount(self, cmd_tshark, test_env):
         '''fieldcount'''
         self.assertRun((cmd_tshark, '-G', 'fieldcount'), env=test_env)
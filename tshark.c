@@ -30,6 +30,8 @@
 
 #ifndef _WIN32
 #include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #endif
 
 #include <glib.h>
@@ -81,6 +83,7 @@
 #include "ui/dissect_opts.h"
 #include "ui/ssl_key_export.h"
 #include "ui/failure_message.h"
+#include "ui/quic_shard.h"
 #if defined(HAVE_LIBSMI)
 #include "epan/oids.h"
 #endif
@@ -138,6 +141,7 @@
 #define LONGOPT_CAPTURE_COMMENT         LONGOPT_BASE_APPLICATION+6
 #define LONGOPT_HEXDUMP                 LONGOPT_BASE_APPLICATION+7
 #define LONGOPT_SELECTED_FRAME          LONGOPT_BASE_APPLICATION+8
+#define LONGOPT_QUIC_SHARDS             LONGOPT_BASE_APPLICATION+9
 
 capture_file cfile;
 
@@ -147,6 +151,19 @@ static frame_data prev_dis_frame;
 static frame_data prev_cap_frame;
 
 static gboolean perform_two_pass_analysis;
+
+/*
+ * Sharded dissection (--quic-shards): the frames are assigned to shards by
+ * QUIC connection and every shard is dissected by a worker process. In a
+ * worker, frames of other shards are skipped, and the output position after
+ * every frame of its own shard is recorded so that the parent can merge the
+ * output in frame order.
+ */
+static guint quic_shard_count;
+static gboolean stats_requested;
+static const quic_shard_map_t *quic_shard_worker_map;
+static guint quic_shard_worker_id;
+static GArray *quic_shard_worker_ends;
 static guint32 epan_auto_reset_count = 0;
 static gboolean epan_auto_reset = FALSE;
 
@@ -172,6 +189,7 @@ static gboolean print_packet_info; /* TRUE if we're to print packet information
 static gboolean print_summary;     /* TRUE if we're to print packet summary information */
 static gboolean print_details;     /* TRUE if we're to print packet details information */
 static gboolean print_hex;         /* TRUE if we're to print hex/ascii information */
+static gboolean prime_output_fields; /* TRUE if we're to prime the tree with the -e fields */
 static gboolean line_buffered;
 static gboolean quiet = FALSE;
 static gboolean really_quiet = FALSE;
@@ -423,6 +441,8 @@ print_usage(FILE *output)
     fprintf(output, "                           enable dissection of heuristic protocol\n");
     fprintf(output, "  --disable-heuristic <short_name>\n");
     fprintf(output, "                           disable dissection of heuristic protocol\n");
+    fprintf(output, "  --quic-shards <count>    dissect a capture file in <count> processes, sharded\n");
+    fprintf(output, "                           by QUIC connection (only with -r, text or fields output)\n");
 
     /*fprintf(output, "\n");*/
     fprintf(output, "Output:\n");
@@ -856,6 +876,7 @@ main(int argc, char *argv[])
         {"capture-comment", ws_required_argument, NULL, LONGOPT_CAPTURE_COMMENT},
         {"hexdump", ws_required_argument, NULL, LONGOPT_HEXDUMP},
         {"selected-frame", ws_required_argument, NULL, LONGOPT_SELECTED_FRAME},
+        {"quic-shards", ws_required_argument, NULL, LONGOPT_QUIC_SHARDS},
         {0, 0, 0, 0}
     };
     gboolean             arg_error = FALSE;
@@ -1617,6 +1638,7 @@ main(int argc, char *argv[])
                     exit_status = WS_EXIT_INVALID_OPTION;
                     goto clean_exit;
                 }
+                stats_requested = TRUE;
                 break;
             case 'd':        /* Decode as rule */
             case 'K':        /* Kerberos keytab file */
@@ -1644,6 +1666,7 @@ main(int argc, char *argv[])
                     exit_status = WS_EXIT_INVALID_OPTION;
                     goto clean_exit;
                 }
+                stats_requested = TRUE;
                 break;
             case LONGOPT_EXPORT_TLS_SESSION_KEYS:   /* --export-tls-session-keys */
                 tls_session_keys_file = ws_optarg;
@@ -1694,6 +1717,14 @@ main(int argc, char *argv[])
                     goto clean_exit;
                 }
                 break;
+            case LONGOPT_QUIC_SHARDS:
+                quic_shard_count = get_positive_int(ws_optarg, "number of QUIC shards");
+                if (quic_shard_count > QUIC_SHARD_MAX) {
+                    cmdarg_err("The number of QUIC shards must be at most %u.", QUIC_SHARD_MAX);
+                    exit_status = WS_EXIT_INVALID_OPTION;
+                    goto clean_exit;
+                }
+                break;
             default:
             case '?':        /* Bad flag - print usage message */
                 switch(ws_optopt) {
@@ -1746,6 +1777,22 @@ main(int argc, char *argv[])
         goto clean_exit;
     }
 
+    if (quic_shard_count > 1) {
+#ifdef _WIN32
+        cmdarg_err("--quic-shards is not supported on Windows.");
+        exit_status = WS_EXIT_INVALID_OPTION;
+        goto clean_exit;
+#else
+        if (!cf_name || perform_two_pass_analysis || output_file_name || stats_requested ||
+                (output_action != WRITE_TEXT && output_action != WRITE_FIELDS)) {
+            cmdarg_err("--quic-shards requires -r and text or fields output, it cannot be "
+                    "combined with -2, -w, -z or --export-objects.");
+            exit_status = WS_EXIT_INVALID_OPTION;
+            goto clean_exit;
+        }
+#endif
+    }
+
     if (dissect_color) {
         if (!color_filters_init(&err_msg, NULL)) {
             fprintf(stderr, "%s\n", err_msg);
@@ -2103,6 +2150,13 @@ main(int argc, char *argv[])
             goto clean_exit;
         }
     }
+
+    /* "-T fields" only needs the values of the fields given with -e.
+       Unless one of them is written using the text of a visible tree,
+       prime an invisible tree with just those fields instead of building
+       the whole tree. */
+    if (output_action == WRITE_FIELDS && output_fields_can_prime_edt(output_fields))
+        prime_output_fields = TRUE;
 #ifdef HAVE_LIBPCAP
     /* We currently don't support taps, or printing dissected packets,
        if we're writing to a pipe. */
@@ -2565,9 +2619,7 @@ tshark_get_frame_ts(struct packet_provider_data *prov, guint32 frame_num)
         return &prov->prev_cap->abs_ts;
 
     if (prov->frames) {
-        frame_data *fd = frame_data_sequence_find(prov->frames, frame_num);
-
-        return (fd) ? &fd->abs_ts : NULL;
+        return frame_data_sequence_find_ts(prov->frames, frame_num);
     }
 
     return NULL;
@@ -2863,8 +2915,9 @@ capture_input_new_packets(capture_session *cap_session, int to_read)
         /* The protocol tree will be "visible", i.e., printed, only if we're
            printing packet details, which is true if we're printing stuff
            ("print_packet_info" is true) and we're in verbose mode
-           ("packet_details" is true). */
-        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details);
+           ("packet_details" is true), unless we're priming it with
+           the "-T fields" fields instead. */
+        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details && !prime_output_fields);
 
         wtap_rec_init(&rec);
         ws_buffer_init(&buf, 1514);
@@ -2872,7 +2925,7 @@ capture_input_new_packets(capture_session *cap_session, int to_read)
         while (to_read-- && cf->provider.wth) {
             wtap_cleareof(cf->provider.wth);
             ret = wtap_read(cf->provider.wth, &rec, &buf, &err, &err_info, &data_offset);
-            reset_epan_mem(cf, edt, create_proto_tree, print_packet_info && print_details);
+            reset_epan_mem(cf, edt, create_proto_tree, print_packet_info && print_details && !prime_output_fields);
             if (ret == FALSE) {
                 /* read from file failed, tell the capture child to stop */
                 sync_pipe_stop(cap_session);
@@ -3095,8 +3148,12 @@ process_packet_first_pass(capture_file *cf, epan_dissect_t *edt,
     }
 
     if (passed) {
+        frame_data *prev_frame = cf->provider.prev_cap;
+
         frame_data_set_after_dissect(&fdlocal, &cum_bytes);
         cf->provider.prev_cap = cf->provider.prev_dis = frame_data_sequence_add(cf->provider.frames, &fdlocal);
+        /* The previous frame is no longer needed in its full form. */
+        frame_data_sequence_release(cf->provider.frames, prev_frame);
 
         /* If we're not doing dissection then there won't be any dependent frames.
          * More importantly, edt.pi.fd.dependent_frames won't be initialized because
@@ -3196,8 +3253,10 @@ process_cap_file_first_pass(capture_file *cf, int max_packet_count,
     wtap_rec_init(&rec);
     ws_buffer_init(&buf, 1514);
 
-    /* Allocate a frame_data_sequence for all the frames. */
-    cf->provider.frames = new_frame_data_sequence();
+    /* Allocate a frame_data_sequence for all the frames. Both passes
+       only need the current and the previous frames in full, keep the
+       others packed. */
+    cf->provider.frames = new_frame_data_sequence_compact();
 
     if (do_dissection) {
         gboolean create_proto_tree;
@@ -3261,6 +3320,7 @@ process_cap_file_first_pass(capture_file *cf, int max_packet_count,
      * don't need after the sequential run-through of the packets. */
     postseq_cleanup_all_protocols();
 
+    frame_data_sequence_release(cf->provider.frames, cf->provider.prev_cap);
     cf->provider.prev_dis = NULL;
     cf->provider.prev_cap = NULL;
 
@@ -3297,6 +3357,9 @@ process_packet_second_pass(capture_file *cf, epan_dissect_t *edt,
 
         col_custom_prime_edt(edt, &cf->cinfo);
 
+        if (prime_output_fields)
+            output_fields_prime_edt(output_fields, edt);
+
         /* We only need the columns if either
            1) some tap needs the columns
            or
@@ -3396,6 +3459,8 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
     int             framenum = 0;
     int             write_framenum = 0;
     frame_data     *fdata;
+    frame_data     *prev_dis, *prev_cap;
+    gboolean        passed;
     gboolean        filtering_tap_listeners;
     guint           tap_flags;
     epan_dissect_t *edt = NULL;
@@ -3445,8 +3510,9 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
         /* The protocol tree will be "visible", i.e., printed, only if we're
            printing packet details, which is true if we're printing stuff
            ("print_packet_info" is true) and we're in verbose mode
-           ("packet_details" is true). */
-        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details);
+           ("packet_details" is true), unless we're priming it with
+           the "-T fields" fields instead. */
+        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details && !prime_output_fields);
     }
 
     /*
@@ -3468,7 +3534,16 @@ process_cap_file_second_pass(capture_file *cf, wtap_dumper *pdh,
             break;
         }
         ws_debug("tshark: invoking process_packet_second_pass() for frame #%d", framenum);
-        if (process_packet_second_pass(cf, edt, fdata, &rec, &buf, tap_flags)) {
+        prev_dis = cf->provider.prev_dis;
+        prev_cap = cf->provider.prev_cap;
+        passed = process_packet_second_pass(cf, edt, fdata, &rec, &buf, tap_flags);
+        /* Only the current and the previous displayed frames are still
+           needed in their full form. */
+        if (prev_cap != cf->provider.prev_dis)
+            frame_data_sequence_release(cf->provider.frames, prev_cap);
+        if (prev_dis != prev_cap && prev_dis != cf->provider.prev_dis)
+            frame_data_sequence_release(cf->provider.frames, prev_dis);
+        if (passed) {
             /* Either there's no read filtering or this packet passed the
                filter, so, if we're writing to a capture file, write
                this packet out. */
@@ -3560,8 +3635,9 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
         /* The protocol tree will be "visible", i.e., printed, only if we're
            printing packet details, which is true if we're printing stuff
            ("print_packet_info" is true) and we're in verbose mode
-           ("packet_details" is true). */
-        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details);
+           ("packet_details" is true), unless we're priming it with
+           the "-T fields" fields instead. */
+        edt = epan_dissect_new(cf->epan, create_proto_tree, print_packet_info && print_details && !prime_output_fields);
     }
 
     /*
@@ -3571,6 +3647,13 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
      */
     set_resolution_synchrony(TRUE);
 
+    /*
+     * If the file is compressed, decompress it in a separate thread,
+     * ahead of us, rather than between the packets we dissect.
+     */
+    if (wtap_get_compression_type(cf->provider.wth) != WTAP_UNCOMPRESSED)
+        wtap_start_read_ahead(cf->provider.wth);
+
     *err = 0;
     while (wtap_read(cf->provider.wth, &rec, &buf, err, err_info, &data_offset)) {
         if (read_interrupted) {
@@ -3590,7 +3673,7 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
 
         ws_debug("tshark: processing packet #%d", framenum);
 
-        reset_epan_mem(cf, edt, create_proto_tree, print_packet_info && print_details);
+        reset_epan_mem(cf, edt, create_proto_tree, print_packet_info && print_details && !prime_output_fields);
 
         if (process_packet_single_pass(cf, edt, data_offset, &rec, &buf, tap_flags)) {
             /* Either there's no read filtering or this packet passed the
@@ -3652,6 +3735,196 @@ process_cap_file_single_pass(capture_file *cf, wtap_dumper *pdh,
     return status;
 }
 
+#ifndef _WIN32
+/*
+ * Runs in a worker process, dissects the frames of one shard. The output is
+ * written to "output", followed by the output position after every frame of
+ * the shard to "index". Returns the exit status of the worker.
+ */
+static int
+process_cap_file_shard(capture_file *cf, const quic_shard_map_t *map, guint shard,
+        FILE *output, FILE *index, int max_packet_count)
+{
+    int          err;
+    gchar       *err_info = NULL;
+    volatile guint32 err_framenum;
+    pass_status_t status;
+
+    /* The file offset of the inherited wtap is shared with the parent and the
+       other workers, so open the file again. */
+    wtap_close(cf->provider.wth);
+    cf->provider.wth = NULL;
+    if (cf_open(cf, cf->filename, cf->open_type, FALSE, &err) != CF_OK) {
+        return WS_EXIT_INVALID_FILE;
+    }
+
+    if (dup2(fileno(output), STDOUT_FILENO) < 0) {
+        cmdarg_err("Can't redirect the output of QUIC shard %u: %s.", shard, g_strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    quic_shard_worker_map = map;
+    quic_shard_worker_id = shard;
+    quic_shard_worker_ends = g_array_sized_new(FALSE, FALSE, sizeof(gint64), map->shard_frames[shard]);
+
+    status = process_cap_file_single_pass(cf, NULL, max_packet_count, 0, 0,
+            &err, &err_info, &err_framenum);
+    wtap_close(cf->provider.wth);
+    cf->provider.wth = NULL;
+
+    switch (status) {
+
+        case PASS_SUCCEEDED:
+            break;
+
+        case PASS_READ_ERROR:
+            cfile_read_failure_message(cf->filename, err, err_info);
+            return 2;
+
+        case PASS_WRITE_ERROR:
+            /* No capture file is written. */
+            return 2;
+
+        case PASS_INTERRUPTED:
+            return EXIT_FAILURE;
+    }
+
+    if (fflush(stdout) != 0) {
+        show_print_file_io_error();
+        return 2;
+    }
+    if (fwrite(quic_shard_worker_ends->data, sizeof(gint64), quic_shard_worker_ends->len, index) != quic_shard_worker_ends->len ||
+            fflush(index) != 0) {
+        cmdarg_err("Can't write the output index of QUIC shard %u: %s.", shard, g_strerror(errno));
+        return 2;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Sharded single pass: assigns the frames to QUIC shards, dissects every
+ * shard in a worker process and writes their output to the standard output
+ * in frame order.
+ */
+static pass_status_t
+process_cap_file_sharded(capture_file *cf, int max_packet_count,
+        int *err, gchar **err_info)
+{
+    quic_shard_map_t map;
+    FILE        *outputs[QUIC_SHARD_MAX] = { NULL };
+    FILE        *indexes[QUIC_SHARD_MAX] = { NULL };
+    gint64       positions[QUIC_SHARD_MAX] = { 0 };
+    pid_t        pids[QUIC_SHARD_MAX];
+    guint        workers = 0;
+    gboolean     failed = FALSE;
+    pass_status_t status = PASS_SUCCEEDED;
+    char        *copy_buf;
+
+    if (!quic_shard_map_build(cf->filename, cf->open_type, quic_shard_count,
+                max_packet_count > 0 ? max_packet_count : 0, &map, err, err_info)) {
+        return PASS_READ_ERROR;
+    }
+    ws_debug("tshark: %u frames assigned to %u QUIC shards", map.frame_count, map.shard_count);
+
+    /* Do not let the workers inherit buffered output. */
+    fflush(stdout);
+
+    for (guint shard = 0; shard < map.shard_count; shard++) {
+        outputs[shard] = tmpfile();
+        indexes[shard] = tmpfile();
+        if (!outputs[shard] || !indexes[shard]) {
+            cmdarg_err("Can't create a temporary file for QUIC shard %u: %s.", shard, g_strerror(errno));
+            failed = TRUE;
+            break;
+        }
+        pids[shard] = fork();
+        if (pids[shard] < 0) {
+            cmdarg_err("Can't start the worker for QUIC shard %u: %s.", shard, g_strerror(errno));
+            failed = TRUE;
+            break;
+        }
+        if (pids[shard] == 0) {
+            /* Skip atexit handlers of the parent, everything that was
+               written is flushed already. */
+            _exit(process_cap_file_shard(cf, &map, shard, outputs[shard], indexes[shard], max_packet_count));
+        }
+        workers++;
+    }
+
+    for (guint shard = 0; shard < workers; shard++) {
+        int wstatus;
+
+        while (waitpid(pids[shard], &wstatus, 0) < 0) {
+            if (errno != EINTR) {
+                wstatus = -1;
+                break;
+            }
+        }
+        if (wstatus == -1 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != EXIT_SUCCESS) {
+            /* The worker reported the reason, if it could. */
+            failed = TRUE;
+        }
+    }
+
+    if (failed) {
+        status = read_interrupted ? PASS_INTERRUPTED : PASS_READ_ERROR;
+        *err = WTAP_ERR_INTERNAL;
+        *err_info = g_strdup("the dissection of a QUIC shard failed");
+        goto out;
+    }
+
+    /* Merge the output of the shards in frame order. */
+    for (guint shard = 0; shard < map.shard_count; shard++) {
+        rewind(outputs[shard]);
+        rewind(indexes[shard]);
+    }
+    copy_buf = (char *)g_malloc(65536);
+    for (guint32 framenum = 0; framenum < map.frame_count && status == PASS_SUCCEEDED; framenum++) {
+        guint shard = map.shards[framenum];
+        gint64 end;
+
+        if (fread(&end, sizeof(end), 1, indexes[shard]) != 1) {
+            /* Every worker records the end of the output of each of its
+               frames, a missing entry means that output was lost. */
+            *err = WTAP_ERR_INTERNAL;
+            *err_info = g_strdup_printf("the output index of QUIC shard %u is truncated", shard);
+            status = PASS_READ_ERROR;
+            break;
+        }
+        while (positions[shard] < end) {
+            size_t chunk = (size_t)MIN(end - positions[shard], 65536);
+
+            if (fread(copy_buf, 1, chunk, outputs[shard]) != chunk) {
+                *err = WTAP_ERR_INTERNAL;
+                *err_info = g_strdup_printf("the output of QUIC shard %u is truncated", shard);
+                status = PASS_READ_ERROR;
+                break;
+            }
+            if (fwrite(copy_buf, 1, chunk, stdout) != chunk) {
+                show_print_file_io_error();
+                exit(2);
+            }
+            positions[shard] += chunk;
+        }
+        if (line_buffered)
+            fflush(stdout);
+    }
+    g_free(copy_buf);
+    cf->count = map.frame_count;
+
+out:
+    for (guint shard = 0; shard < map.shard_count; shard++) {
+        if (outputs[shard])
+            fclose(outputs[shard]);
+        if (indexes[shard])
+            fclose(indexes[shard]);
+    }
+    quic_shard_map_free(&map);
+
+    return status;
+}
+#endif /* _WIN32 */
+
 static process_file_status_t
 process_cap_file(capture_file *cf, char *save_file, int out_file_type,
         gboolean out_file_name_res, int max_packet_count, gint64 max_byte_count,
@@ -3771,6 +4044,15 @@ process_cap_file(capture_file *cf, char *save_file, int out_file_type,
             ws_debug("tshark: done with second pass");
         }
     }
+#ifndef _WIN32
+    else if (quic_shard_count > 1) {
+        ws_debug("tshark: perform sharded analysis with %u QUIC shards", quic_shard_count);
+
+        first_pass_status = PASS_SUCCEEDED; /* There is no first pass */
+        second_pass_status = process_cap_file_sharded(cf, max_packet_count,
+                &err, &err_info);
+    }
+#endif
     else {
         /* !perform_two_pass_analysis */
         ws_debug("tshark: perform one pass analysis, do_dissection=%s", do_dissection ? "TRUE" : "FALSE");
@@ -3939,6 +4221,25 @@ process_packet_single_pass(capture_file *cf, epan_dissect_t *edt, gint64 offset,
     /* Count this packet. */
     cf->count++;
 
+    if (quic_shard_worker_map && (cf->count > quic_shard_worker_map->frame_count ||
+            quic_shard_worker_map->shards[cf->count - 1] != quic_shard_worker_id)) {
+        /* The frame belongs to another shard (or was appended to the file
+           after the shards were assigned). It is not dissected, but it
+           still counts for the time reference and the previous captured
+           frame. */
+        frame_data_init(&fdata, cf->count, rec, offset, cum_bytes);
+        frame_data_set_before_dissect(&fdata, &cf->elapsed_time,
+                &cf->provider.ref, cf->provider.prev_dis);
+        if (cf->provider.ref == &fdata) {
+            ref_frame = fdata;
+            cf->provider.ref = &ref_frame;
+        }
+        prev_cap_frame = fdata;
+        cf->provider.prev_cap = &prev_cap_frame;
+        frame_data_destroy(&fdata);
+        return FALSE;
+    }
+
     /* If we're not running a display filter and we're not printing any
        packet information, we don't need to do a dissection. This means
        that all packets can be marked as 'passed'. */
@@ -3963,6 +4264,9 @@ process_packet_single_pass(capture_file *cf, epan_dissect_t *edt, gint64 offset,
 
         col_custom_prime_edt(edt, &cf->cinfo);
 
+        if (prime_output_fields)
+            output_fields_prime_edt(output_fields, edt);
+
         /* We only need the columns if either
            1) some tap needs the columns
            or
@@ -4034,6 +4338,12 @@ process_packet_single_pass(capture_file *cf, epan_dissect_t *edt, gint64 offset,
         frame_data_destroy(&fdata);
         rec->block = block;
     }
+
+    if (quic_shard_worker_ends) {
+        /* The output of this frame ends here. */
+        gint64 end = ws_ftell64(stdout);
+        g_array_append_val(quic_shard_worker_ends, end);
+    }
     return passed;
 }
 
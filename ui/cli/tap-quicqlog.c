@@ -0,0 +1,387 @@
+/* tap-quicqlog.c
+ * Export of QUIC packets as qlog events (JSON-SEQ) for tshark.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/* This module writes the QUIC packets seen by the "quic" tap as qlog events
+ * to a file ("-z quic,qlog,<file>[,<filter>]"). Events are streamed while the
+ * packets are dissected, the tap does not need a protocol tree.
+ *
+ * The output follows the JSON-SEQ serialization of qlog
+ * (draft-ietf-quic-qlog-main-schema-05, draft-ietf-quic-qlog-quic-events-04):
+ * every record starts with a Record Separator (0x1E) and ends with a newline.
+ * The first record is the header of the (single) trace, the capture point is
+ * a "network" vantage point whose flow is the client, so packets sent by the
+ * client are "packet_sent" events and packets sent by the server are
+ * "packet_received" events. Events of different connections are told apart
+ * by their "group_id", the QUIC connection number (quic.connection.number).
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/dissectors/packet-quic.h>
+
+#include <wsutil/cmdarg_err.h>
+#include <wsutil/file_util.h>
+#include <wsutil/json_dumper.h>
+
+void register_tap_listener_quicqlog(void);
+
+#define QLOG_RECORD_SEPARATOR   0x1e
+
+typedef struct _quicqlog_t {
+    char       *filename;
+    char       *filter;
+    FILE       *fp;
+    json_dumper dumper;
+    gboolean    header_written;
+    nstime_t    reference_time; /* Absolute time of the first event. */
+} quicqlog_t;
+
+/* RFC 9000 Section 19 and RFC 9221 */
+static const char *
+quicqlog_frame_type(guint64 frame_type)
+{
+    if (frame_type >= 0x08 && frame_type <= 0x0f) {
+        return "stream";
+    }
+    switch (frame_type) {
+        case 0x00: return "padding";
+        case 0x01: return "ping";
+        case 0x02:
+        case 0x03: return "ack";
+        case 0x04: return "reset_stream";
+        case 0x05: return "stop_sending";
+        case 0x06: return "crypto";
+        case 0x07: return "new_token";
+        case 0x10: return "max_data";
+        case 0x11: return "max_stream_data";
+        case 0x12:
+        case 0x13: return "max_streams";
+        case 0x14: return "data_blocked";
+        case 0x15: return "stream_data_blocked";
+        case 0x16:
+        case 0x17: return "streams_blocked";
+        case 0x18: return "new_connection_id";
+        case 0x19: return "retire_connection_id";
+        case 0x1a: return "path_challenge";
+        case 0x1b: return "path_response";
+        case 0x1c:
+        case 0x1d: return "connection_close";
+        case 0x1e: return "handshake_done";
+        case 0x30:
+        case 0x31: return "datagram";
+        default: return "unknown";
+    }
+}
+
+static const char *
+quicqlog_packet_type(guint8 packet_type)
+{
+    switch (packet_type) {
+        case QUIC_TAP_PACKET_INITIAL: return "initial";
+        case QUIC_TAP_PACKET_0RTT: return "0RTT";
+        case QUIC_TAP_PACKET_HANDSHAKE: return "handshake";
+        default: return "1RTT";
+    }
+}
+
+static void
+quicqlog_cid(json_dumper *dumper, const char *name, const quic_cid_t *cid)
+{
+    char hex[2 * QUIC_MAX_CID_LENGTH + 1];
+
+    for (guint i = 0; i < cid->len; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", cid->cid[i]);
+    }
+    hex[2 * cid->len] = '\0';
+    json_dumper_set_member_name(dumper, name);
+    json_dumper_value_string(dumper, hex);
+}
+
+static void
+quicqlog_member_uint(json_dumper *dumper, const char *name, guint64 value)
+{
+    json_dumper_set_member_name(dumper, name);
+    json_dumper_value_anyf(dumper, "%" PRIu64, value);
+}
+
+static void
+quicqlog_write_header(quicqlog_t *qlog)
+{
+    json_dumper *dumper = &qlog->dumper;
+
+    fputc(QLOG_RECORD_SEPARATOR, qlog->fp);
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "qlog_version");
+    json_dumper_value_string(dumper, "0.3");
+    json_dumper_set_member_name(dumper, "qlog_format");
+    json_dumper_value_string(dumper, "JSON-SEQ");
+    json_dumper_set_member_name(dumper, "title");
+    json_dumper_value_string(dumper, "QUIC packets exported by TShark");
+    json_dumper_set_member_name(dumper, "trace");
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "vantage_point");
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "type");
+    json_dumper_value_string(dumper, "network");
+    json_dumper_set_member_name(dumper, "flow");
+    json_dumper_value_string(dumper, "client");
+    json_dumper_end_object(dumper);
+    json_dumper_set_member_name(dumper, "common_fields");
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "time_format");
+    json_dumper_value_string(dumper, "relative");
+    json_dumper_set_member_name(dumper, "reference_time");
+    json_dumper_value_double(dumper, nstime_to_msec(&qlog->reference_time));
+    json_dumper_end_object(dumper);
+    json_dumper_end_object(dumper);
+    json_dumper_end_object(dumper);
+    json_dumper_finish(dumper);
+}
+
+static void
+quicqlog_write_frame(json_dumper *dumper, const quic_tap_info_t *info, const quic_tap_frame_t *frame)
+{
+    const char *frame_type = quicqlog_frame_type(frame->frame_type);
+
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "frame_type");
+    json_dumper_value_string(dumper, frame_type);
+
+    switch (frame->frame_type) {
+        case 0x00:  /* PADDING */
+            quicqlog_member_uint(dumper, "length", frame->length);
+            break;
+        case 0x02:  /* ACK */
+        case 0x03:
+            if (info->has_ack) {
+                json_dumper_set_member_name(dumper, "ack_delay");
+                json_dumper_value_double(dumper, info->ack_delay_us / 1000.0);
+                json_dumper_set_member_name(dumper, "acked_ranges");
+                json_dumper_begin_array(dumper);
+                /* qlog lists the ranges in ascending order. */
+                for (guint i = info->ack_range_count; i-- > 0; ) {
+                    json_dumper_begin_array(dumper);
+                    json_dumper_value_anyf(dumper, "%" PRIu64, info->ack_ranges[i].smallest);
+                    json_dumper_value_anyf(dumper, "%" PRIu64, info->ack_ranges[i].largest);
+                    json_dumper_end_array(dumper);
+                }
+                json_dumper_end_array(dumper);
+            }
+            break;
+        case 0x04:  /* RESET_STREAM */
+        case 0x05:  /* STOP_SENDING */
+            quicqlog_member_uint(dumper, "stream_id", frame->stream_id);
+            quicqlog_member_uint(dumper, "error_code", frame->value);
+            break;
+        case 0x06:  /* CRYPTO */
+            quicqlog_member_uint(dumper, "offset", frame->offset);
+            quicqlog_member_uint(dumper, "length", frame->length);
+            break;
+        case 0x10:  /* MAX_DATA */
+            quicqlog_member_uint(dumper, "maximum", frame->value);
+            break;
+        case 0x11:  /* MAX_STREAM_DATA */
+            quicqlog_member_uint(dumper, "stream_id", frame->stream_id);
+            quicqlog_member_uint(dumper, "maximum", frame->value);
+            break;
+        case 0x1c:  /* CONNECTION_CLOSE */
+        case 0x1d:
+            json_dumper_set_member_name(dumper, "error_space");
+            json_dumper_value_string(dumper, frame->frame_type == 0x1c ? "transport" : "application");
+            quicqlog_member_uint(dumper, "raw_error_code", frame->value);
+            break;
+        default:
+            if (frame->frame_type >= 0x08 && frame->frame_type <= 0x0f) {
+                quicqlog_member_uint(dumper, "stream_id", frame->stream_id);
+                quicqlog_member_uint(dumper, "offset", frame->offset);
+                quicqlog_member_uint(dumper, "length", frame->length);
+                if (frame->fin) {
+                    json_dumper_set_member_name(dumper, "fin");
+                    json_dumper_value_anyf(dumper, "true");
+                }
+            } else if (!strcmp(frame_type, "unknown")) {
+                quicqlog_member_uint(dumper, "raw_frame_type", frame->frame_type);
+            }
+            break;
+    }
+    json_dumper_end_object(dumper);
+}
+
+static tap_packet_status
+quicqlog_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_)
+{
+    quicqlog_t *qlog = (quicqlog_t *)tapdata;
+    const quic_tap_info_t *info = (const quic_tap_info_t *)data;
+    json_dumper *dumper = &qlog->dumper;
+    nstime_t delta;
+
+    if (!info) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    if (!qlog->header_written) {
+        qlog->reference_time = pinfo->abs_ts;
+        quicqlog_write_header(qlog);
+        qlog->header_written = TRUE;
+    }
+    nstime_delta(&delta, &pinfo->abs_ts, &qlog->reference_time);
+
+    fputc(QLOG_RECORD_SEPARATOR, qlog->fp);
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "time");
+    json_dumper_value_double(dumper, nstime_to_msec(&delta));
+    json_dumper_set_member_name(dumper, "name");
+    json_dumper_value_string(dumper, info->from_server ? "transport:packet_received" : "transport:packet_sent");
+    json_dumper_set_member_name(dumper, "group_id");
+    json_dumper_value_anyf(dumper, "\"%u\"", info->connection_number);
+
+    json_dumper_set_member_name(dumper, "data");
+    json_dumper_begin_object(dumper);
+
+    json_dumper_set_member_name(dumper, "header");
+    json_dumper_begin_object(dumper);
+    json_dumper_set_member_name(dumper, "packet_type");
+    json_dumper_value_string(dumper, quicqlog_packet_type(info->packet_type));
+    quicqlog_member_uint(dumper, "packet_number", info->packet_number);
+    quicqlog_cid(dumper, "dcid", &info->dcid);
+    if (info->packet_type != QUIC_TAP_PACKET_1RTT) {
+        quicqlog_cid(dumper, "scid", &info->scid);
+    }
+    json_dumper_end_object(dumper);
+
+    json_dumper_set_member_name(dumper, "raw");
+    json_dumper_begin_object(dumper);
+    quicqlog_member_uint(dumper, "length", info->length);
+    quicqlog_member_uint(dumper, "payload_length", info->payload_length);
+    json_dumper_end_object(dumper);
+
+    json_dumper_set_member_name(dumper, "frames");
+    json_dumper_begin_array(dumper);
+    for (guint i = 0; i < info->frame_count; i++) {
+        quicqlog_write_frame(dumper, info, &info->frames[i]);
+    }
+    json_dumper_end_array(dumper);
+    if (info->frames_truncated) {
+        json_dumper_set_member_name(dumper, "frames_truncated");
+        json_dumper_value_anyf(dumper, "true");
+    }
+
+    json_dumper_end_object(dumper);
+    json_dumper_end_object(dumper);
+    json_dumper_finish(dumper);
+
+    return TAP_PACKET_DONT_REDRAW;
+}
+
+static void
+quicqlog_draw(void *tapdata)
+{
+    quicqlog_t *qlog = (quicqlog_t *)tapdata;
+
+    if (fflush(qlog->fp) != 0 || ferror(qlog->fp)) {
+        cmdarg_err("Couldn't write the qlog file \"%s\": %s.", qlog->filename, g_strerror(errno));
+    }
+}
+
+static void
+quicqlog_finish(void *tapdata)
+{
+    quicqlog_t *qlog = (quicqlog_t *)tapdata;
+
+    fclose(qlog->fp);
+    g_free(qlog->filename);
+    g_free(qlog->filter);
+    g_free(qlog);
+}
+
+static void
+quicqlog_init(const char *opt_arg, void *userdata _U_)
+{
+    quicqlog_t *qlog;
+    const char *args;
+    const char *filter = NULL;
+    GString *error_string;
+
+    /* quic,qlog,<file>[,<filter>] */
+    if (strncmp(opt_arg, "quic,qlog,", strlen("quic,qlog,")) != 0 || !opt_arg[strlen("quic,qlog,")]) {
+        cmdarg_err("Invalid \"-z quic,qlog,<file>[,<filter>]\" argument");
+        exit(1);
+    }
+    args = opt_arg + strlen("quic,qlog,");
+
+    qlog = g_new0(quicqlog_t, 1);
+    filter = strchr(args, ',');
+    if (filter) {
+        qlog->filename = g_strndup(args, filter - args);
+        qlog->filter = g_strdup(filter + 1);
+    } else {
+        qlog->filename = g_strdup(args);
+    }
+
+    qlog->fp = ws_fopen(qlog->filename, "w");
+    if (!qlog->fp) {
+        cmdarg_err("Couldn't create the qlog file \"%s\": %s.", qlog->filename, g_strerror(errno));
+        exit(1);
+    }
+    qlog->dumper.output_file = qlog->fp;
+
+    error_string = register_tap_listener("quic", qlog, qlog->filter,
+        TL_REQUIRES_NOTHING, NULL, quicqlog_packet, quicqlog_draw,
+        quicqlog_finish);
+    if (error_string) {
+        /* error, we failed to attach to the tap. clean up */
+        fclose(qlog->fp);
+        g_free(qlog->filename);
+        g_free(qlog->filter);
+        g_free(qlog);
+
+        cmdarg_err("Couldn't register quic,qlog tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        exit(1);
+    }
+}
+
+static stat_tap_ui quicqlog_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "quic,qlog",
+    quicqlog_init,
+    0,
+    NULL
+};
+
+void
+register_tap_listener_quicqlog(void)
+{
+    register_stat_tap_ui(&quicqlog_ui, NULL);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
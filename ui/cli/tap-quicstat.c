@@ -0,0 +1,158 @@
+/* tap-quicstat.c
+ * QUIC connection statistics (packets, loss, RTT and ACK Delay) for tshark.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/* This module provides per connection QUIC statistics to tshark ("-z quic,conn").
+ * The analysis itself is shared with sharkd, see ui/tap-quic-analysis.c.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <epan/packet.h>
+#include <epan/tap.h>
+#include <epan/stat_tap_ui.h>
+#include <epan/dissectors/packet-quic.h>
+
+#include <ui/tap-quic-analysis.h>
+
+#include <wsutil/cmdarg_err.h>
+
+void register_tap_listener_quicstat(void);
+
+typedef struct _quicstat_t {
+    char *filter;
+    quic_analysis_t analysis;
+} quicstat_t;
+
+static void
+quicstat_reset(void *tapdata)
+{
+    quicstat_t *quicstat = (quicstat_t *)tapdata;
+
+    quic_analysis_reset(&quicstat->analysis);
+}
+
+static tap_packet_status
+quicstat_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt, const void *data, tap_flags_t flags)
+{
+    quicstat_t *quicstat = (quicstat_t *)tapdata;
+
+    return quic_analysis_packet(&quicstat->analysis, pinfo, edt, data, flags);
+}
+
+static void
+quicstat_print_dir(const char *sender, const quic_dir_analysis_t *dir)
+{
+    double avg_ack_delay = 0;
+
+    if (dir->ack_delay_samples) {
+        avg_ack_delay = dir->ack_delay_sum / dir->ack_delay_samples;
+    }
+    printf("  %-7s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %6u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+           sender, dir->packets, dir->ack_eliciting, dir->acked, dir->lost, dir->spurious,
+           dir->rtt_samples,
+           dir->min_rtt * 1000, dir->smoothed_rtt * 1000, dir->rttvar * 1000, dir->latest_rtt * 1000,
+           avg_ack_delay * 1000, dir->max_ack_delay * 1000);
+}
+
+static void
+quicstat_draw(void *tapdata)
+{
+    quicstat_t *quicstat = (quicstat_t *)tapdata;
+    GPtrArray *conn_list = quicstat->analysis.conn_list;
+
+    printf("\n");
+    printf("=============================================================================================================================\n");
+    printf("QUIC Connection Statistics (all times in ms):\n");
+    printf("Filter: %s\n", quicstat->filter ? quicstat->filter : "<none>");
+    printf("RTT is estimated per sender from the ACKs of its peer, as seen at the capture point.\n");
+    printf("Connections: %u, with released state: %u\n",
+           get_quic_connections_count(), get_quic_evicted_connections_count());
+
+    for (guint i = 0; i < conn_list->len; i++) {
+        const quic_conn_analysis_t *conn = (const quic_conn_analysis_t *)g_ptr_array_index(conn_list, i);
+
+        printf("\nConnection %u: first frame %u, duration %.3f, handshake ", conn->number,
+               conn->first_frame, (conn->last_time - conn->start_time) * 1000);
+        if (conn->handshake_done) {
+            printf("%.3f\n", conn->handshake_time * 1000);
+        } else {
+            printf("not completed\n");
+        }
+        printf("  %-7s %10s %10s %10s %8s %8s %6s %9s %9s %9s %9s %9s %9s\n",
+               "Sender", "Packets", "AckElicit", "Acked", "Lost", "Spurious",
+               "RTTs", "MinRTT", "SRTT", "RTTVar", "LatestRTT", "AvgAckDly", "MaxAckDly");
+        quicstat_print_dir("Client", &conn->dirs[0]);
+        quicstat_print_dir("Server", &conn->dirs[1]);
+    }
+    printf("=============================================================================================================================\n");
+}
+
+static void
+quicstat_init(const char *opt_arg, void *userdata _U_)
+{
+    quicstat_t *quicstat;
+    const char *filter = NULL;
+    GString *error_string;
+
+    if (strstr(opt_arg, "quic,conn,"))
+        filter = opt_arg + strlen("quic,conn,");
+
+    quicstat = g_new0(quicstat_t, 1);
+    quicstat->filter = g_strdup(filter);
+    quic_analysis_init(&quicstat->analysis);
+
+    error_string = register_tap_listener("quic", quicstat, quicstat->filter,
+        TL_REQUIRES_NOTHING, quicstat_reset, quicstat_packet, quicstat_draw,
+        NULL);
+    if (error_string) {
+        /* error, we failed to attach to the tap. clean up */
+        quic_analysis_cleanup(&quicstat->analysis);
+        g_free(quicstat->filter);
+        g_free(quicstat);
+
+        cmdarg_err("Couldn't register quic,conn tap: %s", error_string->str);
+        g_string_free(error_string, TRUE);
+        exit(1);
+    }
+}
+
+static stat_tap_ui quicstat_ui = {
+    REGISTER_STAT_GROUP_GENERIC,
+    NULL,
+    "quic,conn",
+    quicstat_init,
+    0,
+    NULL
+};
+
+void
+register_tap_listener_quicstat(void)
+{
+    register_stat_tap_ui(&quicstat_ui, NULL);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -12,6 +12,7 @@
 
 #include "config.h"
 
+#include <string.h>
 
 #include <epan/epan_dissect.h>
 
@@ -263,3 +264,185 @@ double get_io_graph_item(const io_graph_item_t *items_, io_graph_item_unit_t val
     }
     return value;
 }
+
+void io_graph_pyramid_init(io_graph_pyramid_t *pyramid, int max_items, int base_interval)
+{
+    memset(pyramid, 0, sizeof(*pyramid));
+    pyramid->max_items = max_items;
+    pyramid->base_interval = MAX(base_interval, 1);
+}
+
+void io_graph_pyramid_clear(io_graph_pyramid_t *pyramid)
+{
+    int level;
+
+    for (level = 0; level < IO_GRAPH_PYRAMID_LEVELS; level++) {
+        g_free(pyramid->items[level]);
+        pyramid->items[level] = NULL;
+        pyramid->num_items[level] = 0;
+        pyramid->space_items[level] = 0;
+        pyramid->truncated[level] = FALSE;
+    }
+}
+
+gboolean io_graph_pyramid_update(io_graph_pyramid_t *pyramid, packet_info *pinfo, epan_dissect_t *edt, int hf_index, int item_unit)
+{
+    int level, idx, new_size;
+    gint64 interval;
+    gboolean updated = FALSE;
+    GPtrArray *gp = NULL;
+
+    /* All levels see the same fields, fetch them once. */
+    if (edt && hf_index >= 0) {
+        gp = proto_get_finfo_ptr_array(edt->tree, hf_index);
+    } else {
+        hf_index = -1;
+    }
+
+    interval = pyramid->base_interval;
+    for (level = 0; level < IO_GRAPH_PYRAMID_LEVELS; level++, interval *= IO_GRAPH_PYRAMID_FACTOR) {
+        if (interval > G_MAXINT) {
+            /* The coarsest levels of a large base interval aren't used. */
+            break;
+        }
+        idx = get_io_graph_index(pinfo, (int) interval);
+        if (idx < 0) {
+            return FALSE;
+        }
+        if (idx >= pyramid->max_items) {
+            /* Too far into the capture for this level. */
+            pyramid->truncated[level] = TRUE;
+            continue;
+        }
+
+        if (idx >= pyramid->num_items[level]) {
+            if (idx >= pyramid->space_items[level]) {
+                new_size = MAX(idx + 1024, pyramid->space_items[level] * 2);
+                new_size = MIN(new_size, pyramid->max_items);
+                pyramid->items[level] = g_renew(io_graph_item_t, pyramid->items[level], new_size);
+                reset_io_graph_items(&pyramid->items[level][pyramid->space_items[level]], new_size - pyramid->space_items[level]);
+                pyramid->space_items[level] = new_size;
+            }
+            pyramid->num_items[level] = idx + 1;
+        }
+
+        /* All levels see the same fields, so they all succeed or fail. */
+        updated = update_io_graph_item_fields(pyramid->items[level], idx, pinfo, gp, hf_index, item_unit, (int) interval);
+    }
+
+    return updated;
+}
+
+/* Add the values of src, which follows the items already merged into dst
+ * in time, to dst. */
+static void merge_io_graph_item(io_graph_item_t *dst, const io_graph_item_t *src, io_graph_item_unit_t item_unit)
+{
+    if (src->fields) {
+        /* Only the members for the type of the field are set, the
+         * others are zero in both items. */
+        if (dst->fields == 0 ||
+                src->double_max > dst->double_max ||
+                src->float_max > dst->float_max ||
+                nstime_cmp(&src->time_max, &dst->time_max) > 0) {
+            dst->int_max = src->int_max;
+            dst->float_max = src->float_max;
+            dst->double_max = src->double_max;
+            dst->time_max = src->time_max;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MAX) {
+                dst->extreme_frame_in_invl = src->extreme_frame_in_invl;
+            }
+        }
+        if (dst->fields == 0 ||
+                src->double_min < dst->double_min ||
+                src->float_min < dst->float_min ||
+                nstime_cmp(&src->time_min, &dst->time_min) < 0) {
+            dst->int_min = src->int_min;
+            dst->float_min = src->float_min;
+            dst->double_min = src->double_min;
+            dst->time_min = src->time_min;
+            if (item_unit == IOG_ITEM_UNIT_CALC_MIN) {
+                dst->extreme_frame_in_invl = src->extreme_frame_in_invl;
+            }
+        }
+    }
+
+    dst->frames += src->frames;
+    dst->bytes += src->bytes;
+    dst->fields += src->fields;
+    dst->int_tot += src->int_tot;
+    dst->float_tot += src->float_tot;
+    dst->double_tot += src->double_tot;
+    nstime_add(&dst->time_tot, &src->time_tot);
+
+    if (dst->first_frame_in_invl == 0) {
+        dst->first_frame_in_invl = src->first_frame_in_invl;
+    }
+    if (src->last_frame_in_invl != 0) {
+        dst->last_frame_in_invl = src->last_frame_in_invl;
+    }
+}
+
+/* Find the coarsest level whose interval divides the requested one, it
+ * has the fewest items to merge and covers the longest part of the
+ * capture. Returns -1 if no level does. */
+static int io_graph_pyramid_level(const io_graph_pyramid_t *pyramid, int interval, int *factor)
+{
+    int level, level_interval;
+
+    if (interval <= 0 || interval % pyramid->base_interval != 0) {
+        return -1;
+    }
+
+    level = 0;
+    level_interval = pyramid->base_interval;
+    while (level + 1 < IO_GRAPH_PYRAMID_LEVELS && level_interval <= G_MAXINT / IO_GRAPH_PYRAMID_FACTOR &&
+            interval % (level_interval * IO_GRAPH_PYRAMID_FACTOR) == 0) {
+        level++;
+        level_interval *= IO_GRAPH_PYRAMID_FACTOR;
+    }
+    *factor = interval / level_interval;
+    return level;
+}
+
+gboolean io_graph_pyramid_has_interval(const io_graph_pyramid_t *pyramid, int interval)
+{
+    int level, factor;
+
+    level = io_graph_pyramid_level(pyramid, interval, &factor);
+    if (level < 0) {
+        return FALSE;
+    }
+    /* A truncated level still gives max_items items of its own interval,
+     * but merged into a multiple of it, only max_items / factor. */
+    return factor == 1 || !pyramid->truncated[level];
+}
+
+io_graph_item_t *io_graph_pyramid_get_items(const io_graph_pyramid_t *pyramid, int interval, io_graph_item_unit_t item_unit, int *num_items)
+{
+    io_graph_item_t *items;
+    int level, factor, level_items, i;
+
+    *num_items = 0;
+    level = io_graph_pyramid_level(pyramid, interval, &factor);
+    if (level < 0) {
+        return NULL;
+    }
+    level_items = pyramid->num_items[level];
+
+    if (level_items == 0) {
+        return NULL;
+    }
+
+    *num_items = (level_items + factor - 1) / factor;
+    items = g_new(io_graph_item_t, *num_items);
+    if (factor == 1) {
+        memcpy(items, pyramid->items[level], sizeof(io_graph_item_t) * level_items);
+    } else {
+        reset_io_graph_items(items, *num_items);
+        for (i = 0; i < level_items; i++) {
+            merge_io_graph_item(&items[i / factor], &pyramid->items[level][i], item_unit);
+        }
+    }
+
+    return items;
+}
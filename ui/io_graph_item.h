@@ -128,22 +128,24 @@ GString *check_field_unit(const char *field_name, int *hf_index, io_graph_item_u
  */
 double get_io_graph_item(const io_graph_item_t *items, io_graph_item_unit_t val_units, int idx, int hf_index, const capture_file *cap_file, int interval, int cur_idx);
 
-/** Update the values of an io_graph_item_t.
+/** Update the values of an io_graph_item_t with the fields of a packet.
  *
- * Frame and byte counts are always calculated. If edt is non-NULL advanced
- * statistics are calculated using hfindex.
+ * Like update_io_graph_item(), for callers that update several items with
+ * the same packet and fetch its fields once.
  *
  * @param items [in,out] Array containing the item to update.
  * @param idx [in] Index of the item to update.
  * @param pinfo [in] Packet containing update information.
- * @param edt [in] Dissection information for advanced statistics. May be NULL.
- * @param hf_index [in] Header field index for advanced statistics.
+ * @param gp [in] The fields of hf_index in the packet, from
+ * proto_get_finfo_ptr_array(). May be NULL.
+ * @param hf_index [in] Header field index for advanced statistics, -1 if
+ * only frame and byte counts are calculated.
  * @param item_unit [in] The type of unit to calculate. From IOG_ITEM_UNITS.
  * @param interval [in] Timing interval in ms.
  * @return TRUE if the update was successful, otherwise FALSE.
  */
 static inline gboolean
-update_io_graph_item(io_graph_item_t *items, int idx, packet_info *pinfo, epan_dissect_t *edt, int hf_index, int item_unit, guint32 interval) {
+update_io_graph_item_fields(io_graph_item_t *items, int idx, packet_info *pinfo, GPtrArray *gp, int hf_index, int item_unit, guint32 interval) {
     io_graph_item_t *item = &items[idx];
 
     /* Set the first and last frame num in current interval matching the target field+filter  */
@@ -152,11 +154,9 @@ update_io_graph_item(io_graph_item_t *items, int idx, packet_info *pinfo, epan_d
     }
     item->last_frame_in_invl = pinfo->num;
 
-    if (edt && hf_index >= 0) {
-        GPtrArray *gp;
+    if (hf_index >= 0) {
         guint i;
 
-        gp = proto_get_finfo_ptr_array(edt->tree, hf_index);
         if (!gp) {
             return FALSE;
         }
@@ -396,6 +396,107 @@ update_io_graph_item(io_graph_item_t *items, int idx, packet_info *pinfo, epan_d
     return TRUE;
 }
 
+/** Update the values of an io_graph_item_t.
+ *
+ * Frame and byte counts are always calculated. If edt is non-NULL advanced
+ * statistics are calculated using hfindex.
+ *
+ * @param items [in,out] Array containing the item to update.
+ * @param idx [in] Index of the item to update.
+ * @param pinfo [in] Packet containing update information.
+ * @param edt [in] Dissection information for advanced statistics. May be NULL.
+ * @param hf_index [in] Header field index for advanced statistics.
+ * @param item_unit [in] The type of unit to calculate. From IOG_ITEM_UNITS.
+ * @param interval [in] Timing interval in ms.
+ * @return TRUE if the update was successful, otherwise FALSE.
+ */
+static inline gboolean
+update_io_graph_item(io_graph_item_t *items, int idx, packet_info *pinfo, epan_dissect_t *edt, int hf_index, int item_unit, guint32 interval) {
+    GPtrArray *gp = NULL;
+
+    if (edt && hf_index >= 0) {
+        gp = proto_get_finfo_ptr_array(edt->tree, hf_index);
+    } else {
+        hf_index = -1;
+    }
+    return update_io_graph_item_fields(items, idx, pinfo, gp, hf_index, item_unit, interval);
+}
+
+/** Number of levels in an io_graph_pyramid_t. */
+#define IO_GRAPH_PYRAMID_LEVELS 8
+
+/** Ratio between the intervals of consecutive levels. With a base
+ * interval of 1 ms, the last level has an interval of 10000 s. */
+#define IO_GRAPH_PYRAMID_FACTOR 10
+
+/** I/O graph items for the intervals base, 10 * base, 100 * base, ...
+ * all collected in the same pass, so that any interval that is a
+ * multiple of the base interval can be served by merging the items of
+ * a level instead of retapping.
+ *
+ * Each level holds at most max_items items. Packets past that are only
+ * counted on the coarser levels, so a fine interval on a long capture
+ * is truncated, but coarse intervals still cover all of it. An interval
+ * merged from a truncated level would cover less of the capture than
+ * max_items items of that interval, see io_graph_pyramid_has_interval().
+ */
+typedef struct _io_graph_pyramid_t {
+    io_graph_item_t *items[IO_GRAPH_PYRAMID_LEVELS];
+    int num_items[IO_GRAPH_PYRAMID_LEVELS];     /* items in use */
+    int space_items[IO_GRAPH_PYRAMID_LEVELS];   /* items allocated */
+    gboolean truncated[IO_GRAPH_PYRAMID_LEVELS]; /* packets past max_items were dropped */
+    int max_items;
+    int base_interval;                          /* interval of the first level in ms */
+} io_graph_pyramid_t;
+
+/** Initialize an empty pyramid.
+ *
+ * @param pyramid [out] The pyramid to initialize.
+ * @param max_items [in] Maximum number of items per level.
+ * @param base_interval [in] Interval of the first level in ms, usually 1.
+ */
+void io_graph_pyramid_init(io_graph_pyramid_t *pyramid, int max_items, int base_interval);
+
+/** Remove all items from a pyramid and free their memory.
+ *
+ * @param pyramid [in,out] The pyramid to clear.
+ */
+void io_graph_pyramid_clear(io_graph_pyramid_t *pyramid);
+
+/** Update every level of a pyramid with a packet.
+ *
+ * Arguments and return value are those of update_io_graph_item().
+ */
+gboolean io_graph_pyramid_update(io_graph_pyramid_t *pyramid, packet_info *pinfo, epan_dissect_t *edt, int hf_index, int item_unit);
+
+/** Check whether a pyramid can provide the items for an interval.
+ *
+ * That is the case if the interval is a multiple of the base interval
+ * and the items merged for it cover as much of the capture as max_items
+ * items tapped at that interval would. Otherwise the caller should
+ * retap into a pyramid with the interval as its base interval.
+ *
+ * @param pyramid [in] The pyramid.
+ * @param interval [in] Timing interval in ms.
+ * @return TRUE if io_graph_pyramid_get_items() gives the same items as a
+ * tap at that interval.
+ */
+gboolean io_graph_pyramid_has_interval(const io_graph_pyramid_t *pyramid, int interval);
+
+/** Get the items of a pyramid for an interval.
+ *
+ * The items come from the coarsest level whose interval divides the
+ * requested one, merged as needed. There are none if the interval is
+ * not a multiple of the base interval.
+ *
+ * @param pyramid [in] The pyramid.
+ * @param interval [in] Timing interval in ms.
+ * @param item_unit [in] The type of unit to calculate. From IOG_ITEM_UNITS.
+ * @param num_items [out] Number of items returned.
+ * @return Array of items, to be freed with g_free(). NULL if there are none.
+ */
+io_graph_item_t *io_graph_pyramid_get_items(const io_graph_pyramid_t *pyramid, int interval, io_graph_item_unit_t item_unit, int *num_items);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,274 @@
+/* io_graph_item_test.c
+ * Unit tests for the I/O graph item pyramid
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <wireshark.h>
+
+#include "ui/io_graph_item.h"
+
+/* Put items into the first level of a pyramid, as if they had been tapped. */
+static void
+fill_first_level(io_graph_pyramid_t *pyramid, const io_graph_item_t *items, int num_items)
+{
+    pyramid->items[0] = (io_graph_item_t *)g_memdup2(items, sizeof(io_graph_item_t) * num_items);
+    pyramid->num_items[0] = num_items;
+    pyramid->space_items[0] = num_items;
+}
+
+static void
+set_double_item(io_graph_item_t *item, guint32 frame, double value)
+{
+    item->frames = 1;
+    item->fields = 1;
+    item->double_max = value;
+    item->double_min = value;
+    item->double_tot = value;
+    item->first_frame_in_invl = frame;
+    item->extreme_frame_in_invl = frame;
+    item->last_frame_in_invl = frame;
+}
+
+static void
+set_time_item(io_graph_item_t *item, guint32 frame, int secs, int nsecs)
+{
+    item->frames = 1;
+    item->fields = 1;
+    item->time_max.secs = secs;
+    item->time_max.nsecs = nsecs;
+    item->time_min = item->time_max;
+    item->time_tot = item->time_max;
+    item->first_frame_in_invl = frame;
+    item->extreme_frame_in_invl = frame;
+    item->last_frame_in_invl = frame;
+}
+
+static void
+test_pyramid_merge_max(void)
+{
+    io_graph_pyramid_t pyramid;
+    io_graph_item_t level[4];
+    io_graph_item_t *items;
+    int num_items;
+
+    io_graph_pyramid_init(&pyramid, 100, 1);
+    reset_io_graph_items(level, G_N_ELEMENTS(level));
+    /* An empty item first, it must not count as a value of 0. */
+    set_double_item(&level[1], 2, -3.0);
+    set_double_item(&level[2], 3, 7.0);
+    set_double_item(&level[3], 4, 5.0);
+    fill_first_level(&pyramid, level, G_N_ELEMENTS(level));
+
+    items = io_graph_pyramid_get_items(&pyramid, 4, IOG_ITEM_UNIT_CALC_MAX, &num_items);
+    g_assert_cmpint(num_items, ==, 1);
+    g_assert_cmpfloat(items[0].double_max, ==, 7.0);
+    g_assert_cmpfloat(items[0].double_min, ==, -3.0);
+    g_assert_cmpfloat(items[0].double_tot, ==, 9.0);
+    g_assert_cmpuint(items[0].fields, ==, 3);
+    g_assert_cmpuint(items[0].frames, ==, 3);
+    g_assert_cmpuint(items[0].extreme_frame_in_invl, ==, 3);
+    g_assert_cmpuint(items[0].first_frame_in_invl, ==, 2);
+    g_assert_cmpuint(items[0].last_frame_in_invl, ==, 4);
+    g_free(items);
+
+    io_graph_pyramid_clear(&pyramid);
+}
+
+static void
+test_pyramid_merge_min(void)
+{
+    io_graph_pyramid_t pyramid;
+    io_graph_item_t level[6];
+    io_graph_item_t *items;
+    int num_items;
+
+    io_graph_pyramid_init(&pyramid, 100, 1);
+    reset_io_graph_items(level, G_N_ELEMENTS(level));
+    set_double_item(&level[0], 1, 4.0);
+    set_double_item(&level[1], 2, 2.0);
+    set_double_item(&level[2], 3, 3.0);
+    set_double_item(&level[3], 4, 8.0);
+    /* The last merged item is incomplete. */
+    set_double_item(&level[5], 6, 1.0);
+    fill_first_level(&pyramid, level, G_N_ELEMENTS(level));
+
+    items = io_graph_pyramid_get_items(&pyramid, 4, IOG_ITEM_UNIT_CALC_MIN, &num_items);
+    g_assert_cmpint(num_items, ==, 2);
+    g_assert_cmpfloat(items[0].double_min, ==, 2.0);
+    g_assert_cmpfloat(items[0].double_max, ==, 8.0);
+    g_assert_cmpuint(items[0].extreme_frame_in_invl, ==, 2);
+    g_assert_cmpfloat(items[1].double_min, ==, 1.0);
+    g_assert_cmpuint(items[1].fields, ==, 1);
+    g_assert_cmpuint(items[1].extreme_frame_in_invl, ==, 6);
+    g_free(items);
+
+    io_graph_pyramid_clear(&pyramid);
+}
+
+static void
+test_pyramid_merge_time(void)
+{
+    io_graph_pyramid_t pyramid;
+    io_graph_item_t level[3];
+    io_graph_item_t *items;
+    int num_items;
+
+    io_graph_pyramid_init(&pyramid, 100, 1);
+    reset_io_graph_items(level, G_N_ELEMENTS(level));
+    set_time_item(&level[0], 1, 0, 600000000);
+    set_time_item(&level[1], 2, 1, 0);
+    set_time_item(&level[2], 3, 0, 700000000);
+    fill_first_level(&pyramid, level, G_N_ELEMENTS(level));
+
+    items = io_graph_pyramid_get_items(&pyramid, 3, IOG_ITEM_UNIT_CALC_MAX, &num_items);
+    g_assert_cmpint(num_items, ==, 1);
+    g_assert_cmpint(items[0].time_max.secs, ==, 1);
+    g_assert_cmpint(items[0].time_max.nsecs, ==, 0);
+    g_assert_cmpint(items[0].time_min.secs, ==, 0);
+    g_assert_cmpint(items[0].time_min.nsecs, ==, 600000000);
+    g_assert_cmpuint(items[0].extreme_frame_in_invl, ==, 2);
+    g_free(items);
+
+    items = io_graph_pyramid_get_items(&pyramid, 3, IOG_ITEM_UNIT_CALC_MIN, &num_items);
+    g_assert_cmpint(num_items, ==, 1);
+    g_assert_cmpuint(items[0].extreme_frame_in_invl, ==, 1);
+    g_free(items);
+
+    io_graph_pyramid_clear(&pyramid);
+}
+
+static void
+test_pyramid_merge_load(void)
+{
+    io_graph_pyramid_t pyramid;
+    io_graph_item_t level[4];
+    io_graph_item_t *items;
+    int num_items;
+
+    /* LOAD only sums the time spent in each interval. */
+    io_graph_pyramid_init(&pyramid, 100, 1);
+    reset_io_graph_items(level, G_N_ELEMENTS(level));
+    level[0].time_tot.nsecs = 600000000;
+    level[1].time_tot.nsecs = 900000000;
+    level[2].time_tot.nsecs = 1000000;
+    level[3].time_tot.secs = 2;
+    fill_first_level(&pyramid, level, G_N_ELEMENTS(level));
+
+    items = io_graph_pyramid_get_items(&pyramid, 2, IOG_ITEM_UNIT_CALC_LOAD, &num_items);
+    g_assert_cmpint(num_items, ==, 2);
+    g_assert_cmpint(items[0].time_tot.secs, ==, 1);
+    g_assert_cmpint(items[0].time_tot.nsecs, ==, 500000000);
+    g_assert_cmpint(items[1].time_tot.secs, ==, 2);
+    g_assert_cmpint(items[1].time_tot.nsecs, ==, 1000000);
+    g_assert_cmpuint(items[0].fields, ==, 0);
+    g_free(items);
+
+    io_graph_pyramid_clear(&pyramid);
+}
+
+static void
+update_pyramid(io_graph_pyramid_t *pyramid, guint32 num, int msecs)
+{
+    packet_info pinfo;
+    frame_data fd;
+
+    memset(&pinfo, 0, sizeof(pinfo));
+    memset(&fd, 0, sizeof(fd));
+    fd.pkt_len = 100;
+    pinfo.fd = &fd;
+    pinfo.num = num;
+    pinfo.rel_ts.secs = msecs / 1000;
+    pinfo.rel_ts.nsecs = (msecs % 1000) * 1000000;
+    g_assert_true(io_graph_pyramid_update(pyramid, &pinfo, NULL, -1, IOG_ITEM_UNIT_PACKETS));
+}
+
+static void
+test_pyramid_truncated(void)
+{
+    io_graph_pyramid_t pyramid;
+    io_graph_item_t *items;
+    int num_items;
+
+    /* The 1 ms level can only hold the first 10 ms. */
+    io_graph_pyramid_init(&pyramid, 10, 1);
+    update_pyramid(&pyramid, 1, 0);
+    update_pyramid(&pyramid, 2, 5);
+    update_pyramid(&pyramid, 3, 25);
+
+    g_assert_true(io_graph_pyramid_has_interval(&pyramid, 1));
+    g_assert_false(io_graph_pyramid_has_interval(&pyramid, 5));
+    g_assert_true(io_graph_pyramid_has_interval(&pyramid, 10));
+    g_assert_true(io_graph_pyramid_has_interval(&pyramid, 20));
+    g_assert_false(io_graph_pyramid_has_interval(&pyramid, 0));
+
+    items = io_graph_pyramid_get_items(&pyramid, 20, IOG_ITEM_UNIT_PACKETS, &num_items);
+    g_assert_cmpint(num_items, ==, 2);
+    g_assert_cmpuint(items[0].frames, ==, 2);
+    g_assert_cmpuint(items[1].frames, ==, 1);
+    g_free(items);
+
+    /* A pyramid based on the interval provides all of it. */
+    io_graph_pyramid_clear(&pyramid);
+    io_graph_pyramid_init(&pyramid, 10, 5);
+    update_pyramid(&pyramid, 1, 0);
+    update_pyramid(&pyramid, 2, 5);
+    update_pyramid(&pyramid, 3, 25);
+
+    g_assert_true(io_graph_pyramid_has_interval(&pyramid, 5));
+    g_assert_false(io_graph_pyramid_has_interval(&pyramid, 1));
+
+    items = io_graph_pyramid_get_items(&pyramid, 5, IOG_ITEM_UNIT_PACKETS, &num_items);
+    g_assert_cmpint(num_items, ==, 6);
+    g_assert_cmpuint(items[0].frames, ==, 1);
+    g_assert_cmpuint(items[1].frames, ==, 1);
+    g_assert_cmpuint(items[5].frames, ==, 1);
+    g_assert_cmpuint(items[5].bytes, ==, 100);
+    g_free(items);
+
+    items = io_graph_pyramid_get_items(&pyramid, 1, IOG_ITEM_UNIT_PACKETS, &num_items);
+    g_assert_null(items);
+    g_assert_cmpint(num_items, ==, 0);
+
+    io_graph_pyramid_clear(&pyramid);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    ws_log_init("io_graph_item_test", NULL);
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/io_graph/pyramid/merge_max", test_pyramid_merge_max);
+    g_test_add_func("/io_graph/pyramid/merge_min", test_pyramid_merge_min);
+    g_test_add_func("/io_graph/pyramid/merge_time", test_pyramid_merge_time);
+    g_test_add_func("/io_graph/pyramid/merge_load", test_pyramid_merge_load);
+    g_test_add_func("/io_graph/pyramid/truncated", test_pyramid_truncated);
+
+    ret = g_test_run();
+
+    return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
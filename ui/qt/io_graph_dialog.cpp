@@ -618,7 +618,9 @@ void IOGraphDialog::syncGraphSettings(int row)
 
     iog->y_axis_factor_ = uat_model_->data(uat_model_->index(row, colYAxisFactor)).toInt();
 
-    iog->setInterval(ui->intervalComboBox->itemData(ui->intervalComboBox->currentIndex()).toInt());
+    if (iog->setInterval(ui->intervalComboBox->itemData(ui->intervalComboBox->currentIndex()).toInt())) {
+        retap = true;
+    }
 
     if (!iog->configError().isEmpty()) {
         hint_err_ = iog->configError();
@@ -1255,22 +1257,28 @@ void IOGraphDialog::loadProfileGraphs()
 void IOGraphDialog::on_intervalComboBox_currentIndexChanged(int)
 {
     int interval = ui->intervalComboBox->itemData(ui->intervalComboBox->currentIndex()).toInt();
+    bool need_recalc = false;
     bool need_retap = false;
 
     if (uat_model_ != NULL) {
         for (int row = 0; row < uat_model_->rowCount(); row++) {
             IOGraph *iog = ioGraphs_.value(row, NULL);
             if (iog) {
-                iog->setInterval(interval);
+                bool iog_retap = iog->setInterval(interval);
                 if (iog->visible()) {
-                    need_retap = true;
+                    need_recalc = true;
+                    need_retap |= iog_retap;
                 }
             }
         }
     }
 
+    // The items for every interval usually come from the same pyramid, so
+    // there's only a need to retap on long captures.
     if (need_retap) {
         scheduleRetap(true);
+    } else if (need_recalc) {
+        scheduleRecalc(true);
     }
 
     updateLegend();
@@ -1678,9 +1686,11 @@ IOGraph::IOGraph(QCustomPlot *parent) :
     bars_(NULL),
     val_units_(IOG_ITEM_UNIT_FIRST),
     hf_index_(-1),
+    items_(NULL),
     cur_idx_(-1)
 {
     Q_ASSERT(parent_ != NULL);
+    io_graph_pyramid_init(&pyramid_, max_io_items_, 1);
     graph_ = parent_->addGraph(parent_->xAxis, parent_->yAxis);
     Q_ASSERT(graph_ != NULL);
 
@@ -1703,6 +1713,8 @@ IOGraph::IOGraph(QCustomPlot *parent) :
 
 IOGraph::~IOGraph() {
     remove_tap_listener(this);
+    io_graph_pyramid_clear(&pyramid_);
+    g_free(items_);
     if (graph_) {
         parent_->removeGraph(graph_);
     }
@@ -1982,7 +1994,7 @@ double IOGraph::startOffset()
 int IOGraph::packetFromTime(double ts)
 {
     int idx = ts * 1000 / interval_;
-    if (idx >= 0 && idx < (int) cur_idx_) {
+    if (items_ && idx >= 0 && idx < (int) cur_idx_) {
         switch (val_units_) {
         case IOG_ITEM_UNIT_CALC_MAX:
         case IOG_ITEM_UNIT_CALC_MIN:
@@ -1997,7 +2009,9 @@ int IOGraph::packetFromTime(double ts)
 void IOGraph::clearAllData()
 {
     cur_idx_ = -1;
-    reset_io_graph_items(items_, max_io_items_);
+    io_graph_pyramid_clear(&pyramid_);
+    g_free(items_);
+    items_ = NULL;
     if (graph_) {
         graph_->data()->clear();
     }
@@ -2024,6 +2038,11 @@ void IOGraph::recalcGraphData(capture_file *cap_file, bool enable_scaling)
         x_axis = bars_->keyAxis();
     }
 
+    int num_items;
+    g_free(items_);
+    items_ = io_graph_pyramid_get_items(&pyramid_, interval_, val_units_, &num_items);
+    cur_idx_ = num_items - 1;
+
     if (moving_avg_period_ > 0 && cur_idx_ >= 0) {
         /* "Warm-up phase" - calculate average on some data not displayed;
          * just to make sure average on leftmost and rightmost displayed
@@ -2238,9 +2257,18 @@ bool IOGraph::hasItemToShow(int idx, double value) const
     return result;
 }
 
-void IOGraph::setInterval(int interval)
+bool IOGraph::setInterval(int interval)
 {
     interval_ = interval;
+    if (io_graph_pyramid_has_interval(&pyramid_, interval)) {
+        return false;
+    }
+
+    // The level this interval would be merged from was truncated, the
+    // next tap fills a pyramid based on this interval instead.
+    io_graph_pyramid_clear(&pyramid_);
+    io_graph_pyramid_init(&pyramid_, max_io_items_, interval);
+    return true;
 }
 
 // Get the value at the given interval (idx) for the current value unit.
@@ -2273,14 +2301,12 @@ tap_packet_status IOGraph::tapPacket(void *iog_ptr, packet_info *pinfo, epan_dis
     bool recalc = false;
 
     /* some sanity checks */
-    if ((idx < 0) || (idx >= max_io_items_)) {
-        iog->cur_idx_ = max_io_items_ - 1;
+    if (idx < 0) {
         return TAP_PACKET_DONT_REDRAW;
     }
 
-    /* update num_items */
-    if (idx > iog->cur_idx_) {
-        iog->cur_idx_ = (guint32) idx;
+    /* cur_idx_ and items_ are updated from the pyramid by recalcGraphData */
+    if (idx > iog->cur_idx_ && iog->cur_idx_ < max_io_items_ - 1) {
         recalc = true;
     }
 
@@ -2298,7 +2324,7 @@ tap_packet_status IOGraph::tapPacket(void *iog_ptr, packet_info *pinfo, epan_dis
         adv_edt = edt;
     }
 
-    if (!update_io_graph_item(iog->items_, idx, pinfo, adv_edt, iog->hf_index_, iog->val_units_, iog->interval_)) {
+    if (!io_graph_pyramid_update(&iog->pyramid_, pinfo, adv_edt, iog->hf_index_, iog->val_units_)) {
         return TAP_PACKET_DONT_REDRAW;
     }
 
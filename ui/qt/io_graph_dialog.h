@@ -39,7 +39,7 @@ class QCustomPlot;
 class QCPAxisTicker;
 class QCPAxisTickerDateTime;
 
-// GTK+ sets this to 100000 (NUM_IO_ITEMS)
+// GTK+ sets this to 100000 (NUM_IO_ITEMS). Limit per level of the pyramid.
 const int max_io_items_ = 250000;
 
 // XXX - Move to its own file?
@@ -67,7 +67,8 @@ public:
     const QString valueUnitField() { return vu_field_; }
     void setValueUnitField(const QString &vu_field);
     unsigned int movingAveragePeriod() { return moving_avg_period_; }
-    void setInterval(int interval);
+    // Returns true if the graph must be retapped for the interval.
+    bool setInterval(int interval);
     bool addToLegend();
     bool removeFromLegend();
     QCPGraph *graph() { return graph_; }
@@ -120,8 +121,10 @@ private:
     QString scaled_value_unit_;
 
     // Cached data. We should be able to change the Y axis without retapping as
-    // much as is feasible.
-    io_graph_item_t items_[max_io_items_];
+    // much as is feasible. The interval can usually be changed without
+    // retapping, items_ is rebuilt from pyramid_ by recalcGraphData.
+    io_graph_pyramid_t pyramid_;
+    io_graph_item_t *items_;
     int cur_idx_;
 };
 
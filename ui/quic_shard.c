@@ -0,0 +1,456 @@
+/* quic_shard.c
+ * Assignment of the frames of a capture file to shards such that all frames
+ * of a QUIC connection end up in the same shard.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * This is a pre-pass for sharded dissection (tshark --quic-shards). It has to
+ * be much faster than dissection, so it only looks at the link, network and
+ * transport headers and at the Connection IDs in the QUIC header, which are
+ * not protected:
+ * - A flow is identified by its (direction independent) address/port pair.
+ * - The Connection IDs of long header packets are remembered together with
+ *   the shard of their flow. A new flow whose first packet carries a known
+ *   Connection ID joins that shard, which follows a client that migrates to
+ *   a new address (RFC 9000 Section 9) while it keeps using a known
+ *   Connection ID.
+ * - Short header packets do not encode the Connection ID length, so all
+ *   lengths seen in long headers are tried.
+ *
+ * Connection IDs which are only announced in (encrypted) NEW_CONNECTION_ID
+ * frames are not known here, a migration which switches to one of them
+ * starts a new flow.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include <wiretap/wtap.h>
+#include <wsutil/buffer.h>
+#include <wsutil/pint.h>
+
+#include "quic_shard.h"
+
+#define QUIC_SHARD_MAX_CID_LENGTH   20
+
+/** Direction independent address/port pair, the lower endpoint comes first. */
+typedef struct {
+    guint8      proto;          /* IP_PROTO_UDP or IP_PROTO_TCP */
+    guint8      addr_len;       /* 4 or 16 */
+    guint16     port[2];
+    guint8      addr[2][16];
+} shard_flow_key_t;
+
+typedef struct {
+    guint8      len;
+    guint8      cid[QUIC_SHARD_MAX_CID_LENGTH];
+} shard_cid_key_t;
+
+typedef struct {
+    GHashTable *flows;          /* shard_flow_key_t -> shard + 1 */
+    GHashTable *cids;           /* shard_cid_key_t -> shard + 1 */
+    guint32     cid_lengths;    /* Bit n is set if a CID of length n was seen. */
+    guint       shard_count;
+    guint       next_shard;
+} shard_state_t;
+
+#define SHARD_IP_PROTO_TCP  6
+#define SHARD_IP_PROTO_UDP  17
+
+static guint
+shard_bytes_hash(const guint8 *data, size_t len)
+{
+    /* FNV-1a */
+    guint32 h = 2166136261U;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ data[i]) * 16777619U;
+    }
+    return h;
+}
+
+static guint
+shard_flow_hash(gconstpointer key)
+{
+    return shard_bytes_hash((const guint8 *)key, sizeof(shard_flow_key_t));
+}
+
+static gboolean
+shard_flow_equal(gconstpointer key1, gconstpointer key2)
+{
+    return memcmp(key1, key2, sizeof(shard_flow_key_t)) == 0;
+}
+
+static guint
+shard_cid_hash(gconstpointer key)
+{
+    const shard_cid_key_t *cid = (const shard_cid_key_t *)key;
+
+    return shard_bytes_hash(cid->cid, cid->len) ^ cid->len;
+}
+
+static gboolean
+shard_cid_equal(gconstpointer key1, gconstpointer key2)
+{
+    const shard_cid_key_t *cid1 = (const shard_cid_key_t *)key1;
+    const shard_cid_key_t *cid2 = (const shard_cid_key_t *)key2;
+
+    return cid1->len == cid2->len && memcmp(cid1->cid, cid2->cid, cid1->len) == 0;
+}
+
+/** Returns the shard of a Connection ID + 1, or 0 if unknown. */
+static guint
+shard_cid_lookup(shard_state_t *state, const guint8 *cid, guint len)
+{
+    shard_cid_key_t key;
+
+    key.len = (guint8)len;
+    memcpy(key.cid, cid, len);
+    return GPOINTER_TO_UINT(g_hash_table_lookup(state->cids, &key));
+}
+
+static void
+shard_cid_insert(shard_state_t *state, const guint8 *cid, guint len, guint shard)
+{
+    shard_cid_key_t *key;
+
+    if (len == 0) {
+        return;
+    }
+    key = g_new0(shard_cid_key_t, 1);
+    key->len = (guint8)len;
+    memcpy(key->cid, cid, len);
+    g_hash_table_replace(state->cids, key, GUINT_TO_POINTER(shard + 1));
+    state->cid_lengths |= 1U << len;
+}
+
+/**
+ * Finds the shard of a QUIC connection from the Connection IDs in "payload",
+ * learning new Connection IDs for "flow_shard" (if non-zero). Returns the
+ * shard + 1, or 0 if no Connection ID is known.
+ */
+static guint
+shard_quic_lookup(shard_state_t *state, const guint8 *payload, guint len, guint flow_shard)
+{
+    guint shard = 0;
+
+    if (len < 1 + QUIC_SHARD_MAX_CID_LENGTH) {
+        /* Too short for QUIC (the smallest valid packet is larger). */
+        return 0;
+    }
+
+    if (payload[0] & 0x80) {
+        /* Long header: flags, version, DCID length, DCID, SCID length, SCID. */
+        guint offset = 5;
+        guint dcid_len, scid_len;
+        const guint8 *dcid, *scid;
+
+        dcid_len = payload[offset++];
+        if (dcid_len > QUIC_SHARD_MAX_CID_LENGTH || offset + dcid_len + 1 > len) {
+            return 0;
+        }
+        dcid = payload + offset;
+        offset += dcid_len;
+        scid_len = payload[offset++];
+        if (scid_len > QUIC_SHARD_MAX_CID_LENGTH || offset + scid_len > len) {
+            return 0;
+        }
+        scid = payload + offset;
+
+        if (dcid_len) {
+            shard = shard_cid_lookup(state, dcid, dcid_len);
+        }
+        if (!shard && scid_len) {
+            shard = shard_cid_lookup(state, scid, scid_len);
+        }
+        if (!shard) {
+            shard = flow_shard;
+        }
+        if (shard) {
+            shard_cid_insert(state, dcid, dcid_len, shard - 1);
+            shard_cid_insert(state, scid, scid_len, shard - 1);
+        }
+    } else if (!flow_shard) {
+        /* Short header of an unknown flow, try all known CID lengths. */
+        for (guint cid_len = 1; cid_len <= QUIC_SHARD_MAX_CID_LENGTH && !shard; cid_len++) {
+            if (state->cid_lengths & (1U << cid_len)) {
+                shard = shard_cid_lookup(state, payload + 1, cid_len);
+            }
+        }
+    }
+    return shard;
+}
+
+/**
+ * Fills in the flow key from the IP header. Returns the offset of the
+ * transport payload, or 0 if this is not the first fragment of a TCP or UDP
+ * packet.
+ */
+static guint
+shard_parse_ip(const guint8 *data, guint len, shard_flow_key_t *key)
+{
+    guint offset, version;
+    const guint8 *src, *dst;
+
+    if (len < 1) {
+        return 0;
+    }
+    version = data[0] >> 4;
+    if (version == 4) {
+        guint ihl = (data[0] & 0x0f) * 4;
+
+        if (len < 20 || ihl < 20 || len < ihl) {
+            return 0;
+        }
+        if (pntoh16(data + 6) & 0x1fff) {
+            /* Not the first fragment. */
+            return 0;
+        }
+        key->proto = data[9];
+        key->addr_len = 4;
+        src = data + 12;
+        dst = data + 16;
+        offset = ihl;
+    } else if (version == 6) {
+        guint8 next_header;
+
+        if (len < 40) {
+            return 0;
+        }
+        next_header = data[6];
+        src = data + 8;
+        dst = data + 24;
+        offset = 40;
+        /* Skip Hop-by-Hop, Routing, Fragment and Destination Options. */
+        while (next_header == 0 || next_header == 43 || next_header == 44 || next_header == 60) {
+            if (offset + 8 > len) {
+                return 0;
+            }
+            if (next_header == 44) {
+                if (pntoh16(data + offset + 2) & 0xfff8) {
+                    return 0;
+                }
+                next_header = data[offset];
+                offset += 8;
+            } else {
+                next_header = data[offset];
+                offset += (data[offset + 1] + 1) * 8;
+            }
+        }
+        key->proto = next_header;
+        key->addr_len = 16;
+    } else {
+        return 0;
+    }
+
+    if (key->proto != SHARD_IP_PROTO_UDP && key->proto != SHARD_IP_PROTO_TCP) {
+        return 0;
+    }
+    if (offset + (key->proto == SHARD_IP_PROTO_UDP ? 8 : 20) > len) {
+        return 0;
+    }
+
+    guint16 sport = pntoh16(data + offset);
+    guint16 dport = pntoh16(data + offset + 2);
+    int cmp = memcmp(src, dst, key->addr_len);
+    if (cmp < 0 || (cmp == 0 && sport <= dport)) {
+        memcpy(key->addr[0], src, key->addr_len);
+        memcpy(key->addr[1], dst, key->addr_len);
+        key->port[0] = sport;
+        key->port[1] = dport;
+    } else {
+        memcpy(key->addr[0], dst, key->addr_len);
+        memcpy(key->addr[1], src, key->addr_len);
+        key->port[0] = dport;
+        key->port[1] = sport;
+    }
+
+    if (key->proto == SHARD_IP_PROTO_UDP) {
+        return offset + 8;
+    }
+    return offset + (data[offset + 12] >> 4) * 4;
+}
+
+/** Returns the offset of the IP header for the link-layer types that are supported. */
+static gboolean
+shard_skip_link_layer(int encap, const guint8 *data, guint len, guint *offset)
+{
+    guint16 ethertype;
+
+    switch (encap) {
+        case WTAP_ENCAP_RAW_IP:
+        case WTAP_ENCAP_RAW_IP4:
+        case WTAP_ENCAP_RAW_IP6:
+            *offset = 0;
+            return TRUE;
+        case WTAP_ENCAP_NULL:
+        case WTAP_ENCAP_LOOP:
+            *offset = 4;
+            return len >= 4;
+        case WTAP_ENCAP_SLL:
+            if (len < 16) {
+                return FALSE;
+            }
+            ethertype = pntoh16(data + 14);
+            *offset = 16;
+            break;
+        case WTAP_ENCAP_SLL2:
+            if (len < 20) {
+                return FALSE;
+            }
+            ethertype = pntoh16(data);
+            *offset = 20;
+            break;
+        case WTAP_ENCAP_ETHERNET:
+            if (len < 14) {
+                return FALSE;
+            }
+            ethertype = pntoh16(data + 12);
+            *offset = 14;
+            /* Up to two VLAN tags (802.1Q, 802.1ad). */
+            for (int i = 0; i < 2 && (ethertype == 0x8100 || ethertype == 0x88a8); i++) {
+                if (*offset + 4 > len) {
+                    return FALSE;
+                }
+                ethertype = pntoh16(data + *offset + 2);
+                *offset += 4;
+            }
+            break;
+        default:
+            return FALSE;
+    }
+    return ethertype == 0x0800 || ethertype == 0x86dd;
+}
+
+static guint
+shard_assign(shard_state_t *state, int encap, const guint8 *data, guint len)
+{
+    shard_flow_key_t key;
+    guint offset, payload_offset;
+    guint flow_shard, shard;
+
+    if (!shard_skip_link_layer(encap, data, len, &offset)) {
+        return 0;
+    }
+    memset(&key, 0, sizeof(key));
+    payload_offset = shard_parse_ip(data + offset, len - offset, &key);
+    if (!payload_offset) {
+        return 0;
+    }
+    payload_offset += offset;
+
+    flow_shard = GPOINTER_TO_UINT(g_hash_table_lookup(state->flows, &key));
+    shard = flow_shard;
+    if (key.proto == SHARD_IP_PROTO_UDP && payload_offset < len) {
+        guint quic_shard = shard_quic_lookup(state, data + payload_offset, len - payload_offset, flow_shard);
+        if (!flow_shard) {
+            shard = quic_shard;
+        }
+    }
+    if (!shard) {
+        /* New flow, distribute them round robin. */
+        shard = state->next_shard + 1;
+        state->next_shard = (state->next_shard + 1) % state->shard_count;
+        if (key.proto == SHARD_IP_PROTO_UDP && payload_offset < len) {
+            /* Learn the Connection IDs of the first packet. */
+            shard_quic_lookup(state, data + payload_offset, len - payload_offset, shard);
+        }
+    }
+    if (!flow_shard) {
+        g_hash_table_insert(state->flows, g_memdup2(&key, sizeof(key)), GUINT_TO_POINTER(shard));
+    }
+    return shard - 1;
+}
+
+gboolean
+quic_shard_map_build(const char *filename, unsigned type, guint shard_count,
+                     guint32 max_frames, quic_shard_map_t *map,
+                     int *err, gchar **err_info)
+{
+    wtap *wth;
+    wtap_rec rec;
+    Buffer buf;
+    gint64 data_offset;
+    shard_state_t state;
+    GByteArray *shards;
+
+    memset(map, 0, sizeof(*map));
+    if (shard_count < 1 || shard_count > QUIC_SHARD_MAX) {
+        *err = WTAP_ERR_INTERNAL;
+        *err_info = g_strdup_printf("invalid number of shards %u", shard_count);
+        return FALSE;
+    }
+
+    wth = wtap_open_offline(filename, type, err, err_info, FALSE);
+    if (!wth) {
+        return FALSE;
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.flows = g_hash_table_new_full(shard_flow_hash, shard_flow_equal, g_free, NULL);
+    state.cids = g_hash_table_new_full(shard_cid_hash, shard_cid_equal, g_free, NULL);
+    state.shard_count = shard_count;
+
+    map->shard_count = shard_count;
+    map->shard_frames = g_new0(guint32, shard_count);
+    shards = g_byte_array_new();
+
+    wtap_rec_init(&rec);
+    ws_buffer_init(&buf, 1514);
+    *err = 0;
+    while ((max_frames == 0 || shards->len < max_frames) &&
+           wtap_read(wth, &rec, &buf, err, err_info, &data_offset)) {
+        guint8 shard = 0;
+
+        if (rec.rec_type == REC_TYPE_PACKET) {
+            shard = (guint8)shard_assign(&state, rec.rec_header.packet_header.pkt_encap,
+                                         ws_buffer_start_ptr(&buf), rec.rec_header.packet_header.caplen);
+        }
+        g_byte_array_append(shards, &shard, 1);
+        map->shard_frames[shard]++;
+        wtap_rec_reset(&rec);
+    }
+    ws_buffer_free(&buf);
+    wtap_rec_cleanup(&rec);
+    wtap_close(wth);
+    g_hash_table_destroy(state.flows);
+    g_hash_table_destroy(state.cids);
+
+    map->frame_count = shards->len;
+    map->shards = g_byte_array_free(shards, FALSE);
+    if (*err != 0) {
+        quic_shard_map_free(map);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void
+quic_shard_map_free(quic_shard_map_t *map)
+{
+    g_free(map->shards);
+    g_free(map->shard_frames);
+    memset(map, 0, sizeof(*map));
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,74 @@
+/** @file
+ *
+ * Assignment of the frames of a capture file to shards such that all frames
+ * of a QUIC connection end up in the same shard.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __QUIC_SHARD_H__
+#define __QUIC_SHARD_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/** Maximum number of shards. */
+#define QUIC_SHARD_MAX      64
+
+typedef struct _quic_shard_map {
+    guint8     *shards;         /**< Shard of frame n at index n - 1. */
+    guint32     frame_count;
+    guint       shard_count;
+    guint32    *shard_frames;   /**< Number of frames per shard. */
+} quic_shard_map_t;
+
+/**
+ * Reads the capture file and assigns every frame to one of "shard_count"
+ * shards. UDP datagrams are grouped by their address/port pair, and a pair is
+ * joined with an existing one if a QUIC Connection ID seen on it is known.
+ * Other TCP and UDP flows are grouped by address/port pair, the remaining
+ * frames are assigned to shard 0.
+ *
+ * The file is only parsed down to the transport header (and the unprotected
+ * part of the QUIC header), without dissecting it.
+ *
+ * @param filename Capture file.
+ * @param type WTAP_TYPE_AUTO or the type of the file.
+ * @param shard_count Number of shards, 1 to QUIC_SHARD_MAX.
+ * @param max_frames Stop after this number of frames if non-zero.
+ * @param[out] map The assignment, release with quic_shard_map_free.
+ * @param[out] err Wiretap error code if FALSE is returned.
+ * @param[out] err_info Wiretap error string if FALSE is returned.
+ * @return TRUE on success.
+ */
+gboolean quic_shard_map_build(const char *filename, unsigned type, guint shard_count,
+                              guint32 max_frames, quic_shard_map_t *map,
+                              int *err, gchar **err_info);
+
+void quic_shard_map_free(quic_shard_map_t *map);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __QUIC_SHARD_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,319 @@
+/* tap-quic-analysis.c
+ * QUIC connection analysis (packet number tracking, RTT and loss estimation)
+ * used by tshark and sharkd.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * The analysis runs incrementally on the packets delivered by the "quic" tap,
+ * following RFC 9002 (QUIC Loss Detection and Congestion Control):
+ * - Section 5 for the RTT estimates (latest_rtt, min_rtt, smoothed_rtt and
+ *   rttvar), using the ACK Delay reported by the peer.
+ * - Section 6.1.1 for the packet threshold based loss detection. The time
+ *   threshold is not applied since the capture point does not know about the
+ *   timers of the endpoints.
+ *
+ * Only the most recent packets of every packet number space are remembered,
+ * see QUIC_ANALYSIS_WINDOW.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <math.h>
+
+#include <epan/packet.h>
+#include <epan/dissectors/packet-quic.h>
+
+#include "tap-quic-analysis.h"
+
+/* RFC 9002 Section 6.1.1 */
+#define QUIC_PACKET_THRESHOLD   3
+
+static void
+quic_pn_space_analysis_free(quic_pn_space_analysis_t *space)
+{
+    g_free(space->sent);
+    space->sent = NULL;
+}
+
+static void
+quic_conn_analysis_free(gpointer data)
+{
+    quic_conn_analysis_t *conn = (quic_conn_analysis_t *)data;
+
+    for (int dir = 0; dir < 2; dir++) {
+        for (int i = 0; i < 3; i++) {
+            quic_pn_space_analysis_free(&conn->dirs[dir].spaces[i]);
+        }
+    }
+    g_free(conn);
+}
+
+void
+quic_analysis_init(quic_analysis_t *analysis)
+{
+    analysis->conns = g_hash_table_new(g_direct_hash, g_direct_equal);
+    analysis->conn_list = g_ptr_array_new_with_free_func(quic_conn_analysis_free);
+}
+
+void
+quic_analysis_reset(void *tapdata)
+{
+    quic_analysis_t *analysis = (quic_analysis_t *)tapdata;
+
+    g_hash_table_remove_all(analysis->conns);
+    g_ptr_array_set_size(analysis->conn_list, 0);
+}
+
+void
+quic_analysis_cleanup(quic_analysis_t *analysis)
+{
+    g_hash_table_destroy(analysis->conns);
+    g_ptr_array_free(analysis->conn_list, TRUE);
+    analysis->conns = NULL;
+    analysis->conn_list = NULL;
+}
+
+/** Returns the ring item for a packet number if it was seen and is still remembered. */
+static quic_sent_packet_t *
+quic_analysis_get_sent(quic_pn_space_analysis_t *space, guint64 packet_number)
+{
+    quic_sent_packet_t *sent = &space->sent[packet_number % space->window];
+
+    if (!(sent->flags & QUIC_SENT_VALID) || sent->packet_number != packet_number) {
+        return NULL;
+    }
+    return sent;
+}
+
+/** Returns the smallest packet number that can still be in the ring. */
+static guint64
+quic_analysis_window_start(const quic_pn_space_analysis_t *space)
+{
+    if (space->largest_sent < space->window) {
+        return 0;
+    }
+    return space->largest_sent - space->window + 1;
+}
+
+static void
+quic_analysis_on_sent(quic_pn_space_analysis_t *space, const quic_tap_info_t *info, double now)
+{
+    quic_sent_packet_t *sent;
+
+    if (!space->sent) {
+        space->window = info->pn_space == QUIC_PN_SPACE_APPDATA ? QUIC_ANALYSIS_WINDOW : QUIC_ANALYSIS_HANDSHAKE_WINDOW;
+        space->sent = g_new0(quic_sent_packet_t, space->window);
+    }
+
+    if (quic_analysis_get_sent(space, info->packet_number)) {
+        /* Duplicate in the capture, keep the first transmission. */
+        return;
+    }
+    if (space->any_sent && info->packet_number + space->window <= space->largest_sent) {
+        /* Too old to be tracked, do not overwrite a more recent packet. */
+        return;
+    }
+
+    sent = &space->sent[info->packet_number % space->window];
+    sent->packet_number = info->packet_number;
+    sent->time = now;
+    sent->flags = QUIC_SENT_VALID;
+    if (info->ack_eliciting) {
+        sent->flags |= QUIC_SENT_ACK_ELICITING;
+    }
+
+    if (!space->any_sent || info->packet_number > space->largest_sent) {
+        space->largest_sent = info->packet_number;
+        space->any_sent = TRUE;
+    }
+}
+
+/* RFC 9002 Section 5.3 */
+static void
+quic_analysis_update_rtt(quic_dir_analysis_t *dir, double latest_rtt, double ack_delay)
+{
+    dir->latest_rtt = latest_rtt;
+    if (dir->rtt_samples == 0) {
+        dir->min_rtt = latest_rtt;
+        dir->smoothed_rtt = latest_rtt;
+        dir->rttvar = latest_rtt / 2;
+    } else {
+        double adjusted_rtt = latest_rtt;
+
+        dir->min_rtt = MIN(dir->min_rtt, latest_rtt);
+        if (latest_rtt >= dir->min_rtt + ack_delay) {
+            adjusted_rtt = latest_rtt - ack_delay;
+        }
+        dir->rttvar = 3.0 / 4 * dir->rttvar + 1.0 / 4 * fabs(dir->smoothed_rtt - adjusted_rtt);
+        dir->smoothed_rtt = 7.0 / 8 * dir->smoothed_rtt + 1.0 / 8 * adjusted_rtt;
+    }
+    dir->rtt_samples++;
+}
+
+/* RFC 9002 Section 6.1.1 */
+static void
+quic_analysis_detect_lost(quic_dir_analysis_t *dir, quic_pn_space_analysis_t *space)
+{
+    guint64 first, last;
+
+    if (space->largest_acked < QUIC_PACKET_THRESHOLD) {
+        return;
+    }
+    first = MAX(space->loss_scan_next, quic_analysis_window_start(space));
+    last = MIN(space->largest_acked - QUIC_PACKET_THRESHOLD, space->largest_sent);
+    if (first > last) {
+        return;
+    }
+
+    for (guint64 pn = first; pn <= last; pn++) {
+        quic_sent_packet_t *sent = quic_analysis_get_sent(space, pn);
+        if (sent && (sent->flags & QUIC_SENT_ACK_ELICITING) &&
+                !(sent->flags & (QUIC_SENT_ACKED | QUIC_SENT_LOST))) {
+            sent->flags |= QUIC_SENT_LOST;
+            dir->lost++;
+        }
+    }
+    space->loss_scan_next = last + 1;
+}
+
+/**
+ * Processes an ACK frame that acknowledges packets of "dir" (i.e. sent by the
+ * peer of the ACK sender).
+ */
+static void
+quic_analysis_on_ack(quic_dir_analysis_t *dir, const quic_tap_info_t *info, double now)
+{
+    quic_pn_space_analysis_t *space = &dir->spaces[info->pn_space];
+    gboolean largest_newly_acked = FALSE;
+    gboolean ack_eliciting_newly_acked = FALSE;
+    double largest_sent_time = 0;
+    double ack_delay;
+
+    if (!space->sent || info->ack_range_count == 0) {
+        /* None of the acknowledged packets were captured. */
+        return;
+    }
+
+    for (guint i = 0; i < info->ack_range_count; i++) {
+        guint64 smallest = MAX(info->ack_ranges[i].smallest, quic_analysis_window_start(space));
+        guint64 largest = MIN(info->ack_ranges[i].largest, space->largest_sent);
+
+        for (guint64 pn = smallest; pn <= largest && smallest <= largest; pn++) {
+            quic_sent_packet_t *sent = quic_analysis_get_sent(space, pn);
+            if (!sent || (sent->flags & QUIC_SENT_ACKED)) {
+                continue;
+            }
+            sent->flags |= QUIC_SENT_ACKED;
+            dir->acked++;
+            if (sent->flags & QUIC_SENT_LOST) {
+                dir->spurious++;
+            }
+            if (sent->flags & QUIC_SENT_ACK_ELICITING) {
+                ack_eliciting_newly_acked = TRUE;
+            }
+            if (pn == info->ack_ranges[0].largest) {
+                largest_newly_acked = TRUE;
+                largest_sent_time = sent->time;
+            }
+        }
+    }
+
+    if (!space->any_acked || info->ack_ranges[0].largest > space->largest_acked) {
+        space->largest_acked = info->ack_ranges[0].largest;
+        space->any_acked = TRUE;
+    }
+
+    /* The ACK Delay is not used for Initial packets, RFC 9002 Section 5.3. */
+    ack_delay = info->pn_space == QUIC_PN_SPACE_INITIAL ? 0 : info->ack_delay_us / 1000000.0;
+    if (info->pn_space != QUIC_PN_SPACE_INITIAL) {
+        dir->ack_delay_samples++;
+        dir->ack_delay_sum += ack_delay;
+        dir->max_ack_delay = MAX(dir->max_ack_delay, ack_delay);
+    }
+
+    /* RFC 9002 Section 5.1: only generate an RTT sample if the largest
+     * acknowledged packet is newly acknowledged and at least one of the newly
+     * acknowledged packets was ack-eliciting. */
+    if (largest_newly_acked && ack_eliciting_newly_acked) {
+        quic_analysis_update_rtt(dir, now - largest_sent_time, ack_delay);
+    }
+
+    quic_analysis_detect_lost(dir, space);
+}
+
+tap_packet_status
+quic_analysis_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt _U_, const void *data, tap_flags_t flags _U_)
+{
+    quic_analysis_t *analysis = (quic_analysis_t *)tapdata;
+    const quic_tap_info_t *info = (const quic_tap_info_t *)data;
+    quic_conn_analysis_t *conn;
+    quic_dir_analysis_t *sender, *peer;
+    double now = nstime_to_sec(&pinfo->rel_ts);
+
+    if (!info || info->pn_space > QUIC_PN_SPACE_APPDATA) {
+        return TAP_PACKET_DONT_REDRAW;
+    }
+
+    conn = (quic_conn_analysis_t *)g_hash_table_lookup(analysis->conns, GUINT_TO_POINTER(info->connection_number));
+    if (!conn) {
+        conn = g_new0(quic_conn_analysis_t, 1);
+        conn->number = info->connection_number;
+        conn->first_frame = pinfo->num;
+        conn->start_time = now;
+        g_hash_table_insert(analysis->conns, GUINT_TO_POINTER(conn->number), conn);
+        g_ptr_array_add(analysis->conn_list, conn);
+    }
+    conn->last_time = now;
+
+    sender = &conn->dirs[info->from_server ? 1 : 0];
+    peer = &conn->dirs[info->from_server ? 0 : 1];
+
+    sender->packets++;
+    if (info->ack_eliciting) {
+        sender->ack_eliciting++;
+    }
+    if (conn->handshake_done && info->pn_space != QUIC_PN_SPACE_APPDATA) {
+        /* Late Initial or Handshake packet, its space was discarded. */
+        return TAP_PACKET_REDRAW;
+    }
+
+    quic_analysis_on_sent(&sender->spaces[info->pn_space], info, now);
+
+    if (info->has_ack) {
+        quic_analysis_on_ack(peer, info, now);
+    }
+
+    if (info->handshake_done && !conn->handshake_done) {
+        conn->handshake_done = TRUE;
+        conn->handshake_time = now - conn->start_time;
+        /* The handshake is confirmed, Initial and Handshake keys are
+         * discarded (RFC 9001 Section 4.9). Release their state as well. */
+        for (int dir = 0; dir < 2; dir++) {
+            quic_pn_space_analysis_free(&conn->dirs[dir].spaces[QUIC_PN_SPACE_INITIAL]);
+            quic_pn_space_analysis_free(&conn->dirs[dir].spaces[QUIC_PN_SPACE_HANDSHAKE]);
+        }
+    }
+
+    return TAP_PACKET_REDRAW;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
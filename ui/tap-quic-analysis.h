@@ -0,0 +1,108 @@
+/** @file
+ *
+ * QUIC connection analysis (packet number tracking, RTT and loss estimation)
+ * used by tshark and sharkd.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __TAP_QUIC_ANALYSIS_H__
+#define __TAP_QUIC_ANALYSIS_H__
+
+#include <epan/packet_info.h>
+#include <epan/tap.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Number of most recent packets for which the send time and state is kept,
+ * per packet number space. ACKs for older packets are ignored, which bounds
+ * the memory usage per connection regardless of its length.
+ */
+#define QUIC_ANALYSIS_WINDOW            512
+#define QUIC_ANALYSIS_HANDSHAKE_WINDOW  32
+
+/** State of a packet sent by an endpoint. */
+typedef struct _quic_sent_packet {
+    guint64     packet_number;
+    double      time;           /**< Time relative to the first packet (s). */
+    guint8      flags;          /**< QUIC_SENT_* */
+} quic_sent_packet_t;
+
+#define QUIC_SENT_VALID         0x01
+#define QUIC_SENT_ACK_ELICITING 0x02
+#define QUIC_SENT_ACKED         0x04
+#define QUIC_SENT_LOST          0x08
+
+/** Per packet number space state for packets sent by an endpoint. */
+typedef struct _quic_pn_space_analysis {
+    quic_sent_packet_t *sent;   /**< Ring of the most recent packets, indexed by packet number. */
+    guint       window;         /**< Number of items in "sent". */
+    gboolean    any_sent;
+    gboolean    any_acked;
+    guint64     largest_sent;
+    guint64     largest_acked;
+    guint64     loss_scan_next; /**< Lowest packet number not yet checked for loss. */
+} quic_pn_space_analysis_t;
+
+/**
+ * Statistics for the packets sent by one endpoint. RTT estimates follow
+ * RFC 9002 Section 5, using the ACKs sent by the peer. They are measured at
+ * the capture point, so they only approximate the path RTT if the capture was
+ * taken close to the sending endpoint.
+ */
+typedef struct _quic_dir_analysis {
+    quic_pn_space_analysis_t spaces[3];
+    guint64     packets;
+    guint64     ack_eliciting;
+    guint64     acked;
+    guint64     lost;           /**< Declared lost by the packet threshold (3). */
+    guint64     spurious;       /**< Declared lost, but acknowledged later. */
+    guint       rtt_samples;
+    double      latest_rtt;     /**< (s) */
+    double      min_rtt;        /**< (s) */
+    double      smoothed_rtt;   /**< (s) */
+    double      rttvar;         /**< (s) */
+    guint       ack_delay_samples;  /**< Number of ACK Delays reported by the peer. */
+    double      ack_delay_sum;  /**< (s) */
+    double      max_ack_delay;  /**< (s) */
+} quic_dir_analysis_t;
+
+/** Analysis of a QUIC connection, identified by quic.connection.number. */
+typedef struct _quic_conn_analysis {
+    guint32     number;
+    guint32     first_frame;
+    double      start_time;     /**< (s) */
+    double      last_time;      /**< (s) */
+    gboolean    handshake_done;
+    double      handshake_time; /**< Time from the first packet to HANDSHAKE_DONE (s). */
+    quic_dir_analysis_t dirs[2];    /**< Packets sent by the client [0] and by the server [1]. */
+} quic_conn_analysis_t;
+
+typedef struct _quic_analysis {
+    GHashTable *conns;          /**< Connection number -> quic_conn_analysis_t */
+    GPtrArray  *conn_list;      /**< Connections in order of appearance. */
+} quic_analysis_t;
+
+void quic_analysis_init(quic_analysis_t *analysis);
+
+/** Releases all connections. Can be used as tap reset callback. */
+void quic_analysis_reset(void *tapdata);
+
+/** Releases all resources of the analysis. */
+void quic_analysis_cleanup(quic_analysis_t *analysis);
+
+/** Tap packet callback for the "quic" tap. */
+tap_packet_status quic_analysis_packet(void *tapdata, packet_info *pinfo, epan_dissect_t *edt, const void *data, tap_flags_t flags);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __TAP_QUIC_ANALYSIS_H__ */
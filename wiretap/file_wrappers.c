@@ -203,6 +203,42 @@ struct wtap_reader {
 #ifdef USE_LZ4
     LZ4F_dctx *lz4_dctx;
 #endif
+    /* read-ahead thread, see file_start_read_ahead() */
+    struct read_ahead *read_ahead;
+};
+
+/*
+ * Read-ahead.
+ *
+ * A thread reads and decompresses the file through a second wtap_reader,
+ * "src", on a duplicate of the file descriptor, and queues the data in a
+ * small ring of buffers; fill_out_buffer() then just takes the next
+ * buffer.  That way decompression runs in parallel with the parsing of
+ * records and, with them, the dissection.  When the ring is full, the
+ * thread waits until a buffer has been taken.
+ *
+ * All buffers are the size of the output buffer, and a buffer that is
+ * taken is swapped with the output buffer, so the data isn't copied
+ * again.
+ */
+#define READ_AHEAD_BUFS 4
+
+struct read_ahead_buf {
+    guint8 *buf;                /* buffer, state->size * 2 bytes */
+    guint len;                  /* number of bytes of data in the buffer */
+    gint64 raw_pos;             /* position in the file after the data */
+};
+
+struct read_ahead {
+    FILE_T src;                 /* reader used by the thread */
+    GThread *thread;
+    GMutex mutex;               /* protects everything below */
+    GCond cond;                 /* signaled when a buffer is queued or taken */
+    struct read_ahead_buf bufs[READ_AHEAD_BUFS];
+    guint head;                 /* first queued buffer */
+    guint count;                /* number of queued buffers */
+    gboolean done;              /* TRUE if the thread reached EOF or an error */
+    gboolean stop;              /* TRUE if the thread should stop */
 };
 
 /* Current read offset within a buffer. */
@@ -291,6 +327,48 @@ fill_in_buffer(FILE_T state)
     return 0;
 }
 
+/* Make sure there are at least n bytes in the input buffer, unless we
+   reach the end of the file first. */
+static int
+fill_in_buffer_min(FILE_T state, guint n)
+{
+    while (state->in.avail < n && !state->eof) {
+        if (state->in.next != state->in.buf) {
+            /* Move what we have to the beginning of the buffer, so
+               buf_read() appends to it. */
+            memmove(state->in.buf, state->in.next, state->in.avail);
+            state->in.next = state->in.buf;
+        }
+        if (fill_in_buffer(state) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+/* Skip n bytes of input. */
+static int
+skip_in_buffer(FILE_T state, guint32 n)
+{
+    guint count;
+
+    while (n != 0) {
+        if (state->in.avail == 0) {
+            if (fill_in_buffer(state) == -1)
+                return -1;
+            if (state->in.avail == 0) {
+                state->err = WTAP_ERR_SHORT_READ;
+                state->err_info = NULL;
+                return -1;
+            }
+        }
+        count = MIN(state->in.avail, n);
+        state->in.next += count;
+        state->in.avail -= count;
+        n -= count;
+    }
+    return 0;
+}
+
 #define ZLIB_WINSIZE 32768
 
 struct fast_seek_point {
@@ -694,6 +772,18 @@ DIAG_ON(cast-qual)
 }
 #endif
 
+static gboolean
+is_zstd_magic(const unsigned char *p)
+{
+    return p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd;
+}
+
+static gboolean
+is_lz4_magic(const unsigned char *p)
+{
+    return p[0] == 0x04 && p[1] == 0x22 && p[2] == 0x4d && p[3] == 0x18;
+}
+
 static int
 gz_head(FILE_T state)
 {
@@ -861,9 +951,48 @@ gz_head(FILE_T state)
     /* FD 37 7A 58 5A 00 */
 #endif
 
-    if (state->in.avail >= 4
-        && state->in.buf[0] == 0x28 && state->in.buf[1] == 0xb5
-        && state->in.buf[2] == 0x2f && state->in.buf[3] == 0xfd) {
+    /*
+     * The zstd and lz4 magic numbers are 4 bytes long, and skippable
+     * frames have 4 more bytes for their size; a file can consist of
+     * several frames, so they need not be at the beginning of the
+     * buffer.
+     */
+    if (fill_in_buffer_min(state, 8) == -1)
+        return -1;
+
+    if (state->in.avail >= 8
+        && (state->in.next[0] & 0xf0) == 0x50 && state->in.next[1] == 0x2a
+        && state->in.next[2] == 0x4d && state->in.next[3] == 0x18) {
+        guint32 frame_size = pletoh32(&state->in.next[4]);
+        gboolean skippable = state->last_compression == ZSTD || state->last_compression == LZ4;
+
+        if (!skippable && frame_size <= state->size - 12) {
+            /*
+             * Not after a zstd or lz4 frame, but it might be in front of
+             * one; pzstd writes a skippable frame with the size of the
+             * next frame before every frame, including the first one.
+             */
+            if (fill_in_buffer_min(state, 12 + frame_size) == -1)
+                return -1;
+            skippable = state->in.avail >= 12 + frame_size
+                && (is_zstd_magic(&state->in.next[8 + frame_size])
+                    || is_lz4_magic(&state->in.next[8 + frame_size]));
+        }
+        if (skippable) {
+            /*
+             * A skippable frame next to a zstd or lz4 frame, such as the
+             * seek table of the zstd seekable format; skip it, and look
+             * for a header again after it.
+             */
+            state->in.next += 8;
+            state->in.avail -= 8;
+            if (skip_in_buffer(state, frame_size) == -1)
+                return -1;
+            return 0;
+        }
+    }
+
+    if (state->in.avail >= 4 && is_zstd_magic(state->in.next)) {
 #ifdef HAVE_ZSTD
         const size_t ret = ZSTD_initDStream(state->zstd_dctx);
         if (ZSTD_isError(ret)) {
@@ -872,6 +1001,13 @@ gz_head(FILE_T state)
             return -1;
         }
 
+        /*
+         * Each frame can be decompressed on its own, so the beginning
+         * of a frame is a point we can seek to.
+         */
+        if (state->fast_seek)
+            fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, ZSTD);
+
         state->compression = ZSTD;
         state->is_compressed = TRUE;
         return 0;
@@ -882,9 +1018,7 @@ gz_head(FILE_T state)
 #endif
     }
 
-    if (state->in.avail >= 4
-        && state->in.buf[0] == 0x04 && state->in.buf[1] == 0x22
-        && state->in.buf[2] == 0x4d && state->in.buf[3] == 0x18) {
+    if (state->in.avail >= 4 && is_lz4_magic(state->in.next)) {
 #ifdef USE_LZ4
 #if LZ4_VERSION_NUMBER >= 10800
         LZ4F_resetDecompressionContext(state->lz4_dctx);
@@ -897,6 +1031,10 @@ gz_head(FILE_T state)
             return -1;
         }
 #endif
+        /* As with zstd, each frame can be decompressed on its own. */
+        if (state->fast_seek)
+            fast_seek_header(state, state->raw_pos - state->in.avail, state->pos, LZ4);
+
         state->compression = LZ4;
         state->is_compressed = TRUE;
         return 0;
@@ -929,14 +1067,55 @@ gz_head(FILE_T state)
     return 0;
 }
 
+/* Take the next buffer queued by the read-ahead thread. */
+static int
+read_ahead_fill_out_buffer(FILE_T state)
+{
+    struct read_ahead *ra = state->read_ahead;
+    struct read_ahead_buf *rab;
+    guint8 *buf;
+
+    g_mutex_lock(&ra->mutex);
+    while (ra->count == 0 && !ra->done)
+        g_cond_wait(&ra->cond, &ra->mutex);
+
+    if (ra->count == 0) {
+        /* Everything the thread read has been handed out, report
+           why it stopped. */
+        state->err = ra->src->err;
+        state->err_info = ra->src->err_info;
+        state->eof = TRUE;
+        g_mutex_unlock(&ra->mutex);
+        return state->err != 0 ? -1 : 0;
+    }
+
+    rab = &ra->bufs[ra->head];
+    buf = state->out.buf;
+    state->out.buf = rab->buf;
+    state->out.next = state->out.buf;
+    state->out.avail = rab->len;
+    state->raw_pos = rab->raw_pos;
+    rab->buf = buf;
+    ra->head = (ra->head + 1) % READ_AHEAD_BUFS;
+    ra->count--;
+    g_cond_signal(&ra->cond);
+    g_mutex_unlock(&ra->mutex);
+    return 0;
+}
+
 static int /* gz_make */
 fill_out_buffer(FILE_T state)
 {
-    if (state->compression == UNKNOWN) {          /* look for compression header */
+    if (state->read_ahead)
+        return read_ahead_fill_out_buffer(state);
+    while (state->compression == UNKNOWN) {       /* look for compression header */
         if (gz_head(state) == -1)
             return -1;
         if (state->out.avail != 0)                /* got some data from gz_head() */
             return 0;
+        if (state->eof && state->in.avail == 0)   /* end of file */
+            return 0;
+        /* gz_head() skipped a skippable frame, look again after it */
     }
     if (state->compression == UNCOMPRESSED) {           /* straight copy */
         if (buf_read(state, &state->out) < 0)
@@ -1060,6 +1239,145 @@ gz_reset(FILE_T state)
     buf_reset(&state->in);        /* no input data yet */
 }
 
+static gpointer
+read_ahead_thread(gpointer data)
+{
+    FILE_T state = (FILE_T)data;
+    struct read_ahead *ra = state->read_ahead;
+    FILE_T src = ra->src;
+    guint bufsize = state->size << 1;
+    guint8 *buf;
+    guint tail, len, n;
+    gboolean done;
+
+    for (;;) {
+        g_mutex_lock(&ra->mutex);
+        while (ra->count == READ_AHEAD_BUFS && !ra->stop)
+            g_cond_wait(&ra->cond, &ra->mutex);
+        if (ra->stop) {
+            g_mutex_unlock(&ra->mutex);
+            break;
+        }
+        /* Nobody else touches a buffer that isn't queued. */
+        tail = (ra->head + ra->count) % READ_AHEAD_BUFS;
+        buf = ra->bufs[tail].buf;
+        g_mutex_unlock(&ra->mutex);
+
+        /* Fill the buffer as file_read() would, except that the data
+           read before an error is kept, so that it is handed out before
+           the error is reported, as it would be without read-ahead. */
+        len = 0;
+        done = FALSE;
+        if (src->seek_pending) {
+            src->seek_pending = FALSE;
+            if (gz_skip(src, src->skip) == -1)
+                done = TRUE;
+        }
+        while (!done && len < bufsize) {
+            if (src->out.avail != 0) {
+                n = MIN(src->out.avail, bufsize - len);
+                memcpy(buf + len, src->out.next, n);
+                src->out.next += n;
+                src->out.avail -= n;
+                src->pos += n;
+                len += n;
+            } else if (src->err != 0 || (src->eof && src->in.avail == 0)) {
+                done = TRUE;
+            } else if (fill_out_buffer(src) == -1) {
+                done = TRUE;
+            }
+        }
+
+        g_mutex_lock(&ra->mutex);
+        if (len != 0) {
+            ra->bufs[tail].len = len;
+            ra->bufs[tail].raw_pos = src->raw_pos;
+            ra->count++;
+        }
+        if (done)
+            ra->done = TRUE;
+        g_cond_signal(&ra->cond);
+        g_mutex_unlock(&ra->mutex);
+        if (done)
+            break;
+    }
+    return NULL;
+}
+
+/* Start the thread; it continues after the buffers already queued. */
+static void
+read_ahead_run(FILE_T file)
+{
+    struct read_ahead *ra = file->read_ahead;
+
+    ra->done = FALSE;
+    ra->stop = FALSE;
+    ra->thread = g_thread_new("wtap_read_ahead", read_ahead_thread, file);
+}
+
+static void
+read_ahead_stop(FILE_T file)
+{
+    struct read_ahead *ra = file->read_ahead;
+
+    if (ra->thread == NULL)
+        return;
+
+    g_mutex_lock(&ra->mutex);
+    ra->stop = TRUE;
+    g_cond_signal(&ra->cond);
+    g_mutex_unlock(&ra->mutex);
+    g_thread_join(ra->thread);
+    ra->thread = NULL;
+}
+
+static void
+read_ahead_free(FILE_T file)
+{
+    struct read_ahead *ra = file->read_ahead;
+    int i;
+
+    read_ahead_stop(file);
+    for (i = 0; i < READ_AHEAD_BUFS; i++)
+        g_free(ra->bufs[i].buf);
+    file_close(ra->src);
+    g_mutex_clear(&ra->mutex);
+    g_cond_clear(&ra->cond);
+    g_free(ra);
+    file->read_ahead = NULL;
+}
+
+/*
+ * Seek to an offset before the data that was handed out; the thread
+ * is past it, so stop the thread, seek its reader and start it again.
+ */
+static gint64
+read_ahead_seek(FILE_T file, gint64 offset, int *err)
+{
+    struct read_ahead *ra = file->read_ahead;
+
+    read_ahead_stop(file);
+    ra->head = 0;
+    ra->count = 0;
+
+    if (file_seek(ra->src, offset, SEEK_SET, err) == -1) {
+        /* Leave the thread stopped, and report the error when the
+           data is read. */
+        ra->src->err = *err;
+        ra->src->err_info = NULL;
+        ra->done = TRUE;
+        return -1;
+    }
+
+    buf_reset(&file->out);
+    file->pos = offset;
+    file->eof = FALSE;
+    file->err = 0;
+    file->err_info = NULL;
+    read_ahead_run(file);
+    return offset;
+}
+
 FILE_T
 file_fdopen(int fd)
 {
@@ -1294,6 +1612,78 @@ file_set_random_access(FILE_T stream, gboolean random_flag _U_, GPtrArray *seek)
     stream->fast_seek = seek;
 }
 
+gboolean
+file_start_read_ahead(FILE_T file)
+{
+    ws_statb64 statb;
+    struct read_ahead *ra;
+    FILE_T src;
+    gint64 pos;
+    int fd, err, i;
+
+    if (file->read_ahead != NULL)
+        return TRUE;
+
+    /*
+     * The thread reads the file again from the start, so it has to be
+     * a regular file, and it doesn't keep fast seek points, so the
+     * file must not be set up for random access.
+     */
+    if (file->fast_seek != NULL || file->err != 0)
+        return FALSE;
+    if (ws_fstat64(file->fd, &statb) == -1 || !S_ISREG(statb.st_mode))
+        return FALSE;
+
+    fd = ws_dup(file->fd);
+    if (fd == -1)
+        return FALSE;
+    if (ws_lseek64(fd, file->start, SEEK_SET) == -1) {
+        ws_close(fd);
+        return FALSE;
+    }
+    src = file_fdopen(fd);
+    if (src == NULL) {
+        ws_close(fd);
+        return FALSE;
+    }
+#ifdef HAVE_ZLIB
+    src->dont_check_crc = file->dont_check_crc;
+#endif
+
+    /* Get the reader of the thread to where we are. */
+    pos = file_tell(file);
+    if (file_seek(src, pos, SEEK_SET, &err) == -1) {
+        file_close(src);
+        return FALSE;
+    }
+
+    ra = g_new0(struct read_ahead, 1);
+    for (i = 0; i < READ_AHEAD_BUFS; i++) {
+        ra->bufs[i].buf = (guint8 *)g_try_malloc(file->size << 1);
+        if (ra->bufs[i].buf == NULL) {
+            while (i-- > 0)
+                g_free(ra->bufs[i].buf);
+            g_free(ra);
+            file_close(src);
+            return FALSE;
+        }
+    }
+    ra->src = src;
+    g_mutex_init(&ra->mutex);
+    g_cond_init(&ra->cond);
+
+    /* Drop what we've buffered; it will be read again by the thread. */
+    buf_reset(&file->in);
+    buf_reset(&file->out);
+    file->seek_pending = FALSE;
+    file->pos = pos;
+    file->eof = FALSE;
+
+    file->read_ahead = ra;
+    read_ahead_run(file);
+    return TRUE;
+}
+
 gint64
 file_seek(FILE_T file, gint64 offset, int whence, int *err)
 {
@@ -1398,6 +1788,19 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
         }
     }
 
+    /*
+     * We're not seeking within the buffer.  If we're reading ahead and
+     * seeking backwards, the read-ahead thread has to go back.  Seeking
+     * forwards is done by skipping, as below.
+     */
+    if (file->read_ahead != NULL && offset < 0) {
+        if (file->pos + offset < 0) {       /* before start of file! */
+            *err = EINVAL;
+            return -1;
+        }
+        return read_ahead_seek(file, file->pos + offset, err);
+    }
+
     /*
      * We're not seeking within the buffer.  Do we have "fast seek" data
      * for the location to which we will be seeking, and is the offset
@@ -1429,7 +1832,11 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             off2 = here->out;
         } else
 #endif
-        {
+        if (here->compression == ZSTD || here->compression == LZ4) {
+            /* Start decompressing at the beginning of the frame. */
+            off = here->in;
+            off2 = here->out;
+        } else {
             off2 = (file->pos + offset);
             off = here->in + (off2 - here->out);
         }
@@ -1481,6 +1888,10 @@ file_seek(FILE_T file, gint64 offset, int whence, int *err)
             file->compression = ZLIB;
         } else
 #endif
+        if (here->compression == ZSTD || here->compression == LZ4) {
+            /* gz_head() sets up the decompressor for the frame. */
+            file->compression = UNKNOWN;
+        } else
             file->compression = here->compression;
 
         offset = (file->pos + offset) - off2;
@@ -1876,15 +2287,36 @@ file_error(FILE_T fh, gchar **err_info)
 void
 file_clearerr(FILE_T stream)
 {
+    struct read_ahead *ra = stream->read_ahead;
+    gboolean done;
+
     /* clear error and end-of-file */
     stream->err = 0;
     stream->err_info = NULL;
     stream->eof = FALSE;
+
+    if (ra != NULL) {
+        /* If the read-ahead thread has stopped at the end of the file,
+           let it try again, e.g. if the file has grown. */
+        g_mutex_lock(&ra->mutex);
+        done = ra->done;
+        g_mutex_unlock(&ra->mutex);
+        if (done) {
+            read_ahead_stop(stream);
+            file_clearerr(ra->src);
+            read_ahead_run(stream);
+        }
+    }
 }
 
 void
 file_fdclose(FILE_T file)
 {
+    /* The read-ahead thread has its own descriptor; reading ahead is
+       only meant for a single sequential pass over the file, which
+       doesn't close and reopen it, so just stop it. */
+    if (file->read_ahead)
+        read_ahead_free(file);
     ws_close(file->fd);
     file->fd = -1;
 }
@@ -1905,6 +2337,9 @@ file_close(FILE_T file)
 {
     int fd = file->fd;
 
+    if (file->read_ahead)
+        read_ahead_free(file);
+
     /* free memory and close file */
     if (file->size) {
 #ifdef HAVE_ZLIB
@@ -29,6 +29,7 @@
 #include "wtap-int.h"
 
 #include <wsutil/filesystem.h>
+#include <wsutil/file_util.h>
 #include "wsutil/os_version_info.h"
 #include <wsutil/wslog.h>
 #include <wsutil/ws_assert.h>
@@ -211,21 +212,95 @@ merge_select_frame_type(const int file_type, int in_file_count, merge_in_file_t
 }
 
 /*
- * returns TRUE if first argument is earlier than second
+ * Binary min-heap of the input files that have a record present, ordered
+ * by that record, so that picking the next record costs O(log n) in the
+ * number of input files rather than a look at every one of them.
+ */
+typedef struct {
+    merge_in_file_t **files;
+    guint             count;
+    gboolean          primed;   /* the first record of every file was read */
+} merge_heap_t;
+
+/*
+ * Returns TRUE if the record of file a goes before the record of file b.
+ *
+ * Records without a time stamp are treated as earlier than all other
+ * records and are taken in file order.  Yes, this means you won't get a
+ * chronological merge of those records, but you obviously *can't* get
+ * that.  Records with the same time stamp are taken from the last file
+ * first.
  */
 static gboolean
-is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
+merge_heap_less(const merge_in_file_t *a, const merge_in_file_t *b)
 {
-    if (l->secs > r->secs) {  /* left is later */
-        return FALSE;
-    } else if (l->secs < r->secs) { /* left is earlier */
-        return TRUE;
-    } else if (l->nsecs > r->nsecs) { /* tv_sec equal, l.usec later */
-        return FALSE;
+    gboolean a_has_ts = (a->rec.presence_flags & WTAP_HAS_TS) != 0;
+    gboolean b_has_ts = (b->rec.presence_flags & WTAP_HAS_TS) != 0;
+
+    if (!a_has_ts || !b_has_ts) {
+        if (a_has_ts != b_has_ts)
+            return !a_has_ts;
+        return a < b;
     }
-    /* either one < two or one == two
-     * either way, return one
-     */
+    if (a->rec.ts.secs != b->rec.ts.secs)
+        return a->rec.ts.secs < b->rec.ts.secs;
+    if (a->rec.ts.nsecs != b->rec.ts.nsecs)
+        return a->rec.ts.nsecs < b->rec.ts.nsecs;
+    return a > b;
+}
+
+static void
+merge_heap_push(merge_heap_t *heap, merge_in_file_t *in_file)
+{
+    guint i = heap->count++;
+    guint parent;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (!merge_heap_less(in_file, heap->files[parent]))
+            break;
+        heap->files[i] = heap->files[parent];
+        i = parent;
+    }
+    heap->files[i] = in_file;
+}
+
+static void
+merge_heap_sift_down(merge_heap_t *heap, guint i)
+{
+    merge_in_file_t *in_file = heap->files[i];
+    guint child;
+
+    while ((child = 2 * i + 1) < heap->count) {
+        if (child + 1 < heap->count &&
+            merge_heap_less(heap->files[child + 1], heap->files[child]))
+            child++;
+        if (!merge_heap_less(heap->files[child], in_file))
+            break;
+        heap->files[i] = heap->files[child];
+        i = child;
+    }
+    heap->files[i] = in_file;
+}
+
+/*
+ * Read the next record of a file, setting its state to RECORD_PRESENT or
+ * AT_EOF. On a read error, set the state to GOT_ERROR and return FALSE.
+ */
+static gboolean
+merge_read_record(merge_in_file_t *in_file, int *err, gchar **err_info)
+{
+    gint64 data_offset;
+
+    if (!wtap_read(in_file->wth, &in_file->rec, &in_file->frame_buffer,
+                   err, err_info, &data_offset)) {
+        if (*err != 0) {
+            in_file->state = GOT_ERROR;
+            return FALSE;
+        }
+        in_file->state = AT_EOF;
+    } else
+        in_file->state = RECORD_PRESENT;
     return TRUE;
 }
 
@@ -241,6 +316,7 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * On an EOF (meaning all the files are at EOF), set *err to 0 and return
  * NULL.
  *
+ * @param heap the files with a record present, empty on the first call
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
  * @param err wiretap error, if failed
@@ -250,80 +326,56 @@ is_earlier(nstime_t *l, nstime_t *r) /* XXX, move to nstime.c */
  * all files
  */
 static merge_in_file_t *
-merge_read_packet(int in_file_count, merge_in_file_t in_files[],
-                  int *err, gchar **err_info)
+merge_read_packet(merge_heap_t *heap, int in_file_count,
+                  merge_in_file_t in_files[], int *err, gchar **err_info)
 {
     int i;
-    int ei = -1;
-    nstime_t tv = NSTIME_INIT_MAX;
-    wtap_rec *rec;
-
-    /*
-     * Make sure we have a record available from each file that's not at
-     * EOF, and search for the record with the earliest time stamp or
-     * with no time stamp (those records are treated as earlier than
-     * all other records).  Yes, this means you won't get a chronological
-     * merge of those records, but you obviously *can't* get that.
-     */
-    for (i = 0; i < in_file_count; i++) {
-        gint64 data_offset;
-
-        if (in_files[i].state == RECORD_NOT_PRESENT) {
-            /*
-             * No packet available, and we haven't seen an error or EOF yet,
-             * so try to read the next packet.
-             */
-            if (!wtap_read(in_files[i].wth, &in_files[i].rec,
-                           &in_files[i].frame_buffer, err, err_info,
-                           &data_offset)) {
-                if (*err != 0) {
-                    in_files[i].state = GOT_ERROR;
-                    return &in_files[i];
-                }
-                in_files[i].state = AT_EOF;
-            } else
-                in_files[i].state = RECORD_PRESENT;
-        }
+    merge_in_file_t *in_file;
 
-        if (in_files[i].state == RECORD_PRESENT) {
-            rec = &in_files[i].rec;
-            if (!(rec->presence_flags & WTAP_HAS_TS)) {
-                /*
-                 * No time stamp.  Pick this record, and stop looking.
-                 */
-                ei = i;
-                break;
-            }
-            if (is_earlier(&rec->ts, &tv)) {
-                /*
-                 * This record's time stamp is earlier than any of the
-                 * records we've seen so far.  Pick it, for now, but
-                 * keep looking.
-                 */
-                tv = rec->ts;
-                ei = i;
-            }
+    if (!heap->primed) {
+        /* Read the first record from each file. */
+        for (i = 0; i < in_file_count; i++) {
+            if (!merge_read_record(&in_files[i], err, err_info))
+                return &in_files[i];
+            if (in_files[i].state == RECORD_PRESENT)
+                merge_heap_push(heap, &in_files[i]);
         }
+        heap->primed = TRUE;
+    } else if (heap->count > 0 &&
+               heap->files[0]->state == RECORD_NOT_PRESENT) {
+        /*
+         * The previous packet came from the file at the top; read the
+         * next one from that file and put the file where it now belongs.
+         */
+        in_file = heap->files[0];
+        if (!merge_read_record(in_file, err, err_info))
+            return in_file;
+        if (in_file->state == AT_EOF)
+            heap->files[0] = heap->files[--heap->count];
+        if (heap->count > 0)
+            merge_heap_sift_down(heap, 0);
     }
 
-    if (ei == -1) {
+    if (heap->count == 0) {
         /* All the streams are at EOF.  Return an EOF indication. */
         *err = 0;
         return NULL;
     }
 
+    in_file = heap->files[0];
+
     /* We'll need to read another packet from this file. */
-    in_files[ei].state = RECORD_NOT_PRESENT;
+    in_file->state = RECORD_NOT_PRESENT;
 
     /* Count this packet. */
-    in_files[ei].packet_num++;
+    in_file->packet_num++;
 
     /*
      * Return a pointer to the merge_in_file_t of the file from which the
      * packet was read.
      */
     *err = 0;
-    return &in_files[ei];
+    return in_file;
 }
 
 /** Read the next packet, in file sequence order, from the set of files
@@ -338,6 +390,8 @@ merge_read_packet(int in_file_count, merge_in_file_t in_files[],
  * On an EOF (meaning all the files are at EOF), set *err to 0 and return
  * NULL.
  *
+ * @param first_file index of the first file that may not be at EOF, 0 on
+ * the first call
  * @param in_file_count number of entries in in_files
  * @param in_files input file array
  * @param err wiretap error, if failed
@@ -347,7 +401,8 @@ merge_read_packet(int in_file_count, merge_in_file_t in_files[],
  * all files
  */
 static merge_in_file_t *
-merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
+merge_append_read_packet(int *first_file, int in_file_count,
+                         merge_in_file_t in_files[],
                          int *err, gchar **err_info)
 {
     int i;
@@ -355,8 +410,10 @@ merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
 
     /*
      * Find the first file not at EOF, and read the next packet from it.
+     * The files are read in order, so all the files before *first_file
+     * are already at EOF.
      */
-    for (i = 0; i < in_file_count; i++) {
+    for (i = *first_file; i < in_file_count; i++) {
         if (in_files[i].state == AT_EOF)
             continue; /* This file is already at EOF */
         if (wtap_read(in_files[i].wth, &in_files[i].rec,
@@ -370,6 +427,7 @@ merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
         }
         /* EOF - flag this file as being at EOF, and try the next one. */
         in_files[i].state = AT_EOF;
+        *first_file = i + 1;
     }
     if (i == in_file_count) {
         /* All the streams are at EOF.  Return an EOF indication. */
@@ -388,7 +446,8 @@ merge_append_read_packet(int in_file_count, merge_in_file_t in_files[],
 
 /* creates a section header block for the new output file */
 static GArray*
-create_shb_header(const merge_in_file_t *in_files, const guint in_file_count,
+create_shb_header(const merge_in_file_t *in_files,
+                  const char *const *in_filenames, const guint in_file_count,
                   const gchar *app_name)
 {
     GArray  *shb_hdrs;
@@ -423,7 +482,7 @@ create_shb_header(const merge_in_file_t *in_files, const guint in_file_count,
     g_string_append_printf(comment_gstr, "File created by merging: \n");
 
     for (i = 0; i < in_file_count; i++) {
-        g_string_append_printf(comment_gstr, "File%d: %s \n",i+1,in_files[i].filename);
+        g_string_append_printf(comment_gstr, "File%d: %s \n",i+1,in_filenames[i]);
     }
 
     os_info_str = g_string_new("");
@@ -923,19 +982,27 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
 {
     merge_result        status = MERGE_OK;
     merge_in_file_t    *in_file;
+    merge_in_file_t    *prev_in_file = NULL;
+    merge_heap_t        heap;
+    int                 append_file = 0;
     int                 count = 0;
     gboolean            stop_flag = FALSE;
     wtap_rec *rec,      snap_rec;
+    guint               idb_first, idb_last;
+
+    heap.files = g_new(merge_in_file_t *, in_file_count);
+    heap.count = 0;
+    heap.primed = FALSE;
 
     for (;;) {
         *err = 0;
 
         if (do_append) {
-            in_file = merge_append_read_packet(in_file_count, in_files, err,
-                                               err_info);
+            in_file = merge_append_read_packet(&append_file, in_file_count,
+                                               in_files, err, err_info);
         }
         else {
-            in_file = merge_read_packet(in_file_count, in_files, err,
+            in_file = merge_read_packet(&heap, in_file_count, in_files, err,
                                         err_info);
         }
 
@@ -964,11 +1031,26 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
 
         if (wtap_file_type_subtype_supports_block(file_type,
                                                   WTAP_BLOCK_IF_ID_AND_INFO) != BLOCK_NOT_SUPPORTED) {
-            if (!process_new_idbs(pdh, in_files, in_file_count, mode, idb_inf, err, err_info)) {
+            /*
+             * Only the files read since the previous record can have new
+             * IDBs: all of them the first time, then the file of the
+             * previous record, and when appending the files after it up
+             * to this one.
+             */
+            if (prev_in_file == NULL) {
+                idb_first = 0;
+                idb_last = in_file_count - 1;
+            } else {
+                idb_first = (guint)(prev_in_file - in_files);
+                idb_last = do_append ? (guint)(in_file - in_files) : idb_first;
+            }
+            if (!process_new_idbs(pdh, &in_files[idb_first], idb_last - idb_first + 1,
+                                  mode, idb_inf, err, err_info)) {
                 status = MERGE_ERR_CANT_WRITE_OUTFILE;
                 break;
             }
         }
+        prev_in_file = in_file;
 
         switch (rec->rec_type) {
 
@@ -1042,6 +1124,8 @@ merge_process_packets(wtap_dumper *pdh, const int file_type,
         wtap_rec_reset(rec);
     }
 
+    g_free(heap.files);
+
     if (cb)
         cb->callback_func(MERGE_EVENT_DONE, count, in_files, in_file_count, cb->data);
 
@@ -1121,6 +1205,92 @@ merge_files_common(const gchar* out_filename, /* filename in normal output mode,
                    const guint in_file_count, const gboolean do_append,
                    idb_merge_mode mode, guint snaplen,
                    const gchar *app_name, merge_progress_callback_t* cb,
+                   const char *const *shb_filenames, const guint shb_file_count,
+                   int *err, gchar **err_info, guint *err_fileno,
+                   guint32 *err_framenum);
+
+/*
+ * Merges the files in batches of batch_size files to temporary pcapng
+ * files, and then merges those. This is used when we can't have all the
+ * input files open at once.
+ *
+ * The result is the same as that of merging all the files at once as long
+ * as each input file is in chronological order.
+ */
+static merge_result
+merge_files_in_batches(const gchar* out_filename, gchar **out_filenamep,
+                       const char *pfx, const int file_type,
+                       const char *const *in_filenames,
+                       const guint in_file_count, const guint batch_size,
+                       const gboolean do_append, idb_merge_mode mode,
+                       guint snaplen, const gchar *app_name,
+                       merge_progress_callback_t* cb,
+                       const char *const *shb_filenames,
+                       const guint shb_file_count,
+                       int *err, gchar **err_info, guint *err_fileno,
+                       guint32 *err_framenum)
+{
+    guint batch_count = (in_file_count + batch_size - 1) / batch_size;
+    gchar **batch_filenames = g_new0(gchar *, batch_count);
+    merge_result status = MERGE_OK;
+    guint first;
+    guint i;
+
+    ws_debug("merging %u files in %u batches", in_file_count, batch_count);
+
+    for (i = 0; i < batch_count; i++) {
+        first = i * batch_size;
+        /*
+         * The SHB of the first input file is copied unchanged, so that
+         * the final merge creates the same SHB as without batches.
+         */
+        status = merge_files_common(NULL, &batch_filenames[i], "wireshark_merge",
+                                    wtap_pcapng_file_type_subtype(),
+                                    &in_filenames[first],
+                                    MIN(batch_size, in_file_count - first),
+                                    do_append, mode, snaplen, app_name, cb,
+                                    NULL, 0,
+                                    err, err_info, err_fileno, err_framenum);
+        if (status != MERGE_OK) {
+            *err_fileno += first;
+            break;
+        }
+    }
+
+    if (status == MERGE_OK) {
+        status = merge_files_common(out_filename, out_filenamep, pfx, file_type,
+                                    (const char *const *)batch_filenames,
+                                    batch_count, do_append, mode, snaplen,
+                                    app_name, cb, shb_filenames, shb_file_count,
+                                    err, err_info, err_fileno, err_framenum);
+        /*
+         * Errors while reading a batch can only be reported against the
+         * first input file of the batch.
+         */
+        *err_fileno *= batch_size;
+    }
+
+    for (i = 0; i < batch_count; i++) {
+        if (batch_filenames[i] != NULL) {
+            ws_unlink(batch_filenames[i]);
+            g_free(batch_filenames[i]);
+        }
+    }
+    g_free(batch_filenames);
+
+    return status;
+}
+
+static merge_result
+merge_files_common(const gchar* out_filename, /* filename in normal output mode,
+                   optional tempdir in tempfile mode (NULL for OS default) */
+                   gchar **out_filenamep, const char *pfx, /* tempfile mode  */
+                   const int file_type, const char *const *in_filenames,
+                   const guint in_file_count, const gboolean do_append,
+                   idb_merge_mode mode, guint snaplen,
+                   const gchar *app_name, merge_progress_callback_t* cb,
+                   const char *const *shb_filenames, /* NULL to copy the SHB */
+                   const guint shb_file_count,
                    int *err, gchar **err_info, guint *err_fileno,
                    guint32 *err_framenum)
 {
@@ -1149,6 +1319,22 @@ merge_files_common(const gchar* out_filename, /* filename in normal output mode,
     if (!merge_open_in_files(in_file_count, in_filenames, &in_files, cb,
                              err, err_info, err_fileno)) {
         ws_debug("merge_open_in_files() failed with err=%d", *err);
+        if ((*err == EMFILE || *err == ENFILE) && *err_fileno >= 4) {
+            /*
+             * We ran out of file descriptors. Merge batches of half as
+             * many files as we could open, which leaves descriptors for
+             * the output files, and then merge the results.
+             */
+            g_free(*err_info);
+            *err_info = NULL;
+            return merge_files_in_batches(out_filename, out_filenamep, pfx,
+                                          file_type, in_filenames,
+                                          in_file_count, *err_fileno / 2,
+                                          do_append, mode, snaplen, app_name,
+                                          cb, shb_filenames, shb_file_count,
+                                          err, err_info, err_fileno,
+                                          err_framenum);
+        }
         *err_framenum = 0;
         return MERGE_ERR_CANT_OPEN_INFILE;
     }
@@ -1188,7 +1374,12 @@ merge_files_common(const gchar* out_filename, /* filename in normal output mode,
      */
     if (wtap_file_type_subtype_supports_block(file_type,
                                               WTAP_BLOCK_IF_ID_AND_INFO) != BLOCK_NOT_SUPPORTED) {
-        shb_hdrs = create_shb_header(in_files, in_file_count, app_name);
+        if (shb_filenames != NULL) {
+            shb_hdrs = create_shb_header(in_files, shb_filenames,
+                                         shb_file_count, app_name);
+        } else {
+            shb_hdrs = wtap_file_get_shb_for_new_file(in_files[0].wth);
+        }
         ws_debug("SHB created");
 
         idb_inf = generate_merged_idbs(in_files, in_file_count, &mode);
@@ -1273,7 +1464,8 @@ merge_files(const gchar* out_filename, const int file_type,
 
     return merge_files_common(out_filename, NULL, NULL,
                               file_type, in_filenames, in_file_count,
-                              do_append, mode, snaplen, app_name, cb, err,
+                              do_append, mode, snaplen, app_name, cb,
+                              in_filenames, in_file_count, err,
                               err_info, err_fileno, err_framenum);
 }
 
@@ -1298,7 +1490,8 @@ merge_files_to_tempfile(const char *tmpdir, gchar **out_filenamep, const char *p
 
     return merge_files_common(tmpdir, out_filenamep, pfx,
                               file_type, in_filenames, in_file_count,
-                              do_append, mode, snaplen, app_name, cb, err,
+                              do_append, mode, snaplen, app_name, cb,
+                              in_filenames, in_file_count, err,
                               err_info, err_fileno, err_framenum);
 }
 
@@ -1317,7 +1510,8 @@ merge_files_to_stdout(const int file_type, const char *const *in_filenames,
 {
     return merge_files_common(NULL, NULL, NULL,
                               file_type, in_filenames, in_file_count,
-                              do_append, mode, snaplen, app_name, cb, err,
+                              do_append, mode, snaplen, app_name, cb,
+                              in_filenames, in_file_count, err,
                               err_info, err_fileno, err_framenum);
 }
 
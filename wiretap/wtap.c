@@ -1509,6 +1509,14 @@ wtap_cleareof(wtap *wth) {
 	file_clearerr(wth->fh);
 }
 
+gboolean
+wtap_start_read_ahead(wtap *wth)
+{
+	if (wth->fh == NULL || wth->random_fh != NULL)
+		return FALSE;
+	return file_start_read_ahead(wth->fh);
+}
+
 static inline void
 wtapng_process_nrb_ipv4(wtap *wth, wtap_block_t nrb)
 {
@@ -1765,6 +1765,21 @@ struct wtap* wtap_open_offline(const char *filename, unsigned int type, int *err
 WS_DLL_PUBLIC
 void wtap_cleareof(wtap *wth);
 
+/**
+ * Read and decompress the file in a separate thread, ahead of wtap_read(),
+ * so that decompression doesn't take time away from whatever is done with
+ * the records. The records and the errors are the same as without
+ * read-ahead.
+ *
+ * Only possible for a regular file opened without random access, i.e.
+ * with do_random FALSE.
+ *
+ * @param wth The wtap.
+ * @return TRUE if the file is now read ahead, FALSE if it isn't possible.
+ */
+WS_DLL_PUBLIC
+gboolean wtap_start_read_ahead(wtap *wth);
+
 /**
  * Set callback functions to add new hostnames. Currently pcapng-only.
  * MUST match add_ipv4_name and add_ipv6_name in addr_resolv.c.
@@ -0,0 +1,234 @@
+/*
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "prefix_trie.h"
+
+#include <string.h>
+
+#include <wsutil/ws_assert.h>
+
+/*
+ * Each node holds a prefix, stored with the bits beyond prefix_len cleared.
+ * A child extends the prefix of its parent, and the first bit after the
+ * prefix of the parent selects which child. Nodes without a value only
+ * exist where two longer prefixes diverge, so the trie has at most two
+ * nodes per prefix and a lookup visits at most key_bits + 1 nodes.
+ */
+
+#define KEY_BYTES   (PREFIX_TRIE_MAX_BITS / 8)
+
+typedef struct _prefix_trie_node {
+    uint8_t key[KEY_BYTES];
+    unsigned prefix_len;
+    void *value;
+    struct _prefix_trie_node *child[2];
+} prefix_trie_node_t;
+
+struct _prefix_trie {
+    prefix_trie_node_t *root;
+    unsigned key_bits;
+    unsigned count;
+    GDestroyNotify value_free;
+};
+
+static inline unsigned
+key_bit(const uint8_t *key, unsigned pos)
+{
+    return (key[pos / 8] >> (7 - pos % 8)) & 1;
+}
+
+/* Number of leading bits, up to max_bits, that a and b have in common. */
+static unsigned
+common_prefix_len(const uint8_t *a, const uint8_t *b, unsigned max_bits)
+{
+    unsigned len = 0;
+    uint8_t diff;
+
+    while (len < max_bits) {
+        diff = a[len / 8] ^ b[len / 8];
+        if (diff == 0) {
+            len += 8;
+            continue;
+        }
+        while (!(diff & 0x80)) {
+            diff <<= 1;
+            len++;
+        }
+        break;
+    }
+    return MIN(len, max_bits);
+}
+
+static prefix_trie_node_t *
+node_new(const uint8_t *key, unsigned prefix_len, void *value)
+{
+    prefix_trie_node_t *node = g_new0(prefix_trie_node_t, 1);
+    unsigned nbytes = (prefix_len + 7) / 8;
+
+    memcpy(node->key, key, nbytes);
+    if (prefix_len % 8) {
+        node->key[nbytes - 1] &= (uint8_t)(0xff << (8 - prefix_len % 8));
+    }
+    node->prefix_len = prefix_len;
+    node->value = value;
+    return node;
+}
+
+prefix_trie_t *
+prefix_trie_new(unsigned key_bits, GDestroyNotify value_free)
+{
+    prefix_trie_t *trie;
+
+    ws_assert(key_bits > 0 && key_bits <= PREFIX_TRIE_MAX_BITS && key_bits % 8 == 0);
+
+    trie = g_new0(prefix_trie_t, 1);
+    trie->key_bits = key_bits;
+    trie->value_free = value_free;
+    return trie;
+}
+
+static void
+node_free(prefix_trie_node_t *node, GDestroyNotify value_free)
+{
+    /* The depth is bounded by the key length. */
+    if (node->child[0])
+        node_free(node->child[0], value_free);
+    if (node->child[1])
+        node_free(node->child[1], value_free);
+    if (node->value && value_free)
+        value_free(node->value);
+    g_free(node);
+}
+
+void
+prefix_trie_free(prefix_trie_t *trie)
+{
+    if (!trie)
+        return;
+    if (trie->root)
+        node_free(trie->root, trie->value_free);
+    g_free(trie);
+}
+
+void
+prefix_trie_insert(prefix_trie_t *trie, const uint8_t *key,
+                   unsigned prefix_len, void *value)
+{
+    prefix_trie_node_t **link = &trie->root;
+    prefix_trie_node_t *node, *leaf, *glue;
+    unsigned common;
+
+    ws_assert(prefix_len <= trie->key_bits);
+    ws_assert(value);
+
+    for (;;) {
+        node = *link;
+        if (node == NULL) {
+            *link = node_new(key, prefix_len, value);
+            trie->count++;
+            return;
+        }
+
+        common = common_prefix_len(node->key, key, MIN(node->prefix_len, prefix_len));
+
+        if (common == node->prefix_len) {
+            if (node->prefix_len == prefix_len) {
+                /* Same prefix. */
+                if (node->value == NULL) {
+                    trie->count++;
+                }
+                else if (trie->value_free) {
+                    trie->value_free(node->value);
+                }
+                node->value = value;
+                return;
+            }
+            /* The new prefix is longer, descend. */
+            link = &node->child[key_bit(key, node->prefix_len)];
+            continue;
+        }
+
+        leaf = node_new(key, prefix_len, value);
+        trie->count++;
+
+        if (common == prefix_len) {
+            /* The new prefix is a prefix of this node. */
+            leaf->child[key_bit(node->key, prefix_len)] = node;
+            *link = leaf;
+            return;
+        }
+
+        /* The prefixes diverge, join them under a node without a value. */
+        glue = node_new(key, common, NULL);
+        glue->child[key_bit(key, common)] = leaf;
+        glue->child[key_bit(node->key, common)] = node;
+        *link = glue;
+        return;
+    }
+}
+
+void *
+prefix_trie_lookup(const prefix_trie_t *trie, const uint8_t *key,
+                   unsigned *prefix_len)
+{
+    const prefix_trie_node_t *node = trie->root;
+    const prefix_trie_node_t *best = NULL;
+
+    while (node) {
+        if (common_prefix_len(node->key, key, node->prefix_len) != node->prefix_len)
+            break;
+        if (node->value)
+            best = node;
+        if (node->prefix_len == trie->key_bits)
+            break;
+        node = node->child[key_bit(key, node->prefix_len)];
+    }
+
+    if (best == NULL)
+        return NULL;
+    if (prefix_len)
+        *prefix_len = best->prefix_len;
+    return best->value;
+}
+
+void *
+prefix_trie_find(const prefix_trie_t *trie, const uint8_t *key,
+                 unsigned prefix_len)
+{
+    const prefix_trie_node_t *node = trie->root;
+
+    while (node && node->prefix_len <= prefix_len) {
+        if (common_prefix_len(node->key, key, node->prefix_len) != node->prefix_len)
+            break;
+        if (node->prefix_len == prefix_len)
+            return node->value;
+        node = node->child[key_bit(key, node->prefix_len)];
+    }
+    return NULL;
+}
+
+unsigned
+prefix_trie_count(const prefix_trie_t *trie)
+{
+    return trie->count;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,100 @@
+/** @file
+ *
+ * Longest prefix match of IPv4 and IPv6 addresses (or any other bit string
+ * of up to 128 bits) using a path-compressed binary trie.
+ *
+ * Wireshark - Network traffic analyzer
+ * By Gerald Combs <gerald@wireshark.org>
+ * Copyright 1998 Gerald Combs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef __WSUTIL_PREFIX_TRIE_H__
+#define __WSUTIL_PREFIX_TRIE_H__
+
+#include <wireshark.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum key length in bits. */
+#define PREFIX_TRIE_MAX_BITS    128
+
+struct _prefix_trie;
+typedef struct _prefix_trie prefix_trie_t;
+
+/**
+ * Creates an empty trie.
+ *
+ * @param key_bits Length of the keys in bits, e.g. 32 for IPv4 and 128
+ * for IPv6. At most PREFIX_TRIE_MAX_BITS.
+ * @param value_free Called for each value when it is replaced or when the
+ * trie is freed, can be NULL.
+ */
+WS_DLL_PUBLIC prefix_trie_t *
+prefix_trie_new(unsigned key_bits, GDestroyNotify value_free);
+
+WS_DLL_PUBLIC void
+prefix_trie_free(prefix_trie_t *trie);
+
+/**
+ * Adds a prefix. An existing value of the same prefix is replaced.
+ *
+ * @param key Key in network byte order, key_bits / 8 bytes. Bits beyond
+ * prefix_len are ignored.
+ * @param prefix_len Number of significant bits, 0 to key_bits.
+ * @param value Non-NULL value.
+ */
+WS_DLL_PUBLIC void
+prefix_trie_insert(prefix_trie_t *trie, const uint8_t *key,
+                   unsigned prefix_len, void *value);
+
+/**
+ * Finds the longest prefix that matches the key. The number of nodes
+ * visited is bounded by the key length.
+ *
+ * @param key Key in network byte order, key_bits / 8 bytes.
+ * @param[out] prefix_len Length of the matching prefix, can be NULL.
+ * @return The value of the matching prefix or NULL.
+ */
+WS_DLL_PUBLIC void *
+prefix_trie_lookup(const prefix_trie_t *trie, const uint8_t *key,
+                   unsigned *prefix_len);
+
+/**
+ * Finds the value of exactly the given prefix, without falling back to a
+ * shorter one.
+ *
+ * @param key Key in network byte order, key_bits / 8 bytes. Bits beyond
+ * prefix_len are ignored.
+ * @param prefix_len Number of significant bits, 0 to key_bits.
+ * @return The value of the prefix or NULL.
+ */
+WS_DLL_PUBLIC void *
+prefix_trie_find(const prefix_trie_t *trie, const uint8_t *key,
+                 unsigned prefix_len);
+
+/** Number of prefixes in the trie. */
+WS_DLL_PUBLIC unsigned
+prefix_trie_count(const prefix_trie_t *trie);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WSUTIL_PREFIX_TRIE_H__ */
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 4
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=4 tabstop=8 expandtab:
+ * :indentSize=4:tabSize=8:noTabs=true:
+ */
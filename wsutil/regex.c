@@ -22,6 +22,53 @@ struct _ws_regex {
 
 #define ERROR_MAXLEN_IN_CODE_UNITS   128
 
+/* Size of the JIT stack. The default (32K, on the machine stack) is too
+ * small for some patterns, which then fail with PCRE2_ERROR_JIT_STACKLIMIT. */
+#define JIT_STACK_START_SIZE    (32 * 1024)
+#define JIT_STACK_MAX_SIZE      (512 * 1024)
+
+/*
+ * Matching state that is reused by all the matches of a thread, to avoid
+ * allocations for every packet. We only use the offsets of the whole match,
+ * so a single pair of offsets is enough for all patterns.
+ */
+typedef struct {
+    pcre2_match_data *match_data;
+    pcre2_match_context *match_context;
+    pcre2_jit_stack *jit_stack;
+} match_state_t;
+
+static void
+match_state_free(void *data)
+{
+    match_state_t *state = data;
+
+    pcre2_match_data_free(state->match_data);
+    pcre2_match_context_free(state->match_context);
+    pcre2_jit_stack_free(state->jit_stack);
+    g_free(state);
+}
+
+static GPrivate match_state_key = G_PRIVATE_INIT(match_state_free);
+
+static match_state_t *
+get_match_state(void)
+{
+    match_state_t *state = g_private_get(&match_state_key);
+
+    if (state == NULL) {
+        state = g_new0(match_state_t, 1);
+        state->match_data = pcre2_match_data_create(1, NULL);
+        state->match_context = pcre2_match_context_create(NULL);
+        /* NULL if JIT is not supported, pcre2_jit_stack_assign() ignores it then. */
+        state->jit_stack = pcre2_jit_stack_create(JIT_STACK_START_SIZE, JIT_STACK_MAX_SIZE, NULL);
+        if (state->match_context != NULL && state->jit_stack != NULL)
+            pcre2_jit_stack_assign(state->match_context, NULL, state->jit_stack);
+        g_private_set(&match_state_key, state);
+    }
+    return state;
+}
+
 static char *
 get_error_msg(int errorcode)
 {
@@ -91,6 +138,16 @@ ws_regex_compile_ex(const char *patt, ssize_t size, char **errmsg, unsigned flag
     ws_regex_t *re = g_new(ws_regex_t, 1);
     re->code = code;
     re->pattern = ws_escape_string_len(NULL, patt, size, false);
+    /* Try to compile to machine code. This fails if PCRE2 was built
+     * without JIT support or if it is not available on this platform (or
+     * forbidden, e.g. by SELinux); fall back to the interpreter then. */
+    int rc = pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+    if (rc != 0) {
+        char *msg = get_error_msg(rc);
+        ws_debug("JIT compilation of \"%s\" failed, using the interpreter: %s.",
+                        re->pattern, msg);
+        g_free(msg);
+    }
     return re;
 }
 
@@ -104,7 +161,7 @@ ws_regex_compile(const char *patt, char **errmsg)
 
 static bool
 match_pcre2(pcre2_code *code, const char *subject, ssize_t subj_length,
-                pcre2_match_data *match_data)
+                pcre2_match_data *match_data, pcre2_match_context *match_context)
 {
     PCRE2_SIZE length;
     int rc;
@@ -120,7 +177,19 @@ match_pcre2(pcre2_code *code, const char *subject, ssize_t subj_length,
                     0,          /* start at offset zero of the subject */
                     0,          /* default options */
                     match_data,
-                    NULL);
+                    match_context);
+
+    if (rc == PCRE2_ERROR_JIT_STACKLIMIT) {
+        /* The pattern needs more than JIT_STACK_MAX_SIZE, use the
+         * interpreter (which has its own, larger, limits). */
+        rc = pcre2_match(code,
+                        subject,
+                        length,
+                        0,
+                        PCRE2_NO_JIT,
+                        match_data,
+                        match_context);
+    }
 
     if (rc < 0) {
         /* No match */
@@ -150,18 +219,15 @@ bool
 ws_regex_matches_length(const ws_regex_t *re,
                         const char *subj, ssize_t subj_length)
 {
-    bool matched;
-    pcre2_match_data *match_data;
+    match_state_t *state;
 
     ws_return_val_if_null(re, FALSE);
     ws_return_val_if_null(subj, FALSE);
 
     /* We don't use the matched substring but pcre2_match requires
      * at least one pair of offsets. */
-    match_data = pcre2_match_data_create(1, NULL);
-    matched = match_pcre2(re->code, subj, subj_length, match_data);
-    pcre2_match_data_free(match_data);
-    return matched;
+    state = get_match_state();
+    return match_pcre2(re->code, subj, subj_length, state->match_data, state->match_context);
 }
 
 
@@ -171,19 +237,18 @@ ws_regex_matches_pos(const ws_regex_t *re,
                         size_t pos_vect[2])
 {
     bool matched;
-    pcre2_match_data *match_data;
+    match_state_t *state;
 
     ws_return_val_if_null(re, FALSE);
     ws_return_val_if_null(subj, FALSE);
 
-    match_data = pcre2_match_data_create(1, NULL);
-    matched = match_pcre2(re->code, subj, subj_length, match_data);
+    state = get_match_state();
+    matched = match_pcre2(re->code, subj, subj_length, state->match_data, state->match_context);
     if (matched && pos_vect) {
-        PCRE2_SIZE *ovect = pcre2_get_ovector_pointer(match_data);
+        PCRE2_SIZE *ovect = pcre2_get_ovector_pointer(state->match_data);
         pos_vect[0] = ovect[0];
         pos_vect[1] = ovect[1];
     }
-    pcre2_match_data_free(match_data);
     return matched;
 }
 
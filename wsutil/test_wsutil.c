@@ -635,6 +635,89 @@ void test_nstime_from_iso8601(void)
     g_assert_cmpint(result.nsecs, ==, expect.nsecs);
 }
 
+#include "prefix_trie.h"
+
+static void test_prefix_trie_ipv4(void)
+{
+    prefix_trie_t *trie;
+    ws_in4_addr addr;
+    unsigned len;
+
+    trie = prefix_trie_new(32, NULL);
+
+    /* Inserted out of order: the /8 ends up above the /16. */
+    ws_inet_pton4("10.1.0.0", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 16, "10.1/16");
+    ws_inet_pton4("10.0.0.0", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 8, "10/8");
+    ws_inet_pton4("10.1.2.3", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 32, "10.1.2.3/32");
+    /* Diverges from 10.1.2.3 at bit 21, below a node without a value. */
+    ws_inet_pton4("10.1.4.0", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 24, "10.1.4/24");
+    g_assert_cmpuint(prefix_trie_count(trie), ==, 4);
+
+    ws_inet_pton4("10.1.2.3", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, &len), ==, "10.1.2.3/32");
+    g_assert_cmpuint(len, ==, 32);
+    ws_inet_pton4("10.1.2.4", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, &len), ==, "10.1/16");
+    g_assert_cmpuint(len, ==, 16);
+    ws_inet_pton4("10.1.4.200", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, NULL), ==, "10.1.4/24");
+    ws_inet_pton4("10.200.0.1", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, NULL), ==, "10/8");
+    ws_inet_pton4("11.0.0.1", &addr);
+    g_assert_null(prefix_trie_lookup(trie, (uint8_t *)&addr, NULL));
+
+    /* Exact prefixes, the bits beyond the prefix length are ignored. */
+    ws_inet_pton4("10.1.2.3", &addr);
+    g_assert_cmpstr(prefix_trie_find(trie, (uint8_t *)&addr, 8), ==, "10/8");
+    g_assert_cmpstr(prefix_trie_find(trie, (uint8_t *)&addr, 16), ==, "10.1/16");
+    g_assert_cmpstr(prefix_trie_find(trie, (uint8_t *)&addr, 32), ==, "10.1.2.3/32");
+    g_assert_null(prefix_trie_find(trie, (uint8_t *)&addr, 24));
+    g_assert_null(prefix_trie_find(trie, (uint8_t *)&addr, 21));
+
+    /* Replace a value and add a default route. */
+    ws_inet_pton4("10.0.0.0", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 8, "net10");
+    ws_inet_pton4("0.0.0.0", &addr);
+    prefix_trie_insert(trie, (uint8_t *)&addr, 0, "default");
+    g_assert_cmpuint(prefix_trie_count(trie), ==, 5);
+    ws_inet_pton4("10.200.0.1", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, NULL), ==, "net10");
+    ws_inet_pton4("11.0.0.1", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, (uint8_t *)&addr, &len), ==, "default");
+    g_assert_cmpuint(len, ==, 0);
+
+    prefix_trie_free(trie);
+}
+
+static void test_prefix_trie_ipv6(void)
+{
+    prefix_trie_t *trie;
+    ws_in6_addr addr;
+
+    trie = prefix_trie_new(128, NULL);
+
+    ws_inet_pton6("2001:db8::", &addr);
+    prefix_trie_insert(trie, addr.bytes, 32, "doc");
+    ws_inet_pton6("2001:db8:ffaa::", &addr);
+    prefix_trie_insert(trie, addr.bytes, 48, "site");
+    ws_inet_pton6("2001:db8:ffaa:ddbb:1199:2288:3377:1", &addr);
+    prefix_trie_insert(trie, addr.bytes, 128, "host");
+
+    g_assert_cmpstr(prefix_trie_lookup(trie, in6_test1.addr.bytes, NULL), ==, "host");
+    ws_inet_pton6("2001:db8:ffaa:ddbb:1199:2288:3377:2", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, addr.bytes, NULL), ==, "site");
+    ws_inet_pton6("2001:db8:1::1", &addr);
+    g_assert_cmpstr(prefix_trie_lookup(trie, addr.bytes, NULL), ==, "doc");
+    ws_inet_pton6("2001:db9::1", &addr);
+    g_assert_null(prefix_trie_lookup(trie, addr.bytes, NULL));
+
+    prefix_trie_free(trie);
+}
+
 #include "ws_getopt.h"
 
 #define ARGV_MAX 31
@@ -852,6 +935,9 @@ int main(int argc, char **argv)
 
     g_test_add_func("/nstime/from_iso8601", test_nstime_from_iso8601);
 
+    g_test_add_func("/prefix_trie/ipv4", test_prefix_trie_ipv4);
+    g_test_add_func("/prefix_trie/ipv6", test_prefix_trie_ipv6);
+
     g_test_add_func("/ws_getopt/basic1", test_getopt_long_basic1);
     g_test_add_func("/ws_getopt/basic2", test_getopt_long_basic2);
     g_test_add_func("/ws_getopt/optional1", test_getopt_optional_argument1);